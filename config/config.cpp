@@ -71,6 +71,12 @@ void Config::loadFromEnvironment() {
     if (const char* thread_pool = std::getenv("SKIPLIST_THREAD_POOL_SIZE")) {
         server_config_.thread_pool_size = std::atoi(thread_pool);
     }
+    if (const char* reactors = std::getenv("SKIPLIST_REACTOR_THREADS")) {
+        server_config_.reactor_threads = std::atoi(reactors);
+    }
+    if (const char* network_backend = std::getenv("SKIPLIST_NETWORK_BACKEND")) {
+        server_config_.network_backend = network_backend;
+    }
     if (const char* cluster = std::getenv("SKIPLIST_ENABLE_CLUSTER")) {
         server_config_.enable_cluster = (std::string(cluster) == "true");
     }
@@ -91,6 +97,9 @@ void Config::loadFromEnvironment() {
     if (const char* interval = std::getenv("SKIPLIST_PERSISTENCE_INTERVAL")) {
         skiplist_config_.persistence_interval = std::atoi(interval);
     }
+    if (const char* engine = std::getenv("SKIPLIST_STORAGE_ENGINE")) {
+        skiplist_config_.storage_engine = engine;
+    }
     
     // 日志配置
     if (const char* log_level = std::getenv("SKIPLIST_LOG_LEVEL")) {
@@ -141,6 +150,9 @@ bool Config::saveToFile(const std::string& filename) const {
     file << "host=" << server_config_.host << "\n";
     file << "max_connections=" << server_config_.max_connections << "\n";
     file << "thread_pool_size=" << server_config_.thread_pool_size << "\n";
+    file << "reactor_threads=" << server_config_.reactor_threads << "\n";
+    file << "network_backend=" << server_config_.network_backend << "\n";
+    file << "client_query_buffer_limit=" << server_config_.client_query_buffer_limit << "\n";
     file << "enable_cluster=" << (server_config_.enable_cluster ? "true" : "false") << "\n";
     file << "cluster_nodes=" << server_config_.cluster_nodes << "\n\n";
     
@@ -149,7 +161,43 @@ bool Config::saveToFile(const std::string& filename) const {
     file << "max_level=" << skiplist_config_.max_level << "\n";
     file << "data_file=" << skiplist_config_.data_file << "\n";
     file << "enable_persistence=" << (skiplist_config_.enable_persistence ? "true" : "false") << "\n";
-    file << "persistence_interval=" << skiplist_config_.persistence_interval << "\n\n";
+    file << "persistence_interval=" << skiplist_config_.persistence_interval << "\n";
+    file << "persistence_io_backend=" << skiplist_config_.persistence_io_backend << "\n";
+    file << "persistence_io_threads=" << skiplist_config_.persistence_io_threads << "\n";
+    file << "persistence_io_rate_mb=" << skiplist_config_.persistence_io_rate_mb << "\n";
+    file << "persistence_io_burst_mb=" << skiplist_config_.persistence_io_burst_mb << "\n";
+    file << "persistence_io_adaptive=" << (skiplist_config_.persistence_io_adaptive ? "true" : "false") << "\n";
+    file << "persistence_io_fsync_target_ms=" << skiplist_config_.persistence_io_fsync_target_ms << "\n";
+    file << "snapshot_load_threads=" << skiplist_config_.snapshot_load_threads << "\n";
+    file << "snapshot_load_mmap=" << (skiplist_config_.snapshot_load_mmap ? "true" : "false") << "\n";
+    file << "progressive_loading=" << (skiplist_config_.progressive_loading ? "true" : "false") << "\n";
+    file << "snapshot_incremental=" << (skiplist_config_.snapshot_incremental ? "true" : "false") << "\n";
+    file << "snapshot_delta_max=" << skiplist_config_.snapshot_delta_max << "\n";
+    file << "snapshot_delta_ratio=" << skiplist_config_.snapshot_delta_ratio << "\n";
+    file << "snapshot_compression=" << skiplist_config_.snapshot_compression << "\n";
+    file << "lazy_free=" << (skiplist_config_.lazy_free ? "true" : "false") << "\n";
+    file << "lazy_free_threads=" << skiplist_config_.lazy_free_threads << "\n";
+    file << "lazy_free_chunk=" << skiplist_config_.lazy_free_chunk << "\n";
+    file << "storage_engine=" << skiplist_config_.storage_engine << "\n";
+    file << "mmap_file=" << skiplist_config_.mmap_file << "\n";
+    file << "mmap_initial_size=" << skiplist_config_.mmap_initial_size << "\n";
+    file << "value_log_enabled=" << (skiplist_config_.value_log_enabled ? "true" : "false") << "\n";
+    file << "value_log_dir=" << skiplist_config_.value_log_dir << "\n";
+    file << "value_log_threshold=" << skiplist_config_.value_log_threshold << "\n";
+    file << "value_log_segment_size=" << skiplist_config_.value_log_segment_size << "\n";
+    file << "value_log_gc_ratio=" << skiplist_config_.value_log_gc_ratio << "\n";
+    file << "value_log_gc_interval=" << skiplist_config_.value_log_gc_interval << "\n";
+    file << "lsm_dir=" << skiplist_config_.lsm_dir << "\n";
+    file << "lsm_memtable_size=" << skiplist_config_.lsm_memtable_size << "\n";
+    file << "lsm_block_size=" << skiplist_config_.lsm_block_size << "\n";
+    file << "lsm_bloom_bits_per_key=" << skiplist_config_.lsm_bloom_bits_per_key << "\n";
+    file << "lsm_compaction_trigger=" << skiplist_config_.lsm_compaction_trigger << "\n";
+    file << "active_defrag=" << (skiplist_config_.active_defrag ? "true" : "false") << "\n";
+    file << "active_defrag_ignore_bytes=" << skiplist_config_.active_defrag_ignore_bytes << "\n";
+    file << "active_defrag_threshold_lower=" << skiplist_config_.active_defrag_threshold_lower << "\n";
+    file << "active_defrag_threshold_upper=" << skiplist_config_.active_defrag_threshold_upper << "\n";
+    file << "active_defrag_cycle_min=" << skiplist_config_.active_defrag_cycle_min << "\n";
+    file << "active_defrag_cycle_max=" << skiplist_config_.active_defrag_cycle_max << "\n\n";
     
     // 日志配置
     file << "[Log]\n";
@@ -224,6 +272,15 @@ void Config::applyCustomConfig() {
     if (custom_config_.find("thread_pool_size") != custom_config_.end()) {
         server_config_.thread_pool_size = getInt("thread_pool_size", server_config_.thread_pool_size);
     }
+    if (custom_config_.find("reactor_threads") != custom_config_.end()) {
+        server_config_.reactor_threads = getInt("reactor_threads", server_config_.reactor_threads);
+    }
+    if (custom_config_.find("network_backend") != custom_config_.end()) {
+        server_config_.network_backend = getString("network_backend", server_config_.network_backend);
+    }
+    if (custom_config_.find("client_query_buffer_limit") != custom_config_.end()) {
+        server_config_.client_query_buffer_limit = getInt("client_query_buffer_limit", server_config_.client_query_buffer_limit);
+    }
     if (custom_config_.find("enable_cluster") != custom_config_.end()) {
         server_config_.enable_cluster = getBool("enable_cluster", server_config_.enable_cluster);
     }
@@ -243,6 +300,114 @@ void Config::applyCustomConfig() {
     if (custom_config_.find("persistence_interval") != custom_config_.end()) {
         skiplist_config_.persistence_interval = getInt("persistence_interval", skiplist_config_.persistence_interval);
     }
+    if (custom_config_.find("persistence_io_backend") != custom_config_.end()) {
+        skiplist_config_.persistence_io_backend = getString("persistence_io_backend", skiplist_config_.persistence_io_backend);
+    }
+    if (custom_config_.find("persistence_io_threads") != custom_config_.end()) {
+        skiplist_config_.persistence_io_threads = getInt("persistence_io_threads", skiplist_config_.persistence_io_threads);
+    }
+    if (custom_config_.find("persistence_io_rate_mb") != custom_config_.end()) {
+        skiplist_config_.persistence_io_rate_mb = getInt("persistence_io_rate_mb", skiplist_config_.persistence_io_rate_mb);
+    }
+    if (custom_config_.find("persistence_io_burst_mb") != custom_config_.end()) {
+        skiplist_config_.persistence_io_burst_mb = getInt("persistence_io_burst_mb", skiplist_config_.persistence_io_burst_mb);
+    }
+    if (custom_config_.find("persistence_io_adaptive") != custom_config_.end()) {
+        skiplist_config_.persistence_io_adaptive = getBool("persistence_io_adaptive", skiplist_config_.persistence_io_adaptive);
+    }
+    if (custom_config_.find("persistence_io_fsync_target_ms") != custom_config_.end()) {
+        skiplist_config_.persistence_io_fsync_target_ms = getInt("persistence_io_fsync_target_ms", skiplist_config_.persistence_io_fsync_target_ms);
+    }
+    if (custom_config_.find("snapshot_load_threads") != custom_config_.end()) {
+        skiplist_config_.snapshot_load_threads = getInt("snapshot_load_threads", skiplist_config_.snapshot_load_threads);
+    }
+    if (custom_config_.find("snapshot_load_mmap") != custom_config_.end()) {
+        skiplist_config_.snapshot_load_mmap = getBool("snapshot_load_mmap", skiplist_config_.snapshot_load_mmap);
+    }
+    if (custom_config_.find("progressive_loading") != custom_config_.end()) {
+        skiplist_config_.progressive_loading = getBool("progressive_loading", skiplist_config_.progressive_loading);
+    }
+    if (custom_config_.find("snapshot_incremental") != custom_config_.end()) {
+        skiplist_config_.snapshot_incremental = getBool("snapshot_incremental", skiplist_config_.snapshot_incremental);
+    }
+    if (custom_config_.find("snapshot_delta_max") != custom_config_.end()) {
+        skiplist_config_.snapshot_delta_max = getInt("snapshot_delta_max", skiplist_config_.snapshot_delta_max);
+    }
+    if (custom_config_.find("snapshot_delta_ratio") != custom_config_.end()) {
+        skiplist_config_.snapshot_delta_ratio = getInt("snapshot_delta_ratio", skiplist_config_.snapshot_delta_ratio);
+    }
+    if (custom_config_.find("snapshot_compression") != custom_config_.end()) {
+        skiplist_config_.snapshot_compression = getInt("snapshot_compression", skiplist_config_.snapshot_compression);
+    }
+    if (custom_config_.find("lazy_free") != custom_config_.end()) {
+        skiplist_config_.lazy_free = getBool("lazy_free", skiplist_config_.lazy_free);
+    }
+    if (custom_config_.find("lazy_free_threads") != custom_config_.end()) {
+        skiplist_config_.lazy_free_threads = getInt("lazy_free_threads", skiplist_config_.lazy_free_threads);
+    }
+    if (custom_config_.find("lazy_free_chunk") != custom_config_.end()) {
+        skiplist_config_.lazy_free_chunk = getInt("lazy_free_chunk", skiplist_config_.lazy_free_chunk);
+    }
+    if (custom_config_.find("storage_engine") != custom_config_.end()) {
+        skiplist_config_.storage_engine = getString("storage_engine", skiplist_config_.storage_engine);
+    }
+    if (custom_config_.find("mmap_file") != custom_config_.end()) {
+        skiplist_config_.mmap_file = getString("mmap_file", skiplist_config_.mmap_file);
+    }
+    if (custom_config_.find("mmap_initial_size") != custom_config_.end()) {
+        skiplist_config_.mmap_initial_size = getInt("mmap_initial_size", skiplist_config_.mmap_initial_size);
+    }
+    if (custom_config_.find("value_log_enabled") != custom_config_.end()) {
+        skiplist_config_.value_log_enabled = getBool("value_log_enabled", skiplist_config_.value_log_enabled);
+    }
+    if (custom_config_.find("value_log_dir") != custom_config_.end()) {
+        skiplist_config_.value_log_dir = getString("value_log_dir", skiplist_config_.value_log_dir);
+    }
+    if (custom_config_.find("value_log_threshold") != custom_config_.end()) {
+        skiplist_config_.value_log_threshold = getInt("value_log_threshold", skiplist_config_.value_log_threshold);
+    }
+    if (custom_config_.find("value_log_segment_size") != custom_config_.end()) {
+        skiplist_config_.value_log_segment_size = getInt("value_log_segment_size", skiplist_config_.value_log_segment_size);
+    }
+    if (custom_config_.find("value_log_gc_ratio") != custom_config_.end()) {
+        skiplist_config_.value_log_gc_ratio = getInt("value_log_gc_ratio", skiplist_config_.value_log_gc_ratio);
+    }
+    if (custom_config_.find("value_log_gc_interval") != custom_config_.end()) {
+        skiplist_config_.value_log_gc_interval = getInt("value_log_gc_interval", skiplist_config_.value_log_gc_interval);
+    }
+    if (custom_config_.find("lsm_dir") != custom_config_.end()) {
+        skiplist_config_.lsm_dir = getString("lsm_dir", skiplist_config_.lsm_dir);
+    }
+    if (custom_config_.find("lsm_memtable_size") != custom_config_.end()) {
+        skiplist_config_.lsm_memtable_size = getInt("lsm_memtable_size", skiplist_config_.lsm_memtable_size);
+    }
+    if (custom_config_.find("lsm_block_size") != custom_config_.end()) {
+        skiplist_config_.lsm_block_size = getInt("lsm_block_size", skiplist_config_.lsm_block_size);
+    }
+    if (custom_config_.find("lsm_bloom_bits_per_key") != custom_config_.end()) {
+        skiplist_config_.lsm_bloom_bits_per_key = getInt("lsm_bloom_bits_per_key", skiplist_config_.lsm_bloom_bits_per_key);
+    }
+    if (custom_config_.find("lsm_compaction_trigger") != custom_config_.end()) {
+        skiplist_config_.lsm_compaction_trigger = getInt("lsm_compaction_trigger", skiplist_config_.lsm_compaction_trigger);
+    }
+    if (custom_config_.find("active_defrag") != custom_config_.end()) {
+        skiplist_config_.active_defrag = getBool("active_defrag", skiplist_config_.active_defrag);
+    }
+    if (custom_config_.find("active_defrag_ignore_bytes") != custom_config_.end()) {
+        skiplist_config_.active_defrag_ignore_bytes = getInt("active_defrag_ignore_bytes", skiplist_config_.active_defrag_ignore_bytes);
+    }
+    if (custom_config_.find("active_defrag_threshold_lower") != custom_config_.end()) {
+        skiplist_config_.active_defrag_threshold_lower = getInt("active_defrag_threshold_lower", skiplist_config_.active_defrag_threshold_lower);
+    }
+    if (custom_config_.find("active_defrag_threshold_upper") != custom_config_.end()) {
+        skiplist_config_.active_defrag_threshold_upper = getInt("active_defrag_threshold_upper", skiplist_config_.active_defrag_threshold_upper);
+    }
+    if (custom_config_.find("active_defrag_cycle_min") != custom_config_.end()) {
+        skiplist_config_.active_defrag_cycle_min = getInt("active_defrag_cycle_min", skiplist_config_.active_defrag_cycle_min);
+    }
+    if (custom_config_.find("active_defrag_cycle_max") != custom_config_.end()) {
+        skiplist_config_.active_defrag_cycle_max = getInt("active_defrag_cycle_max", skiplist_config_.active_defrag_cycle_max);
+    }
     
     if (custom_config_.find("log_level") != custom_config_.end()) {
         log_config_.log_level = getString("log_level", log_config_.log_level);
@@ -267,4 +432,19 @@ void Config::applyCustomConfig() {
     if (custom_config_.find("aof_fsync_interval") != custom_config_.end()) {
         aof_config_.aof_fsync_interval = getInt("aof_fsync_interval", aof_config_.aof_fsync_interval);
     }
+    if (custom_config_.find("aof_rewrite_percentage") != custom_config_.end()) {
+        aof_config_.aof_rewrite_percentage = getInt("aof_rewrite_percentage", aof_config_.aof_rewrite_percentage);
+    }
+    if (custom_config_.find("aof_rewrite_min_size") != custom_config_.end()) {
+        aof_config_.aof_rewrite_min_size = getInt("aof_rewrite_min_size", aof_config_.aof_rewrite_min_size);
+    }
+    if (custom_config_.find("aof_use_preamble") != custom_config_.end()) {
+        aof_config_.aof_use_preamble = getBool("aof_use_preamble", aof_config_.aof_use_preamble);
+    }
+    if (custom_config_.find("aof_segment_size") != custom_config_.end()) {
+        aof_config_.aof_segment_size = getInt("aof_segment_size", aof_config_.aof_segment_size);
+    }
+    if (custom_config_.find("wal_backlog_size") != custom_config_.end()) {
+        aof_config_.wal_backlog_size = getInt("wal_backlog_size", aof_config_.wal_backlog_size);
+    }
 } 
\ No newline at end of file
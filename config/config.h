@@ -18,6 +18,9 @@ public:
         std::string host = "0.0.0.0";
         int max_connections = 1000;
         int thread_pool_size = 4;
+        int reactor_threads = 0;       // 网络事件循环线程数，各自有SO_REUSEPORT监听socket；0为CPU核数
+        std::string network_backend = "epoll"; // 网络事件循环：epoll, io_uring, auto（内核支持时用io_uring）
+        int client_query_buffer_limit = 1024 * 1024 * 1024; // 每个连接未处理输入的上限（字节），超过时关闭连接，0表示不限
         bool enable_cluster = false;
         std::string cluster_nodes;
     };
@@ -27,6 +30,42 @@ public:
         std::string data_file = "store/dumpFile";
         bool enable_persistence = true;
         int persistence_interval = 60; // seconds
+        std::string persistence_io_backend = "auto"; // 快照和AOF的文件I/O：auto, io_uring, threads（线程池）
+        int persistence_io_threads = 2; // threads后端的I/O线程数
+        int persistence_io_rate_mb = 0; // 后台保存和AOF重写的写出限速（MB/s），0表示不限速
+        int persistence_io_burst_mb = 16; // 限速允许的突发（MB）
+        bool persistence_io_adaptive = false; // AOF的fdatasync耗时超过目标时自动降速
+        int persistence_io_fsync_target_ms = 10; // 自适应限速的fdatasync目标耗时（毫秒）
+        int snapshot_load_threads = 0; // 并行加载快照的线程数，0表示使用全部CPU
+        bool snapshot_load_mmap = true; // 用mmap直接从映射页面解码快照
+        bool progressive_loading = true; // 启动时先开始监听，数据在后台加载
+        bool snapshot_incremental = true; // 定期保存只写出变化的key（增量快照）
+        int snapshot_delta_max = 16; // 增量文件达到该数量时合并为新的基础快照
+        int snapshot_delta_ratio = 50; // 增量总大小超过基础快照的该百分比时合并
+        int snapshot_compression = 1; // 快照数据块（含AOF前导）的LZ压缩级别，0不压缩，1~9越大压缩率越高
+        bool lazy_free = true; // FLUSH和关闭时在后台线程释放节点
+        int lazy_free_threads = 1; // 后台释放线程数
+        int lazy_free_chunk = 1024; // 每次连续释放的节点数
+        std::string storage_engine = "memory"; // memory: 内存跳表, mmap: 文件映射持久化跳表, lsm: 跳表memtable+磁盘有序段
+        std::string mmap_file = "store/skiplist.mmap";
+        int mmap_initial_size = 64 * 1024 * 1024; // 64MB
+        bool value_log_enabled = false; // 键值分离：大value写入值日志
+        std::string value_log_dir = "store/vlog";
+        int value_log_threshold = 1024; // 超过该字节数的value写入值日志
+        int value_log_segment_size = 64 * 1024 * 1024; // 64MB
+        int value_log_gc_ratio = 50; // 段内垃圾比例超过该百分比时回收
+        int value_log_gc_interval = 10; // seconds
+        std::string lsm_dir = "store/lsm";
+        int lsm_memtable_size = 16 * 1024 * 1024; // memtable超过该估算字节数时冻结并刷盘
+        int lsm_block_size = 4096; // 有序段数据块大小
+        int lsm_bloom_bits_per_key = 10;
+        int lsm_compaction_trigger = 4; // 相邻的该数量个大小相近的段合并为一个
+        bool active_defrag = false; // 主动碎片整理（memory引擎）
+        int active_defrag_ignore_bytes = 100 * 1024 * 1024; // 碎片字节数低于该值时不整理
+        int active_defrag_threshold_lower = 10; // 碎片率超过该百分比时开始整理
+        int active_defrag_threshold_upper = 100; // 碎片率达到该百分比时使用最大CPU预算
+        int active_defrag_cycle_min = 1; // 最小CPU预算（百分比）
+        int active_defrag_cycle_max = 25; // 最大CPU预算（百分比）
     };
     
     struct LogConfig {
@@ -42,6 +81,11 @@ public:
         std::string aof_file = "store/appendonly.aof";
         std::string aof_fsync = "everysec"; // always, everysec, no
         int aof_fsync_interval = 1; // 秒
+        int aof_rewrite_percentage = 100; // 比上次重写后增长该百分比时自动重写，0表示关闭
+        int aof_rewrite_min_size = 64 * 1024 * 1024; // 自动重写的最小文件大小（字节）
+        bool aof_use_preamble = true; // 重写时以二进制快照作为AOF前导
+        int aof_segment_size = 64 * 1024 * 1024; // 增量段写满该大小后滚动到新段（字节），新段按此预分配
+        int wal_backlog_size = 1024 * 1024; // 预写日志在内存中保留的最近记录（字节），供从节点续传，0表示只从磁盘续传
     };
     
     // 配置优先级：环境变量 > 配置文件 > 默认值
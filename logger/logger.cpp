@@ -208,11 +208,17 @@ void Logger::rotateLogFile() {
     file_stream_.open(log_file_, std::ios::app);
     current_file_size_ = 0;
     
-    info("Log file rotated");
+    // 持有log_mutex_，直接写入新文件而不经过info()
+    std::string message = getCurrentTimestamp() + " [" + getLevelString(LogLevel::INFO) + "] Log file rotated\n";
+    file_stream_ << message;
+    current_file_size_ += message.length();
 }
 
+// 调用方已持有log_mutex_，这里不能再调用加锁的checkRotation
 void Logger::writeToFile(const std::string& message) {
-    checkRotation(message);
+    if (current_file_size_ + message.length() >= max_file_size_) {
+        rotateLogFile();
+    }
     if (file_stream_.is_open()) {
         file_stream_ << message;
         file_stream_.flush();
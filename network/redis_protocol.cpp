@@ -3,6 +3,12 @@
 #include <algorithm>
 #include <cctype>
 
+namespace {
+// 与Redis相同的请求上限，防止错误的长度让连接无限缓冲
+const int64_t MAX_ARRAY_LENGTH = 1024 * 1024;
+const int64_t MAX_BULK_LENGTH = 512LL * 1024 * 1024;
+}
+
 RedisValuePtr RedisProtocol::parse(const std::string& data) {
     if (data.empty()) {
         return nullptr;
@@ -40,6 +46,10 @@ std::string RedisProtocol::serialize(const RedisValue& value) {
 }
 
 RedisCommand RedisProtocol::parseCommand(const std::string& data) {
+    if (!data.empty() && data[0] != '*') {
+        return parseInlineCommand(data);
+    }
+    
     RedisCommand cmd;
     auto value = parse(data);
     
@@ -68,6 +78,70 @@ RedisCommand RedisProtocol::parseCommand(const std::string& data) {
     return cmd;
 }
 
+RedisCommand RedisProtocol::parseInlineCommand(const std::string& data) {
+    RedisCommand cmd;
+    size_t end = data.find('\n');
+    if (end == std::string::npos) {
+        end = data.length();
+    }
+    if (end > 0 && data[end - 1] == '\r') {
+        end--;
+    }
+    
+    std::vector<std::string> words;
+    size_t pos = 0;
+    while (pos < end) {
+        size_t begin = data.find_first_not_of(" \t", pos);
+        if (begin == std::string::npos || begin >= end) {
+            break;
+        }
+        pos = std::min(data.find_first_of(" \t", begin), end);
+        words.push_back(data.substr(begin, pos - begin));
+    }
+    if (words.empty()) {
+        return cmd;
+    }
+    
+    cmd.command = words[0];
+    std::transform(cmd.command.begin(), cmd.command.end(), cmd.command.begin(), ::toupper);
+    cmd.arguments.assign(words.begin() + 1, words.end());
+    return cmd;
+}
+
+size_t RedisProtocol::requestLength(const std::string& data, size_t pos) {
+    if (pos < data.length() && data[pos] != '*') {
+        // 内联命令以\n结尾（telnet等发送\r\n）
+        size_t newline = data.find('\n', pos);
+        return newline == std::string::npos ? 0 : newline + 1 - pos;
+    }
+    size_t line_end = data.find("\r\n", pos);
+    if (line_end == std::string::npos) {
+        return 0;
+    }
+    
+    int64_t count;
+    if (!parseLength(data, pos + 1, line_end, MAX_ARRAY_LENGTH, count)) {
+        return line_end + 2 - pos;
+    }
+    // 按长度跳过每个批量字符串，不在数据中查找分隔符
+    size_t cursor = line_end + 2;
+    for (int64_t i = 0; i < count; ++i) {
+        line_end = data.find("\r\n", cursor);
+        if (line_end == std::string::npos) {
+            return 0;
+        }
+        int64_t length;
+        if (data[cursor] != '$' || !parseLength(data, cursor + 1, line_end, MAX_BULK_LENGTH, length)) {
+            return line_end + 2 - pos;
+        }
+        cursor = line_end + 2 + static_cast<size_t>(length) + 2;
+        if (cursor > data.length()) {
+            return 0;
+        }
+    }
+    return cursor - pos;
+}
+
 std::string RedisProtocol::createSimpleString(const std::string& str) {
     return "+" + str + "\r\n";
 }
@@ -227,4 +301,21 @@ std::string RedisProtocol::readBytes(const std::string& data, size_t& pos, size_
     std::string result = data.substr(pos, length);
     pos += length;
     return result;
-} 
\ No newline at end of file
+}
+
+bool RedisProtocol::parseLength(const std::string& data, size_t begin, size_t end, int64_t max_length, int64_t& length) {
+    if (begin >= end) {
+        return false;
+    }
+    length = 0;
+    for (size_t i = begin; i < end; ++i) {
+        if (!std::isdigit(static_cast<unsigned char>(data[i]))) {
+            return false;
+        }
+        length = length * 10 + (data[i] - '0');
+        if (length > max_length) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -60,9 +60,13 @@ public:
     // 序列化为RESP协议
     static std::string serialize(const RedisValue& value);
     
-    // 解析Redis命令
+    // 解析Redis命令：RESP数组，或以空白分隔参数、以\n（或\r\n）结尾的内联命令
     static RedisCommand parseCommand(const std::string& data);
     
+    // 从pos开始的一个完整请求（RESP数组或内联命令）的长度，数据还不完整时返回0。
+    // 头部格式错误时只算到该行结尾，由parseCommand报错
+    static size_t requestLength(const std::string& data, size_t pos);
+    
     // 创建简单字符串响应
     static std::string createSimpleString(const std::string& str);
     
@@ -111,4 +115,10 @@ private:
     
     // 读取指定长度的数据
     static std::string readBytes(const std::string& data, size_t& pos, size_t length);
+    
+    // 解析内联命令：按空格和制表符切分第一行
+    static RedisCommand parseInlineCommand(const std::string& data);
+    
+    // 解析[begin, end)中的非负长度，不超过max_length
+    static bool parseLength(const std::string& data, size_t begin, size_t end, int64_t max_length, int64_t& length);
 }; 
\ No newline at end of file
@@ -1,7 +1,13 @@
 #include "tcp_server.h"
+#include "uring_event_loop.h"
 #include "../include/exceptions.h"
+#include "../logger/logger.h"
 #include <iostream>
 #include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
 
 ClientConnection::ClientConnection(SocketType socket, const std::string& client_addr)
     : socket_(socket), client_address_(client_addr) {
@@ -12,17 +18,49 @@ ClientConnection::~ClientConnection() {
 }
 
 bool ClientConnection::send(const std::string& data) {
+    if (output_notifier_) {
+        bool was_empty;
+        {
+            std::lock_guard<std::mutex> lock(send_mutex_);
+            if (socket_ == INVALID_SOCKET_VALUE) {
+                return false;
+            }
+            was_empty = output_.empty();
+            output_.append(data);
+        }
+        // 前面的回复还没被事件循环取走时它会一起发送，不用重复通知
+        if (was_empty) {
+            output_notifier_();
+        }
+        return true;
+    }
+    
     std::lock_guard<std::mutex> lock(send_mutex_);
     
     if (socket_ == INVALID_SOCKET_VALUE) {
         return false;
     }
     
+    // 之前的回复还没写完时只能排在后面，保证顺序
+    if (output_offset_ < output_.size()) {
+        output_.append(data);
+        return true;
+    }
+    
     size_t total_sent = 0;
     //TCP的send不能保证一次发完所有数据，可能由于缓冲区慢，网络状况等等
     while (total_sent < data.length()) {
-        int sent = ::send(socket_, data.c_str() + total_sent, 
-                         static_cast<int>(data.length() - total_sent), 0);
+        ssize_t sent = ::send(socket_, data.data() + total_sent, data.length() - total_sent, MSG_NOSIGNAL);
+        countSyscall();
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // socket写满，剩余部分等可写事件时由事件循环写出
+            output_.assign(data, total_sent, std::string::npos);
+            output_offset_ = 0;
+            return true;
+        }
         if (sent <= 0) {
             return false;
         }
@@ -32,38 +70,211 @@ bool ClientConnection::send(const std::string& data) {
     return true;
 }
 
-std::string ClientConnection::receive() {
-    char buffer[4096];
+bool ClientConnection::flushOutput() {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    
+    if (socket_ == INVALID_SOCKET_VALUE) {
+        return false;
+    }
+    
+    while (output_offset_ < output_.size()) {
+        ssize_t sent = ::send(socket_, output_.data() + output_offset_, output_.size() - output_offset_, MSG_NOSIGNAL);
+        countSyscall();
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        output_offset_ += sent;
+    }
+    output_.clear();
+    output_offset_ = 0;
+    return true;
+}
+
+void ClientConnection::takeOutput(std::string* data) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    data->clear();
+    data->swap(output_);
+}
+
+void ClientConnection::countSyscall() {
+    if (syscalls_ != nullptr) {
+        syscalls_->fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool ClientConnection::readAvailable() {
+    char buffer[16384];
+    bool open = true;
+    bool eof = false;
     std::string data;
     
+    // 边缘触发下必须读到EAGAIN，否则剩余数据不会再有事件通知
     while (true) {
-        int received = ::recv(socket_, buffer, sizeof(buffer) - 1, 0);
-        if (received <= 0) {
-            break;
+        ssize_t received = ::recv(socket_, buffer, sizeof(buffer), 0);
+        countSyscall();
+        if (received > 0) {
+            data.append(buffer, received);
+            if (query_buffer_limit_ > 0 && data.size() > query_buffer_limit_) {
+                break;
+            }
+            continue;
         }
-        
-        buffer[received] = '\0';
-        data += buffer;
-        
-        // 检查是否接收到完整的RESP消息
-        if (data.find("\r\n") != std::string::npos) {
-            break;
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received == 0) {
+            eof = true;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            open = false;
+        }
+        break;
+    }
+    
+    if (!data.empty() && !appendInput(data.data(), data.size())) {
+        return false;
+    }
+    if (eof) {
+        {
+            std::lock_guard<std::mutex> lock(input_mutex_);
+            peer_closed_ = true;
+        }
+        input_cv_.notify_all();
+    }
+    return open;
+}
+
+bool ClientConnection::appendInput(const char* data, size_t size) {
+    {
+        std::lock_guard<std::mutex> lock(input_mutex_);
+        if (input_overflow_) {
+            return false;
+        }
+        if (query_buffer_limit_ > 0 && input_.size() + pending_bytes_.load() + size > query_buffer_limit_) {
+            // 连接随后被关闭，关闭前到达的数据一并丢弃
+            input_overflow_ = true;
+            LOG_WARN("Closing client " + client_address_ + " that reached the query buffer limit");
+            return false;
+        }
+        input_.append(data, size);
+    }
+    input_cv_.notify_all();
+    return true;
+}
+
+bool ClientConnection::beginTask() {
+    std::lock_guard<std::mutex> lock(input_mutex_);
+    if (busy_ || input_.empty()) {
+        return false;
+    }
+    busy_ = true;
+    return true;
+}
+
+bool ClientConnection::takeInput(std::string* data) {
+    bool closing;
+    {
+        std::lock_guard<std::mutex> lock(input_mutex_);
+        if (!input_.empty()) {
+            data->swap(input_);
+            input_.clear();
+            return true;
+        }
+        busy_ = false;
+        if (!closing_ && !peer_closed_) {
+            return false;
         }
+        closing = closing_;
     }
+    if (output_notifier_) {
+        // 事件循环发完剩余回复后关闭
+        output_notifier_();
+    } else if (closing) {
+        close();
+    } else {
+        // 对端已关闭写端：回复已写完时关闭读写两端，事件循环收到EPOLLHUP后关闭连接；
+        // 还有剩余回复时由事件循环在可写事件中写完后关闭
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        if (socket_ != INVALID_SOCKET_VALUE && output_offset_ >= output_.size()) {
+            ::shutdown(socket_, SHUT_RDWR);
+        }
+    }
+    return false;
+}
+
+bool ClientConnection::finishedAfterPeerClosed() {
+    {
+        std::lock_guard<std::mutex> lock(input_mutex_);
+        if (!peer_closed_ || busy_ || !input_.empty()) {
+            return false;
+        }
+    }
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    return output_offset_ >= output_.size();
+}
+
+void ClientConnection::closeAfterTask() {
+    {
+        std::lock_guard<std::mutex> lock(input_mutex_);
+        if (busy_) {
+            closing_ = true;
+            return;
+        }
+    }
+    close();
+}
+
+void ClientConnection::markClosing() {
+    std::lock_guard<std::mutex> lock(input_mutex_);
+    closing_ = true;
+}
+
+bool ClientConnection::isBusy() {
+    std::lock_guard<std::mutex> lock(input_mutex_);
+    return busy_;
+}
+
+std::string ClientConnection::receive(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(input_mutex_);
+    input_cv_.wait_for(lock, timeout, [this] { return !input_.empty() || closing_ || peer_closed_; });
     
+    std::string data;
+    data.swap(input_);
     return data;
 }
 
 void ClientConnection::close() {
-    if (socket_ != INVALID_SOCKET_VALUE) {
-        ::close(socket_);
-        socket_ = INVALID_SOCKET_VALUE;
+    {
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        if (socket_ != INVALID_SOCKET_VALUE) {
+            ::close(socket_);
+            socket_ = INVALID_SOCKET_VALUE;
+        }
     }
+    {
+        std::lock_guard<std::mutex> lock(input_mutex_);
+        closing_ = true;
+    }
+    input_cv_.notify_all();
+}
+
+namespace {
+const int ACCEPT_BATCH = 64;   // 每次可读事件最多接受的连接数，避免连接风暴饿死已有连接的读写
+const int MAX_EVENTS = 256;
 }
 
 TCPServer::TCPServer()
-    : server_socket_(INVALID_SOCKET_VALUE)
+    : port_(0)
+    , thread_pool_size_(1)
+    , backend_(Backend::Epoll)
     , running_(false)
+    , requests_(0)
+    , syscalls_(0)
     , network_initialized_(false) {
 }
 
@@ -72,64 +283,173 @@ TCPServer::~TCPServer() {
     cleanupNetwork();
 }
 
-bool TCPServer::init(const std::string& host, int port, int thread_pool_size) {
+bool TCPServer::init(const std::string& host, int port, int thread_pool_size, int reactor_threads,
+                     const std::string& backend) {
     if (!initNetwork()) {
         return false;
     }
     
     host_ = host;
     port_ = port;
+    thread_pool_size_ = std::max(thread_pool_size, 1);
+    
+    if (reactor_threads <= 0) {
+        reactor_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
     
-    // 创建socket
-    server_socket_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_socket_ == INVALID_SOCKET_VALUE) {
+    backend_ = Backend::Epoll;
+    if (backend != "epoll") {
+        if (UringEventLoop::probe()) {
+            backend_ = Backend::IoUring;
+        } else if (backend == "io_uring") {
+            LOG_WARN("io_uring networking is not supported by this kernel, falling back to epoll");
+        }
+    }
+    
+    // 每个事件循环绑定自己的监听socket，由内核在它们之间分配新连接
+    for (int i = 0; i < reactor_threads; ++i) {
+        reactors_.push_back(std::make_unique<Reactor>());
+        initReactor(reactors_.back().get(), reactor_threads > 1);
+    }
+    
+    return true;
+}
+
+SocketType TCPServer::createListenSocket(bool reuse_port) {
+    // 创建socket，监听socket也是非阻塞的，一次可读事件中批量接受连接
+    SocketType listen_socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_socket == INVALID_SOCKET_VALUE) {
         throw skiplist::SocketException("Failed to create socket");
     }
     
     // 设置socket选项
     // 允许服务器socket端口被快速重用，避免重启服务器端口被占用的问题
     int opt = 1;
-    if (setsockopt(server_socket_, SOL_SOCKET, SO_REUSEADDR, 
+    if (setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, 
                    reinterpret_cast<char*>(&opt), sizeof(opt)) < 0) {
+        CLOSE_SOCKET(listen_socket);
         throw skiplist::SocketException("Failed to set socket options");
     }
+    // 多个事件循环各自监听同一端口
+    if (reuse_port && setsockopt(listen_socket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        CLOSE_SOCKET(listen_socket);
+        throw skiplist::SocketException("Failed to set SO_REUSEPORT");
+    }
     
     // 绑定地址
     struct sockaddr_in server_addr;
+    std::memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port);
+    server_addr.sin_port = htons(port_);
     
-    if (host == "0.0.0.0") {
+    if (host_ == "0.0.0.0") {
         server_addr.sin_addr.s_addr = INADDR_ANY;
     } else {
-        server_addr.sin_addr.s_addr = inet_addr(host.c_str());
+        server_addr.sin_addr.s_addr = inet_addr(host_.c_str());
     }
     
-    if (bind(server_socket_, reinterpret_cast<struct sockaddr*>(&server_addr), 
+    if (bind(listen_socket, reinterpret_cast<struct sockaddr*>(&server_addr), 
              sizeof(server_addr)) < 0) {
-        throw skiplist::BindException(host, port);
+        CLOSE_SOCKET(listen_socket);
+        throw skiplist::BindException(host_, port_);
+    }
+    
+    // 端口为0时由系统分配，其余事件循环绑定同一个端口
+    if (port_ == 0) {
+        socklen_t addr_len = sizeof(server_addr);
+        if (getsockname(listen_socket, reinterpret_cast<struct sockaddr*>(&server_addr), &addr_len) == 0) {
+            port_ = ntohs(server_addr.sin_port);
+        }
     }
     
     // 监听连接
-    if (listen(server_socket_, SOMAXCONN) < 0) {
+    if (listen(listen_socket, SOMAXCONN) < 0) {
+        CLOSE_SOCKET(listen_socket);
         throw skiplist::SocketException("Failed to listen on socket");
     }
     
-    // 创建工作线程
-    for (int i = 0; i < thread_pool_size; ++i) {
-        worker_threads_.emplace_back(&TCPServer::workerLoop, this);//原地构建新的thread，所以直接传参即可
+    return listen_socket;
+}
+
+void TCPServer::initReactor(Reactor* reactor, bool reuse_port) {
+    reactor->listen_socket = createListenSocket(reuse_port);
+    
+    if (backend_ == Backend::IoUring) {
+        reactor->uring = std::make_unique<UringEventLoop>(reactor->listen_socket, &syscalls_,
+            [this](std::shared_ptr<ClientConnection> client) { dispatch(std::move(client)); });
+        if (reactor->uring->init()) {
+            return;
+        }
+        // 环或提供缓冲组创建失败（如达到locked memory上限）时这个事件循环改用epoll
+        LOG_WARN("io_uring network setup failed: " + std::string(strerror(errno)) + ", using epoll");
+        reactor->uring.reset();
     }
     
-    return true;
+    reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor->epoll_fd == INVALID_SOCKET_VALUE) {
+        throw skiplist::SocketException("Failed to create epoll instance");
+    }
+    reactor->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reactor->wakeup_fd == INVALID_SOCKET_VALUE) {
+        throw skiplist::SocketException("Failed to create eventfd");
+    }
+    
+    // 监听socket用水平触发，每次只接受一批连接，剩余的下一轮事件循环继续接受
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = reactor->listen_socket;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->listen_socket, &event) < 0) {
+        throw skiplist::SocketException("Failed to add listening socket to epoll");
+    }
+    event.data.fd = reactor->wakeup_fd;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->wakeup_fd, &event) < 0) {
+        throw skiplist::SocketException("Failed to add eventfd to epoll");
+    }
+}
+
+void TCPServer::closeReactor(Reactor* reactor) {
+    if (reactor->uring) {
+        reactor->uring->closeConnections();
+        reactor->uring.reset();
+    }
+    
+    // 关闭所有客户端连接
+    {
+        std::lock_guard<std::mutex> lock(reactor->connections_mutex);
+        for (auto& conn : reactor->connections) {
+            conn.second->close();
+        }
+        reactor->connections.clear();
+    }
+    
+    if (reactor->listen_socket != INVALID_SOCKET_VALUE) {
+        CLOSE_SOCKET(reactor->listen_socket);
+        reactor->listen_socket = INVALID_SOCKET_VALUE;
+    }
+    if (reactor->epoll_fd != INVALID_SOCKET_VALUE) {
+        close(reactor->epoll_fd);
+        reactor->epoll_fd = INVALID_SOCKET_VALUE;
+    }
+    if (reactor->wakeup_fd != INVALID_SOCKET_VALUE) {
+        close(reactor->wakeup_fd);
+        reactor->wakeup_fd = INVALID_SOCKET_VALUE;
+    }
 }
 
 bool TCPServer::start() {
-    if (server_socket_ == INVALID_SOCKET_VALUE) {
+    if (reactors_.empty()) {
         return false;
     }
     
     running_ = true;
-    accept_thread_ = std::thread(&TCPServer::acceptLoop, this);
+    
+    // 创建工作线程
+    for (int i = 0; i < thread_pool_size_; ++i) {
+        worker_threads_.emplace_back(&TCPServer::workerLoop, this);//原地构建新的thread，所以直接传参即可
+    }
+    for (auto& reactor : reactors_) {
+        reactor->thread = std::thread(&TCPServer::eventLoop, this, reactor.get());
+    }
     
     return true;
 }
@@ -137,19 +457,27 @@ bool TCPServer::start() {
 void TCPServer::stop() {
     running_ = false;
     
-    // 关闭服务器socket
-    if (server_socket_ != INVALID_SOCKET_VALUE) {
-        CLOSE_SOCKET(server_socket_);
-        server_socket_ = INVALID_SOCKET_VALUE;
+    // 唤醒事件循环并等待它们结束
+    for (auto& reactor : reactors_) {
+        if (reactor->uring) {
+            reactor->uring->wakeup();
+        } else if (reactor->wakeup_fd != INVALID_SOCKET_VALUE) {
+            uint64_t one = 1;
+            ssize_t written = write(reactor->wakeup_fd, &one, sizeof(one));
+            (void)written;
+        }
     }
-    
-    // 等待接受线程结束
-    if (accept_thread_.joinable()) {
-        accept_thread_.join();
+    for (auto& reactor : reactors_) {
+        if (reactor->thread.joinable()) {
+            reactor->thread.join();
+        }
     }
     
     // 通知所有工作线程
-    queue_cv_.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        queue_cv_.notify_all();
+    }
     
     // 等待工作线程结束
     for (auto& thread : worker_threads_) {
@@ -158,61 +486,187 @@ void TCPServer::stop() {
         }
     }
     worker_threads_.clear();
-    
-    // 关闭所有客户端连接
     {
-        std::lock_guard<std::mutex> lock(connections_mutex_);
-        for (auto& conn : connections_) {
-            conn->close();
-        }
-        connections_.clear();
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        task_queue_ = std::queue<Task>();
     }
+    
+    for (auto& reactor : reactors_) {
+        closeReactor(reactor.get());
+    }
+    reactors_.clear();
 }
 
 void TCPServer::setMessageHandler(MessageHandler handler) {
     message_handler_ = handler;
 }
 
+void TCPServer::setFrameSplitter(FrameSplitter splitter) {
+    frame_splitter_ = splitter;
+}
+
+void TCPServer::setBatchHooks(BatchHook before, BatchHook after) {
+    batch_before_ = before;
+    batch_after_ = after;
+}
+
+void TCPServer::setQueryBufferLimit(size_t limit) {
+    query_buffer_limit_ = limit;
+    for (auto& reactor : reactors_) {
+        if (reactor->uring) {
+            reactor->uring->setQueryBufferLimit(limit);
+        }
+    }
+}
+
 size_t TCPServer::getConnectionCount() const {
-    std::lock_guard<std::mutex> lock(connections_mutex_);
-    return connections_.size();
+    size_t count = 0;
+    for (const auto& reactor : reactors_) {
+        std::lock_guard<std::mutex> lock(reactor->connections_mutex);
+        count += reactor->connections.size();
+        if (reactor->uring) {
+            count += reactor->uring->connectionCount();
+        }
+    }
+    return count;
+}
+
+TCPServer::Stats TCPServer::getStats() const {
+    Stats stats;
+    stats.requests = requests_.load(std::memory_order_relaxed);
+    stats.syscalls = syscalls_.load(std::memory_order_relaxed);
+    return stats;
 }
 
-void TCPServer::acceptLoop() {
+void TCPServer::eventLoop(Reactor* reactor) {
+    if (reactor->uring) {
+        reactor->uring->run(running_);
+        return;
+    }
+    
+    struct epoll_event events[MAX_EVENTS];
+    
     while (running_) {
+        int count = epoll_wait(reactor->epoll_fd, events, MAX_EVENTS, -1);
+        syscalls_.fetch_add(1, std::memory_order_relaxed);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "epoll_wait failed: " << strerror(errno) << std::endl;
+            break;
+        }
+        
+        for (int i = 0; i < count && running_; ++i) {
+            SocketType fd = events[i].data.fd;
+            if (fd == reactor->listen_socket) {
+                acceptConnections(reactor);
+            } else if (fd != reactor->wakeup_fd) {
+                handleEvent(reactor, fd, events[i].events);
+            }
+        }
+    }
+}
+
+void TCPServer::acceptConnections(Reactor* reactor) {
+    for (int i = 0; i < ACCEPT_BATCH && running_; ++i) {
         struct sockaddr_in client_addr;
         socklen_t client_addr_len = sizeof(client_addr);
         
-        SocketType client_socket = accept(server_socket_, 
-                                        reinterpret_cast<struct sockaddr*>(&client_addr), 
-                                        &client_addr_len);
+        SocketType client_socket = accept4(reactor->listen_socket, 
+                                         reinterpret_cast<struct sockaddr*>(&client_addr), 
+                                         &client_addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        syscalls_.fetch_add(1, std::memory_order_relaxed);
         
         if (client_socket == INVALID_SOCKET_VALUE) {
-            if (running_) {
-                std::cerr << "Failed to accept connection" << std::endl;
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
             }
-            continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "Failed to accept connection: " << strerror(errno) << std::endl;
+            }
+            break;
         }
         
+        int nodelay = 1;
+        setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        
         std::string client_address = inet_ntoa(client_addr.sin_addr) + 
                                    std::string(":") + std::to_string(ntohs(client_addr.sin_port));
         
         auto client = std::make_shared<ClientConnection>(client_socket, client_address);
+        client->syscalls_ = &syscalls_;
+        client->query_buffer_limit_ = query_buffer_limit_;
+        
+        // 边缘触发下可写事件只在socket从写满变为可写时通知，所以一开始就同时注册读写
+        struct epoll_event event = {};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.fd = client_socket;
+        syscalls_.fetch_add(2, std::memory_order_relaxed);  // setsockopt和epoll_ctl
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, client_socket, &event) < 0) {
+            std::cerr << "Failed to add connection to epoll: " << strerror(errno) << std::endl;
+            continue;
+        }
         
         // 添加到连接列表
         {
-            std::lock_guard<std::mutex> lock(connections_mutex_);
-            connections_.push_back(client);
+            std::lock_guard<std::mutex> lock(reactor->connections_mutex);
+            reactor->connections[client_socket] = client;
         }
-        
-        // 启动客户端处理线程
-        std::thread(&TCPServer::handleClient, this, client).detach();
     }
 }
 
+void TCPServer::handleEvent(Reactor* reactor, SocketType fd, uint32_t events) {
+    std::shared_ptr<ClientConnection> client;
+    {
+        std::lock_guard<std::mutex> lock(reactor->connections_mutex);
+        auto it = reactor->connections.find(fd);
+        if (it == reactor->connections.end()) {
+            return;
+        }
+        client = it->second;
+    }
+    
+    bool open = true;
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        open = client->readAvailable();
+        if (client->beginTask()) {
+            dispatch(client);
+        }
+    }
+    if (open && (events & EPOLLOUT)) {
+        open = client->flushOutput();
+    }
+    // 对端半关闭后连接保持注册，直到已读到的请求都处理完、回复都写完
+    if (open && client->finishedAfterPeerClosed()) {
+        open = false;
+    }
+    
+    if (!open) {
+        removeConnection(reactor, fd);
+        // 已读到的请求处理完后再关闭
+        client->closeAfterTask();
+    }
+}
+
+void TCPServer::removeConnection(Reactor* reactor, SocketType fd) {
+    epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    syscalls_.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(reactor->connections_mutex);
+    reactor->connections.erase(fd);
+}
+
+void TCPServer::dispatch(std::shared_ptr<ClientConnection> client) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        task_queue_.emplace(std::move(client));
+    }
+    queue_cv_.notify_one();
+}
+
 void TCPServer::workerLoop() {
     while (running_) {
-        Task task(nullptr, "");
+        Task task(nullptr);
         
         {
             std::unique_lock<std::mutex> lock(queue_mutex_);
@@ -222,46 +676,67 @@ void TCPServer::workerLoop() {
                 break;
             }
             
-            if (!task_queue_.empty()) {
-                task = task_queue_.front();
-                task_queue_.pop();
-            }
+            task = std::move(task_queue_.front());
+            task_queue_.pop();
         }
         
-        if (task.client && message_handler_) { //是否有效的客户端连接，并且消息处理器
-            std::string response = message_handler_(task.data, task.client);
-            if (!response.empty()) {
-                task.client->send(response);
-            }
+        if (task.client) {
+            handleClient(task.client);
         }
     }
 }
 
 void TCPServer::handleClient(std::shared_ptr<ClientConnection> client) {
-    while (running_ && client->isValid()) {
-        std::string data = client->receive();
-        if (data.empty()) {
-            break;
+    // 处理期间事件循环新读到的数据也在这里依次处理，同一连接的回复不会乱序
+    std::string data;
+    while (client->takeInput(&data)) {
+        if (!message_handler_) {
+            continue;
         }
-        
-        if (message_handler_) {
-            std::string response = message_handler_(data, client);
-            if (!response.empty()) {
-                client->send(response);
-            }
+        std::string response;
+        if (frame_splitter_) {
+            response = handleFrames(data, client);
+        } else {
+            requests_.fetch_add(1, std::memory_order_relaxed);
+            response = message_handler_(data, client);
+        }
+        if (!response.empty()) {
+            client->send(response);
         }
     }
-    
-    // 从连接列表中移除
-    {
-        std::lock_guard<std::mutex> lock(connections_mutex_);
-        connections_.erase(
-            std::remove(connections_.begin(), connections_.end(), client),
-            connections_.end()
-        );
+}
+
+std::string TCPServer::handleFrames(std::string& data, const std::shared_ptr<ClientConnection>& client) {
+    // 接上次剩下的不完整请求
+    std::string& buffer = client->pending_request_;
+    if (buffer.empty()) {
+        buffer.swap(data);
+    } else {
+        buffer.append(data);
     }
     
-    client->close();
+    std::string responses;
+    size_t pos = 0;
+    bool batch = false;
+    while (pos < buffer.size()) {
+        size_t length = frame_splitter_(buffer, pos);
+        if (length == 0) {
+            break;
+        }
+        if (!batch && batch_before_) {
+            batch_before_();
+        }
+        batch = true;
+        requests_.fetch_add(1, std::memory_order_relaxed);
+        responses += message_handler_(buffer.substr(pos, length), client);
+        pos += length;
+    }
+    buffer.erase(0, pos);
+    client->pending_bytes_ = buffer.size();
+    if (batch && batch_after_) {
+        batch_after_();
+    }
+    return responses;
 }
 
 bool TCPServer::setNonBlocking(SocketType socket) {
@@ -8,6 +8,8 @@
 #include <condition_variable>
 #include <queue>
 #include <memory>
+#include <chrono>
+#include <unordered_map>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -21,12 +23,16 @@ typedef SOCKET SocketType;
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/epoll.h>
 typedef int SocketType;
 #define INVALID_SOCKET_VALUE -1
 #define CLOSE_SOCKET(s) close(s)
 #endif
 
 // 客户端连接类
+// 由TCPServer的事件循环管理的连接是非阻塞的：事件循环把读到的数据追加到输入缓冲区，
+// 同一连接同时最多只有一个工作线程在处理请求，保证回复的顺序。
+// io_uring后端下回复只追加到输出缓冲区，由事件循环批量提交发送
 class ClientConnection {
 public:
     ClientConnection(SocketType socket, const std::string& client_addr);
@@ -38,11 +44,11 @@ public:
     // 获取socket
     SocketType getSocket() const { return socket_; }
     
-    // 发送数据
+    // 发送数据，socket写满时剩余数据留在输出缓冲区，等可写事件时由事件循环写出
     bool send(const std::string& data);
     
-    // 接收数据
-    std::string receive();
+    // 接收数据，等待事件循环读到新的数据，超时或连接关闭时返回空字符串
+    std::string receive(std::chrono::milliseconds timeout = std::chrono::seconds(5));
     
     // 关闭连接
     void close();
@@ -51,30 +57,97 @@ public:
     bool isValid() const { return socket_ != INVALID_SOCKET_VALUE; }
 
 private:
+    friend class TCPServer;
+    friend class UringEventLoop;
+    
+    // 读取socket中的全部数据直到EAGAIN，读到EOF时标记对端已关闭写端；返回false表示出错
+    // 或输入超过了上限
+    bool readAvailable();
+    
+    // 追加事件循环读到的数据；加上未处理的输入和不完整的请求帧超过上限时不追加，返回false，
+    // 事件循环应关闭连接
+    bool appendInput(const char* data, size_t size);
+    
+    // 有待处理的输入且没有工作线程在处理时标记为处理中，返回true表示需要分派任务
+    bool beginTask();
+    
+    // 取出全部待处理的输入；没有输入时结束处理，返回false
+    bool takeInput(std::string* data);
+    
+    // 写出输出缓冲区中的剩余数据，返回false表示出错
+    bool flushOutput();
+    
+    // 取出全部待发送的回复（io_uring后端）
+    void takeOutput(std::string* data);
+    
+    // 计入一次系统调用，用于网络基准
+    void countSyscall();
+    
+    // 对端已关闭写端，且已读到的请求都处理完、回复都写完
+    bool finishedAfterPeerClosed();
+    
+    // 事件循环发现连接出错时调用，有请求正在处理时由工作线程处理完后关闭
+    void closeAfterTask();
+    
+    // io_uring后端由事件循环关闭连接：标记为关闭中，工作线程处理完后通知事件循环
+    void markClosing();
+    
+    // 是否有工作线程在处理该连接
+    bool isBusy();
+    
     SocketType socket_;
     std::string client_address_;
     std::mutex send_mutex_;
+    std::string output_;         // 尚未写出的回复
+    size_t output_offset_ = 0;
+    std::function<void()> output_notifier_;  // 设置时send只追加输出，缓冲区由空变非空时通知事件循环
+    std::atomic<uint64_t>* syscalls_ = nullptr;  // 所属TCPServer的系统调用计数
+    size_t query_buffer_limit_ = 0;  // 输入缓冲区上限，0表示不限
+    
+    std::mutex input_mutex_;
+    std::condition_variable input_cv_;
+    std::string input_;          // 已读到但尚未处理的请求数据
+    std::string pending_request_;  // 不完整的请求帧，只由正在处理该连接的工作线程访问
+    std::atomic<size_t> pending_bytes_{0};  // pending_request_的大小，供事件循环检查输入上限
+    bool busy_ = false;          // 已有工作线程在处理该连接
+    bool closing_ = false;
+    bool peer_closed_ = false;   // 读到EOF，对端已关闭写端
+    bool input_overflow_ = false;  // 输入超过了上限，等待关闭
 };
 
 // 任务结构
 struct Task {
     std::shared_ptr<ClientConnection> client;
-    std::string data;
     
-    Task(std::shared_ptr<ClientConnection> c, const std::string& d)
-        : client(c), data(d) {}
+    explicit Task(std::shared_ptr<ClientConnection> c)
+        : client(std::move(c)) {}
 };
 
+class UringEventLoop;
+
 // TCP服务器类
 class TCPServer {
 public:
     using MessageHandler = std::function<std::string(const std::string&, std::shared_ptr<ClientConnection>)>;
+    // 返回buffer中从pos开始的一个完整请求的长度，不完整时返回0
+    using FrameSplitter = std::function<size_t(const std::string& buffer, size_t pos)>;
+    using BatchHook = std::function<void()>;
+    
+    enum class Backend { Epoll, IoUring };
+    
+    // 网络统计，用于基准测试
+    struct Stats {
+        uint64_t requests = 0;   // 交给消息处理器的请求数
+        uint64_t syscalls = 0;   // 事件循环和收发路径上的系统调用数（不含线程间唤醒的futex）
+    };
     
     TCPServer();
     ~TCPServer();
     
-    // 初始化服务器
-    bool init(const std::string& host, int port, int thread_pool_size = 4);
+    // 初始化服务器，reactor_threads个事件循环各自监听同一端口（SO_REUSEPORT），<=0时为CPU核数；
+    // backend为epoll、io_uring或auto，内核不支持io_uring时回退到epoll
+    bool init(const std::string& host, int port, int thread_pool_size = 4, int reactor_threads = 1,
+              const std::string& backend = "epoll");
     
     // 启动服务器
     bool start();
@@ -85,22 +158,80 @@ public:
     // 设置消息处理器
     void setMessageHandler(MessageHandler handler);
     
+    // 设置请求分帧：设置后读到的数据按帧依次交给消息处理器，不完整的帧留到下次读到数据，
+    // 同一批数据中全部请求的回复合并为一次发送；未设置时每次读到的数据作为一条消息
+    void setFrameSplitter(FrameSplitter splitter);
+    
+    // 设置一批请求帧前后的回调（在同一工作线程中）：before在执行本批第一帧之前调用，after在
+    // 合并的回复发送之前调用，用于把逐条命令的等待（如AOF落盘）合并为每批一次
+    void setBatchHooks(BatchHook before, BatchHook after);
+    
+    // 设置每个连接输入缓冲区（已读到未处理的数据和不完整的请求）的上限，超过时关闭连接，
+    // 防止不读回复的流水线或声明了巨大长度的请求无限占用内存；0表示不限。在start之前设置
+    void setQueryBufferLimit(size_t limit);
+    
     // 获取当前连接数
     size_t getConnectionCount() const;
     
     // 获取服务器状态
     bool isRunning() const { return running_; }
+    
+    // 实际监听的端口（init时端口为0则由系统分配）
+    int getPort() const { return port_; }
+    
+    // 实际使用的网络后端
+    Backend backend() const { return backend_; }
+    const char* backendName() const { return backend_ == Backend::IoUring ? "io_uring" : "epoll"; }
+    
+    Stats getStats() const;
 
 private:
-    // 接受连接的线程函数
-    void acceptLoop();
+    // 一个事件循环：自己的监听socket、epoll实例和连接表，连接固定由接受它的事件循环读写
+    struct Reactor {
+        SocketType listen_socket = INVALID_SOCKET_VALUE;
+        SocketType epoll_fd = INVALID_SOCKET_VALUE;
+        SocketType wakeup_fd = INVALID_SOCKET_VALUE;  // stop时用来唤醒事件循环的eventfd
+        std::thread thread;
+        std::unique_ptr<UringEventLoop> uring;        // io_uring后端时代替epoll
+        
+        // 连接管理，按socket索引，只由本事件循环线程增删
+        std::unordered_map<SocketType, std::shared_ptr<ClientConnection>> connections;
+        mutable std::mutex connections_mutex; //为了在const成员函数中也能进行加锁
+    };
+    
+    // 创建并绑定一个非阻塞的监听socket
+    SocketType createListenSocket(bool reuse_port);
+    
+    // 创建事件循环的监听socket，以及epoll实例和eventfd或io_uring事件循环
+    void initReactor(Reactor* reactor, bool reuse_port);
+    
+    // 关闭事件循环的全部连接和文件描述符
+    void closeReactor(Reactor* reactor);
+    
+    // 事件循环线程函数：epoll处理接受连接和连接的读写事件
+    void eventLoop(Reactor* reactor);
+    
+    // 用accept4批量接受待处理的连接
+    void acceptConnections(Reactor* reactor);
+    
+    // 处理连接上的epoll事件
+    void handleEvent(Reactor* reactor, SocketType fd, uint32_t events);
+    
+    // 从epoll和连接列表中移除连接
+    void removeConnection(Reactor* reactor, SocketType fd);
+    
+    // 把连接的请求分派到工作线程
+    void dispatch(std::shared_ptr<ClientConnection> client);
     
     // 工作线程函数
     void workerLoop();
     
-    // 处理客户端连接
+    // 依次处理连接上全部待处理的请求
     void handleClient(std::shared_ptr<ClientConnection> client);
     
+    // 执行data中全部完整的请求帧并返回合并的回复，剩余的不完整帧留在连接上
+    std::string handleFrames(std::string& data, const std::shared_ptr<ClientConnection>& client);
+    
     // 设置socket为非阻塞模式
     bool setNonBlocking(SocketType socket);
     
@@ -112,12 +243,19 @@ private:
     
     std::string host_;
     int port_;
-    SocketType server_socket_;
+    int thread_pool_size_;
+    Backend backend_;
     std::atomic<bool> running_;
     
+    // 网络统计
+    std::atomic<uint64_t> requests_;
+    std::atomic<uint64_t> syscalls_;
+    
+    // 事件循环
+    std::vector<std::unique_ptr<Reactor>> reactors_;
+    
     // 线程池
     std::vector<std::thread> worker_threads_;
-    std::thread accept_thread_;
     
     // 任务队列
     std::queue<Task> task_queue_;
@@ -126,10 +264,10 @@ private:
     
     // 消息处理器
     MessageHandler message_handler_;
-    
-    // 连接管理
-    std::vector<std::shared_ptr<ClientConnection>> connections_;
-    mutable std::mutex connections_mutex_; //为了在const成员函数中也能进行加锁
+    FrameSplitter frame_splitter_;
+    BatchHook batch_before_;
+    BatchHook batch_after_;
+    size_t query_buffer_limit_ = 0;
     
     // 网络库初始化标志
     bool network_initialized_;
@@ -0,0 +1,368 @@
+#include "uring_event_loop.h"
+#include "../logger/logger.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/utsname.h>
+
+namespace {
+const unsigned RING_ENTRIES = 256;
+const unsigned CQ_ENTRIES = 4096;      // 多次触发的请求会持续产生CQE，CQ比SQ大得多
+const unsigned BUF_COUNT = 256;        // 提供缓冲个数，必须是2的幂
+const unsigned BUF_SIZE = 16384;
+const uint16_t BUF_GROUP = 0;
+
+uint64_t userData(uint64_t id, uint64_t op) {
+    return (id << 3) | op;
+}
+}
+
+bool UringEventLoop::probe() {
+    // 多次触发的recv从6.0开始支持
+    struct utsname name;
+    int major = 0;
+    int minor = 0;
+    if (uname(&name) != 0 || sscanf(name.release, "%d.%d", &major, &minor) != 2 || major < 6) {
+        return false;
+    }
+    IoUringRing ring;
+    if (!ring.setup(4)) {
+        return false;
+    }
+    const unsigned max_ops = 256;
+    std::vector<char> buffer(sizeof(io_uring_probe) + max_ops * sizeof(io_uring_probe_op), 0);
+    io_uring_probe* ops = reinterpret_cast<io_uring_probe*>(buffer.data());
+    if (ring.registerOp(IORING_REGISTER_PROBE, ops, max_ops) != 0) {
+        return false;
+    }
+    for (unsigned op : {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_READ, IORING_OP_PROVIDE_BUFFERS}) {
+        if (op >= ops->ops_len || (ops->ops[op].flags & IO_URING_OP_SUPPORTED) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+UringEventLoop::UringEventLoop(SocketType listen_socket, std::atomic<uint64_t>* syscalls, Dispatcher dispatch)
+    : listen_socket_(listen_socket)
+    , syscalls_(syscalls)
+    , dispatch_(std::move(dispatch)) {
+}
+
+UringEventLoop::~UringEventLoop() {
+    closeConnections();
+    // 先关闭环取消全部请求，再释放内核可能写入的缓冲
+    ring_.reset();
+    delete[] buffers_;
+    if (wakeup_fd_ >= 0) {
+        close(wakeup_fd_);
+    }
+}
+
+bool UringEventLoop::init() {
+    ring_ = std::make_unique<IoUringRing>();
+    if (!ring_->setup(RING_ENTRIES, CQ_ENTRIES)) {
+        return false;
+    }
+
+    // 全部缓冲一次性交给内核，随第一次io_uring_enter提交
+    buffers_ = new char[static_cast<size_t>(BUF_COUNT) * BUF_SIZE];
+    provideBuffers(0, BUF_COUNT);
+
+    wakeup_fd_ = eventfd(0, EFD_CLOEXEC);
+    return wakeup_fd_ >= 0;
+}
+
+void UringEventLoop::run(const std::atomic<bool>& running) {
+    armWakeup();
+    armAccept();
+
+    while (running) {
+        flushOutput();
+
+        // 先声明要睡眠再检查待发送的回复，工作线程看到sleeping_时才需要写eventfd唤醒
+        sleeping_.store(true);
+        bool has_output;
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            has_output = !pending_output_.empty();
+        }
+        if (has_output) {
+            sleeping_.store(false);
+            continue;
+        }
+
+        int error = ring_->enter(1);
+        syscalls_->fetch_add(1, std::memory_order_relaxed);
+        sleeping_.store(false);
+        if (error != 0) {
+            LOG_ERROR("io_uring_enter failed in network event loop: " + std::string(strerror(error)));
+            break;
+        }
+
+        unsigned head = *ring_->cq_head;
+        unsigned tail = __atomic_load_n(ring_->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            handleCompletion(ring_->cqes[head & *ring_->cq_mask]);
+        }
+        __atomic_store_n(ring_->cq_head, tail, __ATOMIC_RELEASE);
+    }
+}
+
+void UringEventLoop::wakeup() {
+    uint64_t one = 1;
+    ssize_t written = write(wakeup_fd_, &one, sizeof(one));
+    (void)written;
+    syscalls_->fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t UringEventLoop::connectionCount() const {
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    return connections_.size();
+}
+
+void UringEventLoop::closeConnections() {
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    for (auto& entry : connections_) {
+        entry.second.client->output_notifier_ = nullptr;
+        entry.second.client->close();
+    }
+    connections_.clear();
+}
+
+io_uring_sqe* UringEventLoop::getSqe() {
+    if (ring_->sqSpace() == 0) {
+        ring_->enter(0);
+        syscalls_->fetch_add(1, std::memory_order_relaxed);
+    }
+    return ring_->nextSqe();
+}
+
+void UringEventLoop::armAccept() {
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_socket_;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = userData(0, OP_ACCEPT);
+}
+
+void UringEventLoop::armRecv(uint64_t id, SocketType fd) {
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = userData(id, OP_RECV);
+}
+
+void UringEventLoop::armWakeup() {
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeup_fd_;
+    sqe->addr = reinterpret_cast<uint64_t>(&wakeup_value_);
+    sqe->len = sizeof(wakeup_value_);
+    sqe->user_data = userData(0, OP_WAKEUP);
+}
+
+void UringEventLoop::submitSend(uint64_t id, Connection& conn) {
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = conn.client->getSocket();
+    sqe->addr = reinterpret_cast<uint64_t>(conn.sending.data() + conn.sent);
+    sqe->len = static_cast<uint32_t>(conn.sending.size() - conn.sent);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = userData(id, OP_SEND);
+    conn.send_inflight = true;
+}
+
+void UringEventLoop::queueOutput(uint64_t id) {
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        pending_output_.push_back(id);
+    }
+    if (sleeping_.exchange(false)) {
+        wakeup();
+    }
+}
+
+void UringEventLoop::flushOutput() {
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        flushing_.swap(pending_output_);
+    }
+    for (uint64_t id : flushing_) {
+        auto it = connections_.find(id);
+        if (it != connections_.end()) {
+            continueOutput(it);
+        }
+    }
+    flushing_.clear();
+}
+
+void UringEventLoop::continueOutput(std::unordered_map<uint64_t, Connection>::iterator it) {
+    Connection& conn = it->second;
+    // 上一次发送还没完成时，完成后会接着取走新的回复
+    if (conn.send_inflight) {
+        return;
+    }
+    // 先确认工作线程已结束再取回复，保证它的回复都已追加到输出缓冲区
+    bool busy = conn.removed && conn.client->isBusy();
+    conn.client->takeOutput(&conn.sending);
+    conn.sent = 0;
+    if (!conn.sending.empty() && !conn.failed) {
+        submitSend(it->first, conn);
+        return;
+    }
+    if (conn.removed && !busy) {
+        conn.client->close();
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        connections_.erase(it);
+    }
+}
+
+void UringEventLoop::handleCompletion(const io_uring_cqe& cqe) {
+    uint64_t id = cqe.user_data >> 3;
+    switch (cqe.user_data & 7) {
+        case OP_ACCEPT:
+            onAccept(cqe.res, cqe.flags);
+            break;
+        case OP_RECV:
+            onRecv(id, cqe.res, cqe.flags);
+            break;
+        case OP_SEND:
+            onSend(id, cqe.res);
+            break;
+        case OP_WAKEUP:
+            armWakeup();
+            break;
+        case OP_PROVIDE:
+            LOG_ERROR("Failed to provide receive buffers: " + std::string(strerror(-cqe.res)));
+            break;
+    }
+}
+
+void UringEventLoop::onAccept(int res, uint32_t flags) {
+    // 多次触发的accept出错后不再产生CQE，需要重新挂上
+    if ((flags & IORING_CQE_F_MORE) == 0) {
+        armAccept();
+    }
+    if (res < 0) {
+        if (res != -ECANCELED) {
+            std::cerr << "Failed to accept connection: " << strerror(-res) << std::endl;
+        }
+        return;
+    }
+
+    SocketType client_socket = res;
+    int nodelay = 1;
+    setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    struct sockaddr_in client_addr;
+    socklen_t client_addr_len = sizeof(client_addr);
+    std::string client_address;
+    if (getpeername(client_socket, reinterpret_cast<struct sockaddr*>(&client_addr), &client_addr_len) == 0) {
+        client_address = inet_ntoa(client_addr.sin_addr) + std::string(":") + std::to_string(ntohs(client_addr.sin_port));
+    }
+    syscalls_->fetch_add(2, std::memory_order_relaxed);
+
+    uint64_t id = next_id_++;
+    auto client = std::make_shared<ClientConnection>(client_socket, client_address);
+    client->syscalls_ = syscalls_;
+    client->query_buffer_limit_ = query_buffer_limit_;
+    client->output_notifier_ = [this, id]() { queueOutput(id); };
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        connections_[id].client = client;
+    }
+    armRecv(id, client_socket);
+}
+
+void UringEventLoop::onRecv(uint64_t id, int res, uint32_t flags) {
+    auto it = connections_.find(id);
+    bool overflow = false;
+    if (res > 0 && (flags & IORING_CQE_F_BUFFER) != 0) {
+        uint16_t bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+        if (it != connections_.end()) {
+            overflow = !it->second.client->appendInput(buffers_ + static_cast<size_t>(bid) * BUF_SIZE, res);
+        }
+        provideBuffers(bid, 1);
+    }
+    if (it == connections_.end()) {
+        return;
+    }
+
+    std::shared_ptr<ClientConnection> client = it->second.client;
+    if (res > 0) {
+        if (overflow) {
+            // 输入超过上限：关闭读写两端，recv随之结束后按正常断开处理
+            shutdown(client->getSocket(), SHUT_RDWR);
+            syscalls_->fetch_add(1, std::memory_order_relaxed);
+        } else if (client->beginTask()) {
+            dispatch_(client);
+        }
+        if ((flags & IORING_CQE_F_MORE) == 0) {
+            armRecv(id, client->getSocket());
+        }
+        return;
+    }
+    // 缓冲暂时用完时多次触发的recv会结束，归还缓冲的请求排在重新挂上的recv之前提交
+    if (res == -ENOBUFS) {
+        armRecv(id, client->getSocket());
+        return;
+    }
+    // 对端关闭或出错
+    removeConnection(id);
+}
+
+void UringEventLoop::onSend(uint64_t id, int res) {
+    auto it = connections_.find(id);
+    if (it == connections_.end()) {
+        return;
+    }
+    Connection& conn = it->second;
+    conn.send_inflight = false;
+
+    if (res < 0) {
+        conn.failed = true;
+        if (!conn.removed) {
+            // 关闭读写两端，recv随之结束后按正常断开处理
+            shutdown(conn.client->getSocket(), SHUT_RDWR);
+            syscalls_->fetch_add(1, std::memory_order_relaxed);
+        }
+    } else {
+        conn.sent += static_cast<size_t>(res);
+        if (conn.sent < conn.sending.size()) {
+            submitSend(id, conn);
+            return;
+        }
+    }
+    continueOutput(it);
+}
+
+void UringEventLoop::provideBuffers(uint16_t bid, unsigned count) {
+    // 成功时不产生CQE，和本轮其他请求一起提交，不需要额外的系统调用
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(count);
+    sqe->addr = reinterpret_cast<uint64_t>(buffers_ + static_cast<size_t>(bid) * BUF_SIZE);
+    sqe->len = BUF_SIZE;
+    sqe->off = bid;
+    sqe->buf_group = BUF_GROUP;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = userData(0, OP_PROVIDE);
+}
+
+void UringEventLoop::removeConnection(uint64_t id) {
+    auto it = connections_.find(id);
+    if (it == connections_.end()) {
+        return;
+    }
+    // 已读到的请求处理完、回复发完后再关闭
+    it->second.removed = true;
+    it->second.client->markClosing();
+    continueOutput(it);
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "tcp_server.h"
+#include "../utils/io_uring.h"
+#include <unordered_map>
+
+// TCPServer的io_uring后端，每个事件循环线程一个环：
+//   - 监听socket上一个多次触发的accept，每个新连接产生一个CQE
+//   - 每个连接一个多次触发的recv，内核从共享的提供缓冲组中挑选缓冲收取数据，拷贝到连接的
+//     输入缓冲区后立即归还
+//   - 工作线程的回复只追加到连接的输出缓冲区并通知事件循环，事件循环把这一轮所有待发送
+//     连接的send和重新挂上的请求放在同一次io_uring_enter中提交
+// 正常情况下读和写都不需要单独的系统调用，每轮事件循环只进入内核一次。
+// 需要6.0以上的内核（多次触发的recv），不满足时TCPServer回退到epoll
+class UringEventLoop {
+public:
+    using Dispatcher = std::function<void(std::shared_ptr<ClientConnection>)>;
+
+    // 内核是否支持所需的操作
+    static bool probe();
+
+    // 不接管listen_socket；syscalls为所属TCPServer的系统调用计数
+    UringEventLoop(SocketType listen_socket, std::atomic<uint64_t>* syscalls, Dispatcher dispatch);
+    ~UringEventLoop();
+
+    UringEventLoop(const UringEventLoop&) = delete;
+    UringEventLoop& operator=(const UringEventLoop&) = delete;
+
+    // 创建环和提供缓冲组，失败时返回false
+    bool init();
+
+    // 每个连接输入缓冲区的上限（见TCPServer::setQueryBufferLimit），在run之前设置
+    void setQueryBufferLimit(size_t limit) { query_buffer_limit_ = limit; }
+
+    // 运行事件循环直到running变为false
+    void run(const std::atomic<bool>& running);
+
+    // 从其他线程唤醒事件循环
+    void wakeup();
+
+    // 当前连接数
+    size_t connectionCount() const;
+
+    // 关闭全部连接，只能在事件循环和工作线程都结束后调用
+    void closeConnections();
+
+private:
+    struct Connection {
+        std::shared_ptr<ClientConnection> client;
+        std::string sending;      // 已提交发送的回复
+        size_t sent = 0;
+        bool send_inflight = false;
+        bool removed = false;     // recv已结束，剩余回复发完、工作线程结束后释放
+        bool failed = false;      // 发送出错，之后的回复直接丢弃
+    };
+
+    // user_data的低3位是操作类型，其余是连接号
+    enum Op : uint64_t { OP_ACCEPT = 0, OP_RECV = 1, OP_SEND = 2, OP_WAKEUP = 3, OP_PROVIDE = 4 };
+
+    // 取一个SQE，SQ满时先提交已填入的
+    io_uring_sqe* getSqe();
+    void armAccept();
+    void armRecv(uint64_t id, SocketType fd);
+    void armWakeup();
+    void submitSend(uint64_t id, Connection& conn);
+
+    // 工作线程通知有回复待发送
+    void queueOutput(uint64_t id);
+    // 提交本轮全部待发送的回复
+    void flushOutput();
+
+    // 提交连接的下一批回复；连接已移除且没有剩余工作时关闭并释放
+    void continueOutput(std::unordered_map<uint64_t, Connection>::iterator it);
+
+    void handleCompletion(const io_uring_cqe& cqe);
+    void onAccept(int res, uint32_t flags);
+    void onRecv(uint64_t id, int res, uint32_t flags);
+    void onSend(uint64_t id, int res);
+
+    // 把从bid开始的count个缓冲交给（或还给）提供缓冲组
+    void provideBuffers(uint16_t bid, unsigned count);
+    void removeConnection(uint64_t id);
+
+    SocketType listen_socket_;
+    std::atomic<uint64_t>* syscalls_;
+    Dispatcher dispatch_;
+    size_t query_buffer_limit_ = 0;
+    std::unique_ptr<IoUringRing> ring_;
+
+    // 提供缓冲组的全部缓冲
+    char* buffers_ = nullptr;
+
+    int wakeup_fd_ = -1;
+    uint64_t wakeup_value_ = 0;
+    std::atomic<bool> sleeping_{false};
+
+    // 只由事件循环线程增删，加锁是为了其他线程读取连接数
+    std::unordered_map<uint64_t, Connection> connections_;
+    mutable std::mutex connections_mutex_;
+    uint64_t next_id_ = 1;
+
+    // 工作线程写入、事件循环取走的待发送连接
+    std::mutex pending_mutex_;
+    std::vector<uint64_t> pending_output_;
+    std::vector<uint64_t> flushing_;
+};
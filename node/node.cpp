@@ -1,19 +1,40 @@
 #include <iostream>
 #include <cstring>
 #include "node.h"
+#include "node_allocator.h"
 
 template <typename K, typename V>
 Node<K,V>::Node(K k, V v, int level){
     this->key = k;
-    this->value = v;
+    this->value = std::move(v);
     this->node_level = level;
-    this->forward = new Node<K,V>* [level + 1];
+    // forward数组紧跟在节点对象之后
+    this->forward = reinterpret_cast<Node<K,V>**>(reinterpret_cast<char*>(this) + sizeof(Node<K,V>));
     memset(this->forward, 0, sizeof(Node<K,V>*)*(level + 1));
 }
 
 template <typename K, typename V>
 Node<K,V>::~Node(){
-    delete [] forward;
+}
+
+template <typename K, typename V>
+std::size_t Node<K,V>::alloc_size(int level){
+    return sizeof(Node<K,V>) + sizeof(Node<K,V>*) * (level + 1);
+}
+
+template <typename K, typename V>
+void* Node<K,V>::operator new(std::size_t, int level){
+    return NodeAllocator::getInstance().allocate(alloc_size(level));
+}
+
+template <typename K, typename V>
+void Node<K,V>::operator delete(void* ptr){
+    NodeAllocator::getInstance().deallocate(ptr);
+}
+
+template <typename K, typename V>
+void Node<K,V>::operator delete(void* ptr, int){
+    NodeAllocator::getInstance().deallocate(ptr);
 }
 
 
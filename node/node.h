@@ -1,7 +1,10 @@
 #pragma once
 #include <iostream>
+#include <cstddef>
 
 // 节点的实现
+// 节点与它的forward数组在NodeAllocator中作为一个整体分配，创建方式为
+// new (level) Node<K,V>(k, v, level)
 template <typename K, typename V>
 class Node{
 public:
@@ -11,6 +14,11 @@ public:
     K get_key() const;
     V get_value() const;
     void set_value(V);
+    static void* operator new(std::size_t size, int level);
+    static void operator delete(void* ptr);
+    static void operator delete(void* ptr, int level);
+    // level层节点（含forward数组）占用的字节数
+    static std::size_t alloc_size(int level);
     Node<K,V> **forward;
 
     int node_level;
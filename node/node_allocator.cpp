@@ -0,0 +1,209 @@
+#include "node_allocator.h"
+#include <new>
+#include <sys/mman.h>
+
+namespace {
+const uint32_t LARGE_CLASS = UINT32_MAX;
+const size_t MAX_SLOT_SIZE = 4096;
+}
+
+// 页头，位于每个页的起始处
+struct NodeAllocator::Page {
+    uint32_t class_index;
+    uint32_t capacity;
+    uint32_t used;
+    uint32_t bump;      // 从未分配过的槽位从这里开始
+    void* free_list;    // 释放过的槽位组成的单链表
+    size_t large_size;  // 大块分配的映射长度
+};
+
+namespace {
+const size_t HEADER_SIZE = 64;
+
+// 映射length字节并按alignment对齐，裁掉两端多余的部分
+char* mapAligned(size_t length, size_t alignment){
+    size_t mapped = length + alignment;
+    void* p = ::mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED){
+        throw std::bad_alloc();
+    }
+    uintptr_t base = reinterpret_cast<uintptr_t>(p);
+    uintptr_t aligned = (base + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+    if(aligned > base){
+        ::munmap(p, aligned - base);
+    }
+    size_t tail = (base + mapped) - (aligned + length);
+    if(tail > 0){
+        ::munmap(reinterpret_cast<void*>(aligned + length), tail);
+    }
+    return reinterpret_cast<char*>(aligned);
+}
+}
+
+NodeAllocator& NodeAllocator::getInstance(){
+    // 节点可能在静态对象析构期间释放，分配器本身永不析构
+    static NodeAllocator* instance = new NodeAllocator();
+    return *instance;
+}
+
+NodeAllocator::NodeAllocator(){
+    static_assert(sizeof(Page) <= HEADER_SIZE, "page header too large");
+    classes_.resize(MAX_SLOT_SIZE / GRANULE);
+    for(size_t i = 0; i < classes_.size(); i++){
+        classes_[i].slot_size = (i + 1) * GRANULE;
+    }
+}
+
+NodeAllocator::Page* NodeAllocator::pageOf(const void* ptr){
+    return reinterpret_cast<Page*>(reinterpret_cast<uintptr_t>(ptr) & ~(static_cast<uintptr_t>(SLAB_PAGE_SIZE) - 1));
+}
+
+NodeAllocator::Page* NodeAllocator::newPage(size_t class_index){
+    if(free_pages_.empty()){
+        char* chunk = mapAligned(CHUNK_PAGES * SLAB_PAGE_SIZE, SLAB_PAGE_SIZE);
+        for(size_t i = CHUNK_PAGES; i > 0; i--){
+            free_pages_.push_back(reinterpret_cast<Page*>(chunk + (i - 1) * SLAB_PAGE_SIZE));
+        }
+    }
+    Page* page = free_pages_.back();
+    free_pages_.pop_back();
+
+    SizeClass& cls = classes_[class_index];
+    page->class_index = static_cast<uint32_t>(class_index);
+    page->capacity = static_cast<uint32_t>((SLAB_PAGE_SIZE - HEADER_SIZE) / cls.slot_size);
+    page->used = 0;
+    page->bump = 0;
+    page->free_list = nullptr;
+    page->large_size = 0;
+    cls.pages++;
+    cls.partial.insert(page);
+    active_pages_++;
+    return page;
+}
+
+void NodeAllocator::releasePage(Page* page){
+    SizeClass& cls = classes_[page->class_index];
+    cls.partial.erase(page);
+    cls.pages--;
+    active_pages_--;
+    // 归还物理内存，页头随之清零，复用时重新初始化
+    ::madvise(page, SLAB_PAGE_SIZE, MADV_DONTNEED);
+    free_pages_.push_back(page);
+}
+
+void* NodeAllocator::allocateFrom(Page* page){
+    SizeClass& cls = classes_[page->class_index];
+    void* slot;
+    if(page->free_list != nullptr){
+        slot = page->free_list;
+        page->free_list = *static_cast<void**>(slot);
+    } else {
+        slot = reinterpret_cast<char*>(page) + HEADER_SIZE + static_cast<size_t>(page->bump) * cls.slot_size;
+        page->bump++;
+    }
+    page->used++;
+    cls.used_slots++;
+    allocated_bytes_ += cls.slot_size;
+    if(page->used == page->capacity){
+        cls.partial.erase(page);
+    }
+    return slot;
+}
+
+void* NodeAllocator::allocateLarge(size_t size){
+    size_t length = (HEADER_SIZE + size + 4095) & ~static_cast<size_t>(4095);
+    char* base = mapAligned(length, SLAB_PAGE_SIZE);
+    Page* page = reinterpret_cast<Page*>(base);
+    page->class_index = LARGE_CLASS;
+    page->capacity = 1;
+    page->used = 1;
+    page->large_size = length;
+    large_bytes_ += length;
+    return base + HEADER_SIZE;
+}
+
+void* NodeAllocator::allocate(size_t size){
+    if(size == 0){
+        size = 1;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(size > MAX_SLOT_SIZE){
+        return allocateLarge(size);
+    }
+    size_t class_index = (size + GRANULE - 1) / GRANULE - 1;
+    SizeClass& cls = classes_[class_index];
+    Page* page = cls.partial.empty() ? newPage(class_index) : *cls.partial.begin();
+    return allocateFrom(page);
+}
+
+void NodeAllocator::deallocate(void* ptr){
+    if(ptr == nullptr){
+        return;
+    }
+    Page* page = pageOf(ptr);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(page->class_index == LARGE_CLASS){
+        large_bytes_ -= page->large_size;
+        ::munmap(page, page->large_size);
+        return;
+    }
+
+    SizeClass& cls = classes_[page->class_index];
+    *static_cast<void**>(ptr) = page->free_list;
+    page->free_list = ptr;
+    if(page->used == page->capacity){
+        cls.partial.insert(page);
+    }
+    page->used--;
+    cls.used_slots--;
+    allocated_bytes_ -= cls.slot_size;
+    if(page->used == 0){
+        releasePage(page);
+    }
+}
+
+bool NodeAllocator::shouldMove(const void* ptr){
+    Page* page = pageOf(ptr);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(page->class_index == LARGE_CLASS || page->used == page->capacity){
+        return false;
+    }
+    const SizeClass& cls = classes_[page->class_index];
+    // page->used / capacity < used_slots / (pages * capacity)
+    return static_cast<uint64_t>(page->used) * cls.pages < cls.used_slots;
+}
+
+void* NodeAllocator::reallocForDefrag(const void* ptr){
+    Page* page = pageOf(ptr);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(page->class_index == LARGE_CLASS){
+        return nullptr;
+    }
+    SizeClass& cls = classes_[page->class_index];
+    if(cls.partial.empty()){
+        return nullptr;
+    }
+    Page* target = *cls.partial.begin();
+    if(!(target < page)){
+        return nullptr;
+    }
+    return allocateFrom(target);
+}
+
+NodeAllocator::Stats NodeAllocator::getStats(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.allocated_bytes = allocated_bytes_ + large_bytes_;
+    stats.active_bytes = active_pages_ * SLAB_PAGE_SIZE + large_bytes_;
+    stats.active_pages = active_pages_;
+    stats.retained_pages = free_pages_.size();
+    return stats;
+}
+
+double NodeAllocator::fragmentationRatio(){
+    Stats stats = getStats();
+    if(stats.allocated_bytes == 0){
+        return 1.0;
+    }
+    return static_cast<double>(stats.active_bytes) / static_cast<double>(stats.allocated_bytes);
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <vector>
+
+// 跳表节点的slab分配器
+//
+// 节点连同它的forward数组作为一个整体分配，按16字节粒度分成若干大小级别。
+// 每个级别的内存以64KB的页为单位切分成等大的槽位，页按地址有序管理，分配时
+// 总是使用地址最低的未满页，使存活节点向低地址集中。页变空后用MADV_DONTNEED
+// 归还物理内存并留待复用；超过一页的分配独占一段映射。
+//
+// 页头记录已用槽位数，因此可以精确统计已分配字节和页占用字节，得到碎片率，
+// 并为主动碎片整理提供提示：位于利用率低于同级别平均值的页上的节点值得迁移，
+// reallocForDefrag只在能迁移到更低地址的页时才分配新槽位，保证整理单调收敛。
+class NodeAllocator {
+public:
+    struct Stats {
+        size_t allocated_bytes = 0; // 已分配槽位的字节数
+        size_t active_bytes = 0;    // 至少有一个槽位被使用的页的字节数
+        size_t active_pages = 0;
+        size_t retained_pages = 0;  // 已归还物理内存、保留地址空间待复用的页
+    };
+
+    static NodeAllocator& getInstance();
+
+    NodeAllocator(const NodeAllocator&) = delete;
+    NodeAllocator& operator=(const NodeAllocator&) = delete;
+
+    void* allocate(size_t size);
+    void deallocate(void* ptr);
+
+    // ptr所在页的利用率是否低于同级别平均值，值得迁移
+    bool shouldMove(const void* ptr);
+
+    // 在地址更低的未满页中为ptr分配一个同级别的新槽位；没有更好的位置时返回nullptr
+    void* reallocForDefrag(const void* ptr);
+
+    Stats getStats();
+
+    // 碎片率：页占用字节 / 已分配字节
+    double fragmentationRatio();
+
+    static const size_t SLAB_PAGE_SIZE = 64 * 1024;
+
+private:
+    struct Page;
+    struct PageLess {
+        bool operator()(const Page* a, const Page* b) const { return a < b; }
+    };
+    struct SizeClass {
+        size_t slot_size = 0;
+        size_t pages = 0;      // 非空页数
+        size_t used_slots = 0; // 已分配槽位数
+        std::set<Page*, PageLess> partial; // 未满页，按地址排序
+    };
+
+    NodeAllocator();
+    ~NodeAllocator() = default;
+
+    static Page* pageOf(const void* ptr);
+    Page* newPage(size_t class_index);
+    void releasePage(Page* page);
+    void* allocateFrom(Page* page);
+    void* allocateLarge(size_t size);
+
+    static const size_t GRANULE = 16;
+    static const size_t CHUNK_PAGES = 64; // 每次向系统申请64页(4MB)
+
+    std::mutex mutex_;
+    std::vector<SizeClass> classes_;
+    std::vector<Page*> free_pages_; // 已归还物理内存、可复用的页
+    size_t allocated_bytes_ = 0;
+    size_t active_pages_ = 0;
+    size_t large_bytes_ = 0;
+};
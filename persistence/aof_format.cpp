@@ -0,0 +1,324 @@
+#include "aof_format.h"
+#include "../include/exceptions.h"
+#include "../utils/utils.h"
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace {
+const char FILE_MAGIC[AOF_HEADER_SIZE] = {'S', 'L', 'A', 'O', 'F', '0', '0', '1'};
+const size_t READ_BUFFER_SIZE = 4 * 1024 * 1024;
+const size_t RECORD_HEADER_SIZE = 9;  // op + key + value_length
+
+void putU32(char* p, uint32_t v){
+    memcpy(p, &v, sizeof(v));
+}
+
+uint32_t getU32(const char* p){
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint64_t getU64(const char* p){
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+bool validOp(uint8_t op){
+    return op >= static_cast<uint8_t>(AofOp::Set) && op <= static_cast<uint8_t>(AofOp::Flush);
+}
+
+void writeFile(int fd, const std::string& path, const std::string& data){
+    const char* p = data.data();
+    size_t remaining = data.size();
+    while(remaining > 0){
+        ssize_t n = ::write(fd, p, remaining);
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n <= 0){
+            throw skiplist::FileIOException(path, "write");
+        }
+        p += n;
+        remaining -= static_cast<size_t>(n);
+    }
+}
+
+// 把旧文本AOF的每一行（"命令 key value"，value可含空格）转换为二进制记录
+uint64_t convertTextAof(const std::string& path){
+    std::ifstream in(path);
+    if(!in.is_open()){
+        throw skiplist::FileIOException(path, "open");
+    }
+    std::string out = aofFileHeader();
+    uint64_t records = 0;
+    std::string line;
+    while(std::getline(in, line)){
+        if(!line.empty() && line.back() == '\r'){
+            line.pop_back();
+        }
+        size_t command_end = line.find(' ');
+        std::string command = line.substr(0, command_end);
+        if(command == "FLUSH"){
+            encodeAofRecord(out, AofOp::Flush, 0);
+            records++;
+            continue;
+        }
+        if(command_end == std::string::npos || (command != "SET" && command != "DEL")){
+            continue;
+        }
+        size_t key_end = line.find(' ', command_end + 1);
+        int key;
+        try {
+            key = std::stoi(line.substr(command_end + 1, key_end - command_end - 1));
+        } catch (const std::exception&) {
+            continue;
+        }
+        if(command == "DEL"){
+            encodeAofRecord(out, AofOp::Del, key);
+        } else {
+            std::string value = key_end == std::string::npos ? std::string() : line.substr(key_end + 1);
+            encodeAofRecord(out, AofOp::Set, key, value.data(), value.size());
+        }
+        records++;
+    }
+
+    std::string tmp_path = path + ".tmp";
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        throw skiplist::FileIOException(tmp_path, "open");
+    }
+    try {
+        writeFile(fd, tmp_path, out);
+        if(::fsync(fd) != 0){
+            throw skiplist::FileIOException(tmp_path, "fsync");
+        }
+    } catch (...) {
+        ::close(fd);
+        ::unlink(tmp_path.c_str());
+        throw;
+    }
+    ::close(fd);
+    if(::rename(tmp_path.c_str(), path.c_str()) != 0){
+        ::unlink(tmp_path.c_str());
+        throw skiplist::FileIOException(path, "rename");
+    }
+    return records;
+}
+}
+
+std::string aofFileHeader() {
+    return std::string(FILE_MAGIC, AOF_HEADER_SIZE);
+}
+
+void encodeAofRecord(std::string& out, AofOp op, int32_t key, const char* value, size_t length) {
+    size_t start = out.size();
+    out.resize(start + RECORD_HEADER_SIZE);
+    char* p = &out[start];
+    p[0] = static_cast<char>(op);
+    putU32(p + 1, static_cast<uint32_t>(key));
+    putU32(p + 5, static_cast<uint32_t>(length));
+    out.append(value, length);
+    char crc[4];
+    putU32(crc, Utils::crc32c(out.data() + start, out.size() - start));
+    out.append(crc, sizeof(crc));
+}
+
+std::string aofPreambleRecord(uint64_t snapshot_length) {
+    std::string out;
+    char length[8];
+    memcpy(length, &snapshot_length, sizeof(length));
+    encodeAofRecord(out, AofOp::Preamble, 0, length, sizeof(length));
+    return out;
+}
+
+size_t aofRecordSize(const char* record) {
+    return AOF_RECORD_OVERHEAD + getU32(record + 5);
+}
+
+size_t decodeAofRecord(const char* data, size_t size, AofOp* op, int32_t* key, const char** value, size_t* length) {
+    if(size < RECORD_HEADER_SIZE || size < aofRecordSize(data)){
+        return 0;
+    }
+    size_t record_size = aofRecordSize(data);
+    if(!validOp(static_cast<uint8_t>(data[0])) ||
+       Utils::crc32c(data, record_size - 4) != getU32(data + record_size - 4)){
+        throw skiplist::DataCorruptionException("bad AOF record in replication stream");
+    }
+    *op = static_cast<AofOp>(data[0]);
+    *key = static_cast<int32_t>(getU32(data + 1));
+    *value = data + RECORD_HEADER_SIZE;
+    *length = record_size - AOF_RECORD_OVERHEAD;
+    return record_size;
+}
+
+bool isBinaryAof(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[AOF_HEADER_SIZE];
+    return in.read(magic, sizeof(magic)) && memcmp(magic, FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+uint64_t prepareAofFile(const std::string& path) {
+    if(Utils::fileExists(path) && Utils::getFileSize(path) > 0){
+        return isBinaryAof(path) ? 0 : convertTextAof(path);
+    }
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        throw skiplist::FileIOException(path, "open");
+    }
+    try {
+        writeFile(fd, path, aofFileHeader());
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+    return 0;
+}
+
+AofReader::AofReader(const std::string& path)
+    : path_(path) {
+    int fd = ::open(path_.c_str(), O_RDONLY);
+    if(fd < 0){
+        throw skiplist::FileIOException(path_, "open");
+    }
+    char head[AOF_HEADER_SIZE + AOF_PREAMBLE_RECORD_SIZE];
+    ssize_t n = ::pread(fd, head, sizeof(head), 0);
+    struct stat st;
+    bool stat_ok = ::fstat(fd, &st) == 0;
+    ::close(fd);
+    if(n < 0 || !stat_ok){
+        throw skiplist::FileIOException(path_, "read");
+    }
+    if(static_cast<size_t>(n) < AOF_HEADER_SIZE || memcmp(head, FILE_MAGIC, AOF_HEADER_SIZE) != 0){
+        throw skiplist::DataCorruptionException("bad AOF header in " + path_);
+    }
+    const char* p = head + AOF_HEADER_SIZE;
+    if(static_cast<size_t>(n) < sizeof(head) || static_cast<uint8_t>(p[0]) != static_cast<uint8_t>(AofOp::Preamble)){
+        return;
+    }
+    // 前导在重写的子进程中fsync后才随rename生效，不会写到一半
+    if(getU32(p + 5) != 8 || Utils::crc32c(p, AOF_PREAMBLE_RECORD_SIZE - 4) != getU32(p + AOF_PREAMBLE_RECORD_SIZE - 4)){
+        throw skiplist::DataCorruptionException("bad AOF preamble record in " + path_);
+    }
+    preamble_length_ = getU64(p + RECORD_HEADER_SIZE);
+    records_offset_ = preambleOffset() + preamble_length_;
+    if(records_offset_ > static_cast<uint64_t>(st.st_size)){
+        throw skiplist::DataCorruptionException("AOF preamble extends past end of file: " + path_);
+    }
+}
+
+uint64_t AofReader::replay(const Visitor& visitor, bool truncate_torn_tail) {
+    return scan([&](const char* p, size_t record_size) {
+        visitor(static_cast<AofOp>(p[0]), static_cast<int32_t>(getU32(p + 1)), p + RECORD_HEADER_SIZE,
+                record_size - AOF_RECORD_OVERHEAD);
+        return true;
+    }, truncate_torn_tail ? TornTail::Truncate : TornTail::Fail);
+}
+
+uint64_t AofReader::readRecords(const RawVisitor& visitor) {
+    return scan(visitor, TornTail::Ignore);
+}
+
+template<typename OnRecord>
+uint64_t AofReader::scan(OnRecord&& on_record, TornTail torn_tail) {
+    int fd = ::open(path_.c_str(), O_RDONLY);
+    if(fd < 0){
+        throw skiplist::FileIOException(path_, "open");
+    }
+    struct stat st;
+    if(::fstat(fd, &st) != 0){
+        ::close(fd);
+        throw skiplist::FileIOException(path_, "stat");
+    }
+    uint64_t file_size = static_cast<uint64_t>(st.st_size);
+    if(::lseek(fd, static_cast<off_t>(records_offset_), SEEK_SET) < 0){
+        ::close(fd);
+        throw skiplist::FileIOException(path_, "seek");
+    }
+    ::posix_fadvise(fd, static_cast<off_t>(records_offset_), 0, POSIX_FADV_SEQUENTIAL);
+
+    std::vector<char> buffer(READ_BUFFER_SIZE);
+    size_t have = 0;
+    uint64_t base = records_offset_;  // buffer[0]在文件中的偏移
+    uint64_t records = 0;
+    bool eof = false;
+    bool torn = false;
+    bool stopped = false;
+    try {
+        while(!eof && !torn && !stopped){
+            ssize_t n = ::read(fd, buffer.data() + have, buffer.size() - have);
+            if(n < 0){
+                if(errno == EINTR){
+                    continue;
+                }
+                throw skiplist::FileIOException(path_, "read");
+            }
+            eof = n == 0;
+            have += static_cast<size_t>(n);
+
+            size_t pos = 0;
+            while(have - pos >= RECORD_HEADER_SIZE){
+                const char* p = buffer.data() + pos;
+                size_t length = getU32(p + 5);
+                size_t record_size = RECORD_HEADER_SIZE + length + 4;
+                if(!validOp(static_cast<uint8_t>(p[0])) || base + pos + record_size > file_size){
+                    // 长度越过文件尾或头部无效：只有它是最后一条记录时才是写到一半
+                    if(base + pos + record_size >= file_size){
+                        torn = true;
+                        break;
+                    }
+                    throw skiplist::DataCorruptionException("bad AOF record at offset " + std::to_string(base + pos) + " in " + path_);
+                }
+                if(have - pos < record_size){
+                    if(record_size > buffer.size()){
+                        buffer.resize(record_size);
+                    }
+                    break;
+                }
+                if(Utils::crc32c(p, record_size - 4) != getU32(p + record_size - 4)){
+                    if(base + pos + record_size == file_size){
+                        torn = true;
+                        break;
+                    }
+                    throw skiplist::DataCorruptionException("AOF checksum mismatch at offset " + std::to_string(base + pos) + " in " + path_);
+                }
+                records++;
+                pos += record_size;
+                if(!on_record(p, record_size)){
+                    stopped = true;
+                    break;
+                }
+            }
+
+            memmove(buffer.data(), buffer.data() + pos, have - pos);
+            base += pos;
+            have -= pos;
+            if(eof && have > 0){
+                torn = true;
+            }
+        }
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+
+    if(!torn || base >= file_size || torn_tail == TornTail::Ignore){
+        return records;
+    }
+    if(torn_tail == TornTail::Fail){
+        throw skiplist::DataCorruptionException("incomplete AOF record at offset " + std::to_string(base) + " in " + path_);
+    }
+    // 截掉崩溃时写了一半的最后一条记录，之后的追加从完整记录之后开始
+    truncated_bytes_ = file_size - base;
+    if(::truncate(path_.c_str(), static_cast<off_t>(base)) != 0){
+        throw skiplist::FileIOException(path_, "truncate");
+    }
+    return records;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+// 二进制AOF格式
+//
+// 文件布局：
+//   文件头   magic "SLAOF001"(8)
+//   [前导]   PREAMBLE记录（value为快照长度u64）| 完整的二进制快照（见snapshot.h）
+//   记录*N   op(u8) | key(i32) | value_length(u32) | value | crc32c(u32)
+//            crc32c覆盖op到value的全部字节；DEL和FLUSH没有value，FLUSH的key为0
+//
+// 重写出的文件以前导快照保存重写开始时的全部数据，其后只是重写期间及之后的写入：
+// 加载时快照部分并行解码、批量接入跳表，只有尾部记录需要逐条重放。前导只能紧跟
+// 在文件头之后。
+//
+// 记录定长的头部让重放只需顺序扫描、校验后直接调用存储引擎，不再经过RESP解析和
+// 命令分发。追加写入时崩溃可能只写出最后一条记录的一部分：文件末尾不完整或校验
+// 失败的记录在加载时被截掉；校验失败的记录之后还有数据则视为文件损坏。
+enum class AofOp : uint8_t {
+    Set = 1,
+    Del = 2,
+    Flush = 3,
+    Preamble = 4
+};
+
+const size_t AOF_HEADER_SIZE = 8;
+const size_t AOF_PREAMBLE_RECORD_SIZE = 21;  // 记录头 + 快照长度 + crc32c
+const size_t AOF_RECORD_OVERHEAD = 13;       // 每条记录除value之外的字节数
+
+// 文件头
+std::string aofFileHeader();
+
+// 把一条记录追加到out
+void encodeAofRecord(std::string& out, AofOp op, int32_t key, const char* value = nullptr, size_t length = 0);
+
+// 前导记录，snapshot_length为其后快照的字节数
+std::string aofPreambleRecord(uint64_t snapshot_length);
+
+// 已编码记录的总长度，record至少包含完整的记录头
+size_t aofRecordSize(const char* record);
+
+// 解码data开头的一条记录，返回记录长度；数据不足一条记录时返回0，校验失败时抛出
+// DataCorruptionException。value指向data内部
+size_t decodeAofRecord(const char* data, size_t size, AofOp* op, int32_t* key, const char** value, size_t* length);
+
+// 文件是否以二进制AOF的magic开头
+bool isBinaryAof(const std::string& path);
+
+// 文件不存在或为空时写入文件头；已有的旧文本AOF（每行"SET key value"）转换为
+// 二进制格式后原子替换，返回转换的记录数
+uint64_t prepareAofFile(const std::string& path);
+
+class AofReader {
+public:
+    using Visitor = std::function<void(AofOp op, int32_t key, const char* value, size_t length)>;
+    // 收到一条完整记录的原始字节，返回false时停止读取
+    using RawVisitor = std::function<bool(const char* record, size_t size)>;
+
+    // 校验文件头并读取前导记录，文件头无效时抛出DataCorruptionException
+    explicit AofReader(const std::string& path);
+
+    // 前导快照在文件中的区间，没有前导时长度为0
+    bool hasPreamble() const { return preamble_length_ > 0; }
+    uint64_t preambleOffset() const { return AOF_HEADER_SIZE + AOF_PREAMBLE_RECORD_SIZE; }
+    uint64_t preambleLength() const { return preamble_length_; }
+
+    // 用大块顺序read扫描前导之后的全部记录并逐条回调，返回记录数。truncate_torn_tail
+    // 为true时末尾不完整的记录被截掉（只有最后写入的文件可能如此），否则与中间的
+    // 记录损坏一样抛出DataCorruptionException
+    uint64_t replay(const Visitor& visitor, bool truncate_torn_tail = true);
+
+    // 按顺序读取前导之后的完整记录并交给visitor，返回读取的记录数。文件可能正在被追加：
+    // 末尾不完整的记录被忽略，不截断文件
+    uint64_t readRecords(const RawVisitor& visitor);
+
+    // 加载时截掉的字节数
+    uint64_t truncatedBytes() const { return truncated_bytes_; }
+
+private:
+    // 文件末尾不完整的记录：截掉、报错或忽略
+    enum class TornTail { Truncate, Fail, Ignore };
+
+    // 扫描前导之后的记录，对每条完整记录调用on_record(记录, 长度)，返回false时停止
+    template<typename OnRecord>
+    uint64_t scan(OnRecord&& on_record, TornTail torn_tail);
+
+    std::string path_;
+    uint64_t preamble_length_ = 0;
+    uint64_t records_offset_ = AOF_HEADER_SIZE;  // 第一条普通记录的偏移
+    uint64_t truncated_bytes_ = 0;
+};
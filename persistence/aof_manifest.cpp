@@ -0,0 +1,316 @@
+#include "aof_manifest.h"
+#include "aof_format.h"
+#include "../include/exceptions.h"
+#include "../utils/utils.h"
+#include "../logger/logger.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+const char BASE_KIND[] = "base";
+const char INCR_KIND[] = "incr";
+
+void writeAndSync(int fd, const std::string& path, const std::string& data){
+    const char* p = data.data();
+    size_t remaining = data.size();
+    while(remaining > 0){
+        ssize_t n = ::write(fd, p, remaining);
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n <= 0){
+            throw skiplist::FileIOException(path, "write");
+        }
+        p += n;
+        remaining -= static_cast<size_t>(n);
+    }
+    if(::fdatasync(fd) != 0){
+        throw skiplist::FileIOException(path, "fsync");
+    }
+}
+
+// 从"<prefix>.<kind>.<seq>"中解析序号，不匹配时返回false
+bool parseSequence(const std::string& name, const std::string& prefix, const char* kind, uint64_t* sequence){
+    std::string head = prefix + "." + kind + ".";
+    if(name.compare(0, head.size(), head) != 0 || name.size() == head.size()){
+        return false;
+    }
+    char* end = nullptr;
+    *sequence = strtoull(name.c_str() + head.size(), &end, 10);
+    return *end == '\0';
+}
+
+// 解析manifest行中可选的lsn字段，旧格式没有这一列
+uint64_t parseLsn(std::istringstream& fields){
+    std::string token;
+    if(!(fields >> token)){
+        return AOF_UNKNOWN_LSN;
+    }
+    char* end = nullptr;
+    uint64_t lsn = strtoull(token.c_str(), &end, 10);
+    return *end == '\0' ? lsn : AOF_UNKNOWN_LSN;
+}
+
+std::string lsnField(uint64_t lsn){
+    return lsn == AOF_UNKNOWN_LSN ? std::string() : " " + std::to_string(lsn);
+}
+}
+
+AofManifest::AofManifest(const std::string& aof_file)
+    : aof_file_(aof_file)
+    , dir_(Utils::getDirectory(aof_file))
+    , prefix_(std::filesystem::path(aof_file).filename().string())
+    , manifest_path_(aof_file + ".manifest") {
+}
+
+std::string AofManifest::segmentName(const char* kind, uint64_t sequence) const {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "%012llu", static_cast<unsigned long long>(sequence));
+    return prefix_ + "." + kind + "." + suffix;
+}
+
+std::string AofManifest::fullPath(const std::string& name) const {
+    return dir_.empty() ? name : dir_ + "/" + name;
+}
+
+uint64_t AofManifest::open() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t converted = 0;
+    if(Utils::fileExists(manifest_path_)){
+        load();
+    } else if(Utils::fileExists(aof_file_)){
+        // 升级：原来的单文件AOF原样成为base，不需要搬动数据
+        converted = prepareAofFile(aof_file_);
+        base_ = {prefix_, 0, AOF_UNKNOWN_LSN};
+        persist();
+    }
+    removeOrphans();
+    return converted;
+}
+
+bool AofManifest::read() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!Utils::fileExists(manifest_path_)){
+        return false;
+    }
+    load();
+    return true;
+}
+
+void AofManifest::load() {
+    std::ifstream in(manifest_path_);
+    if(!in.is_open()){
+        throw skiplist::FileIOException(manifest_path_, "open");
+    }
+    base_ = {"", 0, 0};
+    incrs_.clear();
+    std::string line;
+    while(std::getline(in, line)){
+        if(line.empty()){
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string kind, name;
+        fields >> kind >> name;
+        uint64_t sequence = 0;
+        if(kind == BASE_KIND && !name.empty()){
+            parseSequence(name, prefix_, BASE_KIND, &sequence);
+            base_ = {name, sequence, parseLsn(fields)};
+        } else if(kind == INCR_KIND && parseSequence(name, prefix_, INCR_KIND, &sequence)){
+            incrs_.push_back({name, sequence, parseLsn(fields)});
+        } else {
+            throw skiplist::DataCorruptionException("bad AOF manifest line '" + line + "' in " + manifest_path_);
+        }
+    }
+    next_incr_ = incrs_.empty() ? 1 : incrs_.back().sequence + 1;
+}
+
+bool AofManifest::persist() {
+    std::string content;
+    if(!base_.name.empty()){
+        content += std::string(BASE_KIND) + " " + base_.name + lsnField(base_.lsn) + "\n";
+    }
+    for(const auto& incr : incrs_){
+        content += std::string(INCR_KIND) + " " + incr.name + lsnField(incr.lsn) + "\n";
+    }
+    std::string tmp_path = manifest_path_ + ".tmp";
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        throw skiplist::FileIOException(tmp_path, "open");
+    }
+    try {
+        writeAndSync(fd, tmp_path, content);
+    } catch (...) {
+        ::close(fd);
+        ::unlink(tmp_path.c_str());
+        throw;
+    }
+    ::close(fd);
+    if(::rename(tmp_path.c_str(), manifest_path_.c_str()) != 0){
+        ::unlink(tmp_path.c_str());
+        throw skiplist::FileIOException(manifest_path_, "rename");
+    }
+    // 新manifest已经替换旧的，不能再回滚；目录没有落盘时由调用方保留旧文件
+    if(!Utils::syncParentDirectory(manifest_path_)){
+        LOG_ERROR("Failed to fsync AOF directory of " + manifest_path_ + ": " + std::string(strerror(errno)));
+        return false;
+    }
+    return true;
+}
+
+void AofManifest::removeOrphans() {
+    std::error_code ec;
+    for(const auto& entry : std::filesystem::directory_iterator(dir_.empty() ? "." : dir_, ec)){
+        std::string name = entry.path().filename().string();
+        uint64_t sequence;
+        bool segment = parseSequence(name, prefix_, BASE_KIND, &sequence) || parseSequence(name, prefix_, INCR_KIND, &sequence);
+        bool listed = name == base_.name;
+        for(const auto& incr : incrs_){
+            listed = listed || name == incr.name;
+        }
+        // 滚动或重写中途崩溃留下的段，以及写到一半的临时文件
+        if((segment && !listed) || name == prefix_ + ".rewrite.tmp" || name == prefix_ + ".manifest.tmp"){
+            std::filesystem::remove(entry.path(), ec);
+        }
+    }
+}
+
+std::vector<std::string> AofManifest::files() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> files;
+    if(!base_.name.empty()){
+        files.push_back(fullPath(base_.name));
+    }
+    for(const auto& incr : incrs_){
+        files.push_back(fullPath(incr.name));
+    }
+    return files;
+}
+
+std::string AofManifest::lastIncr() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return incrs_.empty() ? std::string() : fullPath(incrs_.back().name);
+}
+
+std::vector<AofManifest::IncrInfo> AofManifest::incrs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<IncrInfo> result;
+    for(const auto& incr : incrs_){
+        result.push_back({fullPath(incr.name), incr.lsn});
+    }
+    return result;
+}
+
+uint64_t AofManifest::baseLsn() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return base_.name.empty() ? 0 : base_.lsn;
+}
+
+uint64_t AofManifest::lastIncrSequence() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return incrs_.empty() ? 0 : incrs_.back().sequence;
+}
+
+int AofManifest::addIncr(uint64_t preallocate, uint64_t start_lsn, std::string* path, uint64_t* sequence) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Segment segment{segmentName(INCR_KIND, next_incr_), next_incr_, start_lsn};
+    std::string segment_path = fullPath(segment.name);
+    int fd = ::open(segment_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if(fd < 0){
+        throw skiplist::FileIOException(segment_path, "open");
+    }
+    try {
+        // 预分配的块在文件大小之外，追加时不必再分配块，重放仍以文件大小为准
+        if(preallocate > 0){
+            ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(preallocate));
+        }
+        writeAndSync(fd, segment_path, aofFileHeader());
+        incrs_.push_back(segment);
+        try {
+            persist();
+        } catch (...) {
+            incrs_.pop_back();
+            throw;
+        }
+    } catch (...) {
+        ::close(fd);
+        ::unlink(segment_path.c_str());
+        throw;
+    }
+    next_incr_++;
+    *path = segment_path;
+    *sequence = segment.sequence;
+    return fd;
+}
+
+void AofManifest::installBase(const std::string& temp_path, uint64_t first_incr) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Segment old_base = base_;
+    std::vector<Segment> old_incrs = incrs_;
+
+    Segment new_base{"", base_.sequence + 1, AOF_UNKNOWN_LSN};
+    if(!temp_path.empty()){
+        new_base.name = segmentName(BASE_KIND, new_base.sequence);
+        if(::rename(temp_path.c_str(), fullPath(new_base.name).c_str()) != 0){
+            ::unlink(temp_path.c_str());
+            throw skiplist::FileIOException(fullPath(new_base.name), "rename");
+        }
+    }
+    std::vector<Segment> kept;
+    std::vector<Segment> dropped;
+    for(const auto& incr : incrs_){
+        (incr.sequence >= first_incr ? kept : dropped).push_back(incr);
+    }
+    if(!kept.empty()){
+        new_base.lsn = kept.front().lsn;
+    }
+    base_ = new_base;
+    incrs_ = kept;
+    bool durable;
+    try {
+        durable = persist();
+    } catch (...) {
+        base_ = old_base;
+        incrs_ = old_incrs;
+        if(!new_base.name.empty()){
+            ::unlink(fullPath(new_base.name).c_str());
+        }
+        throw;
+    }
+
+    // 新manifest已生效且落盘，旧文件只需整体删除；没有落盘时旧manifest可能在崩溃后重新生效，
+    // 旧文件留到下次打开时作为孤立文件清理
+    if(!durable){
+        return;
+    }
+    if(!old_base.name.empty() && old_base.name != new_base.name){
+        ::unlink(fullPath(old_base.name).c_str());
+    }
+    for(const auto& incr : dropped){
+        ::unlink(fullPath(incr.name).c_str());
+    }
+}
+
+uint64_t AofManifest::totalSize() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t total = 0;
+    if(!base_.name.empty()){
+        total += Utils::getFileSize(fullPath(base_.name));
+    }
+    for(const auto& incr : incrs_){
+        total += Utils::getFileSize(fullPath(incr.name));
+    }
+    return total;
+}
+
+size_t AofManifest::segmentCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return incrs_.size() + (base_.name.empty() ? 0 : 1);
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+// manifest中没有记录LSN的段
+constexpr uint64_t AOF_UNKNOWN_LSN = UINT64_MAX;
+
+// 多段AOF
+//
+// AOF由一个base文件和若干按序号递增的增量段组成，<aof_file>.manifest按顺序记录它们：
+//   base <文件名> <lsn>     重写出的基础文件（可带快照前导），最多一个；lsn为它包含的最后一条写入
+//   incr <文件名> <lsn>     增量段，写满或开始重写时滚动到下一段；lsn为段内第一条记录之前的LSN
+// 段文件名为<aof_file>.base.<seq>和<aof_file>.incr.<seq>，与manifest在同一目录；
+// 升级前的单文件AOF直接作为base，保留原文件名。
+//
+// 第N条记录的LSN为段的lsn加N，复制从磁盘续传时据此定位。旧manifest没有lsn字段，
+// 这样的段LSN未知，只能全量同步。
+//
+// manifest先写临时文件，fsync后rename替换。新段写好文件头并落盘后才加入manifest，
+// 旧段在新manifest生效后才删除，任意时刻崩溃manifest都指向一组完整的文件；不在
+// manifest中的段文件是崩溃残留，打开时删除。重写不再复制重写期间的写入：开始时
+// 滚动到新的增量段，完成时新base加上此后的增量段即为完整数据，旧文件整体删除。
+class AofManifest {
+public:
+    explicit AofManifest(const std::string& aof_file);
+
+    // 读取manifest；没有manifest时把已有的单文件AOF作为base（旧文本格式先转换），
+    // 并删除不在manifest中的段文件。返回转换的文本记录数，失败时抛出异常
+    uint64_t open();
+
+    // 只读取已有的manifest，不转换旧文件也不删除残留段（离线工具使用）；没有manifest时返回false
+    bool read();
+
+    // 加载顺序的全部文件：base在前，增量段按序号升序
+    std::vector<std::string> files() const;
+
+    struct IncrInfo {
+        std::string path;
+        uint64_t start_lsn;  // 段内第一条记录之前的LSN，未知时为AOF_UNKNOWN_LSN
+    };
+    // 全部增量段，按序号升序
+    std::vector<IncrInfo> incrs() const;
+    // base包含的最后一条写入的LSN，没有base时为0
+    uint64_t baseLsn() const;
+
+    // 最后一个增量段的路径，没有增量段时返回空串
+    std::string lastIncr() const;
+    uint64_t lastIncrSequence() const;
+
+    // 创建下一个增量段：写入文件头、用fallocate预分配preallocate字节（不改变文件大小）
+    // 并落盘，再加入manifest；start_lsn为此前最后一条写入的LSN。返回以追加方式打开的
+    // 描述符，失败时抛出FileIOException
+    int addIncr(uint64_t preallocate, uint64_t start_lsn, std::string* path, uint64_t* sequence);
+
+    // 重写完成：temp_path成为新的base（为空表示不需要base），manifest只保留序号不小于
+    // first_incr的增量段，生效后删除旧base和其余增量段。新base的LSN即第一个保留段的起点
+    void installBase(const std::string& temp_path, uint64_t first_incr);
+
+    // base和全部增量段的总大小
+    uint64_t totalSize() const;
+    size_t segmentCount() const;
+
+    const std::string& manifestPath() const { return manifest_path_; }
+
+private:
+    struct Segment {
+        std::string name;  // 相对于dir_的文件名
+        uint64_t sequence;
+        uint64_t lsn;
+    };
+
+    std::string segmentName(const char* kind, uint64_t sequence) const;
+    std::string fullPath(const std::string& name) const;
+    void load();
+    // 写出当前的base和增量段列表并fsync所在目录，调用方持有mutex_。rename之前失败时抛出
+    // FileIOException；新manifest已替换旧的而目录fsync失败时返回false
+    bool persist();
+    void removeOrphans();
+
+    std::string aof_file_;
+    std::string dir_;
+    std::string prefix_;  // aof_file的文件名部分
+    std::string manifest_path_;
+    Segment base_{"", 0, 0};
+    std::vector<Segment> incrs_;
+    uint64_t next_incr_ = 1;
+    mutable std::mutex mutex_;
+};
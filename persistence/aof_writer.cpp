@@ -0,0 +1,380 @@
+#include "aof_writer.h"
+#include "aof_format.h"
+#include "../include/exceptions.h"
+#include "../logger/logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+AofWriter::FsyncPolicy AofWriter::parsePolicy(const std::string& name) {
+    if(name == "always"){
+        return FsyncPolicy::Always;
+    }
+    if(name == "no"){
+        return FsyncPolicy::No;
+    }
+    return FsyncPolicy::EverySec;
+}
+
+bool AofWriter::writeAll(int fd, const char* data, size_t size) {
+    while(size > 0){
+        ssize_t n = ::write(fd, data, size);
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n <= 0){
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+AofWriter::AofWriter() {
+}
+
+AofWriter::~AofWriter() {
+    close();
+}
+
+void AofWriter::open(AofManifest* manifest, FsyncPolicy policy, int fsync_interval_seconds, uint64_t segment_size,
+                     uint64_t last_lsn) {
+    close();
+    next_lsn_ = last_lsn;
+    written_lsn_ = last_lsn;
+    durable_lsn_ = last_lsn;
+    buffer_lsn_ = last_lsn;
+    last_write_ok_ = true;
+    last_sync_ok_ = true;
+    manifest_ = manifest;
+    policy_ = policy;
+    fsync_interval_ = std::chrono::milliseconds(1000 * std::max(1, fsync_interval_seconds));
+    segment_size_ = segment_size;
+    // 继续追加最后一段（重放时已截掉写到一半的记录），没有段时新建
+    path_ = manifest_->lastIncr();
+    if(path_.empty()){
+        uint64_t sequence;
+        fd_ = manifest_->addIncr(segment_size_, last_lsn, &path_, &sequence);
+        segment_sequence_ = sequence;
+    } else {
+        fd_ = ::open(path_.c_str(), O_WRONLY | O_APPEND);
+        if(fd_ < 0){
+            throw skiplist::FileIOException(path_, "open");
+        }
+        segment_sequence_ = manifest_->lastIncrSequence();
+    }
+    struct stat st;
+    file_size_ = ::fstat(fd_, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+    file_ = std::make_unique<AsyncFile>(fd_, path_);
+    last_fsync_ = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        running_ = true;
+        stopping_ = false;
+        rotate_requested_ = false;
+    }
+    thread_ = std::thread(&AofWriter::run, this);
+}
+
+void AofWriter::close() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        if(!running_){
+            return;
+        }
+        stopping_ = true;
+    }
+    wake_cv_.notify_all();
+    if(thread_.joinable()){
+        thread_.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        running_ = false;
+    }
+    durable_cv_.notify_all();
+    rotate_cv_.notify_all();
+    file_.reset();
+    ::close(fd_);
+    fd_ = -1;
+}
+
+uint64_t AofWriter::append(std::string record) {
+    uint64_t lsn = next_lsn_.fetch_add(1) + 1;
+    Record* node = new Record{nullptr, lsn, std::move(record)};
+    Record* head = head_.load(std::memory_order_relaxed);
+    do {
+        node->next = head;
+    } while(!head_.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+
+    // 栈由空变非空时写线程可能在睡眠，经过wake_mutex_再通知，避免丢失唤醒
+    if(head == nullptr){
+        { std::lock_guard<std::mutex> lock(wake_mutex_); }
+        wake_cv_.notify_one();
+    }
+    // 入栈后节点随时可能被写线程写出并释放，不能再访问
+    return lsn;
+}
+
+bool AofWriter::waitDurable(uint64_t lsn) {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    durable_cv_.wait(lock, [&]() { return durable_lsn_ >= lsn || !running_ || stopping_; });
+    return durable_lsn_ >= lsn;
+}
+
+void AofWriter::flush() {
+    uint64_t lsn = next_lsn_;
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        if(!running_){
+            return;
+        }
+        sync_requested_lsn_ = std::max(sync_requested_lsn_, lsn);
+    }
+    wake_cv_.notify_one();
+    waitDurable(lsn);
+}
+
+// 取走栈中全部记录，与之前剩下的记录合并后，把LSN连续且不超过limit的前缀拼入buffer_
+void AofWriter::collect(uint64_t limit) {
+    Record* list = head_.exchange(nullptr, std::memory_order_acquire);
+    size_t old_size = pending_.size();
+    for(Record* node = list; node != nullptr; node = node->next){
+        pending_.push_back(node);
+    }
+    // 栈中记录是逆序的，先反转成大致有序再排序，绝大多数情况下已经有序
+    std::reverse(pending_.begin() + static_cast<std::ptrdiff_t>(old_size), pending_.end());
+    if(!std::is_sorted(pending_.begin(), pending_.end(), [](const Record* a, const Record* b) { return a->lsn < b->lsn; })){
+        std::sort(pending_.begin(), pending_.end(), [](const Record* a, const Record* b) { return a->lsn < b->lsn; });
+    }
+
+    size_t taken = 0;
+    while(taken < pending_.size() && pending_[taken]->lsn == buffer_lsn_ + 1 && pending_[taken]->lsn <= limit){
+        buffer_.append(pending_[taken]->data);
+        buffer_lsn_ = pending_[taken]->lsn;
+        delete pending_[taken];
+        taken++;
+    }
+    pending_.erase(pending_.begin(), pending_.begin() + static_cast<std::ptrdiff_t>(taken));
+}
+
+bool AofWriter::writeOut(bool sync) {
+    size_t written = 0;
+    auto started = std::chrono::steady_clock::now();
+    bool ok = file_->wait(file_->write(buffer_.data(), buffer_.size(), file_size_,
+                                       sync ? AsyncFile::Sync::Data : AsyncFile::Sync::None), &written);
+    int error = errno;
+    bytes_written_ += written;
+    file_size_ += written;
+    if(written < buffer_.size()){
+        // 保留未写出的部分，下一轮重试
+        buffer_.erase(0, written);
+        if(last_write_ok_.exchange(false)){
+            LOG_ERROR("Failed to write AOF file " + path_ + ": " + std::string(strerror(error)));
+        }
+        return false;
+    }
+    if(written_callback_){
+        written_callback_(buffer_lsn_, buffer_);
+    }
+    buffer_.clear();
+    written_lsn_ = buffer_lsn_;
+    batches_++;
+    if(!last_write_ok_.exchange(true)){
+        LOG_INFO("AOF write recovered: " + path_);
+    }
+    // 写出成功而链接的fdatasync失败时，由之后单独的sync()重试
+    if(sync){
+        if(ok){
+            markDurable(written_lsn_, started);
+        } else {
+            last_sync_ok_ = false;
+            LOG_ERROR("Failed to fdatasync AOF file " + path_ + ": " + std::string(strerror(error)));
+        }
+    }
+    return true;
+}
+
+bool AofWriter::sync() {
+    uint64_t lsn = written_lsn_;
+    auto started = std::chrono::steady_clock::now();
+    if(!file_->wait(file_->sync(AsyncFile::Sync::Data))){
+        last_sync_ok_ = false;
+        LOG_ERROR("Failed to fdatasync AOF file " + path_ + ": " + std::string(strerror(errno)));
+        return false;
+    }
+    markDurable(lsn, started);
+    return true;
+}
+
+void AofWriter::markDurable(uint64_t lsn, std::chrono::steady_clock::time_point started) {
+    fsyncs_++;
+    last_fsync_ = std::chrono::steady_clock::now();
+    if(throttle_ != nullptr){
+        throttle_->recordFsyncLatency(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(last_fsync_ - started).count()));
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        durable_lsn_ = lsn;
+    }
+    if(!last_sync_ok_.exchange(true)){
+        LOG_INFO("AOF fdatasync recovered: " + path_);
+    }
+    durable_cv_.notify_all();
+}
+
+void AofWriter::run() {
+    while(true){
+        bool stopping;
+        bool rotating;
+        uint64_t rotate_lsn;
+        uint64_t sync_requested;
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            // everysec下即使没有新记录，也要按时把已写出的部分落盘
+            auto timeout = policy_ == FsyncPolicy::EverySec ? fsync_interval_ : std::chrono::milliseconds(1000);
+            wake_cv_.wait_for(lock, timeout, [this]() {
+                return head_.load(std::memory_order_acquire) != nullptr || stopping_ ||
+                       sync_requested_lsn_ > durable_lsn_ || rotate_requested_;
+            });
+            stopping = stopping_;
+            rotating = rotate_requested_;
+            rotate_lsn = rotate_lsn_;
+            sync_requested = sync_requested_lsn_;
+        }
+
+        // 本批写出后是否立即落盘：是则把fdatasync链接在写之后一起提交
+        bool sync_now = policy_ == FsyncPolicy::Always || stopping || sync_requested > durable_lsn_ ||
+            (policy_ == FsyncPolicy::EverySec && std::chrono::steady_clock::now() - last_fsync_ >= fsync_interval_);
+
+        // 重写请求滚动时先只写出不超过边界的记录，滚动后再写其余的
+        collect(rotating ? rotate_lsn : UINT64_MAX);
+        bool written = buffer_.empty() || writeOut(sync_now);
+        if(written && rotating && buffer_lsn_ >= rotate_lsn){
+            bool ok = rotate();
+            {
+                std::lock_guard<std::mutex> lock(wake_mutex_);
+                rotate_requested_ = false;
+                rotate_ok_ = ok;
+                rotated_sequence_ = segment_sequence_;
+            }
+            rotate_cv_.notify_all();
+            collect(UINT64_MAX);
+            written = buffer_.empty() || writeOut(sync_now);
+        } else if(written && !rotating && segment_size_ > 0 && file_size_ >= segment_size_){
+            rotate();
+        }
+        // write失败时保留数据稍后重试，停止时放弃
+        if(!written){
+            if(stopping){
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+
+        bool need_sync = written_lsn_ > durable_lsn_ &&
+            (policy_ == FsyncPolicy::Always || stopping || sync_requested > durable_lsn_ ||
+             (policy_ == FsyncPolicy::EverySec && std::chrono::steady_clock::now() - last_fsync_ >= fsync_interval_));
+        if(need_sync && !sync()){
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        if(stopping && head_.load() == nullptr){
+            // 停止时仍有缺口说明有append与close并发，剩余记录按LSN顺序直接写出
+            if(!pending_.empty()){
+                for(Record* node : pending_){
+                    buffer_.append(node->data);
+                    buffer_lsn_ = node->lsn;
+                    delete node;
+                }
+                pending_.clear();
+                writeOut(true);
+            }
+            break;
+        }
+    }
+}
+
+// 在写线程中滚动：当前段落盘后才在manifest中加入新段，因此只有最后一段可能写到一半
+bool AofWriter::rotate() {
+    if(written_lsn_ > durable_lsn_ && !sync()){
+        return false;
+    }
+    std::string path;
+    uint64_t sequence;
+    int fd;
+    try {
+        fd = manifest_->addIncr(segment_size_, written_lsn_, &path, &sequence);
+    } catch (const std::exception& e) {
+        LOG_ERROR("Failed to create AOF segment: " + std::string(e.what()));
+        return false;
+    }
+    // 释放旧段文件尾之外没有用到的预分配空间
+    if(segment_size_ > 0){
+        ::fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(file_size_.load()),
+                    static_cast<off_t>(segment_size_));
+    }
+    file_.reset();
+    ::close(fd_);
+    fd_ = fd;
+    path_ = path;
+    file_ = std::make_unique<AsyncFile>(fd_, path_);
+    file_size_ = AOF_HEADER_SIZE;
+    segment_sequence_ = sequence;
+    rotations_++;
+    return true;
+}
+
+void AofWriter::beginRewrite() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        rotate_lsn_ = next_lsn_;
+        rotate_requested_ = true;
+        rotate_ok_ = false;
+    }
+    wake_cv_.notify_one();
+}
+
+void AofWriter::abortRewrite() {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    rotate_requested_ = false;
+}
+
+void AofWriter::finishRewrite(const std::string& temp_path) {
+    uint64_t first_incr = 0;
+    {
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        rotate_cv_.wait(lock, [this]() { return !rotate_requested_ || !running_; });
+        if(rotate_requested_ || !rotate_ok_){
+            rotate_requested_ = false;
+            lock.unlock();
+            if(!temp_path.empty()){
+                ::unlink(temp_path.c_str());
+            }
+            throw skiplist::FileIOException(temp_path, "rotate");
+        }
+        first_incr = rotated_sequence_;
+    }
+    manifest_->installBase(temp_path, first_incr);
+}
+
+AofWriter::Stats AofWriter::getStats() const {
+    Stats stats;
+    stats.last_lsn = next_lsn_;
+    stats.written_lsn = written_lsn_;
+    stats.durable_lsn = durable_lsn_;
+    stats.batches = batches_;
+    stats.fsyncs = fsyncs_;
+    stats.bytes_written = bytes_written_;
+    stats.segment_size = file_size_;
+    stats.segment_sequence = segment_sequence_;
+    stats.rotations = rotations_;
+    stats.last_write_ok = last_write_ok_ && last_sync_ok_;
+    return stats;
+}
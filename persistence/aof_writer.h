@@ -0,0 +1,169 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include "aof_manifest.h"
+#include "async_file.h"
+#include "io_throttle.h"
+
+// AOF组提交写线程
+//
+// 请求线程调用append()时只分配一个LSN并把记录压入无锁栈（CAS入栈），不做任何I/O。
+// 专用写线程每次用一次exchange取走栈中全部记录，按LSN排好序后用一次write写出，
+// 再按策略做一次fdatasync：
+//   always    每批记录写出后立即fdatasync，等待中的客户端只等自己所在批次的LSN落盘，
+//             写线程在fdatasync期间到达的记录自然汇成下一批（组提交）
+//   everysec  写出后最多每fsync_interval秒fdatasync一次
+//   no        只write，何时落盘交给操作系统
+//
+// LSN先于入栈分配，两个并发的append可能以相反的顺序入栈；写线程只写出LSN连续的
+// 前缀，缺口处的记录留到下一批，因此文件中的顺序与LSN一致，durable LSN之前的记录
+// 都已落盘。
+//
+// 写出经过AsyncFile（见async_file.h）：本批需要落盘时，write和fdatasync链接在同一次
+// 提交中（io_uring后端只进入内核一次）。
+//
+// 文件按段组织（见aof_manifest.h）：当前段写满segment_size后，写线程在两批记录
+// 之间把它落盘并滚动到新段。重写时beginRewrite()记下当时的LSN，写线程写完不超过
+// 它的记录后立即滚动，此后的记录都进入新段；finishRewrite()把重写出的文件装入
+// manifest作为base，旧base和旧段整体删除，重写期间的写入不需要再复制一遍。
+class AofWriter {
+public:
+    enum class FsyncPolicy { Always, EverySec, No };
+
+    struct Stats {
+        uint64_t last_lsn = 0;      // 已分配的最大LSN
+        uint64_t written_lsn = 0;   // 已write的最大LSN
+        uint64_t durable_lsn = 0;   // 已fdatasync的最大LSN
+        uint64_t batches = 0;
+        uint64_t fsyncs = 0;
+        uint64_t bytes_written = 0;
+        uint64_t segment_size = 0;      // 当前段的大小
+        uint64_t segment_sequence = 0;  // 当前段的序号
+        uint64_t rotations = 0;
+        bool last_write_ok = true;  // 最近一次write和fdatasync都成功
+    };
+
+    static FsyncPolicy parsePolicy(const std::string& name);
+
+    // 把data完整写入fd，处理短写和EINTR
+    static bool writeAll(int fd, const char* data, size_t size);
+
+    AofWriter();
+    // 写出并同步剩余记录后停止写线程
+    ~AofWriter();
+
+    // 以追加方式打开manifest中的最后一段（没有时新建）并启动写线程，失败时抛出FileIOException。
+    // 当前段超过segment_size后滚动到新段，新段按segment_size预分配。last_lsn为已有
+    // 文件中最后一条记录的LSN，新记录从它之后编号
+    void open(AofManifest* manifest, FsyncPolicy policy, int fsync_interval_seconds, uint64_t segment_size,
+              uint64_t last_lsn = 0);
+    void close();
+
+    // 追加一条完整编码的记录，返回它的LSN；不阻塞
+    uint64_t append(std::string record);
+
+    // 等待lsn及之前的记录全部落盘；写出或fdatasync失败时写线程会重试，期间继续等待。
+    // 写线程已停止时返回false
+    bool waitDurable(uint64_t lsn);
+
+    // 最近一次write或fdatasync失败且还没有重试成功。调用方应在修改数据之前检查并拒绝写命令，
+    // 而不是让已经应用、之后仍会落盘的写入返回错误
+    bool failing() const { return !last_write_ok_ || !last_sync_ok_; }
+
+    // 写出并fdatasync目前为止追加的全部记录
+    void flush();
+
+    // 开始重写：新base将包含此刻之前的全部数据，之后追加的记录进入新的段。
+    // 调用方应在写入互斥的状态下调用（与取数据镜像同时）
+    void beginRewrite();
+
+    // 等待重写开始时的滚动完成，把temp_path装入manifest作为新base（为空表示不需要base），
+    // 删除被它取代的文件；失败时删除temp_path并抛出FileIOException
+    void finishRewrite(const std::string& temp_path);
+
+    // 放弃重写（已经滚动出的新段照常使用）
+    void abortRewrite();
+
+    // 每次fdatasync的耗时报告给后台写出的限速器（自适应模式据此降速）
+    void setThrottle(IoThrottle* throttle) { throttle_ = throttle; }
+
+    // 每批记录write成功后在写线程中调用，bytes为本批按LSN顺序拼接的记录，最后一条的
+    // LSN为last_lsn。在open之前设置
+    using WrittenCallback = std::function<void(uint64_t last_lsn, const std::string& bytes)>;
+    void setWrittenCallback(WrittenCallback callback) { written_callback_ = std::move(callback); }
+
+    FsyncPolicy policy() const { return policy_; }
+    // 已分配的最大LSN
+    uint64_t lastLsn() const { return next_lsn_; }
+    Stats getStats() const;
+
+private:
+    struct Record {
+        Record* next;
+        uint64_t lsn;
+        std::string data;
+    };
+
+    void run();
+    // 把LSN连续且不超过limit的记录拼入buffer_
+    void collect(uint64_t limit);
+    // sync为true时在写出之后链接fdatasync
+    bool writeOut(bool sync);
+    bool sync();
+    // fdatasync成功，lsn及之前的记录已落盘；started为提交的时间
+    void markDurable(uint64_t lsn, std::chrono::steady_clock::time_point started);
+    // 落盘当前段并切换到新段
+    bool rotate();
+
+    AofManifest* manifest_ = nullptr;
+    std::string path_;  // 当前段
+    int fd_ = -1;
+    std::unique_ptr<AsyncFile> file_;  // fd_上的异步写出
+    IoThrottle* throttle_ = nullptr;
+    WrittenCallback written_callback_;
+    uint64_t segment_size_ = 0;
+    FsyncPolicy policy_ = FsyncPolicy::EverySec;
+    std::chrono::milliseconds fsync_interval_{1000};
+
+    std::atomic<Record*> head_{nullptr};  // 无锁栈，写线程整体取走
+    std::atomic<uint64_t> next_lsn_{0};
+
+    // 以下只由写线程访问
+    std::vector<Record*> pending_;  // 已取走但LSN不连续、尚未写出的记录
+    std::string buffer_;            // 本批待write的数据
+    uint64_t buffer_lsn_ = 0;       // buffer_中最后一条记录的LSN
+    std::chrono::steady_clock::time_point last_fsync_;
+
+    std::atomic<uint64_t> written_lsn_{0};
+    std::atomic<uint64_t> durable_lsn_{0};
+    std::atomic<uint64_t> batches_{0};
+    std::atomic<uint64_t> fsyncs_{0};
+    std::atomic<uint64_t> bytes_written_{0};
+    std::atomic<uint64_t> file_size_{0};
+    std::atomic<uint64_t> segment_sequence_{0};
+    std::atomic<uint64_t> rotations_{0};
+    std::atomic<bool> last_write_ok_{true};
+    std::atomic<bool> last_sync_ok_{true};
+
+    std::thread thread_;
+    bool running_ = false;
+    bool stopping_ = false;
+    uint64_t sync_requested_lsn_ = 0;  // flush()请求落盘的LSN
+    // 重写请求的滚动：LSN不超过rotate_lsn_的记录留在旧段
+    bool rotate_requested_ = false;
+    uint64_t rotate_lsn_ = 0;
+    bool rotate_ok_ = false;
+    uint64_t rotated_sequence_ = 0;    // 滚动出的新段的序号
+    std::mutex wake_mutex_;            // 只在栈由空变非空、等待落盘和滚动时使用
+    std::condition_variable wake_cv_;
+    std::condition_variable durable_cv_;
+    std::condition_variable rotate_cv_;
+};
@@ -0,0 +1,333 @@
+#include "async_file.h"
+#include "../logger/logger.h"
+#include "../utils/io_uring.h"
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+const unsigned RING_ENTRIES = 16;
+const size_t MAX_WRITE = 1u << 30;  // 单个SQE的长度上限，更长的写按短写续写
+
+std::atomic<int> g_backend{-1};
+}
+
+IoThreadPool& IoThreadPool::getInstance() {
+    static IoThreadPool instance;
+    return instance;
+}
+
+IoThreadPool::~IoThreadPool() {
+    stop();
+}
+
+void IoThreadPool::start(int thread_count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!workers_.empty()){
+        return;
+    }
+    stopping_ = false;
+    owner_pid_ = ::getpid();
+    for(int i = 0; i < std::max(1, thread_count); i++){
+        workers_.emplace_back(&IoThreadPool::workerLoop, this);
+    }
+}
+
+void IoThreadPool::stop() {
+    if(owner_pid_ != ::getpid()){
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(workers_.empty()){
+            return;
+        }
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    for(auto& worker : workers_){
+        worker.join();
+    }
+    workers_.clear();
+}
+
+void IoThreadPool::post(std::function<void()> task) {
+    if(owner_pid_ == ::getpid()){
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!workers_.empty() && !stopping_){
+            tasks_.push_back(std::move(task));
+            cv_.notify_one();
+            return;
+        }
+    }
+    task();
+}
+
+void IoThreadPool::workerLoop() {
+    while(true){
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+            // 停止时先做完已提交的写，不丢数据
+            if(tasks_.empty()){
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+void AsyncFile::configure(const std::string& backend, int threads) {
+    Backend selected = Backend::Threads;
+    if(backend != "threads"){
+        if(IoUringRing::probe()){
+            selected = Backend::IoUring;
+        } else if(backend == "io_uring"){
+            LOG_WARN("io_uring is not available, falling back to the thread pool I/O backend");
+        }
+    }
+    g_backend = static_cast<int>(selected);
+    if(selected == Backend::Threads){
+        IoThreadPool::getInstance().start(threads);
+    }
+}
+
+AsyncFile::Backend AsyncFile::backend() {
+    int value = g_backend.load();
+    if(value < 0){
+        // 没有configure时按auto探测，线程池未启动时请求在调用线程同步执行
+        value = static_cast<int>(IoUringRing::probe() ? Backend::IoUring : Backend::Threads);
+        g_backend = value;
+    }
+    return static_cast<Backend>(value);
+}
+
+const char* AsyncFile::backendName() {
+    return backend() == Backend::IoUring ? "io_uring" : "threads";
+}
+
+AsyncFile::AsyncFile(int fd, const std::string& path)
+    : fd_(fd)
+    , path_(path) {
+    if(backend() == Backend::IoUring){
+        ring_ = new IoUringRing();
+        if(!ring_->setup(RING_ENTRIES)){
+            // 环资源不足时（如达到locked memory上限）这个文件改用线程池
+            LOG_WARN("io_uring setup failed for " + path_ + ": " + std::string(strerror(errno)) + ", using the thread pool");
+            delete ring_;
+            ring_ = nullptr;
+        }
+    }
+}
+
+AsyncFile::~AsyncFile() {
+    waitAll();
+    if(ring_ != nullptr){
+        delete ring_;
+    }
+}
+
+void AsyncFile::registerBuffers(const std::vector<std::pair<char*, size_t>>& buffers) {
+    if(ring_ == nullptr || buffers.empty()){
+        return;
+    }
+    std::vector<iovec> iovecs;
+    for(const auto& buffer : buffers){
+        iovecs.push_back({buffer.first, buffer.second});
+    }
+    fixed_buffers_ = ring_->registerOp(IORING_REGISTER_BUFFERS, iovecs.data(), static_cast<unsigned>(iovecs.size())) == 0;
+}
+
+AsyncFile::Request* AsyncFile::find(uint64_t id) {
+    if(requests_.empty() || id < requests_.front().id || id - requests_.front().id >= requests_.size()){
+        return nullptr;
+    }
+    return &requests_[static_cast<size_t>(id - requests_.front().id)];
+}
+
+uint64_t AsyncFile::write(const char* data, size_t size, uint64_t offset, Sync sync, int buffer) {
+    requests_.push_back({next_id_++, data, size, 0, offset, sync, buffer});
+    Request& request = requests_.back();
+    if(ring_ != nullptr){
+        submitRing(request);
+    } else {
+        submitThreads(request);
+    }
+    return request.id;
+}
+
+uint64_t AsyncFile::sync(Sync kind) {
+    return write(nullptr, 0, 0, kind);
+}
+
+// user_data的最低位区分写和链接在它之后的同步
+void AsyncFile::submitRing(Request& request) {
+    unsigned needed = (request.written < request.size ? 1 : 0) + (request.sync != Sync::None ? 1 : 0);
+    while(ring_->inflight + needed > ring_->entries){
+        reapRing();
+    }
+    if(request.written < request.size){
+        io_uring_sqe* sqe = ring_->nextSqe();
+        bool fixed = fixed_buffers_ && request.buffer >= 0;
+        sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe->fd = fd_;
+        sqe->addr = reinterpret_cast<uint64_t>(request.data + request.written);
+        sqe->len = static_cast<uint32_t>(std::min(request.size - request.written, MAX_WRITE));
+        sqe->off = request.offset + request.written;
+        sqe->buf_index = fixed ? static_cast<uint16_t>(request.buffer) : 0;
+        sqe->flags = request.sync != Sync::None ? IOSQE_IO_LINK : 0;
+        sqe->user_data = request.id << 1;
+    }
+    if(request.sync != Sync::None){
+        io_uring_sqe* sqe = ring_->nextSqe();
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = fd_;
+        sqe->fsync_flags = request.sync == Sync::Data ? IORING_FSYNC_DATASYNC : 0;
+        sqe->user_data = (request.id << 1) | 1;
+    }
+    request.outstanding = static_cast<int>(needed);
+    if(needed == 0){
+        request.done = true;
+        return;
+    }
+    int error = ring_->enter(0);
+    if(error != 0){
+        // SQE已经进入环，完成事件仍会到达，这里只记录错误
+        request.error = error;
+    }
+}
+
+void AsyncFile::reapRing() {
+    unsigned head = *ring_->cq_head;
+    if(head == __atomic_load_n(ring_->cq_tail, __ATOMIC_ACQUIRE)){
+        int error = ring_->enter(1);
+        if(error != 0){
+            // 环已不可用，未完成的请求全部按失败结束，避免等待方永远阻塞
+            LOG_ERROR("io_uring_enter failed for " + path_ + ": " + std::string(strerror(error)));
+            for(auto& request : requests_){
+                if(!request.done){
+                    request.error = error;
+                    request.done = true;
+                }
+            }
+            return;
+        }
+    }
+    unsigned tail = __atomic_load_n(ring_->cq_tail, __ATOMIC_ACQUIRE);
+    std::vector<Request*> retries;
+    for(; head != tail; head++){
+        const io_uring_cqe& cqe = ring_->cqes[head & *ring_->cq_mask];
+        ring_->inflight--;
+        Request* request = find(cqe.user_data >> 1);
+        if(request == nullptr){
+            continue;
+        }
+        request->outstanding--;
+        if((cqe.user_data & 1) == 0){
+            if(cqe.res < 0){
+                request->error = -cqe.res;
+            } else if(cqe.res == 0){
+                request->error = EIO;
+            } else {
+                request->written += static_cast<size_t>(cqe.res);
+                request->retry = request->written < request->size;
+            }
+        } else if(cqe.res < 0 && cqe.res != -ECANCELED){
+            // 写失败或短写时链接的同步以ECANCELED取消，短写续写时会重新链接
+            request->error = -cqe.res;
+        }
+        if(request->outstanding == 0){
+            if(request->error == 0 && request->retry){
+                request->retry = false;
+                retries.push_back(request);
+            } else {
+                request->done = true;
+            }
+        }
+    }
+    __atomic_store_n(ring_->cq_head, tail, __ATOMIC_RELEASE);
+    for(Request* request : retries){
+        submitRing(*request);
+    }
+}
+
+void AsyncFile::submitThreads(Request& request) {
+    Request* target = &request;
+    IoThreadPool::getInstance().post([this, target]() {
+        int error = 0;
+        size_t written = 0;
+        while(written < target->size){
+            ssize_t n = ::pwrite(fd_, target->data + written, target->size - written,
+                                 static_cast<off_t>(target->offset + written));
+            if(n < 0 && errno == EINTR){
+                continue;
+            }
+            if(n <= 0){
+                error = n < 0 ? errno : EIO;
+                break;
+            }
+            written += static_cast<size_t>(n);
+        }
+        if(error == 0 && target->sync != Sync::None){
+            if((target->sync == Sync::Data ? ::fdatasync(fd_) : ::fsync(fd_)) != 0){
+                error = errno;
+            }
+        }
+        // 持锁通知，等待方醒来后可能立即析构本对象
+        std::lock_guard<std::mutex> lock(mutex_);
+        target->written = written;
+        target->error = error;
+        target->done = true;
+        cv_.notify_all();
+    });
+}
+
+bool AsyncFile::wait(uint64_t id, size_t* written) {
+    Request* request = find(id);
+    if(request == nullptr){
+        return true;
+    }
+    if(ring_ != nullptr){
+        while(!request->done){
+            reapRing();
+        }
+    } else {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [request]() { return request->done; });
+    }
+    return finish(id, written);
+}
+
+bool AsyncFile::finish(uint64_t id, size_t* written) {
+    Request* request = find(id);
+    request->consumed = true;
+    int error = request->error;
+    if(written != nullptr){
+        *written = request->written;
+    }
+    while(!requests_.empty() && requests_.front().consumed){
+        requests_.pop_front();
+    }
+    if(error != 0){
+        errno = error;
+        return false;
+    }
+    return true;
+}
+
+bool AsyncFile::waitAll() {
+    bool ok = true;
+    while(!requests_.empty()){
+        uint64_t id = requests_.front().id;
+        if(!wait(id)){
+            ok = false;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+
+struct IoUringRing;
+
+// 持久化的异步文件写出
+//
+// 两种后端，由AsyncFile::configure()在启动时选定：
+//   io_uring  直接用io_uring_setup/io_uring_enter系统调用（不依赖liburing），每个AsyncFile
+//             一个小环。写之后的fsync/fdatasync用IOSQE_IO_LINK链接在同一次提交里，内核按
+//             顺序执行；registerBuffers()注册的固定缓冲用WRITE_FIXED写出，省去每次提交时
+//             的页面映射
+//   threads   内核不支持io_uring（或被seccomp禁用）时的回退：写请求交给共享的I/O线程池，
+//             在池线程中pwrite并按需同步
+// 两种后端下提交都立即返回，调用方在数据写出期间继续编码下一段数据，需要结果时再wait。
+// 同一文件的多个请求之间不保证执行顺序（写和链接在它之后的同步除外），依赖顺序的调用方
+// 应先等待前面的请求完成。AsyncFile只能由一个线程使用。
+
+// 线程池后端使用的I/O线程
+class IoThreadPool {
+public:
+    static IoThreadPool& getInstance();
+
+    IoThreadPool(const IoThreadPool&) = delete;
+    IoThreadPool& operator=(const IoThreadPool&) = delete;
+
+    void start(int thread_count);
+    void stop();
+
+    // 交给I/O线程执行；未启动或在fork出的子进程中（子进程里没有池线程）直接在调用线程执行
+    void post(std::function<void()> task);
+
+private:
+    IoThreadPool() = default;
+    ~IoThreadPool();
+
+    void workerLoop();
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    // 启动线程池的进程；fork出的子进程里mutex_可能停留在被池线程持有的状态，
+    // 因此不加锁先比较它，子进程中不再碰mutex_
+    std::atomic<pid_t> owner_pid_{0};
+    bool stopping_ = false;
+};
+
+class AsyncFile {
+public:
+    enum class Backend { IoUring, Threads };
+    enum class Sync { None, Data, Full };  // 写之后不同步、fdatasync、fsync
+
+    // 选择后端：auto时探测io_uring，不可用时回退到线程池；threads为线程池的线程数
+    static void configure(const std::string& backend, int threads);
+    static Backend backend();
+    static const char* backendName();
+
+    // 不接管fd，析构时等待未完成的请求但不关闭fd
+    AsyncFile(int fd, const std::string& path);
+    ~AsyncFile();
+
+    AsyncFile(const AsyncFile&) = delete;
+    AsyncFile& operator=(const AsyncFile&) = delete;
+
+    // 注册固定缓冲，之后按下标提交的写使用WRITE_FIXED；注册失败（如超出RLIMIT_MEMLOCK）
+    // 时按普通写处理
+    void registerBuffers(const std::vector<std::pair<char*, size_t>>& buffers);
+
+    // 提交在offset处写size字节，sync不为None时在写完之后同步；data在请求完成前不能修改。
+    // buffer为registerBuffers中data所在缓冲的下标，-1表示普通内存。返回请求号
+    uint64_t write(const char* data, size_t size, uint64_t offset, Sync sync = Sync::None, int buffer = -1);
+
+    // 提交一次单独的同步
+    uint64_t sync(Sync kind);
+
+    // 等待请求完成，返回是否成功；失败时errno为原因，written为实际写出的字节数
+    // （写成功而同步失败时等于请求的长度）
+    bool wait(uint64_t request, size_t* written = nullptr);
+
+    // 等待全部请求完成，返回它们是否都成功
+    bool waitAll();
+
+private:
+    struct Request {
+        uint64_t id;
+        const char* data;
+        size_t size;
+        size_t written = 0;
+        uint64_t offset;
+        Sync sync;
+        int buffer;
+        int outstanding = 0;   // 尚未收割的CQE数
+        bool retry = false;    // 短写后需要重新提交剩余部分
+        int error = 0;
+        bool done = false;
+        bool consumed = false; // 结果已被wait取走
+    };
+
+    Request* find(uint64_t id);
+    void submitRing(Request& request);
+    // 收割至少一个CQE
+    void reapRing();
+    void submitThreads(Request& request);
+    bool finish(uint64_t id, size_t* written);
+
+    int fd_;
+    std::string path_;
+    uint64_t next_id_ = 1;
+    std::deque<Request> requests_;  // 未完成或尚未被wait取走的请求
+
+    IoUringRing* ring_ = nullptr;
+    bool fixed_buffers_ = false;
+
+    // 线程池后端的完成通知
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
@@ -0,0 +1,182 @@
+#include "background_save.h"
+#include "../include/exceptions.h"
+#include "../logger/logger.h"
+#include <chrono>
+#include <new>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+namespace {
+int64_t nowMs(){
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t unixTime(){
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// 累加smaps文件中所有Private_Dirty行（单位kB）
+uint64_t sumPrivateDirty(const char* path){
+    int fd = ::open(path, O_RDONLY);
+    if(fd < 0){
+        return 0;
+    }
+    static const char FIELD[] = "Private_Dirty:";
+    uint64_t total_kb = 0;
+    char buf[4096];
+    std::string pending;
+    ssize_t n;
+    while((n = ::read(fd, buf, sizeof(buf))) > 0){
+        pending.append(buf, static_cast<size_t>(n));
+        size_t line_start = 0;
+        size_t newline;
+        while((newline = pending.find('\n', line_start)) != std::string::npos){
+            if(pending.compare(line_start, sizeof(FIELD) - 1, FIELD) == 0){
+                total_kb += strtoull(pending.c_str() + line_start + sizeof(FIELD) - 1, nullptr, 10);
+            }
+            line_start = newline + 1;
+        }
+        pending.erase(0, line_start);
+    }
+    ::close(fd);
+    return total_kb * 1024;
+}
+}
+
+BackgroundSaver::BackgroundSaver(const std::string& name)
+    : name_(name) {
+    void* addr = ::mmap(nullptr, sizeof(Progress), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(addr == MAP_FAILED){
+        throw skiplist::StorageException("failed to map background save progress");
+    }
+    progress_ = new (addr) Progress();
+}
+
+BackgroundSaver::~BackgroundSaver() {
+    wait();
+    progress_->~Progress();
+    ::munmap(progress_, sizeof(Progress));
+}
+
+uint64_t BackgroundSaver::privateDirtyBytes() {
+    // smaps_rollup（4.14+）一次给出汇总，旧内核退回逐个映射累加
+    if(::access("/proc/self/smaps_rollup", R_OK) == 0){
+        return sumPrivateDirty("/proc/self/smaps_rollup");
+    }
+    return sumPrivateDirty("/proc/self/smaps");
+}
+
+bool BackgroundSaver::start(const LockRunner& with_lock, const ChildJob& job, uint64_t total_keys, const DoneCallback& on_done) {
+    std::lock_guard<std::mutex> lock(start_mutex_);
+    if(child_pid_ > 0){
+        return false;
+    }
+    if(reaper_.joinable()){
+        reaper_.join();
+    }
+    progress_->keys_saved = 0;
+    progress_->cow_bytes = 0;
+
+    pid_t pid = -1;
+    int fork_errno = 0;
+    int64_t fork_usec = 0;
+    with_lock([&]() {
+        auto begin = std::chrono::steady_clock::now();
+        pid = ::fork();
+        fork_errno = errno;
+        fork_usec = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - begin).count();
+    });
+
+    if(pid == 0){
+        // 子进程：with_lock已随作用域释放锁，在fork时刻的镜像上执行任务
+        bool ok = false;
+        try {
+            ok = job(*progress_);
+        } catch (...) {
+            ok = false;
+        }
+        progress_->cow_bytes = privateDirtyBytes();
+        ::_exit(ok ? 0 : 1);
+    }
+    if(pid < 0){
+        std::lock_guard<std::mutex> stats_lock(stats_mutex_);
+        stats_.last_status_ok = false;
+        stats_.failures++;
+        throw skiplist::StorageException("fork failed: " + std::string(strerror(fork_errno)));
+    }
+
+    {
+        std::lock_guard<std::mutex> stats_lock(stats_mutex_);
+        stats_.latest_fork_usec = fork_usec;
+        stats_.current_keys_total = total_keys;
+        start_ms_ = nowMs();
+    }
+    child_pid_ = pid;
+    reaper_ = std::thread(&BackgroundSaver::reap, this, pid, on_done);
+    LOG_INFOF("{} started by pid {} (fork took {} usec)", name_, pid, fork_usec);
+    return true;
+}
+
+void BackgroundSaver::reap(pid_t pid, DoneCallback on_done) {
+    int status = 0;
+    while(::waitpid(pid, &status, 0) < 0 && errno == EINTR){
+    }
+    bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    uint64_t cow_bytes = progress_->cow_bytes;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.last_status_ok = ok;
+        stats_.last_duration_ms = nowMs() - start_ms_;
+        stats_.last_cow_bytes = cow_bytes;
+        stats_.last_cow_pages = cow_bytes / static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+        if(ok){
+            stats_.last_save_time = unixTime();
+            stats_.saves++;
+        } else {
+            stats_.failures++;
+        }
+    }
+    if(on_done){
+        on_done(ok);
+    }
+    child_pid_ = -1;
+    if(ok){
+        LOG_INFOF("{} terminated with success, {} bytes copied on write", name_, cow_bytes);
+    } else {
+        LOG_ERROR(name_ + " failed");
+    }
+}
+
+void BackgroundSaver::wait() {
+    std::lock_guard<std::mutex> lock(start_mutex_);
+    if(reaper_.joinable()){
+        reaper_.join();
+    }
+}
+
+void BackgroundSaver::recordSave() {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.last_save_time = unixTime();
+}
+
+BackgroundSaver::Stats BackgroundSaver::getStats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    Stats stats = stats_;
+    stats.in_progress = child_pid_ > 0;
+    if(stats.in_progress){
+        stats.current_duration_ms = nowMs() - start_ms_;
+        stats.current_keys_saved = progress_->keys_saved;
+        stats.current_cow_bytes = progress_->cow_bytes;
+    } else {
+        stats.current_keys_total = 0;
+    }
+    return stats;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <sys/types.h>
+
+// 基于fork写时复制的后台快照（BGSAVE）
+//
+// 父进程在调用方提供的锁内fork，子进程得到与写入互斥时刻一致的内存镜像，在其上
+// 写快照后直接_exit；父进程fork返回后立即释放锁继续服务，只有被写入的页面才会
+// 被内核复制。子进程的进度和写时复制的页数通过一块MAP_SHARED匿名内存回报给父
+// 进程，父进程由一个回收线程waitpid子进程并记录结果。
+//
+// 子进程中只存在调用fork的线程，其他线程fork时持有的锁在子进程里永远不会释放，
+// 因此子进程的任务不能写日志，也不能触碰除快照所需之外的共享结构。
+class BackgroundSaver {
+public:
+    // 父子进程共享的进度
+    struct Progress {
+        std::atomic<uint64_t> keys_saved{0};
+        std::atomic<uint64_t> cow_bytes{0};
+    };
+
+    struct Stats {
+        bool in_progress = false;
+        int64_t latest_fork_usec = 0;
+        bool last_status_ok = true;
+        int64_t last_save_time = 0;        // 最近一次成功保存的unix时间
+        int64_t last_duration_ms = -1;     // 最近一次后台保存的耗时
+        int64_t current_duration_ms = -1;  // 正在进行的后台保存已耗时
+        uint64_t current_keys_saved = 0;
+        uint64_t current_keys_total = 0;
+        uint64_t current_cow_bytes = 0;
+        uint64_t last_cow_bytes = 0;
+        uint64_t last_cow_pages = 0;
+        uint64_t saves = 0;
+        uint64_t failures = 0;
+    };
+
+    // with_lock持有保证数据一致的锁调用传入的函数（fork在其中执行）
+    using LockRunner = std::function<void(const std::function<void()>&)>;
+    // 在子进程中执行，返回是否成功
+    using ChildJob = std::function<bool(Progress&)>;
+    // 子进程结束后在父进程的回收线程中调用，参数为是否成功
+    using DoneCallback = std::function<void(bool)>;
+
+    // name用于日志，区分快照保存与AOF重写
+    explicit BackgroundSaver(const std::string& name = "Background saving");
+    // 等待仍在运行的子进程
+    ~BackgroundSaver();
+
+    // 启动后台保存；已有子进程在运行时返回false，fork失败时抛出StorageException（不调用on_done）
+    bool start(const LockRunner& with_lock, const ChildJob& job, uint64_t total_keys, const DoneCallback& on_done = nullptr);
+
+    bool inProgress() const { return child_pid_ > 0; }
+
+    // 等待当前的后台保存结束
+    void wait();
+
+    // 记录一次前台保存（SAVE）完成的时间
+    void recordSave();
+
+    Stats getStats() const;
+
+    // 在子进程中调用：读取本进程私有脏页（即写时复制产生的页）的字节数
+    static uint64_t privateDirtyBytes();
+
+private:
+    void reap(pid_t pid, DoneCallback on_done);
+
+    std::string name_;
+    Progress* progress_;  // MAP_SHARED匿名映射
+    std::atomic<pid_t> child_pid_{-1};
+    std::thread reaper_;
+    std::mutex start_mutex_;  // 串行化start/wait
+    mutable std::mutex stats_mutex_;
+    Stats stats_;
+    int64_t start_ms_ = 0;
+};
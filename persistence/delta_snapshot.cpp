@@ -0,0 +1,189 @@
+#include "delta_snapshot.h"
+#include "snapshot.h"
+#include "../include/exceptions.h"
+#include "../utils/utils.h"
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+
+namespace {
+const char PUT_TAG = 'P';
+const char DELETE_TAG = 'D';
+
+std::string deltaPrefix(const std::string& base_path){
+    return std::filesystem::path(base_path).filename().string() + ".delta.";
+}
+
+std::string deltaPath(const std::string& base_path, uint64_t sequence){
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "%012llu", static_cast<unsigned long long>(sequence));
+    return base_path + ".delta." + suffix;
+}
+}
+
+DeltaSnapshots::DeltaSnapshots(const std::string& base_path, int compression)
+    : base_path_(base_path)
+    , compression_(compression) {
+}
+
+std::vector<DeltaSnapshots::DeltaFile> DeltaSnapshots::listDeltas(const std::string& base_path) {
+    std::vector<DeltaFile> files;
+    std::string prefix = deltaPrefix(base_path);
+    std::string dir = Utils::getDirectory(base_path);
+    std::error_code ec;
+    for(const auto& entry : std::filesystem::directory_iterator(dir.empty() ? "." : dir, ec)){
+        std::string name = entry.path().filename().string();
+        if(name.compare(0, prefix.size(), prefix) != 0 || Utils::endsWith(name, ".tmp")){
+            continue;
+        }
+        char* end = nullptr;
+        uint64_t sequence = strtoull(name.c_str() + prefix.size(), &end, 10);
+        if(end == name.c_str() + prefix.size() || *end != '\0'){
+            continue;
+        }
+        files.push_back({sequence, entry.path().string(), static_cast<uint64_t>(entry.file_size(ec))});
+    }
+    std::sort(files.begin(), files.end(), [](const DeltaFile& a, const DeltaFile& b) {
+        return a.sequence < b.sequence;
+    });
+    return files;
+}
+
+bool DeltaSnapshots::hasBase() const {
+    return Utils::fileExists(base_path_);
+}
+
+uint64_t DeltaSnapshots::baseSequence() const {
+    if(!hasBase() || !SnapshotReader::isSnapshot(base_path_)){
+        return 0;
+    }
+    return SnapshotReader(base_path_).sequence();
+}
+
+void DeltaSnapshots::open() {
+    uint64_t base_sequence = baseSequence();
+    removeDeltasBefore(base_path_, base_sequence);
+
+    // 写到一半的增量只留下临时文件
+    std::string prefix = deltaPrefix(base_path_);
+    std::string dir = Utils::getDirectory(base_path_);
+    std::error_code ec;
+    for(const auto& entry : std::filesystem::directory_iterator(dir.empty() ? "." : dir, ec)){
+        std::string name = entry.path().filename().string();
+        if(name.compare(0, prefix.size(), prefix) == 0 && Utils::endsWith(name, ".tmp")){
+            std::filesystem::remove(entry.path(), ec);
+        }
+    }
+
+    uint64_t next = std::max<uint64_t>(base_sequence, 1);
+    for(const auto& file : listDeltas(base_path_)){
+        next = std::max(next, file.sequence + 1);
+    }
+    next_sequence_ = next;
+}
+
+uint64_t DeltaSnapshots::writeDelta(const std::vector<Entry>& entries) {
+    uint64_t sequence = next_sequence_++;
+    SnapshotWriter writer(deltaPath(base_path_, sequence));
+    writer.setSequence(sequence, SNAPSHOT_FLAG_DELTA);
+    writer.setCompression(compression_);
+    writer.setThrottle(throttle_);
+    std::string record;
+    for(const auto& entry : entries){
+        record.assign(1, entry.deleted ? DELETE_TAG : PUT_TAG);
+        if(!entry.deleted){
+            record.append(entry.value);
+        }
+        writer.add(entry.key, record);
+    }
+    writer.commit();
+    deltas_written_++;
+    return sequence;
+}
+
+std::vector<DeltaSnapshots::DeltaFile> DeltaSnapshots::deltas() const {
+    uint64_t base_sequence = baseSequence();
+    std::vector<DeltaFile> files = listDeltas(base_path_);
+    files.erase(std::remove_if(files.begin(), files.end(), [base_sequence](const DeltaFile& file) {
+        return file.sequence < base_sequence;
+    }), files.end());
+    return files;
+}
+
+void DeltaSnapshots::removeDeltasBefore(const std::string& base_path, uint64_t sequence) {
+    for(const auto& file : listDeltas(base_path)){
+        if(file.sequence < sequence){
+            ::unlink(file.path.c_str());
+        }
+    }
+}
+
+size_t DeltaSnapshots::consolidate() {
+    std::vector<DeltaFile> files = deltas();
+    if(files.empty()){
+        return 0;
+    }
+    if(hasBase() && !SnapshotReader::isSnapshot(base_path_)){
+        convertTextSnapshot(base_path_, base_path_);
+    }
+
+    // 游标按从旧到新排列：基础快照（若存在）在最前，同一个key以最新的来源为准
+    std::vector<std::unique_ptr<SnapshotReader>> readers;
+    bool has_base = hasBase();
+    if(has_base){
+        readers.push_back(std::make_unique<SnapshotReader>(base_path_));
+    }
+    for(const auto& file : files){
+        readers.push_back(std::make_unique<SnapshotReader>(file.path));
+    }
+    std::vector<std::unique_ptr<SnapshotReader::Cursor>> cursors;
+    for(const auto& reader : readers){
+        cursors.push_back(std::make_unique<SnapshotReader::Cursor>(*reader));
+    }
+
+    uint64_t sequence = files.back().sequence + 1;
+    SnapshotWriter writer(base_path_);
+    writer.setSequence(sequence);
+    writer.setCompression(compression_);
+    writer.setThrottle(throttle_);
+    while(true){
+        int64_t key = 0;
+        int newest = -1;
+        for(size_t i = 0; i < cursors.size(); i++){
+            if(cursors[i]->valid() && (newest < 0 || cursors[i]->key() <= key)){
+                key = cursors[i]->key();
+                newest = static_cast<int>(i);
+            }
+        }
+        if(newest < 0){
+            break;
+        }
+
+        const std::string& value = cursors[newest]->value();
+        if(has_base && newest == 0){
+            writer.add(key, value);
+        } else if(value.empty() || (value[0] != PUT_TAG && value[0] != DELETE_TAG)){
+            throw skiplist::DataCorruptionException("malformed delta record in " + files[newest - (has_base ? 1 : 0)].path);
+        } else if(value[0] == PUT_TAG){
+            writer.add(key, value.substr(1));
+        }
+        for(auto& cursor : cursors){
+            if(cursor->valid() && cursor->key() == key){
+                cursor->next();
+            }
+        }
+    }
+    writer.commit();
+
+    cursors.clear();
+    readers.clear();
+    removeDeltasBefore(base_path_, sequence);
+    if(next_sequence_ < sequence){
+        next_sequence_ = sequence;
+    }
+    consolidations_++;
+    return files.size();
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// 增量快照
+//
+// 基础快照（如store/dumpFile）之外，每次定期保存只把上次保存以来被写入或删除的key
+// 写成一个增量文件<base>.delta.<seq>，持久化的I/O与写入量而不是数据集大小成正比。
+// 增量文件与快照格式相同（带SNAPSHOT_FLAG_DELTA标志），value前加一字节标记：
+// 'P'表示写入，'D'表示删除（其后没有value）。
+//
+// 基础快照文件头中的sequence为S，表示它已经包含了所有seq < S的增量。恢复时先合并
+// 基础快照与seq >= S的增量，其余增量只是崩溃残留，直接删除。每个文件都先写临时文件
+// 再rename生效，任意时刻崩溃都能恢复到最近一个完整写出的文件所对应的状态：
+//   - 增量在rename之前崩溃：恢复到上一个增量对应的状态，与全量快照写出前崩溃相同；
+//   - 合并出的新基础快照rename之后、删除旧增量之前崩溃：旧增量的seq都小于新基础
+//     快照的sequence，恢复时被忽略。
+//
+// 增量数量或总大小超过阈值时，把基础快照和所有增量流式归并成新的基础快照，整个过程
+// 不访问跳表，内存占用只与块大小和增量个数有关。
+class IoThrottle;
+
+class DeltaSnapshots {
+public:
+    struct Entry {
+        int64_t key;
+        bool deleted;
+        std::string value;
+    };
+
+    struct DeltaFile {
+        uint64_t sequence;
+        std::string path;
+        uint64_t size;
+    };
+
+    // compression为写出增量和合并后的基础快照时数据块的压缩级别
+    explicit DeltaSnapshots(const std::string& base_path, int compression = 0);
+
+    // 读取基础快照的sequence，删除已被包含的增量和残留的临时文件
+    void open();
+
+    // 基础快照是否存在（不存在时只能保存全量快照）
+    bool hasBase() const;
+
+    // 下一个增量的seq；现在开始写出的全量快照应记录这个值
+    uint64_t nextSequence() const { return next_sequence_; }
+
+    // 按key升序写出一个增量，返回它的seq，失败时抛出FileIOException
+    uint64_t writeDelta(const std::vector<Entry>& entries);
+
+    // 当前仍有效的增量，按seq升序
+    std::vector<DeltaFile> deltas() const;
+
+    // 把基础快照和全部增量归并为新的基础快照，返回合并的增量个数
+    size_t consolidate();
+
+    // 新的全量快照（sequence为seq）已提交，删除seq之前的增量。fork出的子进程也可调用
+    static void removeDeltasBefore(const std::string& base_path, uint64_t sequence);
+
+    // 写出增量和合并时的限速（见io_throttle.h），nullptr表示不限速
+    void setThrottle(IoThrottle* throttle) { throttle_ = throttle; }
+
+    size_t deltasWritten() const { return deltas_written_; }
+    size_t consolidations() const { return consolidations_; }
+
+private:
+    static std::vector<DeltaFile> listDeltas(const std::string& base_path);
+    uint64_t baseSequence() const;
+
+    std::string base_path_;
+    int compression_;
+    IoThrottle* throttle_ = nullptr;
+    std::atomic<uint64_t> next_sequence_{1};
+    std::atomic<size_t> deltas_written_{0};
+    std::atomic<size_t> consolidations_{0};
+};
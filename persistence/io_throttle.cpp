@@ -0,0 +1,118 @@
+#include "io_throttle.h"
+#include "../include/exceptions.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <new>
+#include <sys/mman.h>
+
+namespace {
+const int64_t ADJUST_INTERVAL_NS = 100 * 1000 * 1000;  // 自适应调整的最小间隔
+const int64_t IDLE_RECOVER_NS = 1000 * 1000 * 1000;    // 超过这么久没有fdatasync时按未超标处理
+const uint64_t RATE_STEPS = 16;                        // 下限和回升步长都是rate的1/16
+
+int64_t nowNs(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+IoThrottle::IoThrottle() {
+    void* addr = ::mmap(nullptr, sizeof(State), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(addr == MAP_FAILED){
+        throw skiplist::StorageException("failed to map I/O throttle state");
+    }
+    state_ = new (addr) State();
+}
+
+IoThrottle::~IoThrottle() {
+    state_->~State();
+    ::munmap(state_, sizeof(State));
+}
+
+void IoThrottle::configure(uint64_t rate, uint64_t burst, bool adaptive, uint64_t target_latency_us) {
+    state_->rate = rate;
+    state_->current_rate = rate;
+    state_->burst = std::max<uint64_t>(burst, 1);
+    state_->adaptive = adaptive && target_latency_us > 0;
+    state_->target_latency_us = target_latency_us;
+    state_->tat_ns = 0;
+}
+
+void IoThrottle::acquire(uint64_t bytes) {
+    uint64_t rate = state_->rate.load(std::memory_order_relaxed);
+    if(rate == 0 || bytes == 0){
+        return;
+    }
+    int64_t now = nowNs();
+    if(state_->adaptive.load(std::memory_order_relaxed) &&
+       now - state_->last_sample_ns.load(std::memory_order_relaxed) > IDLE_RECOVER_NS){
+        recover(now);
+    }
+    uint64_t current = std::max<uint64_t>(state_->current_rate.load(std::memory_order_relaxed), 1);
+    int64_t cost = static_cast<int64_t>(static_cast<double>(bytes) * 1e9 / static_cast<double>(current));
+    int64_t window = static_cast<int64_t>(static_cast<double>(state_->burst.load()) * 1e9 / static_cast<double>(current));
+
+    int64_t old_tat = state_->tat_ns.load(std::memory_order_relaxed);
+    int64_t new_tat;
+    do {
+        new_tat = std::max(old_tat, now) + cost;
+    } while(!state_->tat_ns.compare_exchange_weak(old_tat, new_tat, std::memory_order_relaxed));
+
+    state_->throttled_bytes += bytes;
+    int64_t delay = new_tat - window - now;
+    if(delay > 0){
+        state_->wait_ns += static_cast<uint64_t>(delay);
+        std::this_thread::sleep_for(std::chrono::nanoseconds(delay));
+    }
+}
+
+void IoThrottle::recordFsyncLatency(uint64_t micros) {
+    int64_t now = nowNs();
+    state_->last_sample_ns = now;
+    // 滑动平均，新样本占1/8
+    uint64_t average = state_->latency_us.load(std::memory_order_relaxed);
+    average = average == 0 ? micros : average - average / 8 + micros / 8;
+    state_->latency_us = average;
+    if(!state_->adaptive.load(std::memory_order_relaxed) || state_->rate.load(std::memory_order_relaxed) == 0){
+        return;
+    }
+    if(micros <= state_->target_latency_us.load(std::memory_order_relaxed)){
+        recover(now);
+        return;
+    }
+    int64_t last = state_->last_adjust_ns.load(std::memory_order_relaxed);
+    if(now - last < ADJUST_INTERVAL_NS || !state_->last_adjust_ns.compare_exchange_strong(last, now)){
+        return;
+    }
+    uint64_t rate = state_->rate.load(std::memory_order_relaxed);
+    uint64_t current = state_->current_rate.load(std::memory_order_relaxed);
+    state_->current_rate = std::max(current / 2, std::max<uint64_t>(rate / RATE_STEPS, 1));
+    state_->backoffs++;
+}
+
+void IoThrottle::recover(int64_t now) {
+    uint64_t rate = state_->rate.load(std::memory_order_relaxed);
+    uint64_t current = state_->current_rate.load(std::memory_order_relaxed);
+    if(current >= rate){
+        return;
+    }
+    int64_t last = state_->last_adjust_ns.load(std::memory_order_relaxed);
+    if(now - last < ADJUST_INTERVAL_NS || !state_->last_adjust_ns.compare_exchange_strong(last, now)){
+        return;
+    }
+    state_->current_rate = std::min(rate, current + std::max<uint64_t>(rate / RATE_STEPS, 1));
+}
+
+IoThrottle::Stats IoThrottle::getStats() const {
+    Stats stats;
+    stats.rate = state_->rate;
+    stats.enabled = stats.rate > 0;
+    stats.adaptive = state_->adaptive;
+    stats.current_rate = state_->current_rate;
+    stats.throttled_bytes = state_->throttled_bytes;
+    stats.wait_ms = state_->wait_ns / 1000000;
+    stats.fsync_latency_us = state_->latency_us;
+    stats.backoffs = state_->backoffs;
+    return stats;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// 后台持久化的I/O限速
+//
+// 后台保存、增量合并和AOF重写写出的数据先向令牌桶申请额度：速率为每秒rate字节，
+// 最多允许burst字节的突发，超出时写出方睡眠，避免大批写入占满磁盘，拖慢AOF的
+// fdatasync。桶用"理论到达时间"表示：每次申请把它推后bytes/rate，超出当前时间
+// 加突发窗口的部分就是需要等待的时间，用一次CAS完成，不需要锁。
+//
+// 自适应模式下AOF写线程每次fdatasync后报告耗时：超过目标时速率减半（每100ms最多
+// 一次，下限为rate的1/16），低于目标时每100ms回升rate的1/16，直到配置的rate。
+//
+// 状态放在MAP_SHARED匿名内存中：fork出的保存子进程按父进程AOF写线程调整后的速率
+// 限速，父进程也能看到子进程的等待统计。时间用CLOCK_MONOTONIC，父子进程一致。
+class IoThrottle {
+public:
+    struct Stats {
+        bool enabled = false;
+        bool adaptive = false;
+        uint64_t rate = 0;             // 配置的速率（字节/秒）
+        uint64_t current_rate = 0;     // 自适应调整后的速率
+        uint64_t throttled_bytes = 0;  // 经过限速的字节数
+        uint64_t wait_ms = 0;          // 写出方累计等待的时间
+        uint64_t fsync_latency_us = 0; // AOF fdatasync耗时的滑动平均
+        uint64_t backoffs = 0;         // 自适应降速次数
+    };
+
+    IoThrottle();
+    ~IoThrottle();
+
+    IoThrottle(const IoThrottle&) = delete;
+    IoThrottle& operator=(const IoThrottle&) = delete;
+
+    // rate为0表示不限速；adaptive时fdatasync超过target_latency_us就降速
+    void configure(uint64_t rate, uint64_t burst, bool adaptive, uint64_t target_latency_us);
+
+    bool enabled() const { return state_->rate.load(std::memory_order_relaxed) > 0; }
+
+    // 写出bytes字节之前调用，超出速率时睡眠
+    void acquire(uint64_t bytes);
+
+    // AOF写线程每次fdatasync（含链接在写之后的）完成后调用
+    void recordFsyncLatency(uint64_t micros);
+
+    Stats getStats() const;
+
+private:
+    struct State {
+        std::atomic<uint64_t> rate{0};
+        std::atomic<uint64_t> current_rate{0};
+        std::atomic<uint64_t> burst{0};
+        std::atomic<bool> adaptive{false};
+        std::atomic<uint64_t> target_latency_us{0};
+        std::atomic<int64_t> tat_ns{0};          // 理论到达时间
+        std::atomic<int64_t> last_adjust_ns{0};  // 上次自适应调整的时间
+        std::atomic<int64_t> last_sample_ns{0};  // 上次收到fdatasync耗时的时间
+        std::atomic<uint64_t> latency_us{0};
+        std::atomic<uint64_t> throttled_bytes{0};
+        std::atomic<uint64_t> wait_ns{0};
+        std::atomic<uint64_t> backoffs{0};
+    };
+
+    // 离上次调整超过调整间隔时把速率回升一步
+    void recover(int64_t now);
+
+    State* state_;  // MAP_SHARED匿名映射
+};
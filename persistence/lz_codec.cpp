@@ -0,0 +1,217 @@
+#include "lz_codec.h"
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+const size_t MIN_MATCH = 4;
+const size_t MAX_OFFSET = 65535;
+const int HASH_BITS = 15;
+const size_t MAX_ATTEMPTS = 256;
+const size_t NICE_MATCH = 256;  // 找到这么长的匹配后不再查找更多候选
+
+uint32_t read32(const char* p){
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t hash4(uint32_t v){
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+void putLength(std::string& out, size_t length){
+    while(length >= 255){
+        out.push_back(static_cast<char>(255));
+        length -= 255;
+    }
+    out.push_back(static_cast<char>(length));
+}
+
+// match_length为0表示只有字面量的最后一个序列
+void emitSequence(std::string& out, const char* literals, size_t literal_length, size_t offset, size_t match_length){
+    size_t match_code = match_length > 0 ? match_length - MIN_MATCH : 0;
+    out.push_back(static_cast<char>((std::min<size_t>(literal_length, 15) << 4) | std::min<size_t>(match_code, 15)));
+    if(literal_length >= 15){
+        putLength(out, literal_length - 15);
+    }
+    out.append(literals, literal_length);
+    if(match_length == 0){
+        return;
+    }
+    out.push_back(static_cast<char>(offset & 0xff));
+    out.push_back(static_cast<char>(offset >> 8));
+    if(match_code >= 15){
+        putLength(out, match_code - 15);
+    }
+}
+
+bool readLength(const unsigned char*& ip, const unsigned char* end, size_t* length){
+    unsigned char b;
+    do {
+        if(ip >= end){
+            return false;
+        }
+        b = *ip++;
+        *length += b;
+    } while(b == 255);
+    return true;
+}
+
+// 每个线程复用的匹配表。表项保存base + 位置，小于base的表项属于之前的输入，
+// 每次压缩只需推进base，不必清空整张表
+struct MatchTable {
+    std::vector<uint32_t> head = std::vector<uint32_t>(1u << HASH_BITS, 0);
+    std::vector<uint32_t> chain;
+    uint32_t base = 1;
+
+    void reset(size_t size, bool use_chain){
+        if(static_cast<uint64_t>(base) + 2 * static_cast<uint64_t>(size) + MAX_OFFSET >= UINT32_MAX){
+            std::fill(head.begin(), head.end(), 0);
+            base = 1;
+        } else {
+            base += static_cast<uint32_t>(size) + MAX_OFFSET + 1;
+        }
+        if(use_chain && chain.size() < size){
+            chain.resize(size);
+        }
+    }
+};
+}
+
+size_t lzCompress(const char* src, size_t size, std::string& out, int level) {
+    size_t start = out.size();
+    level = std::max(1, std::min(level, LZ_MAX_LEVEL));
+    size_t max_attempts = std::min<size_t>(static_cast<size_t>(1) << (level - 1), MAX_ATTEMPTS);
+    bool use_chain = level > 1;
+    bool lazy = level >= 6;
+
+    thread_local MatchTable table;
+    table.reset(size, use_chain);
+    const uint32_t base = table.base;
+    uint32_t* head = table.head.data();
+    uint32_t* chain = use_chain ? table.chain.data() : nullptr;
+
+    auto insert = [&](size_t p){
+        uint32_t h = hash4(read32(src + p));
+        if(chain != nullptr){
+            chain[p] = head[h];
+        }
+        head[h] = base + static_cast<uint32_t>(p);
+    };
+    // 在p处查找最长匹配，返回长度（小于MIN_MATCH表示没有）
+    auto find = [&](size_t p, size_t* match_pos){
+        size_t best = 0;
+        uint32_t candidate = head[hash4(read32(src + p))];
+        uint32_t word = read32(src + p);
+        for(size_t attempt = 0; attempt < max_attempts && candidate >= base; attempt++){
+            size_t c = candidate - base;
+            if(c >= p || p - c > MAX_OFFSET){
+                break;
+            }
+            if(read32(src + c) == word){
+                size_t length = MIN_MATCH;
+                while(p + length < size && src[c + length] == src[p + length]){
+                    length++;
+                }
+                if(length > best){
+                    best = length;
+                    *match_pos = c;
+                    if(best >= NICE_MATCH){
+                        break;
+                    }
+                }
+            }
+            if(chain == nullptr){
+                break;
+            }
+            candidate = chain[c];
+        }
+        return best;
+    };
+
+    size_t anchor = 0;
+    size_t pos = 0;
+    size_t misses = 0;
+    while(size >= MIN_MATCH && pos + MIN_MATCH <= size){
+        size_t match_pos = 0;
+        size_t length = find(pos, &match_pos);
+        insert(pos);
+        if(length < MIN_MATCH){
+            // 1级连续未命中时加大步长，快速跳过不可压缩的数据
+            pos += level == 1 ? 1 + (misses++ >> 5) : 1;
+            continue;
+        }
+        misses = 0;
+        if(lazy && pos + 1 + MIN_MATCH <= size){
+            size_t next_pos = 0;
+            size_t next = find(pos + 1, &next_pos);
+            if(next > length + 1){
+                pos++;
+                continue;
+            }
+        }
+        emitSequence(out, src + anchor, pos - anchor, pos - match_pos, length);
+        size_t end = pos + length;
+        if(use_chain){
+            for(size_t p = pos + 1; p < end && p + MIN_MATCH <= size; p++){
+                insert(p);
+            }
+        } else if(end >= 2 && end - 2 > pos && end + 2 <= size){
+            insert(end - 2);
+        }
+        pos = end;
+        anchor = pos;
+    }
+    emitSequence(out, src + anchor, size - anchor, 0, 0);
+    return out.size() - start;
+}
+
+bool lzDecompress(const char* src, size_t size, char* dst, size_t original_size) {
+    const unsigned char* ip = reinterpret_cast<const unsigned char*>(src);
+    const unsigned char* end = ip + size;
+    char* op = dst;
+    char* op_end = dst + original_size;
+    while(ip < end){
+        unsigned char token = *ip++;
+        size_t literal_length = token >> 4;
+        if(literal_length == 15 && !readLength(ip, end, &literal_length)){
+            return false;
+        }
+        if(literal_length > static_cast<size_t>(end - ip) || literal_length > static_cast<size_t>(op_end - op)){
+            return false;
+        }
+        memcpy(op, ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+        if(ip == end){
+            break;
+        }
+
+        if(end - ip < 2){
+            return false;
+        }
+        size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        size_t match_length = token & 15;
+        if(match_length == 15 && !readLength(ip, end, &match_length)){
+            return false;
+        }
+        match_length += MIN_MATCH;
+        if(offset == 0 || offset > static_cast<size_t>(op - dst) || match_length > static_cast<size_t>(op_end - op)){
+            return false;
+        }
+        const char* match = op - offset;
+        if(offset >= match_length){
+            memcpy(op, match, match_length);
+            op += match_length;
+        } else {
+            // 与输出重叠（重复的短模式），逐字节复制
+            for(size_t i = 0; i < match_length; i++){
+                *op++ = match[i];
+            }
+        }
+    }
+    return op == op_end;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+// LZ系列块压缩（快照数据块和AOF前导使用），不依赖外部库
+//
+// 压缩结果是一串序列，每个序列：
+//   token(u8)     高4位为字面量长度，低4位为匹配长度-4，值为15时后接扩展长度
+//   [字面量扩展]   若干字节，每字节累加，255表示还有下一字节
+//   字面量
+//   offset(u16)   匹配起点到当前位置的距离（1..65535）
+//   [匹配扩展]     同字面量扩展
+// 最后一个序列只有字面量，读到输入末尾即结束。解码时原始长度由调用方给出，
+// 所有长度和偏移都做越界检查，损坏的输入只会让解码失败。
+//
+// level 1只查哈希表的一个候选；更高级别沿哈希链查找更多候选（级别每加1翻倍，
+// 最多256个），6级以上再做一步惰性匹配，压缩率更高、速度更慢。
+
+const int LZ_MAX_LEVEL = 9;
+
+// 把src压缩后追加到out，返回追加的字节数
+size_t lzCompress(const char* src, size_t size, std::string& out, int level = 1);
+
+// 把src解压到dst，原始长度必须恰好为original_size，否则返回false
+bool lzDecompress(const char* src, size_t size, char* dst, size_t original_size);
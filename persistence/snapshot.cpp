@@ -0,0 +1,509 @@
+#include "snapshot.h"
+#include "lz_codec.h"
+#include "async_file.h"
+#include "io_throttle.h"
+#include "../include/exceptions.h"
+#include "../utils/utils.h"
+#include <map>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+namespace {
+const char FILE_MAGIC[8] = {'S', 'L', 'S', 'N', 'A', 'P', '0', '1'};
+const uint64_t FOOTER_MAGIC = 0x5446504E53534C53ull; // "SLSSNPFT"
+const uint32_t SNAPSHOT_VERSION = 3;
+const size_t FILE_HEADER_SIZE = 24;
+const size_t FILE_HEADER_SIZE_V1 = 16;
+const size_t BLOCK_HEADER_SIZE = 16;
+const size_t BLOCK_HEADER_SIZE_V2 = 12;  // 版本1、2的块头没有raw_size
+const size_t INDEX_ENTRY_SIZE = 20;
+const size_t FOOTER_SIZE = 32;
+const size_t WRITE_BUFFER_SIZE = 1024 * 1024;
+const uint64_t UNMAP_CHUNK_SIZE = 4 * 1024 * 1024; // 已解码部分每满4MB解除一次映射
+
+void putU32(char* p, uint32_t v){
+    memcpy(p, &v, sizeof(v));
+}
+
+void putU64(char* p, uint64_t v){
+    memcpy(p, &v, sizeof(v));
+}
+
+uint32_t getU32(const char* p){
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint64_t getU64(const char* p){
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+bool preadFull(int fd, char* buf, size_t length, uint64_t offset){
+    while(length > 0){
+        ssize_t n = ::pread(fd, buf, length, static_cast<off_t>(offset));
+        if(n <= 0){
+            return false;
+        }
+        buf += n;
+        length -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+}
+
+SnapshotWriter::SnapshotWriter(const std::string& path, size_t block_size)
+    : path_(path)
+    , tmp_path_(path + ".tmp")
+    , block_size_(block_size > 0 ? block_size : 64 * 1024) {
+    fd_ = ::open(tmp_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd_ < 0){
+        throw skiplist::FileIOException(tmp_path_, "open");
+    }
+    init();
+}
+
+SnapshotWriter::SnapshotWriter(int fd, const std::string& path, size_t block_size)
+    : path_(path)
+    , tmp_path_(path)
+    , fd_(fd)
+    , embedded_(true)
+    , block_size_(block_size > 0 ? block_size : 64 * 1024) {
+    off_t position = ::lseek(fd_, 0, SEEK_CUR);
+    if(position < 0){
+        throw skiplist::FileIOException(path_, "seek");
+    }
+    base_ = static_cast<uint64_t>(position);
+    init();
+}
+
+void SnapshotWriter::init() {
+    for(char*& buffer : buffers_){
+        if(posix_memalign(reinterpret_cast<void**>(&buffer), 4096, WRITE_BUFFER_SIZE) != 0){
+            buffer = nullptr;
+            throw std::bad_alloc();
+        }
+    }
+    file_ = std::make_unique<AsyncFile>(fd_, tmp_path_);
+    file_->registerBuffers({{buffers_[0], WRITE_BUFFER_SIZE}, {buffers_[1], WRITE_BUFFER_SIZE}});
+    writeHeader();
+}
+
+void SnapshotWriter::writeHeader() {
+    char header[FILE_HEADER_SIZE];
+    memcpy(header, FILE_MAGIC, sizeof(FILE_MAGIC));
+    putU32(header + 8, SNAPSHOT_VERSION);
+    putU32(header + 12, 0);
+    putU64(header + 16, 0);
+    writeAll(header, sizeof(header));
+}
+
+void SnapshotWriter::setSequence(uint64_t sequence, uint32_t flags) {
+    sequence_ = sequence;
+    flags_ = flags;
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    // 先等待写缓冲上未完成的写，再释放缓冲
+    file_.reset();
+    free(buffers_[0]);
+    free(buffers_[1]);
+    if(embedded_){
+        return;
+    }
+    if(fd_ >= 0){
+        ::close(fd_);
+    }
+    if(!committed_){
+        ::unlink(tmp_path_.c_str());
+    }
+}
+
+void SnapshotWriter::writeAll(const char* data, size_t length) {
+    offset_ += length;
+    while(length > 0){
+        size_t n = std::min(length, WRITE_BUFFER_SIZE - fill_);
+        memcpy(buffers_[current_] + fill_, data, n);
+        fill_ += n;
+        data += n;
+        length -= n;
+        if(fill_ == WRITE_BUFFER_SIZE){
+            submitBuffer();
+        }
+    }
+}
+
+void SnapshotWriter::submitBuffer() {
+    if(fill_ > 0){
+        if(throttle_ != nullptr){
+            throttle_->acquire(fill_);
+        }
+        inflight_[current_] = file_->write(buffers_[current_], fill_, base_ + flushed_, AsyncFile::Sync::None, current_);
+        flushed_ += fill_;
+        fill_ = 0;
+        current_ ^= 1;
+    }
+    if(inflight_[current_] != 0){
+        uint64_t request = inflight_[current_];
+        inflight_[current_] = 0;
+        if(!file_->wait(request)){
+            throw skiplist::FileIOException(tmp_path_, "write");
+        }
+    }
+}
+
+void SnapshotWriter::add(int64_t key, const std::string& value) {
+    if(block_entries_ == 0){
+        block_first_key_ = key;
+        last_key_ = 0;
+    }
+    Utils::appendVarint(block_, Utils::zigzagEncode(key - last_key_));
+    Utils::appendVarint(block_, value.size());
+    block_.append(value);
+    last_key_ = key;
+    block_entries_++;
+    total_entries_++;
+    if(block_.size() >= block_size_){
+        flushBlock();
+    }
+}
+
+void SnapshotWriter::flushBlock() {
+    if(block_entries_ == 0){
+        return;
+    }
+    index_.push_back({block_first_key_, offset_, block_entries_});
+    const std::string* payload = &block_;
+    uint32_t raw_size = 0;
+    if(compression_level_ > 0){
+        compressed_.clear();
+        if(lzCompress(block_.data(), block_.size(), compressed_, compression_level_) < block_.size()){
+            payload = &compressed_;
+            raw_size = static_cast<uint32_t>(block_.size());
+        }
+    }
+    char header[BLOCK_HEADER_SIZE];
+    putU32(header, static_cast<uint32_t>(payload->size()));
+    putU32(header + 4, block_entries_);
+    putU32(header + 8, Utils::crc32c(payload->data(), payload->size()));
+    putU32(header + 12, raw_size);
+    writeAll(header, sizeof(header));
+    writeAll(payload->data(), payload->size());
+    block_.clear();
+    block_entries_ = 0;
+}
+
+void SnapshotWriter::commit() {
+    flushBlock();
+
+    uint64_t index_offset = offset_;
+    std::string index(index_.size() * INDEX_ENTRY_SIZE, '\0');
+    for(size_t i = 0; i < index_.size(); i++){
+        char* p = &index[i * INDEX_ENTRY_SIZE];
+        putU64(p, static_cast<uint64_t>(index_[i].first_key));
+        putU64(p + 8, index_[i].offset);
+        putU32(p + 16, index_[i].entry_count);
+    }
+    char footer[FOOTER_SIZE];
+    putU64(footer, index_offset);
+    putU32(footer + 8, static_cast<uint32_t>(index_.size()));
+    putU32(footer + 12, Utils::crc32c(index.data(), index.size()));
+    putU64(footer + 16, total_entries_);
+    putU64(footer + 24, FOOTER_MAGIC);
+    writeAll(index.data(), index.size());
+    writeAll(footer, sizeof(footer));
+
+    // 把缓冲中剩余的数据写出
+    submitBuffer();
+    if(!file_->waitAll()){
+        throw skiplist::FileIOException(tmp_path_, "write");
+    }
+
+    // 文件头在构造时已写出，sequence和flags在这里回填；独立的快照文件在回填之后链接fsync
+    AsyncFile::Sync sync = embedded_ ? AsyncFile::Sync::None : AsyncFile::Sync::Full;
+    char fields[12];
+    putU32(fields, flags_);
+    putU64(fields + 4, sequence_);
+    bool has_fields = sequence_ != 0 || flags_ != 0;
+    uint64_t request = has_fields ? file_->write(fields, sizeof(fields), base_ + 12, sync) : file_->sync(sync);
+    if(!file_->wait(request)){
+        throw skiplist::FileIOException(tmp_path_, has_fields ? "write" : "fsync");
+    }
+    if(embedded_){
+        // 写出都是定位写，把文件位置移到快照之后，调用方可以继续追加
+        if(::lseek(fd_, static_cast<off_t>(base_ + offset_), SEEK_SET) < 0){
+            throw skiplist::FileIOException(tmp_path_, "seek");
+        }
+        committed_ = true;
+        return;
+    }
+    ::close(fd_);
+    fd_ = -1;
+    if(::rename(tmp_path_.c_str(), path_.c_str()) != 0){
+        throw skiplist::FileIOException(path_, "rename");
+    }
+    committed_ = true;
+    // rename落盘之后调用方才会删除被取代的文件
+    if(!Utils::syncParentDirectory(path_)){
+        throw skiplist::FileIOException(path_, "fsync");
+    }
+}
+
+bool SnapshotReader::isSnapshot(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(FILE_MAGIC)];
+    return in.read(magic, sizeof(magic)) && memcmp(magic, FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+SnapshotReader::SnapshotReader(const std::string& path, uint64_t offset, uint64_t length)
+    : path_(path)
+    , base_(offset) {
+    fd_ = ::open(path_.c_str(), O_RDONLY);
+    if(fd_ < 0){
+        throw skiplist::FileIOException(path_, "open");
+    }
+    try {
+        struct stat st;
+        if(::fstat(fd_, &st) != 0){
+            throw skiplist::FileIOException(path_, "stat");
+        }
+        // 以下的偏移都相对于base_，file_size是快照本身的长度
+        uint64_t file_size = static_cast<uint64_t>(st.st_size);
+        if(length > 0){
+            if(offset + length > file_size){
+                throw skiplist::DataCorruptionException("embedded snapshot extends past end of file: " + path_);
+            }
+            file_size = length;
+        } else if(offset > file_size){
+            throw skiplist::DataCorruptionException("bad snapshot offset: " + path_);
+        } else {
+            file_size -= offset;
+        }
+        char header[FILE_HEADER_SIZE];
+        if(file_size < FILE_HEADER_SIZE_V1 + FOOTER_SIZE || !preadFull(fd_, header, FILE_HEADER_SIZE_V1, base_) ||
+           memcmp(header, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0){
+            throw skiplist::DataCorruptionException("not a snapshot file: " + path_);
+        }
+        uint32_t version = getU32(header + 8);
+        size_t header_size = version == 1 ? FILE_HEADER_SIZE_V1 : FILE_HEADER_SIZE;
+        if(version < 1 || version > SNAPSHOT_VERSION){
+            throw skiplist::DataCorruptionException("unsupported snapshot version " + std::to_string(version) + ": " + path_);
+        }
+        flags_ = getU32(header + 12);
+        block_header_size_ = version >= 3 ? BLOCK_HEADER_SIZE : BLOCK_HEADER_SIZE_V2;
+        if(version >= 2){
+            if(file_size < FILE_HEADER_SIZE + FOOTER_SIZE || !preadFull(fd_, header + FILE_HEADER_SIZE_V1, FILE_HEADER_SIZE - FILE_HEADER_SIZE_V1, base_ + FILE_HEADER_SIZE_V1)){
+                throw skiplist::DataCorruptionException("truncated snapshot header: " + path_);
+            }
+            sequence_ = getU64(header + 16);
+        }
+
+        char footer[FOOTER_SIZE];
+        if(!preadFull(fd_, footer, sizeof(footer), base_ + file_size - FOOTER_SIZE) || getU64(footer + 24) != FOOTER_MAGIC){
+            throw skiplist::DataCorruptionException("bad snapshot footer: " + path_);
+        }
+        index_offset_ = getU64(footer);
+        uint32_t block_count = getU32(footer + 8);
+        uint32_t index_crc = getU32(footer + 12);
+        total_entries_ = getU64(footer + 16);
+        if(index_offset_ + static_cast<uint64_t>(block_count) * INDEX_ENTRY_SIZE + FOOTER_SIZE != file_size){
+            throw skiplist::DataCorruptionException("bad snapshot layout: " + path_);
+        }
+
+        std::string index(static_cast<size_t>(block_count) * INDEX_ENTRY_SIZE, '\0');
+        if(!preadFull(fd_, &index[0], index.size(), base_ + index_offset_) || Utils::crc32c(index.data(), index.size()) != index_crc){
+            throw skiplist::DataCorruptionException("snapshot index checksum mismatch: " + path_);
+        }
+        index_.resize(block_count);
+        uint64_t expected_offset = header_size;
+        for(uint32_t i = 0; i < block_count; i++){
+            const char* p = index.data() + i * INDEX_ENTRY_SIZE;
+            index_[i].first_key = static_cast<int64_t>(getU64(p));
+            index_[i].offset = getU64(p + 8);
+            index_[i].entry_count = getU32(p + 16);
+            if(index_[i].offset < expected_offset || index_[i].offset >= index_offset_){
+                throw skiplist::DataCorruptionException("bad snapshot block offset: " + path_);
+            }
+            expected_offset = index_[i].offset + block_header_size_;
+        }
+    } catch (...) {
+        ::close(fd_);
+        fd_ = -1;
+        throw;
+    }
+}
+
+SnapshotReader::~SnapshotReader() {
+    if(fd_ >= 0){
+        ::close(fd_);
+    }
+}
+
+void SnapshotReader::decodeBlock(const char* data, size_t size, const Visitor& visitor) const {
+    if(size < block_header_size_){
+        throw skiplist::DataCorruptionException("truncated snapshot block: " + path_);
+    }
+    uint32_t payload_size = getU32(data);
+    uint32_t entry_count = getU32(data + 4);
+    uint32_t crc = getU32(data + 8);
+    uint32_t raw_size = block_header_size_ >= BLOCK_HEADER_SIZE ? getU32(data + 12) : 0;
+    if(block_header_size_ + static_cast<size_t>(payload_size) != size){
+        throw skiplist::DataCorruptionException("bad snapshot block size: " + path_);
+    }
+    const char* p = data + block_header_size_;
+    if(Utils::crc32c(p, payload_size) != crc){
+        throw skiplist::DataCorruptionException("snapshot block checksum mismatch: " + path_);
+    }
+    const char* limit = p + payload_size;
+    // 压缩块解压到线程私有的缓冲区，各加载线程互不影响
+    thread_local std::string raw;
+    if(raw_size > 0){
+        raw.resize(raw_size);
+        if(!lzDecompress(p, payload_size, &raw[0], raw_size)){
+            throw skiplist::DataCorruptionException("malformed compressed snapshot block: " + path_);
+        }
+        p = raw.data();
+        limit = p + raw_size;
+    }
+
+    int64_t key = 0;
+    for(uint32_t i = 0; i < entry_count; i++){
+        uint64_t delta, length;
+        p = Utils::decodeVarint(p, limit, &delta);
+        if(p != nullptr){
+            p = Utils::decodeVarint(p, limit, &length);
+        }
+        if(p == nullptr || length > static_cast<uint64_t>(limit - p)){
+            throw skiplist::DataCorruptionException("malformed snapshot record: " + path_);
+        }
+        key += Utils::zigzagDecode(delta);
+        visitor(key, p, static_cast<size_t>(length));
+        p += length;
+    }
+}
+
+uint64_t SnapshotReader::blockEnd(size_t block) const {
+    return block + 1 < index_.size() ? index_[block + 1].offset : index_offset_;
+}
+
+void SnapshotReader::readBlock(size_t block, std::string& buffer, const Visitor& visitor) const {
+    uint64_t begin = index_[block].offset;
+    uint64_t end = blockEnd(block);
+    buffer.resize(static_cast<size_t>(end - begin));
+    if(!preadFull(fd_, &buffer[0], buffer.size(), base_ + begin)){
+        throw skiplist::FileIOException(path_, "read");
+    }
+    decodeBlock(buffer.data(), buffer.size(), visitor);
+}
+
+void SnapshotReader::mapBlocks(size_t begin, size_t end, const Visitor& visitor) const {
+    end = std::min(end, index_.size());
+    if(begin >= end){
+        return;
+    }
+    // 映射和解除映射使用文件中的绝对偏移
+    static const uint64_t page_size = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+    uint64_t map_offset = (base_ + index_[begin].offset) / page_size * page_size;
+    uint64_t map_end = base_ + blockEnd(end - 1);
+    size_t map_size = static_cast<size_t>(map_end - map_offset);
+    void* addr = ::mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd_, static_cast<off_t>(map_offset));
+    if(addr == MAP_FAILED){
+        throw skiplist::FileIOException(path_, "mmap");
+    }
+    ::madvise(addr, map_size, MADV_SEQUENTIAL);
+
+    // 映射区间从unmapped开始仍然有效，之前已解码的整页按块解除映射，常驻的页不随文件增长
+    char* base = static_cast<char*>(addr);
+    uint64_t unmapped = map_offset;
+    try {
+        for(size_t block = begin; block < end; block++){
+            uint64_t block_begin = base_ + index_[block].offset;
+            uint64_t block_end = base_ + blockEnd(block);
+            decodeBlock(base + (block_begin - map_offset), static_cast<size_t>(block_end - block_begin), visitor);
+
+            uint64_t done = block_end / page_size * page_size;
+            if(done - unmapped >= UNMAP_CHUNK_SIZE){
+                ::munmap(base + (unmapped - map_offset), static_cast<size_t>(done - unmapped));
+                unmapped = done;
+            }
+        }
+    } catch (...) {
+        ::munmap(base + (unmapped - map_offset), static_cast<size_t>(map_end - unmapped));
+        throw;
+    }
+    ::munmap(base + (unmapped - map_offset), static_cast<size_t>(map_end - unmapped));
+}
+
+void SnapshotReader::forEach(const Visitor& visitor) const {
+    std::string buffer;
+    for(size_t i = 0; i < index_.size(); i++){
+        readBlock(i, buffer, visitor);
+    }
+}
+
+SnapshotReader::Cursor::Cursor(const SnapshotReader& reader)
+    : reader_(reader) {
+    loadBlock();
+}
+
+void SnapshotReader::Cursor::loadBlock() {
+    entries_.clear();
+    position_ = 0;
+    // 跳过空块，直到读到记录或到达末尾
+    while(entries_.empty() && block_ < reader_.blockCount()){
+        reader_.readBlock(block_++, buffer_, [this](int64_t key, const char* data, size_t length){
+            entries_.emplace_back(key, std::string(data, length));
+        });
+    }
+}
+
+void SnapshotReader::Cursor::next() {
+    if(++position_ >= entries_.size()){
+        loadBlock();
+    }
+}
+
+uint64_t convertTextSnapshot(const std::string& text_path, const std::string& snapshot_path) {
+    std::ifstream in(text_path);
+    if(!in.is_open()){
+        throw skiplist::FileIOException(text_path, "open");
+    }
+    // 旧格式每行为"key:value;"，key按第一个':'切分，去掉行尾的';'
+    std::map<int, std::string> entries;
+    std::string line;
+    while(std::getline(in, line)){
+        if(!line.empty() && line.back() == '\r'){
+            line.pop_back();
+        }
+        size_t colon = line.find(':');
+        if(colon == std::string::npos || colon == 0){
+            continue;
+        }
+        std::string value = line.substr(colon + 1);
+        if(!value.empty() && value.back() == ';'){
+            value.pop_back();
+        }
+        try {
+            entries[std::stoi(line.substr(0, colon))] = std::move(value);
+        } catch (const std::exception&) {
+            continue;
+        }
+    }
+
+    SnapshotWriter writer(snapshot_path);
+    for(const auto& entry : entries){
+        writer.add(entry.first, entry.second);
+    }
+    writer.commit();
+    return writer.entries();
+}
@@ -0,0 +1,179 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+// 二进制快照格式（版本3）
+//
+// 文件布局：
+//   文件头   magic "SLSNAP01"(8) | version(u32) | flags(u32) | sequence(u64)
+//            版本1的文件头没有sequence（视为0），其余部分相同，仍可读取
+//   数据块*N payload_size(u32) | entry_count(u32) | crc32c(u32) | raw_size(u32) | payload
+//            解压后的payload由按key升序排列的记录组成：
+//              zigzag(key - 前一个key)的varint | varint(value_length) | value
+//            raw_size不为0时payload是LZ压缩（见lz_codec.h）后的数据，raw_size为解压后的
+//            长度；为0时payload未压缩。crc32c覆盖文件中保存的payload。版本1和2的块头
+//            没有raw_size，payload都未压缩
+//            每块第一条记录的前一个key视为0，块之间互不依赖，可以并行解压和解码
+//   块索引   每块一项：first_key(i64) | offset(u64) | entry_count(u32)
+//   文件尾   index_offset(u64) | block_count(u32) | index_crc32c(u32) | total_entries(u64) | magic(u64)
+//
+// value按长度前缀保存，可以包含任意字节（包括':'、';'和换行）。写入时先写到
+// 临时文件，fsync后rename替换，中途崩溃不会破坏已有的快照。写出经过AsyncFile
+// （见async_file.h）：两块写缓冲轮流使用，一块在后台写出时继续编码和压缩下一块。
+//
+// sequence和flags由增量快照使用（见delta_snapshot.h）：基础快照的sequence表示它
+// 已包含的增量范围，增量文件带SNAPSHOT_FLAG_DELTA标志。
+//
+// 快照也可以嵌入在其他文件中（AOF前导，见aof_format.h）：块索引中的偏移都相对于
+// 快照的起始位置，读取时给出快照在文件中的区间即可。
+const uint32_t SNAPSHOT_FLAG_DELTA = 1;
+
+class AsyncFile;
+class IoThrottle;
+
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& path, size_t block_size = 64 * 1024);
+    // 写入调用方打开的fd的当前位置（嵌入其他文件）；commit只写出数据，fsync和关闭由调用方负责
+    SnapshotWriter(int fd, const std::string& path, size_t block_size = 64 * 1024);
+    // 未commit时删除临时文件
+    ~SnapshotWriter();
+
+    // 设置文件头中的sequence和flags，在commit之前调用
+    void setSequence(uint64_t sequence, uint32_t flags = 0);
+
+    // 数据块的压缩级别（0不压缩，1~9见lz_codec.h），压缩后没有变小的块按原样保存
+    void setCompression(int level) { compression_level_ = level; }
+
+    // 后台写出时的限速（见io_throttle.h），nullptr表示不限速
+    void setThrottle(IoThrottle* throttle) { throttle_ = throttle; }
+
+    // key必须严格递增
+    void add(int64_t key, const std::string& value);
+
+    // 写出最后一块、块索引和文件尾，fsync并替换目标文件，失败时抛出FileIOException
+    void commit();
+
+    uint64_t entries() const { return total_entries_; }
+
+    // 已写入的字节数，commit之后即快照的总长度
+    uint64_t bytes() const { return offset_; }
+
+private:
+    struct BlockIndex {
+        int64_t first_key;
+        uint64_t offset;
+        uint32_t entry_count;
+    };
+
+    void init();
+    void writeHeader();
+    void flushBlock();
+    void writeAll(const char* data, size_t length);
+    // 提交当前写缓冲，并换到另一块（等待它上次的写完成）
+    void submitBuffer();
+
+    std::string path_;
+    std::string tmp_path_;
+    int fd_ = -1;
+    bool embedded_ = false;
+    uint64_t base_ = 0;  // 快照在文件中的起始偏移
+    size_t block_size_;
+    bool committed_ = false;
+    int compression_level_ = 0;
+    IoThrottle* throttle_ = nullptr;
+    std::string compressed_;  // 压缩缓冲
+    uint64_t sequence_ = 0;
+    uint32_t flags_ = 0;
+    uint64_t offset_ = 0;
+    std::string block_;
+    std::unique_ptr<AsyncFile> file_;
+    char* buffers_[2] = {nullptr, nullptr};  // 注册给io_uring的写缓冲
+    uint64_t inflight_[2] = {0, 0};          // 各缓冲未完成的写请求
+    int current_ = 0;
+    size_t fill_ = 0;                        // 当前缓冲已填入的字节数
+    uint64_t flushed_ = 0;                   // 已提交写出的字节数（当前缓冲在快照中的起始偏移）
+    uint32_t block_entries_ = 0;
+    int64_t block_first_key_ = 0;
+    int64_t last_key_ = 0;
+    uint64_t total_entries_ = 0;
+    std::vector<BlockIndex> index_;
+};
+
+class SnapshotReader {
+public:
+    using Visitor = std::function<void(int64_t key, const char* value, size_t length)>;
+
+    // 文件是否以二进制快照的magic开头
+    static bool isSnapshot(const std::string& path);
+
+    // 读取并校验文件尾和块索引，失败时抛出DataCorruptionException或FileIOException。
+    // length不为0时读取嵌入在文件[offset, offset + length)中的快照
+    explicit SnapshotReader(const std::string& path, uint64_t offset = 0, uint64_t length = 0);
+    ~SnapshotReader();
+
+    size_t blockCount() const { return index_.size(); }
+    // 第block块的第一个key，块按key递增排列
+    int64_t blockFirstKey(size_t block) const { return index_[block].first_key; }
+    // 第block块在快照中的结束偏移（下一块的起始或块索引的起始）
+    uint64_t blockEnd(size_t block) const;
+    uint64_t entries() const { return total_entries_; }
+    uint64_t sequence() const { return sequence_; }
+    bool isDelta() const { return (flags_ & SNAPSHOT_FLAG_DELTA) != 0; }
+
+    // 读取并校验第block块，按顺序对其中每条记录调用visitor，buffer用于复用读缓冲
+    void readBlock(size_t block, std::string& buffer, const Visitor& visitor) const;
+
+    // 用mmap按顺序解码[begin, end)块：记录直接从映射的页面交给visitor，不经过读缓冲，
+    // 已解码的部分随读随解除映射。快照只通过rename替换，读取期间文件不会被截断
+    void mapBlocks(size_t begin, size_t end, const Visitor& visitor) const;
+
+    // 按顺序读取全部记录
+    void forEach(const Visitor& visitor) const;
+
+    // 逐条拉取记录的游标，每次只解码一个块，用于多个快照的流式归并
+    class Cursor {
+    public:
+        explicit Cursor(const SnapshotReader& reader);
+        bool valid() const { return position_ < entries_.size(); }
+        int64_t key() const { return entries_[position_].first; }
+        const std::string& value() const { return entries_[position_].second; }
+        void next();
+
+    private:
+        void loadBlock();
+
+        const SnapshotReader& reader_;
+        size_t block_ = 0;
+        size_t position_ = 0;
+        std::string buffer_;
+        std::vector<std::pair<int64_t, std::string>> entries_;
+    };
+
+    // 校验、解压并解码一个已读入内存的数据块（含块头），供不经过read()的读取方式复用
+    void decodeBlock(const char* data, size_t size, const Visitor& visitor) const;
+
+private:
+    struct BlockIndex {
+        int64_t first_key;
+        uint64_t offset;
+        uint32_t entry_count;
+    };
+
+    std::string path_;
+    int fd_ = -1;
+    uint64_t base_ = 0;  // 快照在文件中的起始偏移
+    size_t block_header_size_ = 0;
+    uint64_t sequence_ = 0;
+    uint32_t flags_ = 0;
+    uint64_t index_offset_ = 0;
+    uint64_t total_entries_ = 0;
+    std::vector<BlockIndex> index_;
+};
+
+// 把旧的"key:value;"文本快照转换为二进制快照，返回转换的记录数
+uint64_t convertTextSnapshot(const std::string& text_path, const std::string& snapshot_path);
@@ -0,0 +1,221 @@
+#include "write_ahead_log.h"
+#include "../logger/logger.h"
+#include <algorithm>
+
+namespace {
+const size_t CHUNK_SIZE = 64 * 1024;  // 小批次合并成的backlog块大小
+
+// 跳过data开头的count条记录，返回跳过的字节数
+size_t skipRecords(const std::string& data, uint64_t count){
+    size_t pos = 0;
+    for(uint64_t i = 0; i < count && pos < data.size(); i++){
+        pos += aofRecordSize(data.data() + pos);
+    }
+    return std::min(pos, data.size());
+}
+}
+
+void WriteAheadLog::open(AofManifest* manifest) {
+    manifest_ = manifest;
+    uint64_t lsn = 0;
+    if(manifest_ != nullptr){
+        // 从最后一个记录了LSN的增量段开始数记录；都没有时以base的LSN为准
+        std::vector<AofManifest::IncrInfo> incrs = manifest_->incrs();
+        size_t first = incrs.size();
+        for(size_t i = incrs.size(); i > 0; i--){
+            if(incrs[i - 1].start_lsn != AOF_UNKNOWN_LSN){
+                first = i - 1;
+                break;
+            }
+        }
+        if(first < incrs.size()){
+            lsn = incrs[first].start_lsn;
+            for(size_t i = first; i < incrs.size(); i++){
+                lsn += AofReader(incrs[i].path).readRecords([](const char*, size_t) { return true; });
+            }
+        } else if(manifest_->baseLsn() != AOF_UNKNOWN_LSN){
+            lsn = manifest_->baseLsn();
+        } else {
+            LOG_WARN("AOF manifest has no LSNs (written by an older version), numbering writes from 0");
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    next_lsn_ = lsn;
+    written_lsn_ = lsn;
+    backlog_.clear();
+    backlog_bytes_ = 0;
+}
+
+uint64_t WriteAheadLog::lastLsn() const {
+    if(writer_ != nullptr){
+        return writer_->lastLsn();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    return next_lsn_;
+}
+
+void WriteAheadLog::attachWriter(AofWriter* writer) {
+    writer_ = writer;
+}
+
+uint64_t WriteAheadLog::append(AofOp op, int32_t key, const char* value, size_t length) {
+    if(writer_ == nullptr && backlog_size_ == 0){
+        // 既不写出也不保留时只需要分配LSN
+        std::lock_guard<std::mutex> lock(mutex_);
+        written_lsn_ = ++next_lsn_;
+        return next_lsn_;
+    }
+    std::string record;
+    encodeAofRecord(record, op, key, value, length);
+    if(writer_ != nullptr){
+        // 写线程写出后经onWritten进入backlog
+        return writer_->append(std::move(record));
+    }
+    uint64_t lsn;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lsn = ++next_lsn_;
+        pushLocked(lsn, lsn, record.data(), record.size());
+    }
+    written_cv_.notify_all();
+    return lsn;
+}
+
+void WriteAheadLog::onWritten(uint64_t last_lsn, const std::string& bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pushLocked(written_lsn_ + 1, last_lsn, bytes.data(), bytes.size());
+    }
+    written_cv_.notify_all();
+}
+
+void WriteAheadLog::pushLocked(uint64_t first_lsn, uint64_t last_lsn, const char* data, size_t size) {
+    written_lsn_ = last_lsn;
+    if(backlog_size_ == 0){
+        return;
+    }
+    // 按记录边界切成不超过块大小的块，大批次写出后也能按块淘汰
+    size_t chunk_size = static_cast<size_t>(std::max<uint64_t>(std::min<uint64_t>(CHUNK_SIZE, backlog_size_ / 8), 1));
+    uint64_t lsn = first_lsn;
+    size_t pos = 0;
+    while(pos < size){
+        if(backlog_.empty() || backlog_.back().bytes.size() >= chunk_size){
+            backlog_.push_back({lsn, lsn - 1, std::string()});
+        }
+        Chunk& chunk = backlog_.back();
+        size_t end = pos;
+        while(end < size && (end == pos || chunk.bytes.size() + (end - pos) < chunk_size)){
+            end += aofRecordSize(data + end);
+            chunk.last_lsn++;
+            lsn++;
+        }
+        chunk.bytes.append(data + pos, end - pos);
+        backlog_bytes_ += end - pos;
+        pos = end;
+    }
+    while(backlog_bytes_ > backlog_size_ && backlog_.size() > 1){
+        backlog_bytes_ -= backlog_.front().bytes.size();
+        backlog_.pop_front();
+    }
+}
+
+WriteAheadLog::ReadStatus WriteAheadLog::read(uint64_t after_lsn, size_t max_bytes, std::string* out, uint64_t* last_lsn) {
+    out->clear();
+    *last_lsn = after_lsn;
+    uint64_t written_lsn;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        written_lsn = written_lsn_;
+        if(after_lsn > written_lsn){
+            return ReadStatus::NeedFullSync;
+        }
+        if(after_lsn == written_lsn){
+            return ReadStatus::Ok;
+        }
+        if(!backlog_.empty() && backlog_.front().first_lsn <= after_lsn + 1){
+            for(const auto& chunk : backlog_){
+                if(chunk.last_lsn <= after_lsn){
+                    continue;
+                }
+                size_t skip = after_lsn >= chunk.first_lsn ? skipRecords(chunk.bytes, after_lsn + 1 - chunk.first_lsn) : 0;
+                out->append(chunk.bytes, skip, std::string::npos);
+                *last_lsn = chunk.last_lsn;
+                if(out->size() >= max_bytes){
+                    break;
+                }
+            }
+            return ReadStatus::Ok;
+        }
+    }
+    return readDisk(after_lsn, written_lsn, max_bytes, out, last_lsn);
+}
+
+WriteAheadLog::ReadStatus WriteAheadLog::readDisk(uint64_t after_lsn, uint64_t written_lsn, size_t max_bytes,
+                                                  std::string* out, uint64_t* last_lsn) {
+    if(manifest_ == nullptr){
+        return ReadStatus::NeedFullSync;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        disk_reads_++;
+    }
+    // 从起点不晚于after_lsn的最后一段开始，按顺序数出每条记录的LSN
+    std::vector<AofManifest::IncrInfo> incrs = manifest_->incrs();
+    size_t first = incrs.size();
+    for(size_t i = 0; i < incrs.size(); i++){
+        if(incrs[i].start_lsn != AOF_UNKNOWN_LSN && incrs[i].start_lsn <= after_lsn){
+            first = i;
+        }
+    }
+    if(first == incrs.size()){
+        return ReadStatus::NeedFullSync;
+    }
+    uint64_t lsn = incrs[first].start_lsn;
+    try {
+        for(size_t i = first; i < incrs.size() && out->size() < max_bytes; i++){
+            if(incrs[i].start_lsn != AOF_UNKNOWN_LSN && incrs[i].start_lsn != lsn){
+                return ReadStatus::NeedFullSync;
+            }
+            AofReader(incrs[i].path).readRecords([&](const char* record, size_t size) {
+                if(++lsn > after_lsn){
+                    out->append(record, size);
+                    *last_lsn = lsn;
+                }
+                return out->size() < max_bytes;
+            });
+        }
+    } catch (const std::exception& e) {
+        // 读取期间段被重写删除
+        LOG_WARN("Failed to read AOF segment for replication: " + std::string(e.what()));
+        out->clear();
+        *last_lsn = after_lsn;
+        return ReadStatus::NeedFullSync;
+    }
+    return *last_lsn > after_lsn || after_lsn >= written_lsn ? ReadStatus::Ok : ReadStatus::NeedFullSync;
+}
+
+bool WriteAheadLog::waitFor(uint64_t after_lsn, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return written_cv_.wait_for(lock, timeout, [&]() { return written_lsn_ > after_lsn; });
+}
+
+WriteAheadLog::Stats WriteAheadLog::getStats() const {
+    Stats stats;
+    stats.last_lsn = lastLsn();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats.written_lsn = written_lsn_;
+        stats.backlog_first_lsn = backlog_.empty() ? 0 : backlog_.front().first_lsn;
+        stats.backlog_bytes = backlog_bytes_;
+        stats.disk_reads = disk_reads_;
+    }
+    if(manifest_ != nullptr){
+        for(const auto& incr : manifest_->incrs()){
+            if(incr.start_lsn != AOF_UNKNOWN_LSN){
+                stats.disk_first_lsn = incr.start_lsn + 1;
+                break;
+            }
+        }
+    }
+    return stats;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include "aof_format.h"
+#include "aof_manifest.h"
+#include "aof_writer.h"
+
+// AOF与复制共用的预写日志
+//
+// 每次写命令只编码一次AOF记录（见aof_format.h）并分配一个LSN：第N条写入的LSN为N，
+// 跨重启连续。开启AOF时记录交给AofWriter写出，复制读取的是写线程写出的同一份字节；
+// 没有AOF时由这里分配LSN。
+//
+// 最近写出的记录按LSN顺序保存在内存backlog中（总大小不超过backlog_size，小块合并到
+// 64KB），从节点按"已收到的最后一个LSN"读取之后的字节。已经不在backlog中的LSN从
+// 磁盘上的AOF增量段读取：manifest记录了每段第一条记录之前的LSN，跳过段内之前的记录
+// 即可续传。base由重写产生，不能按LSN定位，LSN只存在于base中、段已被重写删除，
+// 或manifest是旧格式时，只能全量同步。
+class WriteAheadLog {
+public:
+    enum class ReadStatus {
+        Ok,            // 读到了after_lsn之后的记录（已追上时为空）
+        NeedFullSync   // after_lsn之后的记录已不可得，或从节点领先于本节点
+    };
+
+    struct Stats {
+        uint64_t last_lsn = 0;           // 已分配的最大LSN
+        uint64_t written_lsn = 0;        // 可读取的最大LSN
+        uint64_t backlog_first_lsn = 0;  // backlog中第一条记录的LSN，backlog为空时为0
+        uint64_t backlog_bytes = 0;
+        uint64_t disk_first_lsn = 0;     // 磁盘增量段中可续传的第一条记录的LSN，没有时为0
+        uint64_t disk_reads = 0;         // 从磁盘读取的次数
+    };
+
+    WriteAheadLog() = default;
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // backlog的字节上限，0表示不在内存中保留；在open之前设置
+    void setBacklogSize(uint64_t bytes) { backlog_size_ = bytes; }
+
+    // 从manifest恢复最后一个LSN（AOF重放之后调用），manifest为空表示没有AOF
+    void open(AofManifest* manifest);
+    uint64_t lastLsn() const;
+
+    // 开启AOF：此后的记录由writer分配LSN并写出，writer的写出回调应转发给onWritten()。
+    // writer以lastLsn()打开
+    void attachWriter(AofWriter* writer);
+
+    // 编码并追加一条记录，返回它的LSN
+    uint64_t append(AofOp op, int32_t key, const char* value = nullptr, size_t length = 0);
+
+    // AofWriter写出一批记录后调用（写线程）
+    void onWritten(uint64_t last_lsn, const std::string& bytes);
+
+    // 读取LSN大于after_lsn的记录，最多约max_bytes字节（至少一条），last_lsn为读到的
+    // 最后一条记录的LSN
+    ReadStatus read(uint64_t after_lsn, size_t max_bytes, std::string* out, uint64_t* last_lsn);
+
+    // 等待出现LSN大于after_lsn的可读记录，超时返回false
+    bool waitFor(uint64_t after_lsn, std::chrono::milliseconds timeout);
+
+    Stats getStats() const;
+
+private:
+    struct Chunk {
+        uint64_t first_lsn;
+        uint64_t last_lsn;
+        std::string bytes;
+    };
+
+    // 把LSN为[first_lsn, last_lsn]的记录加入backlog，调用方持有mutex_
+    void pushLocked(uint64_t first_lsn, uint64_t last_lsn, const char* data, size_t size);
+    ReadStatus readDisk(uint64_t after_lsn, uint64_t written_lsn, size_t max_bytes, std::string* out, uint64_t* last_lsn);
+
+    AofManifest* manifest_ = nullptr;
+    AofWriter* writer_ = nullptr;
+    uint64_t backlog_size_ = 1 << 20;
+
+    mutable std::mutex mutex_;
+    std::condition_variable written_cv_;
+    uint64_t next_lsn_ = 0;     // 没有writer时最后分配的LSN
+    uint64_t written_lsn_ = 0;  // 进入backlog（或写出）的最后一个LSN
+    std::deque<Chunk> backlog_;
+    uint64_t backlog_bytes_ = 0;
+    uint64_t disk_reads_ = 0;
+};
@@ -5,6 +5,13 @@
 #include <chrono>
 #include <thread>
 
+namespace {
+// 每次从预写日志读取的最大字节数
+const size_t WAL_READ_BYTES = 1024 * 1024;
+// 部分同步一次回复的最大字节数，超出部分由从节点接着请求
+const size_t WAL_SYNC_BYTES = 16 * 1024 * 1024;
+}
+
 ReplicationManager::ReplicationManager()
     : role_(ReplicationRole::UNKNOWN)
     , state_(ReplicationState::DISCONNECTED)
@@ -61,6 +68,11 @@ bool ReplicationManager::startReplication() {
             return false;
         }
         
+        // 只发送此后写入的记录，之前的数据由从节点同步请求按LSN补齐
+        if (wal_) {
+            shipped_lsn_ = wal_->getStats().written_lsn;
+        }
+        
         // 启动主节点线程
         master_thread_ = std::thread(&ReplicationManager::masterLoop, this);
         ping_thread_ = std::thread(&ReplicationManager::pingSlaves, this);
@@ -192,6 +204,39 @@ void ReplicationManager::replicateCommand(const std::string& command) {
     }
 }
 
+int64_t ReplicationManager::getReplicationOffset() const {
+    if (wal_ && isMaster()) {
+        return static_cast<int64_t>(wal_->lastLsn());
+    }
+    return replication_offset_;
+}
+
+size_t ReplicationManager::applyReplicationStream(const std::string& data) {
+    if (!isSlave()) {
+        std::cerr << "Only slave can apply replication stream" << std::endl;
+        return 0;
+    }
+    
+    size_t pos = 0;
+    while (pos < data.size()) {
+        AofOp op;
+        int32_t key;
+        const char* value;
+        size_t length;
+        size_t size = decodeAofRecord(data.data() + pos, data.size() - pos, &op, &key, &value, &length);
+        if (size == 0) {
+            break;
+        }
+        if (record_handler_) {
+            record_handler_(op, key, value, length);
+        }
+        pos += size;
+        // 每条记录一个LSN
+        replication_offset_++;
+    }
+    return pos;
+}
+
 void ReplicationManager::applyReplicationCommand(const std::string& command) {
     if (!isSlave()) {
         std::cerr << "Only slave can apply replication commands" << std::endl;
@@ -261,6 +306,33 @@ void ReplicationManager::handleNewSlaveConnections() {
 }
 
 void ReplicationManager::processReplicationQueue() {
+    // 预写日志：把已写出的新记录原样发给从节点
+    if (wal_) {
+        std::string data;
+        uint64_t last_lsn;
+        while (true) {
+            auto status = wal_->read(shipped_lsn_, WAL_READ_BYTES, &data, &last_lsn);
+            if (status == WriteAheadLog::ReadStatus::NeedFullSync) {
+                // 主循环落后太多，backlog和磁盘上都没有了：从节点只能全量同步
+                LOG_WARNF("Write-ahead log no longer has LSN {}, slaves need a full resync", shipped_lsn_ + 1);
+                std::lock_guard<std::mutex> lock(slaves_mutex_);
+                for (auto& slave : slaves_) {
+                    if (slave->is_online) {
+                        slave->state = ReplicationState::SYNCING;
+                    }
+                }
+                shipped_lsn_ = wal_->getStats().written_lsn;
+                break;
+            }
+            if (data.empty()) {
+                break;
+            }
+            streamToSlaves(data, last_lsn);
+            shipped_lsn_ = last_lsn;
+        }
+        return;
+    }
+    
     // 处理复制日志队列中的命令
     std::lock_guard<std::mutex> lock(replication_log_mutex_);
     
@@ -292,12 +364,13 @@ void ReplicationManager::updateSlaveStats() {
     
     int online_slaves = 0;
     int64_t total_lag = 0;
+    int64_t master_offset = getReplicationOffset();
     
     for (const auto& slave : slaves_) {
         if (slave->is_online) {
             online_slaves++;
             // 计算复制延迟
-            int64_t lag = replication_offset_ - slave->replication_offset;
+            int64_t lag = master_offset - slave->replication_offset;
             total_lag += lag;
         }
     }
@@ -371,10 +444,11 @@ void ReplicationManager::handleSlaveConnection(std::shared_ptr<ClientConnection>
         // 4. 更新从节点状态
         slave_info->state = ReplicationState::CONNECTED;
         slave_info->is_online = true;
+        slave_info->connection = client;
         slave_info->last_ping = std::chrono::system_clock::now();
         
         // 5. 发送握手响应
-        std::string response = "MASTER:OK:" + std::to_string(replication_offset_);
+        std::string response = "MASTER:OK:" + std::to_string(getReplicationOffset());
         if (!client->send(response)) {
             std::cerr << "Failed to send handshake response to slave" << std::endl;
             slave_info->is_online = false;
@@ -385,7 +459,7 @@ void ReplicationManager::handleSlaveConnection(std::shared_ptr<ClientConnection>
         std::cout << "Slave " << slave_info->id << " connected successfully" << std::endl;
         
         // 6. 开始同步数据（如果有需要）
-        if (slave_info->replication_offset < replication_offset_) {
+        if (slave_info->replication_offset < getReplicationOffset()) {
             slave_info->state = ReplicationState::SYNCING;
             std::cout << "Starting sync with slave " << slave_info->id << std::endl;
             
@@ -437,7 +511,7 @@ std::string ReplicationManager::handleReplicationMessage(const std::string& mess
     if (message.find("SLAVE_CONNECT") == 0) {
         // 从节点连接请求
         handleSlaveConnection(client);
-        return "MASTER:OK:" + std::to_string(replication_offset_);
+        return "MASTER:OK:" + std::to_string(getReplicationOffset());
         
     } else if (message.find("PING") == 0) {
         // 从节点心跳
@@ -497,6 +571,24 @@ void ReplicationManager::updateSlavePing(const std::string& slave_id) {
 
 std::string ReplicationManager::handleSyncRequest(std::shared_ptr<ClientConnection> client, 
                                                  int64_t slave_offset) {
+    // 预写日志：从节点的偏移量即它应用的最后一个LSN，之后的记录还在backlog或磁盘
+    // 增量段中时部分同步，否则要求全量同步
+    if (wal_) {
+        std::string data;
+        uint64_t last_lsn = 0;
+        auto status = slave_offset < 0 ? WriteAheadLog::ReadStatus::NeedFullSync
+                                       : wal_->read(static_cast<uint64_t>(slave_offset), WAL_SYNC_BYTES, &data, &last_lsn);
+        if (status == WriteAheadLog::ReadStatus::NeedFullSync) {
+            return "SYNC:FULLRESYNC:" + std::to_string(wal_->getStats().written_lsn);
+        }
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            stats_.total_bytes_replicated += data.size();
+            stats_.last_sync_time = std::chrono::system_clock::now();
+        }
+        return "SYNC:CONTINUE:" + std::to_string(last_lsn) + ":" + data;
+    }
+    
     std::lock_guard<std::mutex> lock(replication_log_mutex_);
     
     // 计算需要同步的命令数量
@@ -692,6 +784,30 @@ void ReplicationManager::replicateToSlaves(const std::string& command) {
     }
 }
 
+void ReplicationManager::streamToSlaves(const std::string& data, uint64_t last_lsn) {
+    {
+        std::lock_guard<std::mutex> lock(slaves_mutex_);
+        for (auto& slave : slaves_) {
+            if (!slave->is_online || slave->state == ReplicationState::SYNCING || !slave->connection) {
+                continue;
+            }
+            // 从节点用applyReplicationStream()应用
+            if (slave->connection->send(data)) {
+                slave->replication_offset = static_cast<int64_t>(last_lsn);
+            } else {
+                std::cout << "Failed to stream write-ahead log to slave: " << slave->id << std::endl;
+                slave->is_online = false;
+                slave->state = ReplicationState::DISCONNECTED;
+                slave->connection.reset();
+            }
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.total_bytes_replicated += data.size();
+    stats_.last_sync_time = std::chrono::system_clock::now();
+}
+
 void ReplicationManager::pingSlaves() {
     std::cout << "Ping slaves loop started" << std::endl;
     
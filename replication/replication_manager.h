@@ -10,6 +10,7 @@
 #include <functional>
 #include "../network/tcp_server.h"
 #include "../logger/logger.h"
+#include "../persistence/write_ahead_log.h"
 
 // 复制角色枚举
 enum class ReplicationRole {
@@ -43,6 +44,8 @@ struct SlaveInfo {
     int64_t replication_offset;
     // 记录从节点是否在线
     bool is_online;
+    // 从节点的复制连接，预写日志经它流式发送
+    std::shared_ptr<ClientConnection> connection;
     
     SlaveInfo(const std::string& h, int p) 
         : host(h), port(p), state(ReplicationState::CONNECTING), 
@@ -104,8 +107,12 @@ public:
     // 应用复制命令（从节点使用）
     void applyReplicationCommand(const std::string& command);
     
-    // 获取复制偏移量
-    int64_t getReplicationOffset() const { return replication_offset_; }
+    // 应用主节点发来的预写日志字节（从节点使用）：逐条交给记录处理器，复制偏移量即
+    // 最后应用的LSN。返回消费的字节数，末尾不完整的记录留给调用方与后续数据拼接
+    size_t applyReplicationStream(const std::string& data);
+    
+    // 获取复制偏移量：设置了预写日志的主节点为它的最后一个LSN
+    int64_t getReplicationOffset() const;
     
     // 设置复制偏移量
     void setReplicationOffset(int64_t offset) { replication_offset_ = offset; }
@@ -124,6 +131,13 @@ public:
         command_handler_ = handler;
     }
     
+    // 主节点从预写日志读取发往从节点的记录，不再单独格式化命令
+    void setWriteAheadLog(WriteAheadLog* wal) { wal_ = wal; }
+    
+    // 从节点收到的每条记录交给该回调应用
+    using RecordHandler = std::function<void(AofOp op, int32_t key, const char* value, size_t length)>;
+    void setRecordHandler(RecordHandler handler) { record_handler_ = std::move(handler); }
+    
     // 获取复制统计信息
     struct ReplicationStats {
         int64_t total_commands_replicated = 0;
@@ -149,6 +163,7 @@ private:
     std::string handleSyncRequest(std::shared_ptr<ClientConnection> client, int64_t slave_offset);
     void updateSlaveOffset(const std::string& slave_id, int64_t offset);
     void replicateToSlaves(const std::string& command);
+    void streamToSlaves(const std::string& data, uint64_t last_lsn);
     void pingSlaves();
     void cleanupDeadSlaves();
     
@@ -200,6 +215,11 @@ private:
     // 命令处理器回调
     std::function<void(const std::string&)> command_handler_;
     
+    // 预写日志：主节点已发给从节点的最后一个LSN
+    WriteAheadLog* wal_ = nullptr;
+    uint64_t shipped_lsn_ = 0;
+    RecordHandler record_handler_;
+    
     // 配置
     // 主节点监听端口
     int replication_port_;
@@ -1,10 +1,33 @@
 #include "redis_handler.h"
 #include "../logger/logger.h"
 #include "../config/config.h"
+#include "../include/exceptions.h"
+#include "../utils/utils.h"
 #include <sstream>
 #include <algorithm>
 #include <chrono>
 #include <fstream>
+#include <iomanip>
+#include <deque>
+#include <condition_variable>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+// AOF重放时一批折叠的最大key数
+static const size_t AOF_REPLAY_BATCH = 1 << 18;
+// 重放流水线中已折叠、等待写入存储的批数
+static const size_t AOF_REPLAY_QUEUE = 2;
+// AOF写出失败期间拒绝写命令的错误
+static const char* const AOF_MISCONF_ERROR =
+    "MISCONF Errors writing to the AOF file, write commands are disabled until it recovers";
+
+// 当前线程正在执行的一批流水线请求，lsn为其中需要等待落盘的最大LSN
+struct WriteBatch {
+    bool active = false;
+    uint64_t lsn = 0;
+};
+static thread_local WriteBatch write_batch;
 
 RedisHandler::RedisHandler()
     : current_db_(0)
@@ -13,43 +36,222 @@ RedisHandler::RedisHandler()
 }
 
 RedisHandler::~RedisHandler() {
+    waitLoading();
+    if (active_defrag_) {
+        active_defrag_->stop();
+    }
+    // 值日志GC线程会访问跳表，先于跳表停止
+    if (value_log_) {
+        value_log_->close();
+    }
+    if (lsm_store_) {
+        lsm_store_->close();
+    }
 }
 
-void RedisHandler::init(int max_level) {
+void RedisHandler::init(int max_level, bool background_load) {
     skiplist_ = std::make_unique<SkipList<int, std::string>>(max_level);
     registerCommands();
     
+    // 选择持久化的文件I/O后端（io_uring或线程池），之后的快照和AOF写出都经过它
+    const auto& skiplist_config = Config::getInstance().getSkipListConfig();
+    AsyncFile::configure(skiplist_config.persistence_io_backend, skiplist_config.persistence_io_threads);
+    LOG_INFOF("Persistence I/O backend: {}", AsyncFile::backendName());
+    io_throttle_.configure(static_cast<uint64_t>(std::max(0, skiplist_config.persistence_io_rate_mb)) << 20,
+                           static_cast<uint64_t>(std::max(1, skiplist_config.persistence_io_burst_mb)) << 20,
+                           skiplist_config.persistence_io_adaptive,
+                           static_cast<uint64_t>(std::max(0, skiplist_config.persistence_io_fsync_target_ms)) * 1000);
+    
+    // 启动惰性释放线程
+    lazy_free_ = skiplist_config.lazy_free;
+    skiplist_->set_lazy_free(lazy_free_);
+    snapshot_compression_ = std::max(0, std::min(skiplist_config.snapshot_compression, LZ_MAX_LEVEL));
+    skiplist_->set_snapshot_compression(snapshot_compression_);
+    if (lazy_free_) {
+        LazyFreer<int, std::string>::getInstance().start(skiplist_config.lazy_free_threads,
+                                                         skiplist_config.lazy_free_chunk);
+    }
+    
     // 加载AOF配置
     const auto& aof_config = Config::getInstance().getAOFConfig();
     aof_enabled_ = aof_config.enable_aof;
     aof_file_ = aof_config.aof_file;
     aof_fsync_ = aof_config.aof_fsync;
     aof_fsync_interval_ = aof_config.aof_fsync_interval;
-    last_aof_fsync_ = std::chrono::system_clock::now();
+    aof_rewrite_percentage_ = aof_config.aof_rewrite_percentage;
+    aof_rewrite_min_size_ = static_cast<uint64_t>(std::max(0, aof_config.aof_rewrite_min_size));
+    aof_use_preamble_ = aof_config.aof_use_preamble;
+    aof_segment_size_ = static_cast<uint64_t>(std::max(0, aof_config.aof_segment_size));
+    wal_.setBacklogSize(static_cast<uint64_t>(std::max(0, aof_config.wal_backlog_size)));
     
-    // 打开AOF文件
+    // 读取多段AOF的manifest，升级前的单文件AOF成为base（旧的文本格式先转换为二进制）
     if (aof_enabled_) {
-        aof_stream_.open(aof_file_, std::ios::app);
-        if (!aof_stream_.is_open()) {
-            LOG_ERROR("Failed to open AOF file: " + aof_file_);
+        try {
+            aof_manifest_ = std::make_unique<AofManifest>(aof_file_);
+            uint64_t converted = aof_manifest_->open();
+            if (converted > 0) {
+                LOG_INFOF("Converted text AOF {} to binary format ({} records)", aof_file_, converted);
+            }
+        } catch (const std::exception& e) {
+            LOG_ERROR("Failed to open AOF manifest " + aof_file_ + ".manifest: " + e.what());
+            aof_manifest_.reset();
             aof_enabled_ = false;
         }
     }
     
-    // 加载AOF
-    if (aof_enabled_) {
-        loadAOF();
-    }
-    
-    // 加载现有数据
-    loadData();
-    
     // 初始化复制管理器
     initReplication();
     
+    if (background_load) {
+        // 先开始监听，数据在后台加载，期间命令按loading_状态处理
+        loading_ = true;
+        loading_thread_ = std::thread([this, max_level]() {
+            try {
+                loadDataset(max_level);
+            } catch (const std::exception& e) {
+                // 与同步加载失败时一样以状态1退出：不能走正常的关闭流程，否则会把加载了一部分的
+                // 数据保存回快照
+                LOG_ERROR("Failed to load dataset: " + std::string(e.what()));
+                std::_Exit(EXIT_FAILURE);
+            }
+        });
+    } else {
+        loadDataset(max_level);
+    }
+    
     LOG_INFO("Redis handler initialized with max level: " + std::to_string(max_level));
 }
 
+void RedisHandler::waitLoading() {
+    if (loading_thread_.joinable()) {
+        loading_thread_.join();
+    }
+}
+
+void RedisHandler::loadDataset(int max_level) {
+    const auto& skiplist_config = Config::getInstance().getSkipListConfig();
+    auto begin = std::chrono::steady_clock::now();
+    loading_start_time_ = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    loading_start_ms_ = std::chrono::duration_cast<std::chrono::milliseconds>(begin.time_since_epoch()).count();
+    loading_loaded_bytes_ = 0;
+    loading_loaded_keys_ = 0;
+    uint64_t aof_bytes = aof_enabled_ ? aof_manifest_->totalSize() : 0;
+    
+    // mmap引擎：重新映射文件即完成加载，数据无需再从快照或AOF重建
+    if (skiplist_config.storage_engine == "mmap") {
+        mmap_store_ = std::make_unique<MmapSkipList>(max_level);
+        mmap_store_->open(skiplist_config.mmap_file, skiplist_config.mmap_initial_size);
+        LOG_INFOF("mmap storage engine opened: {} ({} keys{})", skiplist_config.mmap_file,
+                  mmap_store_->size(),
+                  mmap_store_->recovered() ? (mmap_store_->truncated() ? ", recovered and truncated" : ", recovered") : "");
+    } else if (skiplist_config.storage_engine == "lsm") {
+        // lsm引擎：已落盘的有序段由MANIFEST记录，memtable中未落盘的写入由AOF重放恢复
+        LsmStore::Options options;
+        options.dir = skiplist_config.lsm_dir;
+        options.memtable_size = static_cast<size_t>(skiplist_config.lsm_memtable_size);
+        options.memory_limit = static_cast<size_t>(Config::getInstance().getInt("memory_limit", 0));
+        options.block_size = static_cast<size_t>(skiplist_config.lsm_block_size);
+        options.bloom_bits_per_key = skiplist_config.lsm_bloom_bits_per_key;
+        options.compaction_trigger = skiplist_config.lsm_compaction_trigger;
+        options.max_level = max_level;
+        lsm_store_ = std::make_unique<LsmStore>();
+        lsm_store_->open(options);
+        
+        if (aof_enabled_) {
+            loading_total_bytes_ = aof_bytes;
+            loadAOF();
+        }
+    } else {
+        // 键值分离：大value写入值日志，跳表中只保存句柄
+        if (skiplist_config.value_log_enabled) {
+            initValueLog();
+        }
+        
+        // 增量快照：加载前先把残留的增量合并进基础快照
+        if (skiplist_config.snapshot_incremental) {
+            delta_snapshots_ = std::make_unique<DeltaSnapshots>(STORE_FILE, snapshot_compression_);
+            delta_snapshots_->setThrottle(&io_throttle_);
+            snapshot_delta_max_ = skiplist_config.snapshot_delta_max;
+            snapshot_delta_ratio_ = skiplist_config.snapshot_delta_ratio;
+        }
+        
+        // 以快照前导开头的AOF已包含全部数据，只需加载AOF；否则先加载快照，再按时间
+        // 顺序在其上重放AOF
+        bool aof_has_preamble = false;
+        if (aof_enabled_) {
+            try {
+                std::vector<std::string> files = aof_manifest_->files();
+                aof_has_preamble = !files.empty() && AofReader(files.front()).hasPreamble();
+            } catch (const std::exception&) {
+                // 文件损坏时由loadAOF报告
+            }
+        }
+        loading_total_bytes_ = aof_bytes + (aof_has_preamble ? 0 : Utils::getFileSize(STORE_FILE));
+        if (aof_has_preamble) {
+            if (delta_snapshots_) {
+                delta_snapshots_->open();
+            }
+        } else {
+            loadData();
+        }
+        bool loaded_snapshot = !aof_has_preamble && storeSize() > 0;
+        if (aof_enabled_) {
+            loadAOF();
+        }
+        // 快照中的数据尚未进入AOF：重写一次，之后重启只需加载AOF
+        if (aof_enabled_ && aof_use_preamble_ && loaded_snapshot) {
+            aof_rewrite_scheduled_ = true;
+        }
+        
+        // 开启后第一次保存为全量快照，此后只写出变化的key
+        if (delta_snapshots_) {
+            skiplist_->set_dirty_tracking(true);
+        }
+        
+        if (skiplist_config.active_defrag) {
+            ActiveDefrag<int, std::string>::Options defrag_options;
+            defrag_options.ignore_bytes = static_cast<size_t>(skiplist_config.active_defrag_ignore_bytes);
+            defrag_options.threshold_lower = skiplist_config.active_defrag_threshold_lower;
+            defrag_options.threshold_upper = skiplist_config.active_defrag_threshold_upper;
+            defrag_options.cycle_min = skiplist_config.active_defrag_cycle_min;
+            defrag_options.cycle_max = skiplist_config.active_defrag_cycle_max;
+            active_defrag_ = std::make_unique<ActiveDefrag<int, std::string>>(skiplist_.get());
+            active_defrag_->start(defrag_options);
+        }
+    }
+    
+    // 重放完成（可能截掉了写到一半的记录）后再打开AOF并启动写线程，LSN接着已有的记录编号
+    if (aof_enabled_) {
+        try {
+            wal_.open(aof_manifest_.get());
+            aof_writer_.setThrottle(&io_throttle_);
+            aof_writer_.setWrittenCallback([this](uint64_t last_lsn, const std::string& bytes) {
+                wal_.onWritten(last_lsn, bytes);
+            });
+            aof_writer_.open(aof_manifest_.get(), AofWriter::parsePolicy(aof_fsync_), aof_fsync_interval_,
+                             aof_segment_size_, wal_.lastLsn());
+            wal_.attachWriter(&aof_writer_);
+            aof_base_size_ = aof_manifest_->totalSize();
+        } catch (const std::exception& e) {
+            LOG_ERROR("Failed to open AOF segment for " + aof_file_ + ": " + e.what());
+            aof_enabled_ = false;
+        }
+    }
+    if (!aof_enabled_) {
+        wal_.open(nullptr);
+    }
+    LOG_INFOF("Write-ahead log opened at LSN {}", wal_.lastLsn());
+    
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin);
+    loading_loaded_keys_ = static_cast<uint64_t>(storeSize());
+    loading_loaded_bytes_ = loading_total_bytes_.load();
+    loading_last_duration_ms_ = static_cast<uint64_t>(elapsed.count());
+    loading_ready_below_.store(INT64_MAX, std::memory_order_release);
+    loading_.store(false, std::memory_order_release);
+    LOG_INFOF("Dataset loaded: {} keys in {} ms", loading_loaded_keys_.load(), elapsed.count());
+}
+
 std::string RedisHandler::handleCommand(const std::string& request, std::shared_ptr<ClientConnection> client) {
     try {
         RedisCommand cmd = RedisProtocol::parseCommand(request);
@@ -64,6 +266,11 @@ std::string RedisHandler::handleCommand(const std::string& request, std::shared_
             stats_.total_commands++;
         }
         
+        // 后台加载期间只执行不依赖完整数据的命令
+        if (isLoading() && !allowedWhileLoading(cmd)) {
+            return loadingErrorResponse();
+        }
+        
         // 查找命令处理器
         auto it = command_handlers_.find(cmd.command);
         if (it != command_handlers_.end()) {
@@ -77,6 +284,30 @@ std::string RedisHandler::handleCommand(const std::string& request, std::shared_
     }
 }
 
+bool RedisHandler::allowedWhileLoading(const RedisCommand& cmd) {
+    if (cmd.command == "INFO" || cmd.command == "ECHO" || cmd.command == "CONFIG" ||
+        cmd.command == "SELECT" || cmd.command == "AUTH" || cmd.command == "QUIT") {
+        return true;
+    }
+    if ((cmd.command == "GET" || cmd.command == "EXISTS") && cmd.arguments.size() == 1) {
+        int key;
+        return stringToInt(cmd.arguments[0], key) &&
+               key < loading_ready_below_.load(std::memory_order_acquire);
+    }
+    return false;
+}
+
+std::string RedisHandler::loadingErrorResponse() {
+    uint64_t total = loading_total_bytes_;
+    uint64_t loaded = std::min(loading_loaded_bytes_.load(), total);
+    std::ostringstream oss;
+    oss << "LOADING Redis is loading the dataset in memory";
+    if (total > 0) {
+        oss << " (" << std::fixed << std::setprecision(2) << 100.0 * loaded / total << "%)";
+    }
+    return createErrorResponse(oss.str());
+}
+
 void RedisHandler::registerCommands() {
     command_handlers_["PING"] = [this](const std::vector<std::string>& args, std::shared_ptr<ClientConnection> client) {
         return handlePing(args, client);
@@ -114,6 +345,14 @@ void RedisHandler::registerCommands() {
         return handleSave(args, client);
     };
     
+    command_handlers_["BGSAVE"] = [this](const std::vector<std::string>& args, std::shared_ptr<ClientConnection> client) {
+        return handleBgsave(args, client);
+    };
+    
+    command_handlers_["BGREWRITEAOF"] = [this](const std::vector<std::string>& args, std::shared_ptr<ClientConnection> client) {
+        return handleBgrewriteaof(args, client);
+    };
+    
     command_handlers_["LOAD"] = [this](const std::vector<std::string>& args, std::shared_ptr<ClientConnection> client) {
         return handleLoad(args, client);
     };
@@ -167,7 +406,11 @@ std::string RedisHandler::handleSet(const std::vector<std::string>& args, std::s
         return createErrorResponse("ERR key must be an integer");
     }
     
-    int result = skiplist_->insert_element(key, args[1]);
+    if (aofWriteFailing()) {
+        return createErrorResponse(AOF_MISCONF_ERROR);
+    }
+    
+    int result = storeInsert(key, args[1]);
     
     {
         std::lock_guard<std::mutex> lock(stats_mutex_);
@@ -175,13 +418,8 @@ std::string RedisHandler::handleSet(const std::vector<std::string>& args, std::s
     }
     
     if (result == 0) {
-        // 追加AOF
-        appendAOF("SET " + args[0] + " " + args[1]);
-        
-        // 复制命令到从节点
-        if (replication_manager_ && replication_manager_->isMaster()) {
-            replication_manager_->replicateCommand("SET " + args[0] + " " + args[1]);
-        }
+        // 写入预写日志，AOF和从节点都从这里读取
+        appendWAL(AofOp::Set, key, args[1]);
         
         return RedisProtocol::createSimpleString("OK");
     } else {
@@ -199,7 +437,8 @@ std::string RedisHandler::handleGet(const std::vector<std::string>& args, std::s
         return createErrorResponse("ERR key must be an integer");
     }
     
-    bool exists = skiplist_->search_element(key);
+    std::string value;
+    bool exists = storeGet(key, &value);
     
     {
         std::lock_guard<std::mutex> lock(stats_mutex_);
@@ -207,8 +446,7 @@ std::string RedisHandler::handleGet(const std::vector<std::string>& args, std::s
     }
     
     if (exists) {
-        // 注意：这里简化了实现，实际应该返回存储的值
-        return RedisProtocol::createBulkString("value_for_key_" + args[0]);
+        return RedisProtocol::createBulkString(value);
     } else {
         return RedisProtocol::createNullBulkString();
     }
@@ -224,20 +462,19 @@ std::string RedisHandler::handleDel(const std::vector<std::string>& args, std::s
         return createErrorResponse("ERR key must be an integer");
     }
     
-    skiplist_->delete_element(key);
+    if (aofWriteFailing()) {
+        return createErrorResponse(AOF_MISCONF_ERROR);
+    }
+    
+    storeDelete(key);
     
     {
         std::lock_guard<std::mutex> lock(stats_mutex_);
         stats_.del_commands++;
     }
     
-    // 追加AOF
-    appendAOF("DEL " + args[0]);
-    
-    // 复制命令到从节点
-    if (replication_manager_ && replication_manager_->isMaster()) {
-        replication_manager_->replicateCommand("DEL " + args[0]);
-    }
+    // 写入预写日志
+    appendWAL(AofOp::Del, key);
     
     return RedisProtocol::createInteger(1);
 }
@@ -252,7 +489,7 @@ std::string RedisHandler::handleExists(const std::vector<std::string>& args, std
         return createErrorResponse("ERR key must be an integer");
     }
     
-    bool exists = skiplist_->search_element(key);
+    bool exists = storeSearch(key);
     
     {
         std::lock_guard<std::mutex> lock(stats_mutex_);
@@ -268,26 +505,39 @@ std::string RedisHandler::handleKeys(const std::vector<std::string>& args, std::
 }
 
 std::string RedisHandler::handleFlush(const std::vector<std::string>& args, std::shared_ptr<ClientConnection> client) {
-    // 清空跳表
-    // 注意：这里需要实现清空功能
+    // 清空跳表，可选参数ASYNC/SYNC覆盖lazy_free配置
+    bool lazy = lazy_free_;
+    if (!args.empty()) {
+        std::string mode = args[0];
+        std::transform(mode.begin(), mode.end(), mode.begin(), ::toupper);
+        if (mode == "ASYNC") {
+            lazy = true;
+        } else if (mode == "SYNC") {
+            lazy = false;
+        } else {
+            return createErrorResponse("ERR syntax error");
+        }
+    }
+    if (aofWriteFailing()) {
+        return createErrorResponse(AOF_MISCONF_ERROR);
+    }
+    storeFlush(lazy);
     
     {
         std::lock_guard<std::mutex> lock(stats_mutex_);
         stats_.flush_commands++;
     }
     
-    // 追加AOF
-    appendAOF("FLUSH");
-    
-    // 复制命令到从节点
-    if (replication_manager_ && replication_manager_->isMaster()) {
-        replication_manager_->replicateCommand("FLUSH");
-    }
+    // 写入预写日志
+    appendWAL(AofOp::Flush);
     
     return RedisProtocol::createSimpleString("OK");
 }
 
 std::string RedisHandler::handleSave(const std::vector<std::string>& args, std::shared_ptr<ClientConnection> client) {
+    if (bgsave_.inProgress()) {
+        return createErrorResponse("ERR Background save already in progress");
+    }
     saveData();
     
     {
@@ -298,6 +548,51 @@ std::string RedisHandler::handleSave(const std::vector<std::string>& args, std::
     return RedisProtocol::createSimpleString("OK");
 }
 
+std::string RedisHandler::handleBgsave(const std::vector<std::string>& /*args*/,
+                                       std::shared_ptr<ClientConnection> /*client*/) {
+    if (aof_rewrite_.inProgress()) {
+        return createErrorResponse("ERR Background append only file rewriting in progress");
+    }
+    try {
+        if (!backgroundSave()) {
+            return createErrorResponse("ERR Background save already in progress");
+        }
+    } catch (const std::exception& e) {
+        return createErrorResponse("ERR " + std::string(e.what()));
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.save_commands++;
+    }
+    
+    return RedisProtocol::createSimpleString("Background saving started");
+}
+
+std::string RedisHandler::handleBgrewriteaof(const std::vector<std::string>& /*args*/,
+                                             std::shared_ptr<ClientConnection> /*client*/) {
+    if (!aof_enabled_) {
+        return createErrorResponse("ERR AOF is not enabled");
+    }
+    if (aof_rewrite_.inProgress()) {
+        return createErrorResponse("ERR Background append only file rewriting already in progress");
+    }
+    // 不同时运行两个fork子进程，等后台保存结束后由checkAOFRewrite启动
+    if (bgsave_.inProgress()) {
+        aof_rewrite_scheduled_ = true;
+        return RedisProtocol::createSimpleString("Background append only file rewriting scheduled");
+    }
+    try {
+        if (!rewriteAOF()) {
+            aof_rewrite_scheduled_ = true;
+            return RedisProtocol::createSimpleString("Background append only file rewriting scheduled");
+        }
+    } catch (const std::exception& e) {
+        return createErrorResponse("ERR " + std::string(e.what()));
+    }
+    return RedisProtocol::createSimpleString("Background append only file rewriting started");
+}
+
 std::string RedisHandler::handleLoad(const std::vector<std::string>& args, std::shared_ptr<ClientConnection> client) {
     loadData();
     
@@ -403,6 +698,8 @@ std::string RedisHandler::getServerInfo() {
     
     auto now = std::chrono::system_clock::now();
     auto time_t = std::chrono::system_clock::to_time_t(now);
+    // 加载线程写入的存储引擎对象在加载结束前不能访问
+    bool loading = isLoading();
     
     oss << "# Server\n";
     oss << "redis_version:1.0.0\n";
@@ -420,8 +717,145 @@ std::string RedisHandler::getServerInfo() {
     oss << "used_memory_peak:" << 0 << "\n";
     oss << "used_memory_peak_human:0B\n";
     oss << "used_memory_lua:0\n";
-    oss << "mem_fragmentation_ratio:0.00\n";
+    auto node_memory = NodeAllocator::getInstance().getStats();
+    oss << "allocator_allocated:" << node_memory.allocated_bytes << "\n";
+    oss << "allocator_active:" << node_memory.active_bytes << "\n";
+    oss << "mem_fragmentation_ratio:" << std::fixed << std::setprecision(2)
+        << NodeAllocator::getInstance().fragmentationRatio() << "\n";
     oss << "mem_allocator:libc\n";
+    oss << "active_defrag_running:" << (!loading && active_defrag_ && active_defrag_->running() ? 1 : 0) << "\n";
+    oss << "lazyfree_pending_objects:" << LazyFreer<int, std::string>::getInstance().pending() << "\n";
+    oss << "lazyfreed_objects:" << LazyFreer<int, std::string>::getInstance().freed() << "\n";
+    const std::string& engine = Config::getInstance().getSkipListConfig().storage_engine;
+    oss << "storage_engine:" << (engine == "mmap" || engine == "lsm" ? engine : "memory") << "\n";
+    if (!loading && mmap_store_) {
+        oss << "mmap_mapped_bytes:" << mmap_store_->mapped_bytes() << "\n";
+        oss << "mmap_used_bytes:" << mmap_store_->used_bytes() << "\n";
+        oss << "mmap_recovered:" << (mmap_store_->recovered() ? 1 : 0) << "\n";
+    }
+    if (!loading && lsm_store_) {
+        auto lsm_stats = lsm_store_->getStats();
+        oss << "lsm_memtable_keys:" << lsm_stats.memtable_keys << "\n";
+        oss << "lsm_memtable_bytes:" << lsm_stats.memtable_bytes << "\n";
+        oss << "lsm_immutable_memtables:" << lsm_stats.immutable_memtables << "\n";
+        oss << "lsm_runs:" << lsm_stats.runs << "\n";
+        oss << "lsm_run_entries:" << lsm_stats.run_entries << "\n";
+        oss << "lsm_run_bytes:" << lsm_stats.run_bytes << "\n";
+        oss << "lsm_flushes:" << lsm_stats.flushes << "\n";
+        oss << "lsm_compactions:" << lsm_stats.compactions << "\n";
+        oss << "lsm_bloom_negatives:" << lsm_stats.bloom_negatives << "\n";
+        oss << "lsm_write_stalls:" << lsm_stats.write_stalls << "\n";
+    }
+    if (!loading && value_log_) {
+        auto vlog_stats = value_log_->getStats();
+        oss << "value_log_segments:" << vlog_stats.segments << "\n";
+        oss << "value_log_bytes:" << vlog_stats.total_bytes << "\n";
+        oss << "value_log_live_bytes:" << vlog_stats.live_bytes << "\n";
+        oss << "value_log_gc_runs:" << vlog_stats.gc_runs << "\n";
+        oss << "value_log_gc_relocated:" << vlog_stats.gc_relocated << "\n";
+        oss << "value_log_gc_reclaimed_bytes:" << vlog_stats.gc_reclaimed_bytes << "\n";
+    }
+    
+    auto bgsave_stats = bgsave_.getStats();
+    oss << "# Persistence\n";
+    oss << "loading:" << (loading ? 1 : 0) << "\n";
+    if (loading) {
+        uint64_t total = loading_total_bytes_;
+        uint64_t loaded = std::min(loading_loaded_bytes_.load(), total);
+        uint64_t keys = loading_loaded_keys_;
+        int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        double seconds = std::max<int64_t>(1, now_ms - loading_start_ms_) / 1000.0;
+        double byte_rate = loaded / seconds;
+        int64_t ready_below = loading_ready_below_.load(std::memory_order_acquire);
+        oss << "loading_start_time:" << loading_start_time_ << "\n";
+        oss << "loading_total_bytes:" << total << "\n";
+        oss << "loading_loaded_bytes:" << loaded << "\n";
+        oss << "loading_loaded_perc:" << (total > 0 ? 100.0 * loaded / total : 0.0) << "\n";
+        oss << "loading_loaded_keys:" << keys << "\n";
+        oss << "loading_rate_bytes_per_sec:" << static_cast<uint64_t>(byte_rate) << "\n";
+        oss << "loading_rate_keys_per_sec:" << static_cast<uint64_t>(keys / seconds) << "\n";
+        // 按目前的平均速率估算，尚未读入任何数据时为-1
+        oss << "loading_eta_seconds:"
+            << (loaded > 0 ? static_cast<int64_t>((total - loaded) / byte_rate) : -1) << "\n";
+        // 可以读取的key范围（小于该值），none表示还没有可读的范围
+        oss << "loading_ready_below:";
+        if (ready_below == INT64_MIN) {
+            oss << "none\n";
+        } else {
+            oss << ready_below << "\n";
+        }
+    } else {
+        oss << "loading_last_time_ms:" << loading_last_duration_ms_ << "\n";
+    }
+    oss << "io_backend:" << AsyncFile::backendName() << "\n";
+    auto throttle_stats = io_throttle_.getStats();
+    oss << "io_throttle_enabled:" << (throttle_stats.enabled ? 1 : 0) << "\n";
+    oss << "io_throttle_adaptive:" << (throttle_stats.adaptive ? 1 : 0) << "\n";
+    oss << "io_throttle_rate:" << throttle_stats.rate << "\n";
+    oss << "io_throttle_current_rate:" << throttle_stats.current_rate << "\n";
+    oss << "io_throttle_bytes:" << throttle_stats.throttled_bytes << "\n";
+    oss << "io_throttle_wait_ms:" << throttle_stats.wait_ms << "\n";
+    oss << "io_throttle_backoffs:" << throttle_stats.backoffs << "\n";
+    oss << "aof_fsync_latency_us:" << throttle_stats.fsync_latency_us << "\n";
+    oss << "aof_enabled:" << (aof_enabled_ ? 1 : 0) << "\n";
+    if (!loading && aof_enabled_) {
+        auto aof_stats = aof_writer_.getStats();
+        oss << "aof_last_lsn:" << aof_stats.last_lsn << "\n";
+        oss << "aof_written_lsn:" << aof_stats.written_lsn << "\n";
+        oss << "aof_durable_lsn:" << aof_stats.durable_lsn << "\n";
+        oss << "aof_write_batches:" << aof_stats.batches << "\n";
+        oss << "aof_fsyncs:" << aof_stats.fsyncs << "\n";
+        oss << "aof_bytes_written:" << aof_stats.bytes_written << "\n";
+        oss << "aof_last_write_status:" << (aof_stats.last_write_ok ? "ok" : "err") << "\n";
+        auto rewrite_stats = aof_rewrite_.getStats();
+        oss << "aof_current_size:" << aof_manifest_->totalSize() << "\n";
+        oss << "aof_base_size:" << aof_base_size_ << "\n";
+        oss << "aof_rewrite_in_progress:" << (rewrite_stats.in_progress ? 1 : 0) << "\n";
+        oss << "aof_rewrite_scheduled:" << (aof_rewrite_scheduled_ ? 1 : 0) << "\n";
+        oss << "aof_last_rewrite_time_ms:" << rewrite_stats.last_duration_ms << "\n";
+        oss << "aof_current_rewrite_time_ms:" << rewrite_stats.current_duration_ms << "\n";
+        oss << "aof_last_bgrewrite_status:" << (aof_last_rewrite_ok_ ? "ok" : "err") << "\n";
+        oss << "aof_last_cow_size:" << rewrite_stats.last_cow_bytes << "\n";
+        oss << "aof_rewrites:" << aof_rewrites_ << "\n";
+        oss << "aof_segments:" << aof_manifest_->segmentCount() << "\n";
+        oss << "aof_current_segment:" << aof_stats.segment_sequence << "\n";
+        oss << "aof_current_segment_size:" << aof_stats.segment_size << "\n";
+        oss << "aof_segment_rotations:" << aof_stats.rotations << "\n";
+    }
+    if (!loading) {
+        auto wal_stats = wal_.getStats();
+        oss << "wal_last_lsn:" << wal_stats.last_lsn << "\n";
+        oss << "wal_written_lsn:" << wal_stats.written_lsn << "\n";
+        oss << "wal_backlog_first_lsn:" << wal_stats.backlog_first_lsn << "\n";
+        oss << "wal_backlog_bytes:" << wal_stats.backlog_bytes << "\n";
+        oss << "wal_disk_first_lsn:" << wal_stats.disk_first_lsn << "\n";
+        oss << "wal_disk_reads:" << wal_stats.disk_reads << "\n";
+    }
+    oss << "rdb_changes_since_last_save:" << (skiplist_ ? skiplist_->dirty_count() : 0) << "\n";
+    oss << "rdb_bgsave_in_progress:" << (bgsave_stats.in_progress ? 1 : 0) << "\n";
+    oss << "rdb_last_save_time:" << bgsave_stats.last_save_time << "\n";
+    oss << "rdb_last_bgsave_status:" << (bgsave_stats.last_status_ok ? "ok" : "err") << "\n";
+    oss << "rdb_last_bgsave_time_ms:" << bgsave_stats.last_duration_ms << "\n";
+    oss << "rdb_current_bgsave_time_ms:" << bgsave_stats.current_duration_ms << "\n";
+    oss << "rdb_current_bgsave_keys_saved:" << bgsave_stats.current_keys_saved << "\n";
+    oss << "rdb_current_bgsave_keys_total:" << bgsave_stats.current_keys_total << "\n";
+    oss << "rdb_current_cow_size:" << bgsave_stats.current_cow_bytes << "\n";
+    oss << "rdb_last_cow_size:" << bgsave_stats.last_cow_bytes << "\n";
+    oss << "rdb_last_cow_pages:" << bgsave_stats.last_cow_pages << "\n";
+    oss << "rdb_bgsaves:" << bgsave_stats.saves << "\n";
+    oss << "rdb_bgsave_failures:" << bgsave_stats.failures << "\n";
+    if (!loading && delta_snapshots_) {
+        auto deltas = delta_snapshots_->deltas();
+        uint64_t delta_bytes = 0;
+        for (const auto& delta : deltas) {
+            delta_bytes += delta.size;
+        }
+        oss << "rdb_delta_files:" << deltas.size() << "\n";
+        oss << "rdb_delta_bytes:" << delta_bytes << "\n";
+        oss << "rdb_delta_saves:" << delta_snapshots_->deltasWritten() << "\n";
+        oss << "rdb_delta_merges:" << delta_snapshots_->consolidations() << "\n";
+    }
     
     // 统计信息
     {
@@ -437,9 +871,14 @@ std::string RedisHandler::getServerInfo() {
         oss << "keyspace_misses:0\n";
         oss << "pubsub_channels:0\n";
         oss << "pubsub_patterns:0\n";
-        oss << "latest_fork_usec:0\n";
+        oss << "latest_fork_usec:" << bgsave_.getStats().latest_fork_usec << "\n";
+        oss << "active_defrag_hits:" << (!loading && active_defrag_ ? active_defrag_->hits() : 0) << "\n";
+        oss << "active_defrag_misses:" << (!loading && active_defrag_ ? active_defrag_->misses() : 0) << "\n";
     }
     
+    oss << "# Keyspace\n";
+    oss << "db0:keys=" << (loading ? static_cast<int64_t>(loading_loaded_keys_) : storeSize()) << "\n";
+    
     return oss.str();
 }
 
@@ -459,60 +898,689 @@ void RedisHandler::resetStats() {
 }
 
 void RedisHandler::saveData() {
+    if (mmap_store_) {
+        mmap_store_->sync();
+        LOG_INFO("mmap store synced to disk");
+        return;
+    }
+    if (lsm_store_) {
+        lsm_store_->checkpoint();
+        LOG_INFO("LSM memtable flushed to disk");
+        return;
+    }
     if (skiplist_) {
-        skiplist_->dump_file();
+        std::lock_guard<std::mutex> lock(snapshot_mutex_);
+        // 与后台保存共用同一个临时文件，先等它结束
+        bgsave_.wait();
+        std::vector<int> dirty_keys;
+        bool dirty_all = skiplist_->take_dirty_keys(dirty_keys);
+        uint64_t sequence = delta_snapshots_ ? delta_snapshots_->nextSequence() : 0;
+        try {
+            skiplist_->dump_file(nullptr, sequence);
+        } catch (...) {
+            skiplist_->restore_dirty(dirty_keys, dirty_all);
+            throw;
+        }
+        if (delta_snapshots_) {
+            DeltaSnapshots::removeDeltasBefore(STORE_FILE, sequence);
+        }
+        bgsave_.recordSave();
         LOG_INFO("Data saved to file");
     }
 }
 
+bool RedisHandler::backgroundSave() {
+    if (mmap_store_ || lsm_store_) {
+        // mmap和lsm引擎的数据已在各自的文件中，保存只是同步脏页或落盘memtable，不需要fork
+        saveData();
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    return startBackgroundSave();
+}
+
+bool RedisHandler::incrementalSave() {
+    if (mmap_store_ || lsm_store_ || !delta_snapshots_) {
+        return backgroundSave();
+    }
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    if (bgsave_.inProgress()) {
+        return false;
+    }
+    // 还没有基础快照，或发生过FLUSH等无法逐个key记录的变化时，保存全量快照
+    std::vector<SkipList<int, std::string>::DirtyEntry> dirty;
+    if (!delta_snapshots_->hasBase() || !skiplist_->take_dirty(dirty)) {
+        return startBackgroundSave();
+    }
+    if (dirty.empty()) {
+        return true;
+    }
+    
+    std::vector<DeltaSnapshots::Entry> entries;
+    entries.reserve(dirty.size());
+    for (auto& entry : dirty) {
+        entries.push_back({entry.key, entry.deleted, std::move(entry.value)});
+    }
+    try {
+        uint64_t sequence = delta_snapshots_->writeDelta(entries);
+        LOG_DEBUGF("Delta snapshot {} written ({} keys)", sequence, entries.size());
+    } catch (...) {
+        std::vector<int> keys;
+        for (const auto& entry : entries) {
+            keys.push_back(entry.key);
+        }
+        skiplist_->restore_dirty(keys, false);
+        throw;
+    }
+    
+    // 增量过多或过大时合并为新的基础快照，只读写文件，不访问跳表
+    auto deltas = delta_snapshots_->deltas();
+    uint64_t delta_bytes = 0;
+    for (const auto& delta : deltas) {
+        delta_bytes += delta.size;
+    }
+    uint64_t base_bytes = Utils::getFileSize(STORE_FILE);
+    if (deltas.size() >= static_cast<size_t>(std::max(1, snapshot_delta_max_)) ||
+        delta_bytes * 100 >= base_bytes * static_cast<uint64_t>(std::max(1, snapshot_delta_ratio_))) {
+        size_t merged = delta_snapshots_->consolidate();
+        LOG_INFOF("Merged {} delta snapshots into {}", merged, STORE_FILE);
+    }
+    bgsave_.recordSave();
+    return true;
+}
+
+bool RedisHandler::startBackgroundSave() {
+    if (bgsave_.inProgress() || aof_rewrite_.inProgress()) {
+        return false;
+    }
+    // 快照包含fork时刻的全部数据，此前记录的脏键不再需要；失败时放回
+    auto dirty_keys = std::make_shared<std::vector<int>>();
+    bool dirty_all = skiplist_->take_dirty_keys(*dirty_keys);
+    uint64_t sequence = delta_snapshots_ ? delta_snapshots_->nextSequence() : 0;
+    // 持有跳表锁fork，子进程看到的是没有写入进行中的一致镜像；值日志的段表同时加共享锁，
+    // 保证fork时没有线程正在修改段表（子进程解析句柄时要读取它）
+    auto with_lock = [this](const std::function<void()>& do_fork) {
+        skiplist_->run_locked([&]() {
+            std::shared_lock<std::shared_mutex> vlog_guard;
+            if (value_log_) {
+                vlog_guard = value_log_->lockSegments();
+            }
+            do_fork();
+        });
+    };
+    auto job = [this, sequence](BackgroundSaver::Progress& progress) {
+        skiplist_->dump_file([&progress](uint64_t keys) {
+            progress.keys_saved = keys;
+            if ((keys & ((1u << 20) - 1)) == 0) {
+                progress.cow_bytes = BackgroundSaver::privateDirtyBytes();
+            }
+        }, sequence, &io_throttle_);
+        if (sequence > 0) {
+            DeltaSnapshots::removeDeltasBefore(STORE_FILE, sequence);
+        }
+        return true;
+    };
+    auto on_done = [this, dirty_keys, dirty_all](bool ok) {
+        if (!ok) {
+            skiplist_->restore_dirty(*dirty_keys, dirty_all);
+        }
+    };
+    bool started = false;
+    try {
+        started = bgsave_.start(with_lock, job, static_cast<uint64_t>(skiplist_->size()), on_done);
+    } catch (...) {
+        skiplist_->restore_dirty(*dirty_keys, dirty_all);
+        throw;
+    }
+    if (!started) {
+        skiplist_->restore_dirty(*dirty_keys, dirty_all);
+    }
+    return started;
+}
+
 void RedisHandler::loadData() {
+    if (mmap_store_ || lsm_store_) {
+        // mmap和lsm引擎的数据始终在各自的文件中
+        return;
+    }
     if (skiplist_) {
-        skiplist_->load_file();
+        if (delta_snapshots_) {
+            std::lock_guard<std::mutex> lock(snapshot_mutex_);
+            bgsave_.wait();
+            delta_snapshots_->open();
+            size_t merged = delta_snapshots_->consolidate();
+            if (merged > 0) {
+                LOG_INFOF("Merged {} delta snapshots into {} before loading", merged, STORE_FILE);
+            }
+        }
+        const auto& config = Config::getInstance().getSkipListConfig();
+        // 后台加载时按key顺序分批接入；之后没有AOF重放时，已接入的key范围可以读取
+        SkipList<int, std::string>::LoadProgress progress;
+        if (loading_) {
+            bool publish_range = !aof_enabled_;
+            progress = [this, publish_range](const SnapshotReader& reader, size_t blocks_done) {
+                reportSnapshotProgress(reader, blocks_done, 0, publish_range);
+            };
+        }
+        skiplist_->load_file(config.snapshot_load_threads, config.snapshot_load_mmap, progress);
         LOG_INFO("Data loaded from file");
     }
 }
 
+void RedisHandler::reportSnapshotProgress(const SnapshotReader& reader, size_t blocks_done, uint64_t base_bytes,
+                                          bool publish_range) {
+    loading_loaded_bytes_ = base_bytes + reader.blockEnd(blocks_done - 1);
+    loading_loaded_keys_ = static_cast<uint64_t>(skiplist_->size());
+    if (publish_range) {
+        // 块按key递增，下一块首key之前的key都已接入跳表
+        int64_t ready_below = blocks_done < reader.blockCount() ? reader.blockFirstKey(blocks_done) : INT64_MAX;
+        loading_ready_below_.store(ready_below, std::memory_order_release);
+    }
+}
+
+void RedisHandler::initValueLog() {
+    const auto& skiplist_config = Config::getInstance().getSkipListConfig();
+    value_log_ = std::make_unique<ValueLog>();
+    value_log_->open(skiplist_config.value_log_dir, skiplist_config.value_log_threshold,
+                     skiplist_config.value_log_segment_size);
+    
+    // 快照中保存完整value，加载时重新分离，保存时还原
+    skiplist_->set_value_codec(
+        [this](const int& key, const std::string& value) { return value_log_->encode(key, value); },
+        [this](const std::string& stored) {
+            std::string value;
+            if (!value_log_->decode(stored, &value)) {
+                throw skiplist::StorageException("failed to read value log record");
+            }
+            return value;
+        });
+    
+    value_log_->startGC(
+        [this](int key, const std::string& handle) {
+            std::string current;
+            return skiplist_->get_element(key, &current) && current == handle;
+        },
+        [this](int key, const std::string& old_handle, const std::string& new_handle) {
+            return skiplist_->compare_and_set(key, old_handle, new_handle);
+        },
+        skiplist_config.value_log_gc_ratio, skiplist_config.value_log_gc_interval);
+    
+    LOG_INFOF("Value log enabled: {} (threshold {} bytes)", skiplist_config.value_log_dir,
+              skiplist_config.value_log_threshold);
+}
+
+int RedisHandler::storeInsert(int key, const std::string& value) {
+    if (mmap_store_) {
+        return mmap_store_->insert_element(key, value);
+    }
+    if (lsm_store_) {
+        return lsm_store_->insert_element(key, value);
+    }
+    if (value_log_) {
+        std::string stored = value_log_->encode(key, value);
+        int result = skiplist_->insert_element(key, stored);
+        if (result != 0) {
+            value_log_->release(stored);
+        }
+        return result;
+    }
+    return skiplist_->insert_element(key, value);
+}
+
+bool RedisHandler::storeSearch(int key) {
+    if (mmap_store_) {
+        return mmap_store_->search_element(key);
+    }
+    if (lsm_store_) {
+        return lsm_store_->search_element(key);
+    }
+    return skiplist_->search_element(key);
+}
+
+bool RedisHandler::storeGet(int key, std::string* value) {
+    if (mmap_store_) {
+        return mmap_store_->get_element(key, value);
+    }
+    if (lsm_store_) {
+        return lsm_store_->get_element(key, value);
+    }
+    if (!value_log_) {
+        return skiplist_->get_element(key, value);
+    }
+    // 句柄所在段可能刚被GC回收，重新读取一次句柄即可拿到迁移后的位置
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        std::string stored;
+        if (!skiplist_->get_element(key, &stored)) {
+            return false;
+        }
+        if (value_log_->decode(stored, value)) {
+            return true;
+        }
+    }
+    throw skiplist::StorageException("failed to read value log record for key " + std::to_string(key));
+}
+
+void RedisHandler::storeDelete(int key) {
+    if (mmap_store_) {
+        mmap_store_->delete_element(key);
+        return;
+    }
+    if (lsm_store_) {
+        lsm_store_->delete_element(key);
+        return;
+    }
+    if (value_log_) {
+        std::string stored;
+        if (skiplist_->get_element(key, &stored)) {
+            skiplist_->delete_element(key);
+            value_log_->release(stored);
+        }
+        return;
+    }
+    skiplist_->delete_element(key);
+}
+
+void RedisHandler::storeFlush(bool lazy) {
+    if (mmap_store_) {
+        mmap_store_->flush();
+        return;
+    }
+    if (lsm_store_) {
+        lsm_store_->flush();
+        return;
+    }
+    skiplist_->flush(lazy);
+    if (value_log_) {
+        value_log_->markAllGarbage();
+    }
+}
+
+int RedisHandler::storeSize() {
+    if (mmap_store_) {
+        return mmap_store_->size();
+    }
+    if (lsm_store_) {
+        return lsm_store_->size();
+    }
+    return skiplist_->size();
+}
+
 bool RedisHandler::isAOFEnabled() const {
     return aof_enabled_;
 }
 
-void RedisHandler::appendAOF(const std::string& cmdline) {
-    if (!aof_enabled_) return;
-    std::lock_guard<std::mutex> lock(aof_mutex_);
-    aof_stream_ << cmdline << "\n";
-    if (aof_fsync_ == "always") {
-        aof_stream_.flush();
-    } else if (aof_fsync_ == "everysec") {
-        auto now = std::chrono::system_clock::now();
-        if (std::chrono::duration_cast<std::chrono::seconds>(now - last_aof_fsync_).count() >= aof_fsync_interval_) {
-            aof_stream_.flush();
-            last_aof_fsync_ = now;
+void RedisHandler::appendWAL(AofOp op, int key, const std::string& value) {
+    uint64_t lsn = wal_.append(op, key, value.data(), value.size());
+    // always：回复客户端之前等待本条记录所在的批次fdatasync完成，写线程出错时会一直重试；
+    // 流水线批处理中同一线程的LSN递增，只记下最后一条，批末统一等待
+    if (aof_enabled_ && aof_writer_.policy() == AofWriter::FsyncPolicy::Always) {
+        if (write_batch.active) {
+            write_batch.lsn = lsn;
+        } else {
+            aof_writer_.waitDurable(lsn);
         }
     }
 }
 
+void RedisHandler::beginWriteBatch() {
+    write_batch.active = true;
+    write_batch.lsn = 0;
+}
+
+void RedisHandler::finishWriteBatch() {
+    write_batch.active = false;
+    if (write_batch.lsn > 0) {
+        aof_writer_.waitDurable(write_batch.lsn);
+        write_batch.lsn = 0;
+    }
+}
+
+bool RedisHandler::aofWriteFailing() const {
+    return aof_enabled_ && aof_writer_.failing();
+}
+
 void RedisHandler::flushAOF() {
     if (!aof_enabled_) return;
-    std::lock_guard<std::mutex> lock(aof_mutex_);
-    aof_stream_.flush();
+    aof_writer_.flush();
 }
 
-void RedisHandler::reopenAOF() {
-    if (!aof_enabled_) return;
-    std::lock_guard<std::mutex> lock(aof_mutex_);
-    if (aof_stream_.is_open()) aof_stream_.close();
-    aof_stream_.open(aof_file_, std::ios::app);
+bool RedisHandler::rewriteAOF() {
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    return startAOFRewrite();
+}
+
+void RedisHandler::checkAOFRewrite() {
+    if (!aof_enabled_ || aof_rewrite_.inProgress() || bgsave_.inProgress()) {
+        return;
+    }
+    if (aof_rewrite_scheduled_.exchange(false)) {
+        if (!rewriteAOF()) {
+            aof_rewrite_scheduled_ = true;
+        }
+        return;
+    }
+    if (aof_rewrite_percentage_ <= 0) {
+        return;
+    }
+    uint64_t size = aof_manifest_->totalSize();
+    uint64_t base = std::max<uint64_t>(aof_base_size_, 1);
+    if (size < aof_rewrite_min_size_ || size <= base) {
+        return;
+    }
+    uint64_t growth = (size - base) * 100 / base;
+    if (growth >= static_cast<uint64_t>(aof_rewrite_percentage_)) {
+        LOG_INFOF("Starting automatic AOF rewrite on {}% growth ({} bytes)", growth, size);
+        rewriteAOF();
+    }
+}
+
+bool RedisHandler::startAOFRewrite() {
+    if (aof_rewrite_.inProgress() || bgsave_.inProgress()) {
+        return false;
+    }
+    std::string temp_path = aof_file_ + ".rewrite.tmp";
+    if (mmap_store_ || lsm_store_) {
+        // 数据已在各自的文件中：先滚动到新段再落盘，AOF只需保留新段，不需要base
+        aof_writer_.beginRewrite();
+        try {
+            saveData();
+        } catch (...) {
+            aof_writer_.abortRewrite();
+            throw;
+        }
+        finishAOFRewrite(std::string(), true);
+        return true;
+    }
+    
+    // 与BGSAVE相同，持有跳表锁fork；同时请求滚动，此后的写入都进入新段
+    auto with_lock = [this](const std::function<void()>& do_fork) {
+        skiplist_->run_locked([&]() {
+            std::shared_lock<std::shared_mutex> vlog_guard;
+            if (value_log_) {
+                vlog_guard = value_log_->lockSegments();
+            }
+            aof_writer_.beginRewrite();
+            do_fork();
+        });
+    };
+    auto job = [this, temp_path](BackgroundSaver::Progress& progress) {
+        return writeAOFRewrite(temp_path, progress);
+    };
+    auto on_done = [this, temp_path](bool ok) {
+        finishAOFRewrite(temp_path, ok);
+    };
+    try {
+        return aof_rewrite_.start(with_lock, job, static_cast<uint64_t>(skiplist_->size()), on_done);
+    } catch (...) {
+        aof_writer_.abortRewrite();
+        throw;
+    }
+}
+
+bool RedisHandler::writeAOFRewrite(const std::string& path, BackgroundSaver::Progress& progress) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    static const size_t WRITE_CHUNK = 1 << 20;
+    std::string buffer = aofFileHeader();
+    std::unique_ptr<SnapshotWriter> preamble;
+    if (aof_use_preamble_) {
+        // 前导记录在快照写完、长度已知后回填
+        buffer.append(AOF_PREAMBLE_RECORD_SIZE, '\0');
+        if (!AofWriter::writeAll(fd, buffer.data(), buffer.size())) {
+            ::close(fd);
+            return false;
+        }
+        buffer.clear();
+        preamble = std::make_unique<SnapshotWriter>(fd, path);
+        preamble->setCompression(snapshot_compression_);
+        preamble->setThrottle(&io_throttle_);
+    }
+    std::string value;
+    uint64_t keys = 0;
+    bool ok = true;
+    skiplist_->for_each([&](const int& key, const std::string& stored) {
+        if (!ok) {
+            return;
+        }
+        if (value_log_ && !value_log_->decode(stored, &value)) {
+            ok = false;
+            return;
+        }
+        const std::string& data = value_log_ ? value : stored;
+        if (preamble) {
+            preamble->add(key, data);
+        } else {
+            encodeAofRecord(buffer, AofOp::Set, key, data.data(), data.size());
+            if (buffer.size() >= WRITE_CHUNK) {
+                io_throttle_.acquire(buffer.size());
+                ok = AofWriter::writeAll(fd, buffer.data(), buffer.size());
+                buffer.clear();
+            }
+        }
+        if ((++keys & 1023) == 0) {
+            progress.keys_saved = keys;
+            if ((keys & ((1u << 20) - 1)) == 0) {
+                progress.cow_bytes = BackgroundSaver::privateDirtyBytes();
+            }
+        }
+    });
+    if (ok && preamble) {
+        preamble->commit();
+        std::string record = aofPreambleRecord(preamble->bytes());
+        ok = ::pwrite(fd, record.data(), record.size(), AOF_HEADER_SIZE) == static_cast<ssize_t>(record.size());
+    }
+    if (ok) {
+        // 剩余的记录与fdatasync链接在一起提交
+        off_t position = ::lseek(fd, 0, SEEK_CUR);
+        AsyncFile file(fd, path);
+        ok = position >= 0 && file.wait(file.write(buffer.data(), buffer.size(), static_cast<uint64_t>(position),
+                                                   AsyncFile::Sync::Data));
+    }
+    progress.keys_saved = keys;
+    ::close(fd);
+    return ok;
+}
+
+void RedisHandler::finishAOFRewrite(const std::string& temp_path, bool ok) {
+    if (!ok) {
+        aof_writer_.abortRewrite();
+        if (!temp_path.empty()) {
+            ::unlink(temp_path.c_str());
+        }
+        aof_last_rewrite_ok_ = false;
+        return;
+    }
+    try {
+        aof_writer_.finishRewrite(temp_path);
+        uint64_t size = aof_manifest_->totalSize();
+        aof_base_size_ = size;
+        aof_last_rewrite_ok_ = true;
+        aof_rewrites_++;
+        LOG_INFOF("AOF rewritten: {} ({} bytes)", aof_file_, size);
+    } catch (const std::exception& e) {
+        aof_last_rewrite_ok_ = false;
+        LOG_ERROR("Failed to replace AOF with rewritten file: " + std::string(e.what()));
+    }
 }
 
 void RedisHandler::loadAOF() {
-    std::ifstream aof_in(aof_file_);
-    if (!aof_in.is_open()) return;
-    std::string line;
-    while (std::getline(aof_in, line)) {
-        if (line.empty()) continue;
-        handleCommand(line, nullptr); // 直接重放命令
+    std::vector<std::string> files = aof_manifest_ ? aof_manifest_->files() : std::vector<std::string>();
+    if (files.empty()) return;
+    auto begin = std::chrono::steady_clock::now();
+    
+    // 重放流水线：读取线程依次扫描base和各增量段，把记录按key折叠成批；主线程先加载
+    // base的前导快照，再把批按顺序写入存储。扫描下一段与写入上一批同时进行，记录不经过
+    // RESP解析、命令分发和统计锁
+    struct ReplayBatch {
+        AofBatch entries;
+        bool flush = false;  // 写入前先清空存储（批中只有FLUSH之后的记录）
+        uint64_t scanned = 0; // 扫描到这一批末尾时的字节数，用于报告加载进度
+    };
+    std::deque<ReplayBatch> queue;
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    bool done = false;
+    bool stop = false;
+    std::exception_ptr error;
+    uint64_t records = 0;
+    uint64_t truncated = 0;
+    
+    std::thread scanner([&]() {
+        ReplayBatch batch;
+        uint64_t scanned = 0;
+        auto push = [&]() {
+            batch.scanned = scanned;
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [&]() { return queue.size() < AOF_REPLAY_QUEUE || stop; });
+            if (stop) {
+                throw skiplist::StorageException("AOF replay stopped");
+            }
+            queue.push_back(std::move(batch));
+            batch = ReplayBatch();
+            queue_cv.notify_all();
+        };
+        try {
+            for (size_t i = 0; i < files.size(); i++) {
+                AofReader reader(files[i]);
+                scanned += reader.hasPreamble() ? reader.preambleOffset() + reader.preambleLength() : AOF_HEADER_SIZE;
+                // 只有最后一段可能在写入时崩溃，其余各段在滚动前已经落盘
+                records += reader.replay([&](AofOp op, int32_t key, const char* value, size_t length) {
+                    scanned += AOF_RECORD_OVERHEAD + length;
+                    switch (op) {
+                    case AofOp::Set: {
+                        auto& entry = batch.entries[key];
+                        entry.first = true;
+                        entry.second.assign(value, length);
+                        break;
+                    }
+                    case AofOp::Del: {
+                        auto& entry = batch.entries[key];
+                        entry.first = false;
+                        entry.second.clear();
+                        break;
+                    }
+                    case AofOp::Flush:
+                        batch.entries.clear();
+                        batch.flush = true;
+                        break;
+                    default:
+                        break;
+                    }
+                    if (batch.entries.size() >= AOF_REPLAY_BATCH) {
+                        push();
+                    }
+                }, i + 1 == files.size());
+                truncated += reader.truncatedBytes();
+            }
+            push();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        done = true;
+        queue_cv.notify_all();
+    });
+    
+    uint64_t preamble_keys = 0;
+    try {
+        AofReader base(files.front());
+        if (base.hasPreamble()) {
+            // 前导快照与普通快照一样并行解码、整段接入跳表
+            SnapshotReader snapshot(files.front(), base.preambleOffset(), base.preambleLength());
+            if (mmap_store_ || lsm_store_) {
+                snapshot.forEach([this](int64_t key, const char* value, size_t length) {
+                    storeInsert(static_cast<int>(key), std::string(value, length));
+                });
+            } else {
+                const auto& config = Config::getInstance().getSkipListConfig();
+                SkipList<int, std::string>::LoadProgress progress;
+                if (loading_) {
+                    uint64_t base_bytes = base.preambleOffset();
+                    progress = [this, base_bytes](const SnapshotReader& reader, size_t blocks_done) {
+                        reportSnapshotProgress(reader, blocks_done, base_bytes, false);
+                    };
+                }
+                skiplist_->load_snapshot(snapshot, config.snapshot_load_threads, config.snapshot_load_mmap, progress);
+            }
+            preamble_keys = snapshot.entries();
+        }
+        while (true) {
+            ReplayBatch batch;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                queue_cv.wait(lock, [&]() { return !queue.empty() || done; });
+                if (queue.empty()) {
+                    break;
+                }
+                batch = std::move(queue.front());
+                queue.pop_front();
+                queue_cv.notify_all();
+            }
+            if (batch.flush) {
+                storeFlush(false);
+            }
+            applyAOFBatch(batch.entries);
+            if (loading_) {
+                loading_loaded_bytes_ = batch.scanned;
+                loading_loaded_keys_ = static_cast<uint64_t>(storeSize());
+            }
+        }
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            stop = true;
+        }
+        queue_cv.notify_all();
+        scanner.join();
+        throw;
+    }
+    scanner.join();
+    if (error) {
+        std::rethrow_exception(error);
     }
-    aof_in.close();
+    
+    if (truncated > 0) {
+        LOG_WARNF("AOF {} ended with an incomplete record, truncated {} bytes", files.back(), truncated);
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin);
+    LOG_INFOF("AOF loaded: {} files, {} preamble keys, {} records in {} ms, {} keys", files.size(), preamble_keys,
+              records, elapsed.count(), storeSize());
+}
+
+void RedisHandler::applyAOFBatch(AofBatch& batch) {
+    if (batch.empty()) return;
+    std::vector<AofBatch::iterator> entries;
+    entries.reserve(batch.size());
+    for (auto it = batch.begin(); it != batch.end(); ++it) {
+        entries.push_back(it);
+    }
+    std::sort(entries.begin(), entries.end(), [](const AofBatch::iterator& a, const AofBatch::iterator& b) {
+        return a->first < b->first;
+    });
+    
+    // 存储为空时（通常是第一批）不需要先删除旧值
+    bool empty = storeSize() == 0;
+    if (mmap_store_ || lsm_store_) {
+        for (auto& it : entries) {
+            if (!empty) storeDelete(it->first);
+            if (it->second.first) storeInsert(it->first, it->second.second);
+        }
+    } else {
+        // 内存跳表：按key升序构建节点段，一次接入跳表
+        auto segment = skiplist_->new_bulk_segment(0x9E3779B97F4A7C15ull ^ entries.size());
+        for (auto& it : entries) {
+            if (!empty) storeDelete(it->first);
+            if (!it->second.first) continue;
+            std::string& value = it->second.second;
+            skiplist_->bulk_append(segment, it->first, value_log_ ? value_log_->encode(it->first, value) : std::move(value));
+        }
+        std::vector<SkipList<int, std::string>::BulkSegment> segments;
+        segments.push_back(std::move(segment));
+        skiplist_->bulk_link(segments);
+    }
+    batch.clear();
 }
 
 // 复制相关方法实现
@@ -525,6 +1593,24 @@ void RedisHandler::initReplication(const std::string& master_host, int master_po
         // 从节点接收到复制命令时，直接执行
         handleCommand(command, nullptr);
     });
+    
+    // 主节点从预写日志读取要发送的记录；从节点收到的记录按AOF重放的语义应用（SET覆盖旧值），
+    // 再写入本地的预写日志
+    replication_manager_->setWriteAheadLog(&wal_);
+    replication_manager_->setRecordHandler([this](AofOp op, int32_t key, const char* value, size_t length) {
+        std::string data(value, length);
+        if (op == AofOp::Set) {
+            storeDelete(key);
+            storeInsert(key, data);
+        } else if (op == AofOp::Del) {
+            storeDelete(key);
+        } else if (op == AofOp::Flush) {
+            storeFlush(lazy_free_);
+        } else {
+            return;
+        }
+        appendWAL(op, key, data);
+    });
 }
 
 bool RedisHandler::startReplication() {
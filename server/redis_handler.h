@@ -2,21 +2,44 @@
 #include <string>
 #include <memory>
 #include <map>
+#include <unordered_map>
 #include <functional>
 #include "../skiplist/skiplist.h"
+#include "../skiplist/mmap_skiplist.h"
+#include "../skiplist/active_defrag.h"
+#include "../storage/value_log.h"
+#include "../storage/lsm_store.h"
+#include "../persistence/background_save.h"
+#include "../persistence/delta_snapshot.h"
+#include "../persistence/aof_writer.h"
+#include "../persistence/aof_format.h"
+#include "../persistence/aof_manifest.h"
+#include "../persistence/write_ahead_log.h"
+#include "../persistence/lz_codec.h"
 #include "../network/redis_protocol.h"
 #include "../network/tcp_server.h"
 #include "../replication/replication_manager.h"
 #include <fstream>
 #include <chrono>
+#include <atomic>
+#include <thread>
+#include <cstdint>
 
 class RedisHandler {
 public:
     RedisHandler();
     ~RedisHandler();
     
-    // 初始化处理器
-    void init(int max_level = 18);
+    // 初始化处理器。background_load为true时数据在后台线程中加载，init立即返回：加载
+    // 期间只有INFO等命令可用，其余命令返回LOADING错误（不经过AOF重放时，已加载的key
+    // 范围内的GET/EXISTS照常服务）
+    void init(int max_level = 18, bool background_load = false);
+
+    // 是否正在后台加载数据
+    bool isLoading() const { return loading_.load(std::memory_order_acquire); }
+
+    // 等待后台加载结束
+    void waitLoading();
     
     // 处理Redis命令
     std::string handleCommand(const std::string& request, std::shared_ptr<ClientConnection> client);
@@ -45,17 +68,38 @@ public:
     
     // 保存数据
     void saveData();
+
+    // 后台保存：memory引擎fork子进程写快照，已有后台保存在进行时返回false
+    bool backgroundSave();
+
+    // 定期保存：开启增量快照时只写出变化的key，需要时合并增量；否则等同于backgroundSave
+    bool incrementalSave();
     
     // 加载数据
     void loadData();
 
+    // 写命令编码一次写入预写日志，AOF和复制共用；AOF为always时等待落盘（批处理中推迟到批末）
+    void appendWAL(AofOp op, int key = 0, const std::string& value = std::string());
+
+    // 当前线程开始/结束一批流水线请求：期间AOF为always时写命令不逐条等待落盘，
+    // finishWriteBatch一次等待本批最后一条记录落盘，调用方在此之后才发送回复
+    void beginWriteBatch();
+    void finishWriteBatch();
+
+    // AOF写出或落盘失败、尚未恢复时，写命令在修改数据之前被拒绝（同Redis的MISCONF）
+    bool aofWriteFailing() const;
+
     // AOF相关
-    void appendAOF(const std::string& cmdline);
     void loadAOF();
     void flushAOF();
-    void reopenAOF();
     bool isAOFEnabled() const;
 
+    // 后台重写AOF（BGREWRITEAOF），已有重写或后台保存在进行时返回false
+    bool rewriteAOF();
+
+    // 定期调用：执行被推迟的重写，或在AOF增长超过阈值时自动重写
+    void checkAOFRewrite();
+
     // 复制相关
     void initReplication(const std::string& master_host = "", int master_port = 0);
     bool startReplication();
@@ -82,6 +126,8 @@ private:
     std::string handleKeys(const std::vector<std::string>& args, std::shared_ptr<ClientConnection> client);
     std::string handleFlush(const std::vector<std::string>& args, std::shared_ptr<ClientConnection> client);
     std::string handleSave(const std::vector<std::string>& args, std::shared_ptr<ClientConnection> client);
+    std::string handleBgsave(const std::vector<std::string>& args, std::shared_ptr<ClientConnection> client);
+    std::string handleBgrewriteaof(const std::vector<std::string>& args, std::shared_ptr<ClientConnection> client);
     std::string handleLoad(const std::vector<std::string>& args, std::shared_ptr<ClientConnection> client);
     std::string handleInfo(const std::vector<std::string>& args, std::shared_ptr<ClientConnection> client);
     std::string handleConfig(const std::vector<std::string>& args, std::shared_ptr<ClientConnection> client);
@@ -106,7 +152,55 @@ private:
     // 获取配置信息
     std::string getConfigInfo();
     
+    // 存储引擎访问：mmap/lsm引擎启用时转发到对应引擎，否则使用内存跳表（启用键值分离时经过值日志）
+    int storeInsert(int key, const std::string& value);
+    bool storeSearch(int key);
+    bool storeGet(int key, std::string* value);
+    void storeDelete(int key);
+    void storeFlush(bool lazy);
+    int storeSize();
+    
+    // 初始化键值分离的值日志
+    void initValueLog();
+
+    // 按存储引擎加载数据（快照、AOF），之后打开AOF写入；background_load时在加载线程中执行
+    void loadDataset(int max_level);
+    // 加载期间命令是否可以执行：INFO等不访问数据的命令总是可以，GET/EXISTS在key已就绪时可以
+    bool allowedWhileLoading(const RedisCommand& cmd);
+    // 加载期间的LOADING错误，附带进度
+    std::string loadingErrorResponse();
+    // 快照每接入一批块后更新加载进度；publish_range时公布已就绪的key范围
+    void reportSnapshotProgress(const SnapshotReader& reader, size_t blocks_done, uint64_t base_bytes,
+                                bool publish_range);
+    
+    // AOF重放中按key折叠的一批记录：key -> (是否存在, value)
+    using AofBatch = std::unordered_map<int, std::pair<bool, std::string>>;
+    // 按key顺序把一批记录写入存储并清空
+    void applyAOFBatch(AofBatch& batch);
+    
+    // 在snapshot_mutex_内启动fork后台保存
+    bool startBackgroundSave();
+    
+    // 在snapshot_mutex_内启动AOF重写
+    bool startAOFRewrite();
+    // 在子进程中把跳表写成新的AOF：以快照前导保存全部数据，或每个key一条SET
+    bool writeAOFRewrite(const std::string& path, BackgroundSaver::Progress& progress);
+    // 重写结束：成功时把新文件装入manifest作为base，删除被取代的段
+    void finishAOFRewrite(const std::string& temp_path, bool ok);
+    
     std::unique_ptr<SkipList<int, std::string>> skiplist_;
+    std::unique_ptr<ActiveDefrag<int, std::string>> active_defrag_;
+    std::unique_ptr<MmapSkipList> mmap_store_;
+    std::unique_ptr<LsmStore> lsm_store_;
+    std::unique_ptr<ValueLog> value_log_;
+    BackgroundSaver bgsave_;
+    std::unique_ptr<DeltaSnapshots> delta_snapshots_;
+    int snapshot_delta_max_ = 16;
+    int snapshot_delta_ratio_ = 50;
+    int snapshot_compression_ = 0;  // 快照数据块和AOF前导的压缩级别
+    IoThrottle io_throttle_;        // 后台保存和AOF重写的写出限速，与子进程共享
+    // 串行化全量保存、增量写出与合并（它们共用快照的临时文件）
+    std::mutex snapshot_mutex_;
     std::map<std::string, CommandHandler> command_handlers_;
     Stats stats_;
     std::mutex stats_mutex_;
@@ -114,18 +208,44 @@ private:
     // 当前数据库编号（Redis支持多个数据库）
     int current_db_;
     
+    // FLUSH时是否默认惰性释放
+    bool lazy_free_ = false;
+    
     // 认证状态
     bool authenticated_;
     std::string password_;
 
-    // AOF相关
-    std::ofstream aof_stream_;
+    // AOF相关：记录交给组提交写线程，always策略下等待自己的LSN落盘
+    std::unique_ptr<AofManifest> aof_manifest_;
+    AofWriter aof_writer_;
     std::string aof_file_;
-    bool aof_enabled_ = false;
+    std::atomic<bool> aof_enabled_{false};  // 后台加载中打开AOF失败时会被关闭
     std::string aof_fsync_;
     int aof_fsync_interval_ = 1;
-    std::mutex aof_mutex_;
-    std::chrono::system_clock::time_point last_aof_fsync_;
+    uint64_t aof_segment_size_ = 0;
+    BackgroundSaver aof_rewrite_{"Background AOF rewrite"};
+    int aof_rewrite_percentage_ = 100;
+    uint64_t aof_rewrite_min_size_ = 0;
+    bool aof_use_preamble_ = true;
+    std::atomic<uint64_t> aof_base_size_{0};        // 上次重写（或启动）时的AOF大小
+    std::atomic<bool> aof_rewrite_scheduled_{false}; // 后台保存结束后再重写
+    std::atomic<bool> aof_last_rewrite_ok_{true};
+    std::atomic<uint64_t> aof_rewrites_{0};
+
+    // 预写日志：AOF写线程写出的记录同时进入复制backlog
+    WriteAheadLog wal_;
+
+    // 后台加载：loading_为false之后加载线程的全部写入都对命令线程可见；加载期间只有
+    // loading_ready_below_之前的key可以读取（以release公布，在它之前写入的结构都已就绪）
+    std::thread loading_thread_;
+    std::atomic<bool> loading_{false};
+    std::atomic<int64_t> loading_ready_below_{INT64_MIN};
+    std::atomic<uint64_t> loading_total_bytes_{0};
+    std::atomic<uint64_t> loading_loaded_bytes_{0};
+    std::atomic<uint64_t> loading_loaded_keys_{0};
+    std::atomic<int64_t> loading_start_time_{0};        // 开始加载的时间（Unix秒）
+    std::atomic<int64_t> loading_start_ms_{0};          // 开始加载的时间（单调时钟毫秒）
+    std::atomic<uint64_t> loading_last_duration_ms_{0}; // 上次加载的耗时
 
     // 复制相关
     std::unique_ptr<ReplicationManager> replication_manager_;
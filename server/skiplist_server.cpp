@@ -1,6 +1,7 @@
 #include "skiplist_server.h"
 #include "../include/exceptions.h"
 #include <iostream>
+#include <algorithm>
 #include <chrono>
 #include <filesystem>
 #include <csignal>
@@ -39,7 +40,7 @@ bool SkipListServer::init(const std::string& config_file) {
         
         // 初始化Redis处理器
         const auto& skiplist_config = config_.getSkipListConfig();
-        redis_handler_.init(skiplist_config.max_level);
+        redis_handler_.init(skiplist_config.max_level, skiplist_config.progressive_loading);
         
         // 初始化网络服务器
         if (!initNetworkServer()) {
@@ -79,8 +80,8 @@ bool SkipListServer::start() {
         
         running_ = true;
         
-        // 启动持久化线程
-        if (persistence_enabled_) {
+        // 启动持久化线程（也负责检查AOF是否需要重写）
+        if (persistence_enabled_ || redis_handler_.isAOFEnabled()) {
             persistence_thread_ = std::thread(&SkipListServer::persistenceLoop, this);
         }
         
@@ -121,9 +122,13 @@ void SkipListServer::stop() {
         monitor_thread_.join();
     }
     
-    // 保存数据
+    // 保存数据（后台加载尚未结束时等它完成，不能把加载了一部分的数据写回快照）
+    redis_handler_.waitLoading();
     redis_handler_.saveData();
     
+    // 停止惰性释放线程，剩余节点不再逐个释放，交给进程退出时回收
+    LazyFreer<int, std::string>::getInstance().stop(false);
+    
     LOG_INFO("SkipList server stopped");
 }
 
@@ -145,13 +150,31 @@ std::string SkipListServer::handleMessage(const std::string& message, std::share
 }
 
 void SkipListServer::persistenceLoop() {
+    int elapsed = 0;
     while (running_) {
-        std::this_thread::sleep_for(std::chrono::seconds(persistence_interval_));
+        // 每秒检查一次AOF重写，每persistence_interval_秒保存一次
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        if (!running_) {
+            break;
+        }
+        // 数据加载完成之前不保存也不重写
+        if (redis_handler_.isLoading()) {
+            continue;
+        }
+        try {
+            redis_handler_.checkAOFRewrite();
+        } catch (const std::exception& e) {
+            LOG_ERROR("Error during AOF rewrite: " + std::string(e.what()));
+        }
         
-        if (running_) {
+        if (persistence_enabled_ && ++elapsed >= persistence_interval_) {
+            elapsed = 0;
             try {
-                redis_handler_.saveData();
-                LOG_DEBUG("Data persisted successfully");
+                // 定期保存只写出变化的key，全量快照在fork出的子进程中进行，不阻塞写入；
+                // 上一次后台保存还没结束时跳过本轮
+                if (!redis_handler_.incrementalSave()) {
+                    LOG_DEBUG("Background save still in progress, skipping");
+                }
             } catch (const std::exception& e) {
                 LOG_ERROR("Error during persistence: " + std::string(e.what()));
             }
@@ -176,7 +199,7 @@ void SkipListServer::monitorLoop() {
                 }
                 
                 // 检查日志轮转
-                Logger::getInstance().checkRotation();
+                Logger::getInstance().checkRotation("");
                 
             } catch (const std::exception& e) {
                 LOG_ERROR("Error in monitor loop: " + std::string(e.what()));
@@ -239,14 +262,23 @@ bool SkipListServer::initNetworkServer() {
     
     tcp_server_ = std::make_unique<TCPServer>();
     
-    if (!tcp_server_->init(server_config.host, server_config.port, server_config.thread_pool_size)) {
+    if (!tcp_server_->init(server_config.host, server_config.port, server_config.thread_pool_size,
+                           server_config.reactor_threads, server_config.network_backend)) {
         return false;
     }
+    LOG_INFOF("Network backend: {}", tcp_server_->backendName());
     
     // 设置消息处理器
     tcp_server_->setMessageHandler([this](const std::string& message, std::shared_ptr<ClientConnection> client) {
         return handleMessage(message, client);
     });
+    // 按RESP请求分帧，流水线发来的多个命令依次执行，回复合并发送
+    tcp_server_->setFrameSplitter(RedisProtocol::requestLength);
+    // AOF为always时同一批请求只等待一次落盘，流水线的写命令可以合并到同一次fdatasync
+    tcp_server_->setBatchHooks([this]() { redis_handler_.beginWriteBatch(); },
+                               [this]() { redis_handler_.finishWriteBatch(); });
+    // 不读回复的流水线或声明了巨大长度的请求不能让输入缓冲区无限增长
+    tcp_server_->setQueryBufferLimit(static_cast<size_t>(std::max(0, server_config.client_query_buffer_limit)));
     
     return true;
 }
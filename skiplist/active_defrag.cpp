@@ -0,0 +1,105 @@
+#include "active_defrag.h"
+#include <chrono>
+#include <algorithm>
+
+namespace {
+const auto CYCLE_PERIOD = std::chrono::milliseconds(100);
+const int NODES_PER_STEP = 64; // 每次持锁处理的节点数
+}
+
+template<typename K, typename V>
+ActiveDefrag<K,V>::ActiveDefrag(SkipList<K,V>* list)
+    : list_(list){
+}
+
+template<typename K, typename V>
+ActiveDefrag<K,V>::~ActiveDefrag(){
+    stop();
+}
+
+template<typename K, typename V>
+void ActiveDefrag<K,V>::start(const Options& options){
+    options_ = options;
+    options_.threshold_upper = std::max(options_.threshold_upper, options_.threshold_lower + 1);
+    options_.cycle_min = std::min(std::max(options_.cycle_min, 1), 100);
+    options_.cycle_max = std::min(std::max(options_.cycle_max, options_.cycle_min), 100);
+    stopping_ = false;
+    thread_ = std::thread(&ActiveDefrag<K,V>::loop, this);
+}
+
+template<typename K, typename V>
+void ActiveDefrag<K,V>::stop(){
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if(thread_.joinable()){
+        thread_.join();
+    }
+}
+
+template<typename K, typename V>
+bool ActiveDefrag<K,V>::shouldStart(){
+    NodeAllocator::Stats stats = NodeAllocator::getInstance().getStats();
+    if(idle_){
+        if(stats.allocated_bytes == idle_allocated_bytes_){
+            return false;
+        }
+        idle_ = false;
+    }
+    size_t fragmented = stats.active_bytes - std::min(stats.active_bytes, stats.allocated_bytes);
+    double percent = NodeAllocator::getInstance().fragmentationRatio() * 100.0 - 100.0;
+    return fragmented > options_.ignore_bytes && percent > options_.threshold_lower;
+}
+
+template<typename K, typename V>
+int ActiveDefrag<K,V>::cpuPercent(double fragmentation_percent) const{
+    double t = (fragmentation_percent - options_.threshold_lower) / (options_.threshold_upper - options_.threshold_lower);
+    t = std::min(std::max(t, 0.0), 1.0);
+    return options_.cycle_min + static_cast<int>(t * (options_.cycle_max - options_.cycle_min));
+}
+
+template<typename K, typename V>
+void ActiveDefrag<K,V>::loop(){
+    size_t cycle_hits = 0;
+    while(true){
+        auto period_start = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if(stopping_){
+                break;
+            }
+        }
+
+        if(!running_ && shouldStart()){
+            running_ = true;
+            cycle_hits = 0;
+        }
+
+        if(running_){
+            double percent = NodeAllocator::getInstance().fragmentationRatio() * 100.0 - 100.0;
+            auto slice = CYCLE_PERIOD * cpuPercent(percent) / 100;
+            auto deadline = period_start + slice;
+            do {
+                size_t scanned = 0, moved = 0;
+                bool finished = list_->defrag_step(NODES_PER_STEP, &scanned, &moved);
+                scanned_ += scanned;
+                hits_ += moved;
+                cycle_hits += moved;
+                if(finished){
+                    running_ = false;
+                    if(cycle_hits == 0){
+                        idle_ = true;
+                        idle_allocated_bytes_ = NodeAllocator::getInstance().getStats().allocated_bytes;
+                    }
+                    break;
+                }
+            } while(std::chrono::steady_clock::now() < deadline);
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait_until(lock, period_start + CYCLE_PERIOD, [this] { return stopping_; });
+    }
+    running_ = false;
+}
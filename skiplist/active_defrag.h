@@ -0,0 +1,57 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "skiplist.h"
+
+// 主动碎片整理任务
+//
+// 后台线程每100ms检查一次NodeAllocator的碎片情况：碎片率超过threshold_lower%
+// 且碎片字节数超过ignore_bytes时开始一轮整理。每个周期只占用cycle_min%到
+// cycle_max%的时间，碎片率在threshold_lower%到threshold_upper%之间线性插值；
+// 时间片内反复调用SkipList::defrag_step，每次只持锁处理一小批节点。
+// 一轮扫描完整个跳表后结束；若这一轮没有迁移任何节点，则等到分配情况变化后
+// 才开始下一轮，避免在无法改善的碎片上空转。
+template <typename K, typename V>
+class ActiveDefrag{
+public:
+    struct Options {
+        size_t ignore_bytes = 100 * 1024 * 1024;
+        int threshold_lower = 10;
+        int threshold_upper = 100;
+        int cycle_min = 1;
+        int cycle_max = 25;
+    };
+
+    explicit ActiveDefrag(SkipList<K,V>* list);
+    ~ActiveDefrag();
+
+    void start(const Options& options);
+    void stop();
+
+    // 当前是否处于一轮整理中
+    bool running() const { return running_; }
+    size_t hits() const { return hits_; }
+    size_t misses() const { return scanned_ - hits_; }
+    size_t scanned() const { return scanned_; }
+
+private:
+    void loop();
+    bool shouldStart();
+    int cpuPercent(double fragmentation_percent) const;
+
+    SkipList<K,V>* list_;
+    Options options_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    std::atomic<bool> running_{false};
+    std::atomic<size_t> hits_{0};
+    std::atomic<size_t> scanned_{0};
+    size_t idle_allocated_bytes_ = 0; // 上一轮没有迁移任何节点时的已分配字节数
+    bool idle_ = false;
+};
+
+template class ActiveDefrag<int, std::string>;
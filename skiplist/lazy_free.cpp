@@ -0,0 +1,168 @@
+#include "lazy_free.h"
+
+template<typename K, typename V>
+LazyFreer<K,V>& LazyFreer<K,V>::getInstance(){
+    static LazyFreer<K,V> instance;
+    return instance;
+}
+
+template<typename K, typename V>
+LazyFreer<K,V>::~LazyFreer(){
+    stop(false);
+}
+
+template<typename K, typename V>
+void LazyFreer<K,V>::start(int thread_count, int chunk_size){
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(started_){
+        return;
+    }
+    thread_count_ = thread_count > 0 ? thread_count : 1;
+    chunk_size_ = chunk_size > 0 ? chunk_size : 1024;
+    started_ = true;
+    for(int i = 0; i < thread_count_; i++){
+        workers_.emplace_back(&LazyFreer<K,V>::worker_loop, this);
+    }
+}
+
+template<typename K, typename V>
+void LazyFreer<K,V>::stop(bool drain){
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!started_ || stopping_){
+            return;
+        }
+        stopping_ = true;
+        drain_ = drain;
+    }
+    cv_.notify_all();
+    for(auto& worker : workers_){
+        if(worker.joinable()){
+            worker.join();
+        }
+    }
+    workers_.clear();
+
+    // 未释放的节点直接放弃，不再遍历，保证关闭过程为O(1)
+    std::lock_guard<std::mutex> lock(mutex_);
+    lists_.clear();
+    segments_.clear();
+}
+
+template<typename K, typename V>
+void LazyFreer<K,V>::submit(Node<K,V>* head, size_t count){
+    if(head == nullptr){
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(stopping_){
+            // 服务器正在退出，节点交给操作系统回收
+            return;
+        }
+        if(started_){
+            lists_.push_back(head);
+            pending_ += count;
+            cv_.notify_one();
+            return;
+        }
+    }
+    // 后台线程未启动时退化为同步释放
+    while(head != nullptr){
+        Node<K,V>* next = head->forward[0];
+        delete head;
+        head = next;
+    }
+}
+
+template<typename K, typename V>
+void LazyFreer<K,V>::split(Node<K,V>* head, std::vector<Segment>& segments){
+    Node<K,V>* first = head->forward[0];
+    if(first == nullptr){
+        return;
+    }
+
+    // 自顶向下找到第一个节点数足够切分的层，只遍历该层，代价远小于整条链
+    const size_t parts = static_cast<size_t>(thread_count_) * 4;
+    int split_level = 0;
+    for(int i = head->node_level; i >= 1; i--){
+        size_t count = 0;
+        for(Node<K,V>* node = head->forward[i]; node != nullptr && count < parts; node = node->forward[i]){
+            count++;
+        }
+        if(count >= parts || i == 1){
+            split_level = i;
+            break;
+        }
+    }
+
+    Node<K,V>* begin = first;
+    if(split_level > 0){
+        for(Node<K,V>* node = head->forward[split_level]; node != nullptr; node = node->forward[split_level]){
+            if(node != begin){
+                segments.push_back({begin, node});
+                begin = node;
+            }
+        }
+    }
+    segments.push_back({begin, nullptr});
+}
+
+template<typename K, typename V>
+void LazyFreer<K,V>::worker_loop(){
+    while(true){
+        Segment segment{nullptr, nullptr};
+        Node<K,V>* list = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stopping_ || !lists_.empty() || !segments_.empty(); });
+
+            if(stopping_ && (!drain_ || (lists_.empty() && segments_.empty()))){
+                break;
+            }
+
+            if(!lists_.empty()){
+                list = lists_.front();
+                lists_.pop_front();
+            } else {
+                segment = segments_.front();
+                segments_.pop_front();
+            }
+        }
+
+        if(list != nullptr){
+            std::vector<Segment> segments;
+            split(list, segments);
+            delete list; // 旧头结点本身不计入数据节点
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for(const auto& s : segments){
+                    segments_.push_back(s);
+                }
+            }
+            cv_.notify_all();
+            continue;
+        }
+
+        // 每次只释放一个块，剩余部分放回队尾，让多条链、多个线程交替推进
+        Node<K,V>* node = segment.begin;
+        size_t released = 0;
+        while(node != segment.end && released < static_cast<size_t>(chunk_size_)){
+            Node<K,V>* next = node->forward[0];
+            delete node;
+            node = next;
+            released++;
+        }
+        freed_ += released;
+        pending_ -= released;
+
+        if(node != segment.end){
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                segments_.push_back({node, segment.end});
+            }
+            cv_.notify_one();
+        }
+        std::this_thread::yield();
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "../node/node.h"
+
+// 惰性释放器：在后台线程中分块、并行地释放从跳表上摘下的整条节点链，
+// 使FLUSH和关闭服务器时调用方线程只需O(1)地摘链
+template <typename K, typename V>
+class LazyFreer{
+public:
+    static LazyFreer& getInstance();
+
+    LazyFreer(const LazyFreer&) = delete;
+    LazyFreer& operator=(const LazyFreer&) = delete;
+
+    // 启动后台释放线程，chunk_size为每次连续释放的节点数
+    void start(int thread_count = 1, int chunk_size = 1024);
+
+    // 停止后台线程。drain为false时直接放弃尚未释放的节点，由进程退出时操作系统回收
+    void stop(bool drain = false);
+
+    // 提交一条已摘下的链：head为旧头结点（连同头结点一起释放），count为链上数据节点数
+    void submit(Node<K,V>* head, size_t count);
+
+    // 是否已经启动过（停止后仍返回true，此时提交的链会被直接放弃）
+    bool is_started() const { return started_; }
+
+    // 等待释放的节点数
+    size_t pending() const { return pending_; }
+
+    // 已释放的节点总数
+    size_t freed() const { return freed_; }
+
+private:
+    LazyFreer() = default;
+    ~LazyFreer();
+
+    // 待释放的一段链表：[begin, end)，end为nullptr表示直到链尾
+    struct Segment{
+        Node<K,V>* begin;
+        Node<K,V>* end;
+    };
+
+    void worker_loop();
+
+    // 利用高层索引把整条链切分成若干段，便于多个线程并行释放
+    void split(Node<K,V>* head, std::vector<Segment>& segments);
+
+    std::vector<std::thread> workers_;
+    std::deque<Node<K,V>*> lists_;   // 刚提交、尚未切分的链
+    std::deque<Segment> segments_;   // 已切分、等待释放的段
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    int thread_count_ = 1;
+    int chunk_size_ = 1024;
+    bool started_ = false;
+    bool stopping_ = false;
+    bool drain_ = false;
+    std::atomic<size_t> pending_{0};
+    std::atomic<size_t> freed_{0};
+};
+
+template class LazyFreer<int, std::string>;
@@ -0,0 +1,486 @@
+#include "mmap_skiplist.h"
+#include "../include/exceptions.h"
+#include "../utils/utils.h"
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+const char MMAP_MAGIC[8] = {'S', 'L', 'M', 'M', 'A', 'P', '0', '1'};
+const uint32_t MMAP_VERSION = 1;
+const size_t HEADER_SIZE = 4096;      // 文件头独占一页
+const size_t ALLOC_UNIT = 64;         // 分配粒度
+const int LARGE_SEARCH_LIMIT = 16;    // 大块空闲链表最多向后查找的块数
+const uint16_t NODE_LIVE = 0x4C56;    // "LV"
+const uint16_t NODE_FREE = 0x4652;    // "FR"
+
+size_t round_up(size_t n, size_t unit){
+    return (n + unit - 1) / unit * unit;
+}
+}
+
+struct MmapSkipList::MmapNode{
+    int64_t key;
+    uint32_t value_length;
+    uint32_t alloc_bytes;     // 该节点实际占用的字节数（64字节的整数倍）
+    uint16_t level;
+    uint16_t flags;
+    uint32_t checksum;        // key、value_length、level以及value的CRC32C
+    // 之后依次为 uint64_t forward[level + 1] 以及 value 字节
+};
+
+MmapSkipList::MmapSkipList(int max_level)
+    : fd_(-1)
+    , base_(nullptr)
+    , mapped_size_(0)
+    , max_level_(max_level)
+    , recovered_(false)
+    , truncated_(false) {
+}
+
+MmapSkipList::~MmapSkipList(){
+    close();
+}
+
+MmapSkipList::MmapHeader* MmapSkipList::header() const{
+    return reinterpret_cast<MmapHeader*>(base_);
+}
+
+MmapSkipList::MmapNode* MmapSkipList::node_at(uint64_t offset) const{
+    return reinterpret_cast<MmapNode*>(base_ + offset);
+}
+
+uint64_t* MmapSkipList::forward_of(MmapNode* node) const{
+    return reinterpret_cast<uint64_t*>(reinterpret_cast<char*>(node) + sizeof(MmapNode));
+}
+
+char* MmapSkipList::value_of(MmapNode* node) const{
+    return reinterpret_cast<char*>(forward_of(node) + node->level + 1);
+}
+
+size_t MmapSkipList::node_bytes(int level, size_t value_length){
+    return sizeof(MmapNode) + sizeof(uint64_t) * (level + 1) + value_length;
+}
+
+uint32_t MmapSkipList::node_checksum(const MmapNode* node, const char* value){
+    uint32_t crc = Utils::crc32c(reinterpret_cast<const char*>(&node->key), sizeof(node->key));
+    crc = Utils::crc32c(reinterpret_cast<const char*>(&node->value_length), sizeof(node->value_length), crc);
+    crc = Utils::crc32c(reinterpret_cast<const char*>(&node->level), sizeof(node->level), crc);
+    return Utils::crc32c(value, node->value_length, crc);
+}
+
+void MmapSkipList::open(const std::string& path, size_t initial_size){
+    std::lock_guard<std::mutex> lock(mtx_);
+    path_ = path;
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd_ < 0){
+        throw skiplist::FileIOException(path, "open");
+    }
+
+    struct stat st;
+    if(fstat(fd_, &st) != 0){
+        throw skiplist::FileIOException(path, "fstat");
+    }
+
+    bool fresh = (st.st_size == 0);
+    size_t file_size = static_cast<size_t>(st.st_size);
+    if(fresh){
+        file_size = round_up(std::max(initial_size, HEADER_SIZE * 2), HEADER_SIZE);
+        if(ftruncate(fd_, file_size) != 0){
+            throw skiplist::FileIOException(path, "ftruncate");
+        }
+    } else if(file_size < HEADER_SIZE){
+        throw skiplist::DataCorruptionException("mmap file too small: " + path);
+    }
+
+    void* addr = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if(addr == MAP_FAILED){
+        throw skiplist::FileIOException(path, "mmap");
+    }
+    base_ = static_cast<char*>(addr);
+    mapped_size_ = file_size;
+
+    try {
+        if(fresh){
+            format(max_level_);
+            recovered_ = false;
+        } else {
+            MmapHeader* h = header();
+            uint32_t crc = Utils::crc32c(h->magic, sizeof(h->magic));
+            crc = Utils::crc32c(reinterpret_cast<const char*>(&h->version), sizeof(h->version), crc);
+            crc = Utils::crc32c(reinterpret_cast<const char*>(&h->max_level), sizeof(h->max_level), crc);
+            if(memcmp(h->magic, MMAP_MAGIC, sizeof(MMAP_MAGIC)) != 0 || h->version != MMAP_VERSION || h->checksum != crc){
+                throw skiplist::DataCorruptionException("invalid mmap file header: " + path);
+            }
+            // 以文件中记录的层数为准
+            max_level_ = static_cast<int>(h->max_level);
+            if(h->head != HEADER_SIZE || h->used > file_size || h->used < h->head + node_bytes(max_level_, 0)){
+                throw skiplist::DataCorruptionException("invalid mmap file layout: " + path);
+            }
+
+            bool clean = (h->clean_shutdown == 1) && (h->capacity == file_size);
+            h->capacity = file_size;
+            if(clean){
+                recovered_ = false;
+            } else {
+                recover();
+                recovered_ = true;
+            }
+        }
+    } catch (...) {
+        // 校验失败时不能让close()把损坏的文件标记为正常关闭
+        munmap(base_, mapped_size_);
+        base_ = nullptr;
+        mapped_size_ = 0;
+        ::close(fd_);
+        fd_ = -1;
+        throw;
+    }
+
+    // 打开期间标记为非正常关闭状态
+    header()->clean_shutdown = 0;
+    msync(base_, HEADER_SIZE, MS_SYNC);
+}
+
+void MmapSkipList::close(){
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(base_ == nullptr){
+        return;
+    }
+    msync(base_, mapped_size_, MS_SYNC);
+    header()->clean_shutdown = 1;
+    msync(base_, HEADER_SIZE, MS_SYNC);
+    munmap(base_, mapped_size_);
+    base_ = nullptr;
+    mapped_size_ = 0;
+    ::close(fd_);
+    fd_ = -1;
+}
+
+void MmapSkipList::format(int max_level){
+    static_assert(sizeof(MmapHeader) <= HEADER_SIZE, "mmap header must fit in the first page");
+    MmapHeader* h = header();
+    memset(h, 0, HEADER_SIZE);
+    memcpy(h->magic, MMAP_MAGIC, sizeof(MMAP_MAGIC));
+    h->version = MMAP_VERSION;
+    h->max_level = static_cast<uint32_t>(max_level);
+    uint32_t crc = Utils::crc32c(h->magic, sizeof(h->magic));
+    crc = Utils::crc32c(reinterpret_cast<const char*>(&h->version), sizeof(h->version), crc);
+    h->checksum = Utils::crc32c(reinterpret_cast<const char*>(&h->max_level), sizeof(h->max_level), crc);
+    h->capacity = mapped_size_;
+    h->head = HEADER_SIZE;
+    h->used = HEADER_SIZE + round_up(node_bytes(max_level, 0), ALLOC_UNIT);
+
+    MmapNode* head = node_at(h->head);
+    memset(head, 0, node_bytes(max_level, 0));
+    head->level = static_cast<uint16_t>(max_level);
+    head->flags = NODE_LIVE;
+    head->alloc_bytes = static_cast<uint32_t>(h->used - h->head);
+    msync(base_, h->used, MS_SYNC);
+}
+
+// 沿第0层校验所有节点，在第一个非法节点处截断，然后重建上层指针和计数
+void MmapSkipList::recover(){
+    MmapHeader* h = header();
+    MmapNode* head = node_at(h->head);
+    uint64_t* head_forward = forward_of(head);
+    for(int i = 1; i <= max_level_; i++){
+        head_forward[i] = 0;
+    }
+
+    std::vector<uint64_t> last(max_level_ + 1, h->head);
+    const uint64_t min_offset = h->head + round_up(node_bytes(max_level_, 0), ALLOC_UNIT);
+    uint64_t prev = h->head;
+    uint64_t offset = head_forward[0];
+    uint64_t count = 0;
+    bool has_prev_key = false;
+    int64_t prev_key = 0;
+    truncated_ = false;
+
+    while(offset != 0){
+        bool valid = offset >= min_offset && offset % ALLOC_UNIT == 0 && offset + sizeof(MmapNode) <= h->used;
+        MmapNode* node = valid ? node_at(offset) : nullptr;
+        if(valid){
+            valid = node->flags == NODE_LIVE
+                && node->level <= max_level_
+                && offset + node->alloc_bytes <= h->used
+                && node_bytes(node->level, node->value_length) <= node->alloc_bytes
+                && (!has_prev_key || node->key > prev_key)
+                && node->checksum == node_checksum(node, value_of(node));
+        }
+        if(!valid){
+            // 之后的节点不可信，从前驱处截断
+            forward_of(node_at(prev))[0] = 0;
+            truncated_ = true;
+            break;
+        }
+
+        uint64_t* forward = forward_of(node);
+        for(int i = 1; i <= node->level; i++){
+            forward[i] = 0;
+            forward_of(node_at(last[i]))[i] = offset;
+            last[i] = offset;
+        }
+        prev = offset;
+        prev_key = node->key;
+        has_prev_key = true;
+        count++;
+        offset = forward[0];
+    }
+
+    h->node_count = count;
+    h->current_level = 0;
+    for(int i = max_level_; i > 0; i--){
+        if(head_forward[i] != 0){
+            h->current_level = i;
+            break;
+        }
+    }
+    // 空闲链表中的节点可能与截断前的链表交叉，直接丢弃
+    memset(h->free_lists, 0, sizeof(h->free_lists));
+    msync(base_, mapped_size_, MS_SYNC);
+}
+
+void MmapSkipList::grow(size_t min_size){
+    size_t new_size = std::max(mapped_size_ * 2, round_up(min_size, HEADER_SIZE));
+    if(ftruncate(fd_, new_size) != 0){
+        throw skiplist::FileIOException(path_, "ftruncate");
+    }
+    void* addr = mremap(base_, mapped_size_, new_size, MREMAP_MAYMOVE);
+    if(addr == MAP_FAILED){
+        throw skiplist::FileIOException(path_, "mremap");
+    }
+    // 映射地址可能变化，所有节点引用都是偏移量，无需修正
+    base_ = static_cast<char*>(addr);
+    mapped_size_ = new_size;
+    header()->capacity = new_size;
+}
+
+uint64_t MmapSkipList::allocate(size_t bytes){
+    MmapHeader* h = header();
+    size_t cls = bytes / ALLOC_UNIT;
+    if(cls < static_cast<size_t>(FREE_CLASSES) && h->free_lists[cls] != 0){
+        uint64_t offset = h->free_lists[cls];
+        h->free_lists[cls] = forward_of(node_at(offset))[0];
+        return offset;
+    }
+    if(cls >= static_cast<size_t>(FREE_CLASSES)){
+        // 大块：在大块链表中首次适配，限制查找长度
+        uint64_t* link = &h->free_lists[FREE_CLASSES];
+        for(int i = 0; *link != 0 && i < LARGE_SEARCH_LIMIT; i++){
+            MmapNode* candidate = node_at(*link);
+            if(candidate->alloc_bytes >= bytes){
+                uint64_t offset = *link;
+                *link = forward_of(candidate)[0];
+                return offset;
+            }
+            link = &forward_of(candidate)[0];
+        }
+    }
+
+    if(h->used + bytes > mapped_size_){
+        grow(h->used + bytes);
+        h = header();
+    }
+    uint64_t offset = h->used;
+    h->used += bytes;
+    node_at(offset)->alloc_bytes = static_cast<uint32_t>(bytes);
+    return offset;
+}
+
+void MmapSkipList::release(uint64_t offset){
+    MmapHeader* h = header();
+    MmapNode* node = node_at(offset);
+    size_t cls = node->alloc_bytes / ALLOC_UNIT;
+    if(cls > static_cast<size_t>(FREE_CLASSES)){
+        cls = FREE_CLASSES;
+    }
+    node->flags = NODE_FREE;
+    forward_of(node)[0] = h->free_lists[cls];
+    h->free_lists[cls] = offset;
+}
+
+int MmapSkipList::get_random_level(){
+    int k = 0;
+    while(rand() % 2 && k < max_level_){
+        k++;
+    }
+    return k;
+}
+
+int MmapSkipList::insert_element(int key, const std::string& value){
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(base_ == nullptr){
+        return -1;
+    }
+
+    // 前驱记录为偏移量，扩容导致映射地址变化后依然有效
+    std::vector<uint64_t> update(max_level_ + 1, header()->head);
+    uint64_t current = header()->head;
+    for(int i = static_cast<int>(header()->current_level); i >= 0; i--){
+        uint64_t next = forward_of(node_at(current))[i];
+        while(next != 0 && node_at(next)->key < key){
+            current = next;
+            next = forward_of(node_at(current))[i];
+        }
+        update[i] = current;
+    }
+
+    uint64_t next = forward_of(node_at(current))[0];
+    if(next != 0 && node_at(next)->key == key){
+        return 1;
+    }
+
+    int level = get_random_level();
+    size_t bytes = round_up(node_bytes(level, value.size()), ALLOC_UNIT);
+    uint64_t offset = allocate(bytes);
+
+    // 先完整写好新节点
+    MmapNode* node = node_at(offset);
+    node->key = key;
+    node->value_length = static_cast<uint32_t>(value.size());
+    node->level = static_cast<uint16_t>(level);
+    node->flags = NODE_LIVE;
+    memcpy(value_of(node), value.data(), value.size());
+    node->checksum = node_checksum(node, value_of(node));
+    uint64_t* forward = forward_of(node);
+    for(int i = 0; i <= level; i++){
+        forward[i] = forward_of(node_at(update[i]))[i];
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // 再自底向上发布，第0层的这一次写入是插入的提交点
+    for(int i = 0; i <= level; i++){
+        forward_of(node_at(update[i]))[i] = offset;
+    }
+
+    MmapHeader* h = header();
+    h->node_count++;
+    if(static_cast<uint64_t>(level) > h->current_level){
+        h->current_level = level;
+    }
+    return 0;
+}
+
+bool MmapSkipList::search_element(int key){
+    return get_element(key, nullptr);
+}
+
+bool MmapSkipList::get_element(int key, std::string* value){
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(base_ == nullptr){
+        return false;
+    }
+    uint64_t current = header()->head;
+    for(int i = static_cast<int>(header()->current_level); i >= 0; i--){
+        uint64_t next = forward_of(node_at(current))[i];
+        while(next != 0 && node_at(next)->key < key){
+            current = next;
+            next = forward_of(node_at(current))[i];
+        }
+    }
+    uint64_t next = forward_of(node_at(current))[0];
+    if(next == 0 || node_at(next)->key != key){
+        return false;
+    }
+    if(value != nullptr){
+        MmapNode* node = node_at(next);
+        value->assign(value_of(node), node->value_length);
+    }
+    return true;
+}
+
+void MmapSkipList::delete_element(int key){
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(base_ == nullptr){
+        return;
+    }
+    std::vector<uint64_t> update(max_level_ + 1, header()->head);
+    uint64_t current = header()->head;
+    for(int i = static_cast<int>(header()->current_level); i >= 0; i--){
+        uint64_t next = forward_of(node_at(current))[i];
+        while(next != 0 && node_at(next)->key < key){
+            current = next;
+            next = forward_of(node_at(current))[i];
+        }
+        update[i] = current;
+    }
+
+    uint64_t target = forward_of(node_at(current))[0];
+    if(target == 0 || node_at(target)->key != key){
+        return;
+    }
+
+    // 自顶向下摘除，第0层最后摘除
+    MmapNode* node = node_at(target);
+    uint64_t* forward = forward_of(node);
+    for(int i = node->level; i >= 0; i--){
+        uint64_t* link = &forward_of(node_at(update[i]))[i];
+        if(*link == target){
+            *link = forward[i];
+        }
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    release(target);
+
+    MmapHeader* h = header();
+    h->node_count--;
+    uint64_t* head_forward = forward_of(node_at(h->head));
+    while(h->current_level > 0 && head_forward[h->current_level] == 0){
+        h->current_level--;
+    }
+}
+
+void MmapSkipList::flush(){
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(base_ == nullptr){
+        return;
+    }
+    MmapHeader* h = header();
+    uint64_t* head_forward = forward_of(node_at(h->head));
+    // 先清空第0层，之后的状态即为空表
+    head_forward[0] = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    for(int i = 1; i <= max_level_; i++){
+        head_forward[i] = 0;
+    }
+    h->used = h->head + round_up(node_bytes(max_level_, 0), ALLOC_UNIT);
+    h->node_count = 0;
+    h->current_level = 0;
+    memset(h->free_lists, 0, sizeof(h->free_lists));
+
+    // 归还已分配空间占用的磁盘块，文件大小不变
+#ifdef FALLOC_FL_PUNCH_HOLE
+    fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, h->used, mapped_size_ - h->used);
+#endif
+}
+
+void MmapSkipList::sync(){
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(base_ == nullptr){
+        return;
+    }
+    msync(base_, mapped_size_, MS_SYNC);
+}
+
+int MmapSkipList::size(){
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(base_ == nullptr){
+        return 0;
+    }
+    return static_cast<int>(header()->node_count);
+}
+
+size_t MmapSkipList::used_bytes() const{
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(base_ == nullptr){
+        return 0;
+    }
+    return header()->used;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <string>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+#define MMAP_STORE_FILE "store/skiplist.mmap" //mmap存储文件路径
+
+// 基于文件映射(mmap)的持久化跳表
+//
+// 所有节点都存放在一个MAP_SHARED映射的文件中，节点之间用相对于映射起始地址的
+// 偏移量（而不是裸指针）相连，因此重启时只需要重新映射文件并校验，不需要解析
+// 快照、重建节点。文件增长时通过ftruncate+mremap扩容，映射地址变化不影响偏移量。
+//
+// 文件布局：
+//   [0, 4096)      文件头 MmapHeader
+//   [4096, ...)    头结点（max_level层）以及数据节点，8字节对齐，按64字节粒度分配
+//
+// 崩溃一致性规则：
+//   1. 第0层链表是唯一的权威数据，上层指针只是索引，随时可以由第0层重建。
+//   2. 插入时先完整写好新节点（含校验和），再用一次8字节对齐的写入把它挂到
+//      第0层前驱上，最后自底向上链接上层；删除时自顶向下摘除，第0层最后摘除。
+//      因此进程在任意时刻崩溃，文件中的第0层都是一条有序且完整的链表。
+//   3. 打开期间文件头的clean_shutdown为0，只有close()在msync之后才把它置1。
+//      打开时若clean_shutdown为1则直接使用；否则沿第0层逐个校验节点（偏移范围、
+//      对齐、层数、键严格递增、CRC32C），遇到第一个非法节点就在其前驱处截断，
+//      然后重建所有上层指针，并丢弃空闲链表（空闲空间宁可泄漏也不复用可疑节点）。
+//   4. 操作系统崩溃或掉电时，只保证最近一次sync()（SAVE、定期持久化、正常关闭）
+//      之前的数据完整；之后的写入可能部分丢失，但按规则3校验后不会读到损坏的节点。
+class MmapSkipList{
+public:
+    MmapSkipList(int max_level);
+    ~MmapSkipList();
+
+    // 打开（不存在则创建）映射文件，失败时抛出StorageException
+    void open(const std::string& path, size_t initial_size);
+
+    // 同步全部脏页并标记为正常关闭，然后解除映射
+    void close();
+
+    int insert_element(int key, const std::string& value);
+    bool search_element(int key);
+    bool get_element(int key, std::string* value);
+    void delete_element(int key);
+
+    // 清空所有节点，O(1)
+    void flush();
+
+    // msync同步全部数据到磁盘
+    void sync();
+
+    int size();
+
+    // 最近一次打开是否经过了崩溃恢复，以及恢复时是否截断了损坏的链表尾部
+    bool recovered() const { return recovered_; }
+    bool truncated() const { return truncated_; }
+
+    // 映射文件大小和已分配字节数
+    size_t mapped_bytes() const { return mapped_size_; }
+    size_t used_bytes() const;
+
+    static constexpr int FREE_CLASSES = 64;  // 64B~4KB按64字节分级的空闲链表，最后一条存放更大的块
+
+    // 文件头，位于映射文件偏移0处
+    struct MmapHeader{
+        char magic[8];
+        uint32_t version;
+        uint32_t max_level;
+        uint32_t checksum;        // magic、version、max_level的CRC32C
+        uint32_t clean_shutdown;  // 正常关闭时为1，打开期间为0
+        uint64_t capacity;        // 映射文件大小
+        uint64_t used;            // 已分配到的偏移量（之后为未使用空间）
+        uint64_t head;            // 头结点偏移量
+        uint64_t node_count;
+        uint64_t current_level;
+        uint64_t free_lists[FREE_CLASSES + 1];
+    };
+
+private:
+    struct MmapNode;
+
+    MmapNode* node_at(uint64_t offset) const;
+    uint64_t* forward_of(MmapNode* node) const;
+    char* value_of(MmapNode* node) const;
+    MmapHeader* header() const;
+
+    static size_t node_bytes(int level, size_t value_length);
+    static uint32_t node_checksum(const MmapNode* node, const char* value);
+
+    // 分配至少bytes字节的块，块的alloc_bytes已记录实际大小（复用的大块可能更大）
+    uint64_t allocate(size_t bytes);
+    void release(uint64_t offset);
+    void grow(size_t min_size);
+    void format(int max_level);
+    void recover();
+    int get_random_level();
+
+    std::string path_;
+    int fd_;
+    char* base_;
+    size_t mapped_size_;
+    int max_level_;
+    bool recovered_;
+    bool truncated_;
+    mutable std::mutex mtx_;
+};
@@ -1,7 +1,9 @@
 #include <iostream>
 #include "skiplist.h"
+#include <thread>
+#include <algorithm>
+#include <exception>
 
-std::mutex mtx;
 std::string delimiter = ":"; //分隔符
 
 template<typename K, typename V>
@@ -9,28 +11,41 @@ SkipList<K,V>::SkipList(int max_level){
     this->max_level_ = max_level;
     this->current_level_ = 0;
     this->node_count_ = 0;
+    this->lazy_free_ = false;
+    this->snapshot_compression_ = 0;
+    this->defrag_cursor_ = K{};
+    this->defrag_cursor_valid_ = false;
+    this->track_dirty_ = false;
+    this->dirty_all_ = false;
     K k = K{};
     V v = V{};
-    this->head_ = new Node<K,V>(k, v, max_level_);
+    this->head_ = new (max_level_) Node<K,V>(k, v, max_level_);
 }
 
 template<typename K, typename V>
 SkipList<K,V>::~SkipList(){
-    clear(head_);
+    // 惰性释放时只把整条链交给后台线程，析构本身为O(1)
+    if(lazy_free_ && LazyFreer<K,V>::getInstance().is_started()){
+        LazyFreer<K,V>::getInstance().submit(head_, node_count_);
+    } else {
+        clear(head_);
+    }
 }
 
 template<typename K, typename V>
-Node<K,V>* SkipList<K,V>::create_node(const K k, const V v, int level){
-    Node<K,V> *n = new Node<K,V>(k, v, level); 
+Node<K,V>* SkipList<K,V>::create_node(const K k, V v, int level){
+    Node<K,V> *n = new (level) Node<K,V>(k, std::move(v), level);
     return n;
 }
 
 template<typename K, typename V>
 bool SkipList<K,V>::search_element(K key){
+    // 加锁，防止查找过程中节点被flush摘下并由后台线程释放
+    std::lock_guard<std::mutex> lock(mtx_);
     //定义一个指针current，初始化为跳表的头结点_header
     Node<K,V>* current = head_;
-    //从跳表的最高层开始搜索
-    for(int i = max_level_; i >= 0; i--){
+    //从跳表的当前最高层开始搜索
+    for(int i = current_level_; i >= 0; i--){
         //遍历当前层级，直到下一个节点的键值大于或等于待查找的键值
         while(current->forward[i] && current->forward[i]->get_key() < key){
             //移动到当前层级的下一个节点
@@ -49,6 +64,46 @@ bool SkipList<K,V>::search_element(K key){
     return false;
 }
 
+// 查找元素并取出value
+// @return 找到时返回true，并在value非空时写入节点中保存的value
+template<typename K, typename V>
+bool SkipList<K,V>::get_element(K key, V* value){
+    std::lock_guard<std::mutex> lock(mtx_);
+    Node<K,V>* current = head_;
+    for(int i = current_level_; i >= 0; i--){
+        while(current->forward[i] && current->forward[i]->get_key() < key){
+            current = current->forward[i];
+        }
+    }
+    current = current->forward[0];
+    if(current && current->get_key() == key){
+        if(value != nullptr){
+            *value = current->get_value();
+        }
+        return true;
+    }
+    return false;
+}
+
+// 当key当前的value等于expected时替换为desired
+// @return 替换成功返回true，key不存在或value已变化返回false
+template<typename K, typename V>
+bool SkipList<K,V>::compare_and_set(K key, const V& expected, const V& desired){
+    std::lock_guard<std::mutex> lock(mtx_);
+    Node<K,V>* current = head_;
+    for(int i = current_level_; i >= 0; i--){
+        while(current->forward[i] && current->forward[i]->get_key() < key){
+            current = current->forward[i];
+        }
+    }
+    current = current->forward[0];
+    if(current && current->get_key() == key && current->get_value() == expected){
+        current->set_value(desired);
+        return true;
+    }
+    return false;
+}
+
 // 在跳表中插入一个新元素
 // @param key 待插入节点的key
 // @param value 待插入节点的value
@@ -56,13 +111,13 @@ bool SkipList<K,V>::search_element(K key){
 
 template<typename K, typename V>
 int SkipList<K,V>::insert_element(const K key, const V value){
-    mtx.lock();
+    mtx_.lock();
     Node<K,V>* current = this->head_;
     Node<K,V>* update[max_level_ + 1]; //用于记录每层中待更新指针的节点
     memset(update, 0, sizeof(Node<K,V>*)*(max_level_ + 1));
 
-    // 从最高层向下搜索插入位置
-    for(int i = max_level_; i >= 0; i--){
+    // 从当前最高层向下搜索插入位置
+    for(int i = current_level_; i >= 0; i--){
         //寻找当前层中最接近且小于key的节点
         while(current->forward[i] != NULL && current->forward[i]->get_key() < key){
             current = current->forward[i]; //移动到下一节点
@@ -77,7 +132,7 @@ int SkipList<K,V>::insert_element(const K key, const V value){
     if(current != NULL && current->get_key() == key){
         // 如果键已存在，取消插入
         std::cout << "key:" << key << ", exists" << std::endl;
-        mtx.unlock();
+        mtx_.unlock();
         return 1;
     }
     // 检查待插入的节点是否已存在于跳表中
@@ -85,13 +140,13 @@ int SkipList<K,V>::insert_element(const K key, const V value){
         // 通过随机函数决定新节点的层级高度
         int random_level = get_random_level();
         // 如果新节点的层级超出了跳表的当前最高层级
-        if(random_level > max_level_){
+        if(random_level > current_level_){
             // 对所有新的更高层级，将头结点设置为它们的前驱节点
-            for(int i = max_level_ + 1; i <= random_level; i++){
+            for(int i = current_level_ + 1; i <= random_level; i++){
                 update[i] = head_;
             }
             //更新跳表的当前最高层级为新节点的层级
-            max_level_ = random_level;
+            current_level_ = random_level;
         }
 
         Node<K,V> *inserted_node = create_node(key, value, random_level);
@@ -102,13 +157,65 @@ int SkipList<K,V>::insert_element(const K key, const V value){
             // 当前节点的下一个节点更新为新节点
             update[i]->forward[i] = inserted_node;
         }
-        // 更新跳表的当前最高层级为新节点的层级
-        max_level_ = random_level;
+        node_count_++;
+        if(track_dirty_){
+            dirty_keys_.insert(key);
+        }
     }
-    mtx.unlock(); // 函数执行完毕后解锁
+    mtx_.unlock(); // 函数执行完毕后解锁
     return 0;
 }
 
+// 插入元素，key已存在时覆盖其value
+// @return 新插入返回0，覆盖已有value返回1
+template<typename K, typename V>
+int SkipList<K,V>::upsert_element(const K key, const V value){
+    std::lock_guard<std::mutex> lock(mtx_);
+    Node<K,V>* current = this->head_;
+    Node<K,V>* update[max_level_ + 1];
+    memset(update, 0, sizeof(Node<K,V>*) * (max_level_ + 1));
+
+    for(int i = current_level_; i >= 0; i--){
+        while(current->forward[i] != NULL && current->forward[i]->get_key() < key){
+            current = current->forward[i];
+        }
+        update[i] = current;
+    }
+
+    if(track_dirty_){
+        dirty_keys_.insert(key);
+    }
+    current = current->forward[0];
+    if(current != NULL && current->get_key() == key){
+        current->set_value(value);
+        return 1;
+    }
+
+    int random_level = get_random_level();
+    if(random_level > current_level_){
+        for(int i = current_level_ + 1; i <= random_level; i++){
+            update[i] = head_;
+        }
+        current_level_ = random_level;
+    }
+    Node<K,V> *inserted_node = create_node(key, value, random_level);
+    for(int i = 0; i <= random_level; i++){
+        inserted_node->forward[i] = update[i]->forward[i];
+        update[i]->forward[i] = inserted_node;
+    }
+    node_count_++;
+    return 0;
+}
+
+// 按key升序遍历所有节点，遍历期间持有跳表锁，回调中不能再访问同一个跳表
+template<typename K, typename V>
+void SkipList<K,V>::for_each(std::function<void(const K&, const V&)> visitor){
+    std::lock_guard<std::mutex> lock(mtx_);
+    for(Node<K,V>* node = head_->forward[0]; node != nullptr; node = node->forward[0]){
+        visitor(node->get_key(), node->get_value());
+    }
+}
+
 template<typename K, typename V>
 int SkipList<K,V>::get_random_level(){
     int k = 1;
@@ -121,13 +228,13 @@ int SkipList<K,V>::get_random_level(){
 
 template<typename K, typename V>
 void SkipList<K,V>::delete_element(K key){
-    mtx.lock();
+    mtx_.lock();
     Node<K,V>* current = this->head_;
     Node<K,V>* update[max_level_ + 1];
     memset(update, 0, sizeof(Node<K,V>*) * (max_level_ + 1));
 
-    // 从最高层开始向下搜索待删除节点
-    for(int i = max_level_; i >= 0; i--){
+    // 从当前最高层开始向下搜索待删除节点
+    for(int i = current_level_; i >= 0; i--){
         while(current->forward[i] != NULL && current->forward[i]->get_key() < key){
             current = current->forward[i];
         }
@@ -138,18 +245,21 @@ void SkipList<K,V>::delete_element(K key){
     // 确认找到了待删除的节点
     if(current != NULL && current->get_key() == key){
         // 逐层更新指针，移除节点
-        for(int i = 0; i <= max_level_; i++){
+        for(int i = 0; i <= current_level_; i++){
             if(update[i]->forward[i] != current) break;
             update[i]->forward[i] = current->forward[i];
         }
         // 调整跳表的层级
-        while(max_level_ > 0 && head_->forward[max_level_] == NULL){
-            max_level_--;
+        while(current_level_ > 0 && head_->forward[current_level_] == NULL){
+            current_level_--;
         }
         delete current;
         node_count_--;
+        if(track_dirty_){
+            dirty_keys_.insert(key);
+        }
     }
-    mtx.unlock();
+    mtx_.unlock();
     return;
 }
 
@@ -170,18 +280,35 @@ void SkipList<K,V>::display_list(){
     }
 }
 
+// 以二进制快照格式（见persistence/snapshot.h）保存全部节点，保存的是还原后的value
+// @param sequence 写入文件头，表示快照已包含seq更小的增量（见persistence/delta_snapshot.h）
+// @param throttle 后台保存时的写出限速，nullptr表示不限速
 template<typename K, typename V>
-void SkipList<K,V>::dump_file(){
-    file_writer_.open(STORE_FILE); // 打开文件
-    Node<K,V>* node = this->head_->forward[0]; // 从头节点开始遍历
-
-    while(node != nullptr){
-        file_writer_ << node->get_key() << ":" << node->get_value() << ";\n"; //写入键值对
-        node = node->forward[0]; // 移动到下一个节点
+void SkipList<K,V>::dump_file(const std::function<void(uint64_t)>& progress, uint64_t sequence, IoThrottle* throttle){
+    SnapshotWriter writer(STORE_FILE);
+    writer.setSequence(sequence);
+    writer.setCompression(snapshot_compression_);
+    writer.setThrottle(throttle);
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        for(Node<K,V>* node = this->head_->forward[0]; node != nullptr; node = node->forward[0]){
+            writer.add(node->get_key(), value_decoder_ ? value_decoder_(node->get_value()) : node->get_value());
+            if(progress && (writer.entries() & 1023) == 0){
+                progress(writer.entries());
+            }
+        }
+    }
+    writer.commit(); // fsync后原子替换旧快照
+    if(progress){
+        progress(writer.entries());
     }
+}
 
-    file_writer_.flush(); // 刷新缓冲区，确保数据完全写入
-    file_writer_.close(); // 关闭文件
+// 持有跳表锁执行fn，用于在没有写入进行时fork出一致的内存镜像
+template<typename K, typename V>
+void SkipList<K,V>::run_locked(const std::function<void()>& fn){
+    std::lock_guard<std::mutex> lock(mtx_);
+    fn();
 }
 
 // 该函数是否是有效字符串
@@ -199,36 +326,378 @@ void SkipList<K,V>::get_key_value_from_string(const std::string &str, std::strin
     *key = str.substr(0, str.find(delimiter)); //substr函数是前闭后开
     *value = str.substr(str.find(delimiter) + 1, str.length());
 }
+// 加载快照；旧的"key:value;"文本快照先转换为二进制格式
+// @param threads 并行解码的线程数，0表示使用全部CPU。各线程按块范围解码并构建
+//                有序节点段，最后由bulk_link按顺序接入跳表
 template<typename K, typename V>
-void SkipList<K,V>::load_file(){
-    file_reader_.open(STORE_FILE);
-    std::string line;
-    std::string *key = new std::string();
-    std::string *value = new std::string();
+void SkipList<K,V>::load_file(int threads, bool use_mmap, const LoadProgress& progress){
+    if(!std::ifstream(STORE_FILE).good()){
+        return;
+    }
+    if(!SnapshotReader::isSnapshot(STORE_FILE)){
+        uint64_t converted = convertTextSnapshot(STORE_FILE, STORE_FILE);
+        std::cout << "converted text snapshot " << STORE_FILE << " (" << converted << " keys)" << std::endl;
+    }
+
+    SnapshotReader reader(STORE_FILE);
+    load_snapshot(reader, threads, use_mmap, progress);
+}
+
+// 并行解码一个已打开的快照（可以是嵌入在AOF中的前导）并接入跳表。有progress时按key顺序
+// 分批加载：每批的块并行解码、接入跳表后回调一次，此时小于下一块首key的key都已就绪
+template<typename K, typename V>
+void SkipList<K,V>::load_snapshot(const SnapshotReader& reader, int threads, bool use_mmap, const LoadProgress& progress){
+    const size_t wave_blocks_per_thread = 16;  // 分批加载时每个线程每批解码的块数
+
+    size_t blocks = reader.blockCount();
+    if(threads <= 0){
+        threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    size_t workers = std::max<size_t>(1, std::min<size_t>(static_cast<size_t>(threads), blocks));
+    size_t wave = progress ? workers * wave_blocks_per_thread : blocks;
 
-    while(getline(file_reader_, line)){
-        get_key_value_from_string(line, key, value);
-        if(key->empty() || value->empty()){
+    for(size_t wave_begin = 0; wave_begin < blocks; wave_begin += wave){
+        size_t wave_end = std::min(blocks, wave_begin + wave);
+        size_t wave_size = wave_end - wave_begin;
+        size_t wave_workers = std::min(workers, wave_size);
+
+        std::vector<BulkSegment> segments;
+        for(size_t t = 0; t < wave_workers; t++){
+            segments.push_back(new_bulk_segment(0x9E3779B97F4A7C15ull * (wave_begin + t + 1)));
+        }
+        std::vector<std::exception_ptr> errors(wave_workers);
+        auto decode = [&](size_t t){
+            try {
+                // value直接由快照中的字节构造
+                auto visitor = [&](int64_t key, const char* data, size_t length){
+                    K k = static_cast<K>(key);
+                    V value(data, length);
+                    bulk_append(segments[t], k, value_encoder_ ? value_encoder_(k, value) : std::move(value));
+                };
+                size_t begin = wave_begin + wave_size * t / wave_workers;
+                size_t end = wave_begin + wave_size * (t + 1) / wave_workers;
+                if(use_mmap){
+                    reader.mapBlocks(begin, end, visitor);
+                } else {
+                    std::string buffer;
+                    for(size_t b = begin; b < end; b++){
+                        reader.readBlock(b, buffer, visitor);
+                    }
+                }
+            } catch (...) {
+                errors[t] = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for(size_t t = 1; t < wave_workers; t++){
+            pool.emplace_back(decode, t);
+        }
+        decode(0);
+        for(auto& thread : pool){
+            thread.join();
+        }
+        for(size_t t = 0; t < wave_workers; t++){
+            if(errors[t]){
+                for(auto& segment : segments){
+                    free_bulk_segment(segment);
+                }
+                std::rethrow_exception(errors[t]);
+            }
+        }
+        bulk_link(segments);
+        if(progress){
+            progress(reader, wave_end);
+        }
+    }
+}
+
+template<typename K, typename V>
+typename SkipList<K,V>::BulkSegment SkipList<K,V>::new_bulk_segment(uint64_t seed){
+    BulkSegment segment;
+    segment.heads.assign(max_level_ + 1, nullptr);
+    segment.tails.assign(max_level_ + 1, nullptr);
+    segment.seed = seed ? seed : 1;
+    return segment;
+}
+
+// 把一个节点追加到段尾，只访问段本身，可在多个线程中对不同的段并行调用
+template<typename K, typename V>
+void SkipList<K,V>::bulk_append(BulkSegment& segment, K key, V value){
+    // xorshift64，避免多个线程争用rand()
+    segment.seed ^= segment.seed << 13;
+    segment.seed ^= segment.seed >> 7;
+    segment.seed ^= segment.seed << 17;
+    int level = 1;
+    for(uint64_t bits = segment.seed; (bits & 1) && level < max_level_; bits >>= 1){
+        level++;
+    }
+
+    if(segment.count > 0 && !(segment.tails[0]->get_key() < key)){
+        segment.sorted = false;
+    }
+    Node<K,V>* node = create_node(key, std::move(value), level);
+    for(int i = 0; i <= level; i++){
+        if(segment.tails[i] != nullptr){
+            segment.tails[i]->forward[i] = node;
+        } else {
+            segment.heads[i] = node;
+        }
+        segment.tails[i] = node;
+    }
+    segment.level = std::max(segment.level, level);
+    segment.count++;
+}
+
+// 按顺序把各段接入跳表：段的key都大于表中现有的最大key时，每层只需把表尾接到段首，
+// 代价与节点数无关；否则（表非空且key有重叠，或段内无序）退化为逐个插入，已存在的key保留原值
+template<typename K, typename V>
+void SkipList<K,V>::bulk_link(std::vector<BulkSegment>& segments){
+    std::lock_guard<std::mutex> lock(mtx_);
+    Node<K,V>* tail[max_level_ + 1];
+    auto find_tails = [&](){
+        Node<K,V>* x = head_;
+        for(int i = max_level_; i >= 0; i--){
+            while(x->forward[i] != nullptr){
+                x = x->forward[i];
+            }
+            tail[i] = x;
+        }
+    };
+    find_tails();
+
+    for(auto& segment : segments){
+        if(segment.count == 0){
             continue;
         }
-        // 将key定义为int类型
-        insert_element(stoi(*key), *value);
-        std::cout << "key:" << *key << "value:" << *value << std::endl;
+        if(segment.sorted && (tail[0] == head_ || tail[0]->get_key() < segment.heads[0]->get_key())){
+            for(int i = 0; i <= max_level_; i++){
+                if(segment.heads[i] != nullptr){
+                    tail[i]->forward[i] = segment.heads[i];
+                    tail[i] = segment.tails[i];
+                }
+            }
+            current_level_ = std::max(current_level_, segment.level);
+            node_count_ += static_cast<int>(segment.count);
+        } else {
+            Node<K,V>* node = segment.heads[0];
+            while(node != nullptr){
+                Node<K,V>* next = node->forward[0];
+                Node<K,V>* update[max_level_ + 1];
+                Node<K,V>* x = head_;
+                for(int i = max_level_; i >= 0; i--){
+                    while(x->forward[i] != nullptr && x->forward[i]->get_key() < node->get_key()){
+                        x = x->forward[i];
+                    }
+                    update[i] = x;
+                }
+                if(x->forward[0] != nullptr && x->forward[0]->get_key() == node->get_key()){
+                    delete node;
+                } else {
+                    for(int i = 0; i <= node->node_level; i++){
+                        node->forward[i] = update[i]->forward[i];
+                        update[i]->forward[i] = node;
+                    }
+                    current_level_ = std::max(current_level_, node->node_level);
+                    node_count_++;
+                }
+                node = next;
+            }
+            find_tails();
+        }
+        // 批量接入的节点不逐个记录脏键，下一次保存全量快照
+        dirty_all_ = dirty_all_ || track_dirty_;
+        segment.heads.assign(max_level_ + 1, nullptr);
+        segment.tails.assign(max_level_ + 1, nullptr);
+        segment.count = 0;
     }
+}
 
-    delete key;
-    delete value;
-    file_reader_.close();
+// 释放尚未接入跳表的段
+template<typename K, typename V>
+void SkipList<K,V>::free_bulk_segment(BulkSegment& segment){
+    clear(segment.heads[0]);
+    segment.heads.assign(max_level_ + 1, nullptr);
+    segment.tails.assign(max_level_ + 1, nullptr);
+    segment.count = 0;
 }
 
+// 沿第0层迭代释放从node开始的整条链，避免递归在大跳表上栈溢出
 template<typename K, typename V>
 void SkipList<K,V>::clear(Node<K,V>* node){
-    if(node == nullptr) return;
-    clear(node->forward[0]);
-    delete node;
+    while(node != nullptr){
+        Node<K,V>* next = node->forward[0];
+        delete node;
+        node = next;
+    }
+}
+
+// 用新的头结点替换旧头结点，O(1)地摘下所有数据节点
+// @return 旧头结点，整条链仍挂在它的forward上，由调用方负责释放
+template<typename K, typename V>
+Node<K,V>* SkipList<K,V>::detach(){
+    Node<K,V>* old_head = head_;
+    head_ = new (old_head->node_level) Node<K,V>(K{}, V{}, old_head->node_level);
+    current_level_ = 0;
+    node_count_ = 0;
+    return old_head;
+}
+
+// 清空跳表
+// @param lazy 为true且后台释放线程已启动时，节点在后台分块释放，调用方O(1)返回
+template<typename K, typename V>
+void SkipList<K,V>::flush(bool lazy){
+    mtx_.lock();
+    int count = node_count_;
+    Node<K,V>* old_head = detach();
+    if(track_dirty_){
+        dirty_all_ = true;
+        dirty_keys_.clear();
+    }
+    mtx_.unlock();
+
+    if(lazy && LazyFreer<K,V>::getInstance().is_started()){
+        LazyFreer<K,V>::getInstance().submit(old_head, count);
+        return;
+    }
+    clear(old_head->forward[0]);
+    delete old_head;
+}
+
+// 主动碎片整理：从游标处继续扫描最多count个节点，把位于稀疏页上的节点迁移到地址更低的页
+// 与delete_element一样维护每层的前驱update[i]，迁移时逐层把前驱的forward指向新节点
+// @return 本次扫描到达表尾（完成一整轮）时返回true
+template<typename K, typename V>
+bool SkipList<K,V>::defrag_step(int count, size_t* scanned, size_t* moved){
+    std::lock_guard<std::mutex> lock(mtx_);
+    NodeAllocator& allocator = NodeAllocator::getInstance();
+    Node<K,V>* current = head_;
+    Node<K,V>* update[max_level_ + 1];
+    for(int i = current_level_; i >= 0; i--){
+        while(defrag_cursor_valid_ && current->forward[i] && current->forward[i]->get_key() <= defrag_cursor_){
+            current = current->forward[i];
+        }
+        update[i] = current;
+    }
+
+    Node<K,V>* node = update[0]->forward[0];
+    for(int n = 0; node != nullptr && n < count; n++){
+        Node<K,V>* next = node->forward[0];
+        if(allocator.shouldMove(node)){
+            void* memory = allocator.reallocForDefrag(node);
+            if(memory != nullptr){
+                Node<K,V>* relocated = ::new (memory) Node<K,V>(node->get_key(), node->get_value(), node->node_level);
+                for(int i = 0; i <= node->node_level; i++){
+                    relocated->forward[i] = node->forward[i];
+                    update[i]->forward[i] = relocated;
+                }
+                delete node;
+                node = relocated;
+                (*moved)++;
+            }
+        }
+        for(int i = 0; i <= node->node_level; i++){
+            update[i] = node;
+        }
+        defrag_cursor_ = node->get_key();
+        defrag_cursor_valid_ = true;
+        (*scanned)++;
+        node = next;
+    }
+
+    if(node == nullptr){
+        defrag_cursor_valid_ = false;
+        return true;
+    }
+    return false;
+}
+
+template<typename K, typename V>
+void SkipList<K,V>::set_lazy_free(bool lazy){
+    lazy_free_ = lazy;
+}
+
+// 设置保存快照时数据块的压缩级别（见persistence/lz_codec.h）
+template<typename K, typename V>
+void SkipList<K,V>::set_snapshot_compression(int level){
+    snapshot_compression_ = level;
+}
+
+// 设置持久化时使用的value编解码函数（例如键值分离时value与值日志句柄之间的转换）
+template<typename K, typename V>
+void SkipList<K,V>::set_value_codec(std::function<V(const K&, const V&)> encoder, std::function<V(const V&)> decoder){
+    value_encoder_ = encoder;
+    value_decoder_ = decoder;
 }
 
 template<typename K, typename V>
 int SkipList<K,V>::size(){
     return node_count_;
-}
\ No newline at end of file
+}
+// 开启或关闭脏键跟踪，开启后的第一次保存必须是全量快照
+template<typename K, typename V>
+void SkipList<K,V>::set_dirty_tracking(bool enabled){
+    std::lock_guard<std::mutex> lock(mtx_);
+    track_dirty_ = enabled;
+    dirty_all_ = enabled;
+    dirty_keys_.clear();
+}
+
+// 取走脏键并按key升序读出它们的当前值，已删除的key标记为deleted
+// @return 需要全量快照时返回false，此时不取走任何内容
+template<typename K, typename V>
+bool SkipList<K,V>::take_dirty(std::vector<DirtyEntry>& entries){
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(dirty_all_){
+        return false;
+    }
+    std::vector<K> keys(dirty_keys_.begin(), dirty_keys_.end());
+    dirty_keys_.clear();
+    std::sort(keys.begin(), keys.end());
+
+    entries.reserve(entries.size() + keys.size());
+    for(const K& key : keys){
+        Node<K,V>* current = head_;
+        for(int i = current_level_; i >= 0; i--){
+            while(current->forward[i] != nullptr && current->forward[i]->get_key() < key){
+                current = current->forward[i];
+            }
+        }
+        current = current->forward[0];
+        if(current != nullptr && current->get_key() == key){
+            entries.push_back({key, false, value_decoder_ ? value_decoder_(current->get_value()) : current->get_value()});
+        } else {
+            entries.push_back({key, true, V{}});
+        }
+    }
+    return true;
+}
+
+// 全量快照开始前调用：清空脏键，返回被清空的key
+// @return 清空前是否需要全量快照，连同keys一起交给restore_dirty用于失败时恢复
+template<typename K, typename V>
+bool SkipList<K,V>::take_dirty_keys(std::vector<K>& keys){
+    std::lock_guard<std::mutex> lock(mtx_);
+    keys.assign(dirty_keys_.begin(), dirty_keys_.end());
+    dirty_keys_.clear();
+    bool all = dirty_all_;
+    dirty_all_ = false;
+    return all;
+}
+
+// 保存失败时把取走的脏键放回
+template<typename K, typename V>
+void SkipList<K,V>::restore_dirty(const std::vector<K>& keys, bool all){
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(!track_dirty_){
+        return;
+    }
+    dirty_keys_.insert(keys.begin(), keys.end());
+    dirty_all_ = dirty_all_ || all;
+}
+
+template<typename K, typename V>
+size_t SkipList<K,V>::dirty_count(){
+    std::lock_guard<std::mutex> lock(mtx_);
+    return dirty_keys_.size();
+}
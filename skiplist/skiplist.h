@@ -5,7 +5,13 @@
 #include <mutex>
 #include <cstring>
 #include <fstream> // 引入文件操作
+#include <functional>
+#include <vector>
+#include <unordered_set>
 #include "../node/node.h"
+#include "../node/node_allocator.h"
+#include "lazy_free.h"
+#include "../persistence/snapshot.h"
 #define STORE_FILE "store/dumpFile" //存储文件路径
 
 // 跳表的实现
@@ -17,23 +23,71 @@ public:
     int get_random_level();
     Node<K,V>* create_node(K, V, int);
     int insert_element(K, V);
+    int upsert_element(K, V);
     void display_list();
     bool search_element(K);
+    bool get_element(K, V*);
+    bool compare_and_set(K, const V&, const V&);
     void delete_element(K);
-    void dump_file();
+    void for_each(std::function<void(const K&, const V&)>);
+    void dump_file(const std::function<void(uint64_t)>& progress = nullptr, uint64_t sequence = 0, IoThrottle* throttle = nullptr);
     bool is_valid_string(const std::string&);
     void get_key_value_from_string(const std::string&, std::string*, std::string*);
-    void load_file();
+    // 加载进度回调：参数为快照和已接入跳表的块数
+    using LoadProgress = std::function<void(const SnapshotReader&, size_t)>;
+    void load_file(int threads = 1, bool use_mmap = true, const LoadProgress& progress = nullptr);
+    void load_snapshot(const SnapshotReader&, int threads = 1, bool use_mmap = true, const LoadProgress& progress = nullptr);
     void clear(Node<K,V>*);
+    Node<K,V>* detach();
+    void flush(bool lazy);
+    void set_lazy_free(bool);
+    void set_snapshot_compression(int);
+    bool defrag_step(int, size_t*, size_t*);
+    void run_locked(const std::function<void()>&);
+
+    // 批量加载时由各线程独立构建的节点段，各层已按key顺序链好，尚未接入跳表
+    struct BulkSegment {
+        std::vector<Node<K,V>*> heads;
+        std::vector<Node<K,V>*> tails;
+        size_t count = 0;
+        int level = 0;       // 段中节点的最高层
+        bool sorted = true;  // key是否严格递增
+        uint64_t seed = 0;   // 段内随机层数的种子
+    };
+    BulkSegment new_bulk_segment(uint64_t seed);
+    void bulk_append(BulkSegment&, K, V);
+    void bulk_link(std::vector<BulkSegment>&);
+    void free_bulk_segment(BulkSegment&);
+    void set_value_codec(std::function<V(const K&, const V&)>, std::function<V(const V&)>);
     int size();
 
+    // 脏键跟踪（增量快照）：记录上次取走以来被写入或删除的key
+    struct DirtyEntry {
+        K key;
+        bool deleted;
+        V value;
+    };
+    void set_dirty_tracking(bool);
+    bool take_dirty(std::vector<DirtyEntry>&);
+    bool take_dirty_keys(std::vector<K>&);
+    void restore_dirty(const std::vector<K>&, bool);
+    size_t dirty_count();
+
 private:
     Node<K,V>* head_; //头结点，作为跳表所有节点组织的入口点，类似与单链表
     int max_level_; //跳表中允许的最大层数
     int current_level_; //跳表当前的层数
     int node_count_; //跳表中节点的数量
-    std::ofstream file_writer_;
-    std::ifstream file_reader_;
+    bool lazy_free_; //析构和清空时是否交给后台线程释放节点
+    int snapshot_compression_; //保存快照时数据块的压缩级别，0为不压缩
+    K defrag_cursor_; //碎片整理游标：上一次扫描到的key
+    bool defrag_cursor_valid_; //为false时下一次碎片整理从表头开始
+    std::function<V(const K&, const V&)> value_encoder_; //加载文件时把value转换为跳表中保存的形式
+    std::function<V(const V&)> value_decoder_; //保存文件时把跳表中保存的形式还原为value
+    bool track_dirty_; //是否记录脏键
+    bool dirty_all_; //发生过flush等无法逐个key记录的变化，下一次必须保存全量快照
+    std::unordered_set<K> dirty_keys_; //上次保存以来被写入或删除的key
+    std::mutex mtx_; //保护跳表结构，每个跳表实例独立加锁
 };
 
 template class SkipList<int, std::string>;
\ No newline at end of file
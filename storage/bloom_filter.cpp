@@ -0,0 +1,64 @@
+#include "bloom_filter.h"
+#include <algorithm>
+
+BloomFilter::BloomFilter(size_t expected_keys, int bits_per_key) {
+    bits_per_key = std::max(bits_per_key, 1);
+    // k = bits_per_key * ln2，误判率约为 0.6185^bits_per_key
+    num_hashes_ = std::min(30, std::max(1, static_cast<int>(bits_per_key * 0.69)));
+    size_t bits = std::max<size_t>(64, expected_keys * static_cast<size_t>(bits_per_key));
+    size_t bytes = (bits + 7) / 8;
+    bits_.assign(bytes, 0);
+    num_bits_ = static_cast<uint32_t>(bytes * 8);
+}
+
+BloomFilter::BloomFilter(const std::string& data) {
+    if (data.size() < 2) {
+        return;
+    }
+    num_hashes_ = static_cast<uint8_t>(data.back());
+    bits_.assign(data.begin(), data.end() - 1);
+    num_bits_ = static_cast<uint32_t>(bits_.size() * 8);
+}
+
+uint64_t BloomFilter::hash(int key) {
+    // splitmix64终结函数，连续的整数key也能均匀分布
+    uint64_t x = static_cast<uint64_t>(static_cast<uint32_t>(key)) + 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+void BloomFilter::add(int key) {
+    if (num_bits_ == 0) {
+        return;
+    }
+    uint64_t h = hash(key);
+    uint32_t h1 = static_cast<uint32_t>(h);
+    uint32_t h2 = static_cast<uint32_t>(h >> 32) | 1;
+    for (int i = 0; i < num_hashes_; ++i) {
+        uint32_t bit = (h1 + static_cast<uint32_t>(i) * h2) % num_bits_;
+        bits_[bit / 8] |= static_cast<uint8_t>(1u << (bit % 8));
+    }
+}
+
+bool BloomFilter::mayContain(int key) const {
+    if (num_bits_ == 0 || num_hashes_ == 0) {
+        return true;
+    }
+    uint64_t h = hash(key);
+    uint32_t h1 = static_cast<uint32_t>(h);
+    uint32_t h2 = static_cast<uint32_t>(h >> 32) | 1;
+    for (int i = 0; i < num_hashes_; ++i) {
+        uint32_t bit = (h1 + static_cast<uint32_t>(i) * h2) % num_bits_;
+        if ((bits_[bit / 8] & (1u << (bit % 8))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string BloomFilter::serialize() const {
+    std::string data(bits_.begin(), bits_.end());
+    data.push_back(static_cast<char>(num_hashes_));
+    return data;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// 整数key的Bloom过滤器
+//
+// 使用双重哈希 h1 + i*h2 生成k个位置，k按每key位数取 bits_per_key*ln2。
+// 序列化格式：位数组 | 哈希函数个数(u8)，与有序段文件一起保存。
+class BloomFilter {
+public:
+    BloomFilter(size_t expected_keys, int bits_per_key);
+    // 从序列化数据恢复，数据非法时得到一个对任何key都返回true的过滤器
+    explicit BloomFilter(const std::string& data);
+
+    void add(int key);
+    // 返回false时key一定不存在
+    bool mayContain(int key) const;
+
+    std::string serialize() const;
+
+private:
+    static uint64_t hash(int key);
+
+    std::vector<uint8_t> bits_;
+    uint32_t num_bits_ = 0;
+    int num_hashes_ = 0;
+};
@@ -0,0 +1,534 @@
+#include "lsm_store.h"
+#include "../include/exceptions.h"
+#include "../logger/logger.h"
+#include "../utils/utils.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <set>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+const char TAG_PUT = 'P';
+const char TAG_DELETE = 'D';
+const size_t NODE_OVERHEAD = 64;          // 估算每个跳表节点的额外开销
+const size_t MAX_IMMUTABLE_MEMTABLES = 2; // 冻结的memtable超过该数量时阻塞写入
+const int MAX_RUNS_FACTOR = 4;            // 段数达到compaction_trigger的该倍数时强制合并
+const char* MANIFEST_FILE = "MANIFEST";
+}
+
+LsmStore::LsmStore() {
+}
+
+LsmStore::~LsmStore() {
+    close();
+}
+
+std::shared_ptr<LsmStore::MemTable> LsmStore::newMemTable() const {
+    auto memtable = std::make_shared<MemTable>(options_.max_level);
+    memtable->set_lazy_free(true);
+    return memtable;
+}
+
+std::string LsmStore::runPath(uint64_t id) const {
+    char name[32];
+    snprintf(name, sizeof(name), "run-%06llu.sst", static_cast<unsigned long long>(id));
+    return options_.dir + "/" + name;
+}
+
+void LsmStore::open(const Options& options) {
+    options_ = options;
+    options_.compaction_trigger = std::max(options_.compaction_trigger, 2);
+    if (options_.memory_limit > 0) {
+        // 一个可写memtable加上最多MAX_IMMUTABLE_MEMTABLES个冻结的memtable不超过内存上限
+        options_.memtable_size = std::min(options_.memtable_size,
+                                          options_.memory_limit / (MAX_IMMUTABLE_MEMTABLES + 1));
+    }
+    options_.memtable_size = std::max<size_t>(options_.memtable_size, 4096);
+
+    std::error_code ec;
+    std::filesystem::create_directories(options_.dir, ec);
+    if (ec) {
+        throw skiplist::StorageException("failed to create LSM directory " + options_.dir + ": " + ec.message());
+    }
+
+    loadManifest();
+    memtable_ = newMemTable();
+    memtable_bytes_ = 0;
+
+    bg_running_ = true;
+    bg_thread_ = std::thread(&LsmStore::backgroundLoop, this);
+    open_ = true;
+}
+
+void LsmStore::close() {
+    if (!open_) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(bg_mutex_);
+        bg_running_ = false;
+    }
+    bg_cv_.notify_all();
+    bg_done_cv_.notify_all();
+    if (bg_thread_.joinable()) {
+        bg_thread_.join();
+    }
+
+    // 后台线程已退出，在当前线程把剩余memtable全部写成有序段
+    std::lock_guard<std::mutex> write_lock(write_mutex_);
+    {
+        std::unique_lock<std::shared_mutex> lock(state_mutex_);
+        if (memtable_->size() > 0) {
+            freezeLocked();
+        }
+    }
+    while (true) {
+        std::shared_ptr<MemTable> oldest;
+        {
+            std::shared_lock<std::shared_mutex> lock(state_mutex_);
+            if (immutables_.empty()) {
+                break;
+            }
+            oldest = immutables_.back();
+        }
+        flushImmutable(oldest);
+    }
+    open_ = false;
+}
+
+bool LsmStore::lookup(int key, std::string* value) {
+    std::shared_lock<std::shared_mutex> lock(state_mutex_);
+    std::string stored;
+    bool found = memtable_->get_element(key, &stored);
+    for (size_t i = 0; !found && i < immutables_.size(); ++i) {
+        found = immutables_[i]->get_element(key, &stored);
+    }
+    if (found) {
+        if (stored.empty() || stored[0] == TAG_DELETE) {
+            return false;
+        }
+        if (value != nullptr) {
+            value->assign(stored, 1, std::string::npos);
+        }
+        return true;
+    }
+
+    for (const auto& run : runs_) {
+        switch (run->get(key, value)) {
+            case SortedRun::LookupResult::Found:
+                return true;
+            case SortedRun::LookupResult::Deleted:
+                return false;
+            case SortedRun::LookupResult::NotFound:
+                break;
+        }
+    }
+    return false;
+}
+
+void LsmStore::put(int key, const std::string& stored) {
+    {
+        std::shared_lock<std::shared_mutex> lock(state_mutex_);
+        memtable_->upsert_element(key, stored);
+    }
+    memtable_bytes_ += sizeof(key) + stored.size() + NODE_OVERHEAD;
+    maybeFreeze();
+}
+
+void LsmStore::maybeFreeze() {
+    if (memtable_bytes_ < options_.memtable_size) {
+        return;
+    }
+
+    // 后台刷盘跟不上时阻塞写入，限制冻结memtable占用的内存
+    {
+        std::unique_lock<std::mutex> lock(bg_mutex_);
+        bool stalled = false;
+        bg_done_cv_.wait(lock, [this, &stalled] {
+            std::shared_lock<std::shared_mutex> state_lock(state_mutex_);
+            if (!bg_running_ || immutables_.size() < MAX_IMMUTABLE_MEMTABLES) {
+                return true;
+            }
+            if (!stalled) {
+                stalled = true;
+                write_stalls_++;
+            }
+            return false;
+        });
+    }
+
+    {
+        std::unique_lock<std::shared_mutex> lock(state_mutex_);
+        freezeLocked();
+    }
+    bg_cv_.notify_one();
+}
+
+void LsmStore::freezeLocked() {
+    immutables_.push_front(memtable_);
+    memtable_ = newMemTable();
+    memtable_bytes_ = 0;
+}
+
+int LsmStore::insert_element(int key, const std::string& value) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    if (lookup(key, nullptr)) {
+        return 1;
+    }
+    std::string stored;
+    stored.reserve(value.size() + 1);
+    stored.push_back(TAG_PUT);
+    stored.append(value);
+    put(key, stored);
+    return 0;
+}
+
+bool LsmStore::search_element(int key) {
+    return lookup(key, nullptr);
+}
+
+bool LsmStore::get_element(int key, std::string* value) {
+    return lookup(key, value);
+}
+
+void LsmStore::delete_element(int key) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    // 只为存在的key写墓碑，避免删除不存在的key时堆积墓碑
+    if (!lookup(key, nullptr)) {
+        return;
+    }
+    put(key, std::string(1, TAG_DELETE));
+}
+
+void LsmStore::flush() {
+    std::lock_guard<std::mutex> write_lock(write_mutex_);
+    std::lock_guard<std::mutex> manifest_lock(manifest_mutex_);
+    {
+        std::unique_lock<std::shared_mutex> lock(state_mutex_);
+        memtable_ = newMemTable();
+        memtable_bytes_ = 0;
+        immutables_.clear();
+        for (auto& run : runs_) {
+            run->markObsolete();
+        }
+        runs_.clear();
+        generation_++;
+    }
+    writeManifest();
+    bg_done_cv_.notify_all();
+}
+
+void LsmStore::checkpoint() {
+    {
+        std::lock_guard<std::mutex> write_lock(write_mutex_);
+        std::unique_lock<std::shared_mutex> lock(state_mutex_);
+        if (memtable_->size() == 0) {
+            if (immutables_.empty()) {
+                return;
+            }
+        } else {
+            freezeLocked();
+        }
+    }
+    bg_cv_.notify_one();
+
+    std::unique_lock<std::mutex> lock(bg_mutex_);
+    bg_done_cv_.wait(lock, [this] {
+        std::shared_lock<std::shared_mutex> state_lock(state_mutex_);
+        return !bg_running_ || immutables_.empty();
+    });
+}
+
+int LsmStore::size() {
+    std::shared_lock<std::shared_mutex> lock(state_mutex_);
+    uint64_t count = static_cast<uint64_t>(memtable_->size());
+    for (const auto& memtable : immutables_) {
+        count += static_cast<uint64_t>(memtable->size());
+    }
+    for (const auto& run : runs_) {
+        count += run->entries();
+    }
+    return static_cast<int>(std::min<uint64_t>(count, INT32_MAX));
+}
+
+LsmStore::Stats LsmStore::getStats() const {
+    Stats stats;
+    std::shared_lock<std::shared_mutex> lock(state_mutex_);
+    if (memtable_) {
+        stats.memtable_keys = static_cast<size_t>(memtable_->size());
+    }
+    stats.memtable_bytes = memtable_bytes_;
+    stats.immutable_memtables = immutables_.size();
+    stats.runs = runs_.size();
+    for (const auto& run : runs_) {
+        stats.run_entries += run->entries();
+        stats.run_bytes += run->fileSize();
+        stats.bloom_negatives += run->bloomNegatives();
+    }
+    stats.flushes = flushes_;
+    stats.compactions = compactions_;
+    stats.write_stalls = write_stalls_;
+    return stats;
+}
+
+void LsmStore::backgroundLoop() {
+    std::unique_lock<std::mutex> lock(bg_mutex_);
+    while (true) {
+        std::shared_ptr<MemTable> oldest;
+        bool compact = false;
+        bg_cv_.wait(lock, [this, &oldest, &compact] {
+            if (!bg_running_) {
+                return true;
+            }
+            std::shared_lock<std::shared_mutex> state_lock(state_mutex_);
+            if (!immutables_.empty()) {
+                oldest = immutables_.back();
+                return true;
+            }
+            compact = runs_.size() >= static_cast<size_t>(options_.compaction_trigger);
+            return compact;
+        });
+        if (!bg_running_) {
+            break;
+        }
+
+        lock.unlock();
+        bool progressed = true;
+        try {
+            if (oldest) {
+                flushImmutable(oldest);
+            } else if (compact) {
+                progressed = compactOnce();
+            }
+        } catch (const std::exception& e) {
+            LOG_ERROR("LSM background job failed: " + std::string(e.what()));
+            progressed = false;
+        }
+        lock.lock();
+        bg_done_cv_.notify_all();
+
+        // 出错或没有可合并的段时等待新的刷盘再重试，避免空转
+        if (!progressed) {
+            bg_cv_.wait_for(lock, std::chrono::seconds(1), [this] { return !bg_running_; });
+        }
+    }
+}
+
+void LsmStore::flushImmutable(std::shared_ptr<MemTable> memtable) {
+    // memtable已冻结，先按key顺序复制出来，写文件时不再持有跳表锁
+    std::vector<std::pair<int, std::string>> entries;
+    entries.reserve(static_cast<size_t>(memtable->size()));
+    memtable->for_each([&entries](const int& key, const std::string& stored) {
+        entries.emplace_back(key, stored);
+    });
+
+    std::shared_ptr<SortedRun> run;
+    if (!entries.empty()) {
+        uint64_t id;
+        {
+            std::lock_guard<std::mutex> lock(manifest_mutex_);
+            id = next_run_id_++;
+        }
+        SortedRunWriter writer(runPath(id), options_.block_size, options_.bloom_bits_per_key);
+        for (auto& entry : entries) {
+            bool deleted = entry.second.empty() || entry.second[0] == TAG_DELETE;
+            if (!deleted) {
+                entry.second.erase(0, 1);
+            }
+            writer.add(entry.first, deleted, entry.second);
+        }
+        writer.finish();
+        run = SortedRun::open(runPath(id));
+    }
+
+    std::lock_guard<std::mutex> manifest_lock(manifest_mutex_);
+    {
+        std::unique_lock<std::shared_mutex> lock(state_mutex_);
+        auto it = std::find(immutables_.begin(), immutables_.end(), memtable);
+        if (it == immutables_.end()) {
+            // 刷盘期间执行了FLUSH，结果作废
+            if (run) {
+                run->markObsolete();
+            }
+            return;
+        }
+        if (run) {
+            runs_.insert(runs_.begin(), run);
+        }
+        immutables_.erase(it);
+    }
+    if (run) {
+        writeManifest();
+    }
+    flushes_++;
+    LOG_DEBUG("LSM memtable flushed: " + std::to_string(entries.size()) + " entries");
+}
+
+bool LsmStore::compactOnce() {
+    std::vector<std::shared_ptr<SortedRun>> window;
+    size_t start = 0;
+    bool includes_oldest = false;
+    uint64_t generation;
+    {
+        std::shared_lock<std::shared_mutex> lock(state_mutex_);
+        const size_t n = static_cast<size_t>(options_.compaction_trigger);
+        if (runs_.size() < n) {
+            return false;
+        }
+        // 在相邻的n个段中挑选大小相近（最大不超过最小的2倍）且总大小最小的一组；
+        // 段数过多时不再要求大小相近，保证点查访问的段数有上界
+        const bool force = runs_.size() >= n * MAX_RUNS_FACTOR;
+        uint64_t best_total = UINT64_MAX;
+        for (size_t i = 0; i + n <= runs_.size(); ++i) {
+            uint64_t total = 0, min_size = UINT64_MAX, max_size = 0;
+            for (size_t j = i; j < i + n; ++j) {
+                uint64_t size = runs_[j]->fileSize();
+                total += size;
+                min_size = std::min(min_size, size);
+                max_size = std::max(max_size, size);
+            }
+            bool similar = max_size <= 2 * min_size || max_size <= options_.memtable_size;
+            if ((similar || force) && total < best_total) {
+                best_total = total;
+                start = i;
+            }
+        }
+        if (best_total == UINT64_MAX) {
+            return false;
+        }
+        window.assign(runs_.begin() + start, runs_.begin() + start + n);
+        includes_oldest = start + n == runs_.size();
+        generation = generation_;
+    }
+
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(manifest_mutex_);
+        id = next_run_id_++;
+    }
+
+    // 多路归并：同一key取最新段中的记录；合并包含最旧的段时墓碑已无可遮蔽的数据
+    std::vector<std::unique_ptr<SortedRun::Iterator>> iterators;
+    for (const auto& run : window) {
+        iterators.push_back(std::make_unique<SortedRun::Iterator>(run.get()));
+    }
+    SortedRunWriter writer(runPath(id), options_.block_size, options_.bloom_bits_per_key);
+    while (true) {
+        int winner = -1;
+        for (size_t i = 0; i < iterators.size(); ++i) {
+            if (iterators[i]->valid() && (winner < 0 || iterators[i]->entry().key < iterators[winner]->entry().key)) {
+                winner = static_cast<int>(i);
+            }
+        }
+        if (winner < 0) {
+            break;
+        }
+        const RunEntry entry = iterators[winner]->entry();
+        if (!(entry.deleted && includes_oldest)) {
+            writer.add(entry.key, entry.deleted, entry.value);
+        }
+        for (auto& iterator : iterators) {
+            if (iterator->valid() && iterator->entry().key == entry.key) {
+                iterator->next();
+            }
+        }
+    }
+
+    std::shared_ptr<SortedRun> merged;
+    if (writer.entries() > 0) {
+        writer.finish();
+        merged = SortedRun::open(runPath(id));
+    }
+
+    std::lock_guard<std::mutex> manifest_lock(manifest_mutex_);
+    {
+        std::unique_lock<std::shared_mutex> lock(state_mutex_);
+        // 合并期间刷写的新段插在最前面，会移动窗口的位置，按段本身重新查找窗口
+        auto found = std::search(runs_.begin(), runs_.end(), window.begin(), window.end());
+        if (generation != generation_ || found == runs_.end()) {
+            if (merged) {
+                merged->markObsolete();
+            }
+            return true;
+        }
+        auto position = runs_.erase(found, found + window.size());
+        if (merged) {
+            runs_.insert(position, merged);
+        }
+        for (auto& run : window) {
+            run->markObsolete();
+        }
+    }
+    writeManifest();
+    compactions_++;
+    LOG_DEBUG("LSM compacted " + std::to_string(window.size()) + " runs into " + runPath(id));
+    return true;
+}
+
+void LsmStore::loadManifest() {
+    const std::string manifest_path = options_.dir + "/" + MANIFEST_FILE;
+    std::set<std::string> live;
+    std::ifstream in(manifest_path);
+    if (in.is_open()) {
+        std::string line;
+        while (std::getline(in, line)) {
+            std::istringstream iss(line);
+            std::string type, value;
+            if (!(iss >> type >> value)) {
+                continue;
+            }
+            if (type == "next_run_id") {
+                next_run_id_ = std::stoull(value);
+            } else if (type == "run") {
+                runs_.push_back(SortedRun::open(options_.dir + "/" + value));
+                live.insert(value);
+            }
+        }
+    }
+
+    // 删除刷盘或合并中途崩溃遗留的、未记录在MANIFEST中的段文件
+    std::error_code ec;
+    for (const auto& file : Utils::listFiles(options_.dir)) {
+        std::string name = std::filesystem::path(file).filename().string();
+        if (Utils::getFileExtension(file) == ".sst" && live.count(name) == 0) {
+            std::filesystem::remove(file, ec);
+        }
+    }
+    std::filesystem::remove(manifest_path + ".tmp", ec);
+
+    LOG_INFOF("LSM store opened: {} ({} runs)", options_.dir, runs_.size());
+}
+
+void LsmStore::writeManifest() {
+    std::ostringstream oss;
+    {
+        std::shared_lock<std::shared_mutex> lock(state_mutex_);
+        oss << "next_run_id " << next_run_id_ << "\n";
+        for (const auto& run : runs_) {
+            oss << "run " << std::filesystem::path(run->path()).filename().string() << "\n";
+        }
+    }
+    const std::string content = oss.str();
+    const std::string manifest_path = options_.dir + "/" + MANIFEST_FILE;
+    const std::string tmp_path = manifest_path + ".tmp";
+
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw skiplist::FileIOException(tmp_path, "open");
+    }
+    bool ok = ::write(fd, content.data(), content.size()) == static_cast<ssize_t>(content.size()) && ::fsync(fd) == 0;
+    ::close(fd);
+    if (!ok) {
+        throw skiplist::FileIOException(tmp_path, "write");
+    }
+    if (::rename(tmp_path.c_str(), manifest_path.c_str()) != 0) {
+        throw skiplist::FileIOException(manifest_path, "rename");
+    }
+    if (!Utils::syncParentDirectory(manifest_path)) {
+        throw skiplist::FileIOException(options_.dir, "fsync");
+    }
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include "../skiplist/skiplist.h"
+#include "sorted_run.h"
+
+// LSM分层存储引擎
+//
+// 跳表作为可写的memtable，估算大小超过阈值后被冻结为只读memtable，同时换上一个
+// 新跳表继续接收写入；后台线程把冻结的memtable按key顺序写成磁盘上的有序段
+// （带块索引和Bloom过滤器，见sorted_run.h），然后更新MANIFEST。
+//
+// 读取顺序为 memtable -> 冻结的memtable（新到旧）-> 有序段（新到旧），第一个命中
+// 的记录决定结果，墓碑表示key已删除。memtable中的value带一个字节的类型前缀。
+//
+// 后台合并采用分层（size-tiered）策略：段数达到compaction_trigger时，挑选相邻
+// compaction_trigger个段中总大小最小的一组合并为一个段，因此点查最多访问
+// compaction_trigger个段；合并包含最旧的段时丢弃墓碑。
+//
+// 持久性：有序段写完即fsync，MANIFEST通过临时文件+rename原子替换。memtable中
+// 尚未落盘的写入依靠AOF恢复；正常关闭和定期持久化时会把memtable写成有序段。
+class LsmStore {
+public:
+    struct Options {
+        std::string dir = "store/lsm";
+        size_t memtable_size = 16 * 1024 * 1024; // memtable估算字节数上限
+        size_t memory_limit = 0;                  // 所有memtable的内存上限，0表示不限制
+        size_t block_size = 4096;
+        int bloom_bits_per_key = 10;
+        int compaction_trigger = 4;
+        int max_level = 18;
+    };
+
+    struct Stats {
+        size_t memtable_keys = 0;
+        size_t memtable_bytes = 0;
+        size_t immutable_memtables = 0;
+        size_t runs = 0;
+        size_t run_entries = 0;
+        size_t run_bytes = 0;
+        size_t flushes = 0;
+        size_t compactions = 0;
+        size_t bloom_negatives = 0;
+        size_t write_stalls = 0;
+    };
+
+    LsmStore();
+    ~LsmStore();
+
+    // 打开（不存在则创建）LSM目录并启动后台线程，失败时抛出StorageException
+    void open(const Options& options);
+
+    // 停止后台线程，并把所有memtable写成有序段
+    void close();
+
+    // 与SkipList::insert_element一致：key已存在返回1，否则写入并返回0
+    int insert_element(int key, const std::string& value);
+    bool search_element(int key);
+    bool get_element(int key, std::string* value);
+    void delete_element(int key);
+
+    // 清空全部数据（包括磁盘上的有序段）
+    void flush();
+
+    // 冻结当前memtable并等待所有memtable写入磁盘
+    void checkpoint();
+
+    // 估算的key数量：有序段中被覆盖的旧版本和墓碑也会被计入
+    int size();
+
+    Stats getStats() const;
+
+private:
+    using MemTable = SkipList<int, std::string>;
+
+    std::shared_ptr<MemTable> newMemTable() const;
+    bool lookup(int key, std::string* value);
+    void put(int key, const std::string& stored);
+    void maybeFreeze();
+    void freezeLocked();
+    void backgroundLoop();
+    void flushImmutable(std::shared_ptr<MemTable> memtable);
+    bool compactOnce();
+    std::string runPath(uint64_t id) const;
+    void loadManifest();
+    void writeManifest();
+
+    Options options_;
+    bool open_ = false;
+
+    // memtable、冻结的memtable和有序段列表：读取时加共享锁，切换时加独占锁
+    mutable std::shared_mutex state_mutex_;
+    std::shared_ptr<MemTable> memtable_;
+    std::deque<std::shared_ptr<MemTable>> immutables_;  // 新的在前
+    std::vector<std::shared_ptr<SortedRun>> runs_;       // 新的在前
+    std::atomic<size_t> memtable_bytes_{0};
+    uint64_t generation_ = 0;  // FLUSH时递增，使进行中的合并结果作废
+
+    // 写入串行化（SET需要先检查再写入）
+    std::mutex write_mutex_;
+
+    // 修改有序段列表并写MANIFEST
+    std::mutex manifest_mutex_;
+    uint64_t next_run_id_ = 1;
+
+    // 后台刷盘与合并
+    std::thread bg_thread_;
+    std::mutex bg_mutex_;
+    std::condition_variable bg_cv_;
+    std::condition_variable bg_done_cv_;
+    bool bg_running_ = false;
+    bool bg_busy_ = false;
+
+    std::atomic<size_t> flushes_{0};
+    std::atomic<size_t> compactions_{0};
+    std::atomic<size_t> write_stalls_{0};
+};
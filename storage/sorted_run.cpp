@@ -0,0 +1,315 @@
+#include "sorted_run.h"
+#include "../include/exceptions.h"
+#include "../utils/utils.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace {
+const uint64_t RUN_MAGIC = 0x314E555253534C53ull; // "SLSSRUN1"
+const size_t ENTRY_HEADER_SIZE = 9;   // key(4) + type(1) + value_length(4)
+const size_t INDEX_ENTRY_SIZE = 24;   // first_key(4) + last_key(4) + offset(8) + size(4) + crc(4)
+const size_t FOOTER_SIZE = 48;
+const uint8_t TYPE_PUT = 1;
+const uint8_t TYPE_DELETE = 2;
+
+void putU32(char* p, uint32_t v){
+    memcpy(p, &v, sizeof(v));
+}
+
+void putU64(char* p, uint64_t v){
+    memcpy(p, &v, sizeof(v));
+}
+
+uint32_t getU32(const char* p){
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint64_t getU64(const char* p){
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+bool preadFull(int fd, char* buf, size_t length, uint64_t offset){
+    while(length > 0){
+        ssize_t n = ::pread(fd, buf, length, static_cast<off_t>(offset));
+        if(n <= 0){
+            return false;
+        }
+        buf += n;
+        length -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+// 解析块内pos处的一条记录，数据越界时返回false
+bool parseEntry(const std::string& data, size_t* pos, RunEntry* entry){
+    if(*pos + ENTRY_HEADER_SIZE > data.size()){
+        return false;
+    }
+    const char* p = data.data() + *pos;
+    uint32_t length = getU32(p + 5);
+    if(*pos + ENTRY_HEADER_SIZE + length > data.size()){
+        return false;
+    }
+    entry->key = static_cast<int>(getU32(p));
+    entry->deleted = static_cast<uint8_t>(p[4]) == TYPE_DELETE;
+    entry->value.assign(p + ENTRY_HEADER_SIZE, length);
+    *pos += ENTRY_HEADER_SIZE + length;
+    return true;
+}
+}
+
+SortedRunWriter::SortedRunWriter(const std::string& path, size_t block_size, int bloom_bits_per_key)
+    : path_(path)
+    , block_size_(block_size > 0 ? block_size : 4096)
+    , bloom_bits_per_key_(bloom_bits_per_key) {
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd_ < 0){
+        throw skiplist::FileIOException(path_, "open");
+    }
+}
+
+SortedRunWriter::~SortedRunWriter() {
+    if(fd_ >= 0){
+        ::close(fd_);
+    }
+    if(!finished_){
+        ::unlink(path_.c_str());
+    }
+}
+
+void SortedRunWriter::writeAll(const std::string& data) {
+    const char* p = data.data();
+    size_t length = data.size();
+    while(length > 0){
+        ssize_t n = ::write(fd_, p, length);
+        if(n <= 0){
+            throw skiplist::FileIOException(path_, "write");
+        }
+        p += n;
+        length -= static_cast<size_t>(n);
+    }
+    offset_ += data.size();
+}
+
+void SortedRunWriter::add(int key, bool deleted, const std::string& value) {
+    if(block_.empty()){
+        block_first_key_ = key;
+    }
+    block_last_key_ = key;
+    keys_.push_back(key);
+
+    char header[ENTRY_HEADER_SIZE];
+    putU32(header, static_cast<uint32_t>(key));
+    header[4] = static_cast<char>(deleted ? TYPE_DELETE : TYPE_PUT);
+    putU32(header + 5, deleted ? 0 : static_cast<uint32_t>(value.size()));
+    block_.append(header, ENTRY_HEADER_SIZE);
+    if(!deleted){
+        block_.append(value);
+    }
+
+    if(block_.size() >= block_size_){
+        flushBlock();
+    }
+}
+
+void SortedRunWriter::flushBlock() {
+    if(block_.empty()){
+        return;
+    }
+    RunBlockHandle handle;
+    handle.first_key = block_first_key_;
+    handle.last_key = block_last_key_;
+    handle.offset = offset_;
+    handle.size = static_cast<uint32_t>(block_.size());
+    handle.crc = Utils::crc32c(block_.data(), block_.size());
+    writeAll(block_);
+    index_.push_back(handle);
+    block_.clear();
+}
+
+void SortedRunWriter::finish() {
+    flushBlock();
+
+    std::string meta(index_.size() * INDEX_ENTRY_SIZE, '\0');
+    for(size_t i = 0; i < index_.size(); i++){
+        char* p = &meta[i * INDEX_ENTRY_SIZE];
+        putU32(p, static_cast<uint32_t>(index_[i].first_key));
+        putU32(p + 4, static_cast<uint32_t>(index_[i].last_key));
+        putU64(p + 8, index_[i].offset);
+        putU32(p + 16, index_[i].size);
+        putU32(p + 20, index_[i].crc);
+    }
+    uint64_t index_offset = offset_;
+
+    BloomFilter bloom(keys_.size(), bloom_bits_per_key_);
+    for(int key : keys_){
+        bloom.add(key);
+    }
+    std::string bloom_data = bloom.serialize();
+    uint64_t bloom_offset = index_offset + meta.size();
+    meta.append(bloom_data);
+
+    std::string footer(FOOTER_SIZE, '\0');
+    putU64(&footer[0], index_offset);
+    putU32(&footer[8], static_cast<uint32_t>(index_.size()));
+    putU64(&footer[12], bloom_offset);
+    putU32(&footer[20], static_cast<uint32_t>(bloom_data.size()));
+    putU64(&footer[24], keys_.size());
+    putU32(&footer[32], Utils::crc32c(meta.data(), meta.size()));
+    putU64(&footer[40], RUN_MAGIC);
+    meta.append(footer);
+    writeAll(meta);
+
+    if(::fsync(fd_) != 0){
+        throw skiplist::FileIOException(path_, "fsync");
+    }
+    ::close(fd_);
+    fd_ = -1;
+    finished_ = true;
+}
+
+SortedRun::SortedRun(const std::string& path, int fd)
+    : path_(path)
+    , fd_(fd) {
+}
+
+SortedRun::~SortedRun() {
+    ::close(fd_);
+    if(obsolete_){
+        ::unlink(path_.c_str());
+    }
+}
+
+std::shared_ptr<SortedRun> SortedRun::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        throw skiplist::FileIOException(path, "open");
+    }
+    std::shared_ptr<SortedRun> run(new SortedRun(path, fd));
+
+    struct stat st;
+    if(::fstat(fd, &st) != 0){
+        throw skiplist::FileIOException(path, "stat");
+    }
+    run->file_size_ = static_cast<uint64_t>(st.st_size);
+    if(run->file_size_ < FOOTER_SIZE){
+        throw skiplist::DataCorruptionException("sorted run too small: " + path);
+    }
+
+    char footer[FOOTER_SIZE];
+    if(!preadFull(fd, footer, FOOTER_SIZE, run->file_size_ - FOOTER_SIZE) || getU64(footer + 40) != RUN_MAGIC){
+        throw skiplist::DataCorruptionException("bad sorted run footer: " + path);
+    }
+    uint64_t index_offset = getU64(footer);
+    uint32_t index_count = getU32(footer + 8);
+    uint64_t bloom_offset = getU64(footer + 12);
+    uint32_t bloom_size = getU32(footer + 20);
+    run->entry_count_ = getU64(footer + 24);
+    uint32_t meta_crc = getU32(footer + 32);
+
+    uint64_t meta_size = static_cast<uint64_t>(index_count) * INDEX_ENTRY_SIZE + bloom_size;
+    if(bloom_offset != index_offset + static_cast<uint64_t>(index_count) * INDEX_ENTRY_SIZE ||
+       index_offset + meta_size + FOOTER_SIZE != run->file_size_){
+        throw skiplist::DataCorruptionException("bad sorted run layout: " + path);
+    }
+    std::string meta(meta_size, '\0');
+    if(!preadFull(fd, &meta[0], meta.size(), index_offset) || Utils::crc32c(meta.data(), meta.size()) != meta_crc){
+        throw skiplist::DataCorruptionException("sorted run metadata checksum mismatch: " + path);
+    }
+
+    run->index_.resize(index_count);
+    for(uint32_t i = 0; i < index_count; i++){
+        const char* p = meta.data() + i * INDEX_ENTRY_SIZE;
+        run->index_[i].first_key = static_cast<int>(getU32(p));
+        run->index_[i].last_key = static_cast<int>(getU32(p + 4));
+        run->index_[i].offset = getU64(p + 8);
+        run->index_[i].size = getU32(p + 16);
+        run->index_[i].crc = getU32(p + 20);
+    }
+    run->bloom_ = std::make_unique<BloomFilter>(meta.substr(index_count * INDEX_ENTRY_SIZE));
+    return run;
+}
+
+void SortedRun::readBlock(size_t block, std::string* data) const {
+    const RunBlockHandle& handle = index_[block];
+    data->resize(handle.size);
+    if(!preadFull(fd_, &(*data)[0], handle.size, handle.offset)){
+        throw skiplist::FileIOException(path_, "read");
+    }
+    if(Utils::crc32c(data->data(), data->size()) != handle.crc){
+        throw skiplist::DataCorruptionException("sorted run block checksum mismatch: " + path_);
+    }
+}
+
+SortedRun::LookupResult SortedRun::get(int key, std::string* value) const {
+    if(index_.empty() || key < index_.front().first_key || key > index_.back().last_key){
+        return LookupResult::NotFound;
+    }
+    if(!bloom_->mayContain(key)){
+        bloom_negatives_++;
+        return LookupResult::NotFound;
+    }
+
+    // 第一个last_key不小于key的块是唯一可能包含key的块
+    auto it = std::lower_bound(index_.begin(), index_.end(), key,
+                               [](const RunBlockHandle& handle, int k) { return handle.last_key < k; });
+    if(it == index_.end() || it->first_key > key){
+        return LookupResult::NotFound;
+    }
+
+    std::string data;
+    readBlock(static_cast<size_t>(it - index_.begin()), &data);
+    size_t pos = 0;
+    RunEntry entry;
+    while(parseEntry(data, &pos, &entry)){
+        if(entry.key == key){
+            if(entry.deleted){
+                return LookupResult::Deleted;
+            }
+            if(value != nullptr){
+                *value = std::move(entry.value);
+            }
+            return LookupResult::Found;
+        }
+        if(entry.key > key){
+            break;
+        }
+    }
+    return LookupResult::NotFound;
+}
+
+SortedRun::Iterator::Iterator(const SortedRun* run)
+    : run_(run) {
+    if(loadBlock(0)){
+        next();
+    }
+}
+
+bool SortedRun::Iterator::loadBlock(size_t block) {
+    block_ = block;
+    pos_ = 0;
+    data_.clear();
+    if(block_ >= run_->index_.size()){
+        valid_ = false;
+        return false;
+    }
+    run_->readBlock(block_, &data_);
+    return true;
+}
+
+void SortedRun::Iterator::next() {
+    while(!parseEntry(data_, &pos_, &entry_)){
+        if(!loadBlock(block_ + 1)){
+            return;
+        }
+    }
+    valid_ = true;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include "bloom_filter.h"
+
+// LSM磁盘上的不可变有序段（sorted run）
+//
+// 文件布局：
+//   数据块*N   每块约block_size字节，块内记录按key升序：
+//              key(i32) | type(u8) | value_length(u32) | value
+//   块索引     每块一项：first_key(i32) | last_key(i32) | offset(u64) | size(u32) | crc32c(u32)
+//   Bloom过滤器
+//   文件尾     index_offset(u64) | index_count(u32) | bloom_offset(u64) | bloom_size(u32) |
+//              entry_count(u64) | meta_crc(u32) | reserved(u32) | magic(u64)
+//
+// 打开时只把块索引和Bloom过滤器读入内存；点查先查过滤器，再二分定位到唯一可能
+// 包含该key的块，只读这一个块。删除以墓碑记录表示，遮蔽更旧段中的同一key。
+
+// 段中的一条记录
+struct RunEntry {
+    int key = 0;
+    bool deleted = false; // 墓碑
+    std::string value;
+};
+
+// 块索引项
+struct RunBlockHandle {
+    int first_key;
+    int last_key;
+    uint64_t offset;
+    uint32_t size;
+    uint32_t crc;
+};
+
+// 顺序写出一个有序段，key必须严格递增
+class SortedRunWriter {
+public:
+    SortedRunWriter(const std::string& path, size_t block_size, int bloom_bits_per_key);
+    // 未调用finish()时删除写了一半的文件
+    ~SortedRunWriter();
+
+    void add(int key, bool deleted, const std::string& value);
+    // 写出索引、过滤器和文件尾并fsync，失败时抛出FileIOException
+    void finish();
+
+    size_t entries() const { return keys_.size(); }
+
+private:
+    void flushBlock();
+    void writeAll(const std::string& data);
+
+    std::string path_;
+    int fd_ = -1;
+    size_t block_size_;
+    int bloom_bits_per_key_;
+    bool finished_ = false;
+    uint64_t offset_ = 0;
+    std::string block_;
+    int block_first_key_ = 0;
+    int block_last_key_ = 0;
+    std::vector<RunBlockHandle> index_;
+    std::vector<int> keys_; // 用于在finish时构建Bloom过滤器
+};
+
+class SortedRun {
+public:
+    enum class LookupResult { NotFound, Found, Deleted };
+
+    // 打开一个已完成的段文件，文件尾或元数据校验失败时抛出DataCorruptionException
+    static std::shared_ptr<SortedRun> open(const std::string& path);
+    ~SortedRun();
+
+    LookupResult get(int key, std::string* value) const;
+
+    // 按key升序读出全部记录，供合并使用
+    class Iterator {
+    public:
+        explicit Iterator(const SortedRun* run);
+        bool valid() const { return valid_; }
+        const RunEntry& entry() const { return entry_; }
+        void next();
+
+    private:
+        bool loadBlock(size_t block);
+
+        const SortedRun* run_;
+        size_t block_ = 0;
+        std::string data_;
+        size_t pos_ = 0;
+        RunEntry entry_;
+        bool valid_ = false;
+    };
+
+    // 标记为已被合并替换，最后一个引用释放时删除文件
+    void markObsolete() { obsolete_ = true; }
+
+    const std::string& path() const { return path_; }
+    uint64_t entries() const { return entry_count_; }
+    uint64_t fileSize() const { return file_size_; }
+
+    // 被Bloom过滤器直接排除的点查次数
+    uint64_t bloomNegatives() const { return bloom_negatives_; }
+
+private:
+    SortedRun(const std::string& path, int fd);
+    void readBlock(size_t block, std::string* data) const;
+
+    std::string path_;
+    int fd_;
+    uint64_t file_size_ = 0;
+    uint64_t entry_count_ = 0;
+    std::vector<RunBlockHandle> index_;
+    std::unique_ptr<BloomFilter> bloom_;
+    std::atomic<bool> obsolete_{false};
+    mutable std::atomic<uint64_t> bloom_negatives_{0};
+};
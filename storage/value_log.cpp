@@ -0,0 +1,354 @@
+#include "value_log.h"
+#include "../include/exceptions.h"
+#include "../logger/logger.h"
+#include "../utils/utils.h"
+#include <filesystem>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+const char HANDLE_TAG[2] = {'\0', 'V'};
+const size_t HANDLE_SIZE = 14;          // 标记(2) + 段号(4) + 偏移(4) + 长度(4)
+const size_t RECORD_HEADER_SIZE = 12;   // crc32c(4) + key(4) + value_length(4)
+const uint64_t MAX_SEGMENT_SIZE = 0xFFFFFFFFull;
+
+void putU32(char* p, uint32_t v){
+    memcpy(p, &v, sizeof(v));
+}
+
+uint32_t getU32(const char* p){
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+bool preadFull(int fd, char* buf, size_t length, uint64_t offset){
+    while(length > 0){
+        ssize_t n = ::pread(fd, buf, length, static_cast<off_t>(offset));
+        if(n <= 0){
+            return false;
+        }
+        buf += n;
+        length -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+bool pwriteFull(int fd, const char* buf, size_t length, uint64_t offset){
+    while(length > 0){
+        ssize_t n = ::pwrite(fd, buf, length, static_cast<off_t>(offset));
+        if(n <= 0){
+            return false;
+        }
+        buf += n;
+        length -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+}
+
+ValueLog::ValueLog() {
+}
+
+ValueLog::~ValueLog() {
+    close();
+}
+
+bool ValueLog::isHandle(const std::string& stored) {
+    return stored.size() == HANDLE_SIZE && stored[0] == HANDLE_TAG[0] && stored[1] == HANDLE_TAG[1];
+}
+
+std::string ValueLog::makeHandle(uint32_t segment_id, uint32_t offset, uint32_t length) {
+    std::string handle(HANDLE_SIZE, '\0');
+    handle[0] = HANDLE_TAG[0];
+    handle[1] = HANDLE_TAG[1];
+    putU32(&handle[2], segment_id);
+    putU32(&handle[6], offset);
+    putU32(&handle[10], length);
+    return handle;
+}
+
+void ValueLog::parseHandle(const std::string& handle, uint32_t* segment_id, uint32_t* offset, uint32_t* length) {
+    *segment_id = getU32(&handle[2]);
+    *offset = getU32(&handle[6]);
+    *length = getU32(&handle[10]);
+}
+
+std::string ValueLog::segmentPath(uint32_t segment_id) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%06u.vlog", segment_id);
+    return dir_ + "/" + name;
+}
+
+void ValueLog::open(const std::string& dir, size_t threshold, size_t segment_size) {
+    std::lock_guard<std::mutex> lock(meta_mutex_);
+    dir_ = dir;
+    threshold_ = threshold > 0 ? threshold : 1;
+    segment_size_ = std::min<uint64_t>(segment_size, MAX_SEGMENT_SIZE);
+
+    // 快照和AOF中保存的是完整value，旧的段文件不再被引用
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+    for (const auto& file : Utils::listFiles(dir_)) {
+        if (Utils::getFileExtension(file) == ".vlog") {
+            std::filesystem::remove(file, ec);
+        }
+    }
+
+    openSegment(1);
+    open_ = true;
+}
+
+void ValueLog::openSegment(uint32_t segment_id) {
+    std::string path = segmentPath(segment_id);
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw skiplist::FileIOException(path, "open");
+    }
+    std::unique_lock<std::shared_mutex> lock(segments_mutex_);
+    Segment segment;
+    segment.fd = fd;
+    segments_[segment_id] = segment;
+    active_segment_ = segment_id;
+}
+
+void ValueLog::close() {
+    gc_running_ = false;
+    gc_cv_.notify_all();
+    if (gc_thread_.joinable()) {
+        gc_thread_.join();
+    }
+
+    std::lock_guard<std::mutex> lock(meta_mutex_);
+    std::unique_lock<std::shared_mutex> segments_lock(segments_mutex_);
+    for (auto& entry : segments_) {
+        if (entry.second.fd >= 0) {
+            ::close(entry.second.fd);
+        }
+    }
+    segments_.clear();
+    open_ = false;
+}
+
+std::string ValueLog::append(int key, const std::string& value) {
+    std::lock_guard<std::mutex> lock(meta_mutex_);
+    const uint64_t record_size = RECORD_HEADER_SIZE + value.size();
+    if (record_size > MAX_SEGMENT_SIZE) {
+        throw skiplist::StorageException("value too large for value log: " + std::to_string(value.size()));
+    }
+
+    Segment* segment = &segments_[active_segment_];
+    if (segment->size > 0 && (segment->size + record_size > segment_size_ || segment->size + record_size > MAX_SEGMENT_SIZE)) {
+        openSegment(active_segment_ + 1);
+        segment = &segments_[active_segment_];
+    }
+
+    std::string record(RECORD_HEADER_SIZE, '\0');
+    putU32(&record[4], static_cast<uint32_t>(key));
+    putU32(&record[8], static_cast<uint32_t>(value.size()));
+    record.append(value);
+    putU32(&record[0], Utils::crc32c(record.data() + 4, record.size() - 4));
+
+    uint64_t offset = segment->size;
+    if (!pwriteFull(segment->fd, record.data(), record.size(), offset)) {
+        throw skiplist::FileIOException(segmentPath(active_segment_), "write");
+    }
+    segment->size += record_size;
+    segment->live_bytes += record_size;
+    return makeHandle(active_segment_, static_cast<uint32_t>(offset), static_cast<uint32_t>(value.size()));
+}
+
+std::string ValueLog::encode(int key, const std::string& value) {
+    if (!open_) {
+        return value;
+    }
+    // 形如句柄的小value也写入日志，保证跳表中的句柄形态没有歧义
+    if (value.size() >= threshold_ || isHandle(value)) {
+        return append(key, value);
+    }
+    return value;
+}
+
+bool ValueLog::decode(const std::string& stored, std::string* value) {
+    if (!isHandle(stored)) {
+        *value = stored;
+        return true;
+    }
+
+    uint32_t segment_id, offset, length;
+    parseHandle(stored, &segment_id, &offset, &length);
+
+    std::shared_lock<std::shared_mutex> lock(segments_mutex_);
+    auto it = segments_.find(segment_id);
+    if (it == segments_.end()) {
+        return false;
+    }
+
+    std::string record(RECORD_HEADER_SIZE + length, '\0');
+    if (!preadFull(it->second.fd, &record[0], record.size(), offset)) {
+        LOG_ERROR("Failed to read value log record from " + segmentPath(segment_id));
+        return false;
+    }
+    if (getU32(&record[8]) != length || getU32(&record[0]) != Utils::crc32c(record.data() + 4, record.size() - 4)) {
+        LOG_ERROR("Value log checksum mismatch in " + segmentPath(segment_id));
+        return false;
+    }
+    value->assign(record, RECORD_HEADER_SIZE, length);
+    return true;
+}
+
+void ValueLog::release(const std::string& stored) {
+    if (!isHandle(stored)) {
+        return;
+    }
+    uint32_t segment_id, offset, length;
+    parseHandle(stored, &segment_id, &offset, &length);
+
+    std::lock_guard<std::mutex> lock(meta_mutex_);
+    auto it = segments_.find(segment_id);
+    if (it != segments_.end()) {
+        uint64_t record_size = RECORD_HEADER_SIZE + length;
+        it->second.live_bytes -= std::min(it->second.live_bytes, record_size);
+    }
+}
+
+void ValueLog::markAllGarbage() {
+    std::lock_guard<std::mutex> lock(meta_mutex_);
+    if (!open_) {
+        return;
+    }
+    for (auto& entry : segments_) {
+        entry.second.live_bytes = 0;
+    }
+    if (segments_[active_segment_].size > 0) {
+        openSegment(active_segment_ + 1);
+    }
+}
+
+ValueLog::Stats ValueLog::getStats() const {
+    Stats stats;
+    std::lock_guard<std::mutex> lock(meta_mutex_);
+    stats.segments = segments_.size();
+    for (const auto& entry : segments_) {
+        stats.total_bytes += entry.second.size;
+        stats.live_bytes += entry.second.live_bytes;
+    }
+    stats.gc_runs = gc_runs_;
+    stats.gc_relocated = gc_relocated_;
+    stats.gc_reclaimed_bytes = gc_reclaimed_bytes_;
+    return stats;
+}
+
+void ValueLog::startGC(LiveCheckCallback is_live, RelocateCallback relocate, int garbage_ratio_percent, int interval_seconds) {
+    is_live_ = is_live;
+    relocate_ = relocate;
+    garbage_ratio_percent_ = garbage_ratio_percent;
+    gc_interval_seconds_ = interval_seconds > 0 ? interval_seconds : 1;
+    gc_running_ = true;
+    gc_thread_ = std::thread(&ValueLog::gcLoop, this);
+}
+
+void ValueLog::gcLoop() {
+    while (gc_running_) {
+        {
+            std::unique_lock<std::mutex> lock(gc_mutex_);
+            gc_cv_.wait_for(lock, std::chrono::seconds(gc_interval_seconds_), [this] { return !gc_running_; });
+        }
+        if (!gc_running_) {
+            break;
+        }
+        try {
+            runGC();
+        } catch (const std::exception& e) {
+            LOG_ERROR("Value log GC failed: " + std::string(e.what()));
+        }
+    }
+}
+
+int ValueLog::runGC() {
+    // 挑选垃圾比例超过阈值的非活跃段
+    std::vector<uint32_t> candidates;
+    {
+        std::lock_guard<std::mutex> lock(meta_mutex_);
+        for (const auto& entry : segments_) {
+            const Segment& segment = entry.second;
+            if (entry.first == active_segment_ || segment.size == 0) {
+                continue;
+            }
+            uint64_t garbage = segment.size - std::min(segment.size, segment.live_bytes);
+            if (garbage * 100 >= segment.size * static_cast<uint64_t>(garbage_ratio_percent_)) {
+                candidates.push_back(entry.first);
+            }
+        }
+    }
+
+    int collected = 0;
+    for (uint32_t segment_id : candidates) {
+        if (collectSegment(segment_id)) {
+            collected++;
+        }
+    }
+    gc_runs_++;
+    return collected;
+}
+
+bool ValueLog::collectSegment(uint32_t segment_id) {
+    int fd;
+    uint64_t size;
+    {
+        std::lock_guard<std::mutex> lock(meta_mutex_);
+        auto it = segments_.find(segment_id);
+        if (it == segments_.end()) {
+            return false;
+        }
+        fd = it->second.fd;
+        size = it->second.size;
+    }
+
+    // 顺序扫描段内记录，把仍然存活的记录迁移到活跃段
+    uint64_t offset = 0;
+    char header[RECORD_HEADER_SIZE];
+    std::string value;
+    while (offset + RECORD_HEADER_SIZE <= size) {
+        if (!preadFull(fd, header, RECORD_HEADER_SIZE, offset)) {
+            LOG_ERROR("Value log GC failed to read " + segmentPath(segment_id));
+            return false;
+        }
+        int key = static_cast<int>(getU32(header + 4));
+        uint32_t length = getU32(header + 8);
+        std::string handle = makeHandle(segment_id, static_cast<uint32_t>(offset), length);
+
+        if (is_live_ && is_live_(key, handle)) {
+            value.resize(length);
+            if (!preadFull(fd, &value[0], length, offset + RECORD_HEADER_SIZE)) {
+                LOG_ERROR("Value log GC failed to read " + segmentPath(segment_id));
+                return false;
+            }
+            std::string new_handle = append(key, value);
+            if (relocate_ && relocate_(key, handle, new_handle)) {
+                gc_relocated_++;
+            } else {
+                release(new_handle);
+            }
+        }
+        offset += RECORD_HEADER_SIZE + length;
+    }
+
+    // 句柄已全部迁移，删除旧段；仍持有旧句柄的读请求会读取失败并重新获取句柄
+    {
+        std::lock_guard<std::mutex> lock(meta_mutex_);
+        std::unique_lock<std::shared_mutex> segments_lock(segments_mutex_);
+        segments_.erase(segment_id);
+    }
+    ::close(fd);
+    std::error_code ec;
+    std::filesystem::remove(segmentPath(segment_id), ec);
+    gc_reclaimed_bytes_ += size;
+    LOG_DEBUG("Value log segment " + std::to_string(segment_id) + " collected");
+    return true;
+}
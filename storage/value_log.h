@@ -0,0 +1,119 @@
+#pragma once
+#include <string>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+// 键值分离的值日志（WiscKey风格）
+//
+// 超过阈值的大value追加写入只追加的日志段文件，跳表节点里只保存一个14字节的
+// 句柄（"\0V" + 段号 + 段内偏移 + 长度），正好放进std::string的SSO缓冲区，
+// 节点本身不再为value分配堆内存。热的键/塔索引因此能留在缓存中，而大value
+// 留在磁盘上，数据集可以超过内存。
+//
+// 恰好形如句柄的小value（14字节且以"\0V"开头）也一律写入日志，因此跳表中
+// 任何句柄形态的值都一定是句柄，无需额外的类型标记。
+//
+// 段文件记录格式：crc32c(u32) | key(i32) | value_length(u32) | value
+//
+// 快照和AOF中保存的都是完整value，值日志本身不参与持久化：启动时清空目录，
+// 加载数据时重新分离。后台GC挑选垃圾比例超过阈值的旧段，把仍然存活的记录
+// 重写到当前段，通过比较并交换更新跳表中的句柄，然后删除旧段。
+class ValueLog {
+public:
+    // GC存活检查回调：key的当前值是否仍为handle
+    using LiveCheckCallback = std::function<bool(int key, const std::string& handle)>;
+    // GC迁移回调：当key的当前值仍为old_handle时替换为new_handle并返回true
+    using RelocateCallback = std::function<bool(int key, const std::string& old_handle, const std::string& new_handle)>;
+
+    struct Stats {
+        size_t segments = 0;
+        size_t total_bytes = 0;
+        size_t live_bytes = 0;
+        size_t gc_runs = 0;
+        size_t gc_relocated = 0;
+        size_t gc_reclaimed_bytes = 0;
+    };
+
+    ValueLog();
+    ~ValueLog();
+
+    // 打开值日志目录（清空旧段），失败时抛出StorageException
+    void open(const std::string& dir, size_t threshold, size_t segment_size);
+
+    // 启动后台GC线程
+    void startGC(LiveCheckCallback is_live, RelocateCallback relocate, int garbage_ratio_percent, int interval_seconds);
+
+    // 停止GC线程并关闭所有段
+    void close();
+
+    // 把待写入的value编码为跳表中保存的形式：小value原样返回，大value写入日志后返回句柄
+    std::string encode(int key, const std::string& value);
+
+    // 把跳表中保存的值还原为真实value；句柄所在段已被GC回收时返回false，调用方应重新读取句柄
+    bool decode(const std::string& stored, std::string* value);
+
+    // 跳表中的值被删除或覆盖时调用，用于统计各段的垃圾量
+    void release(const std::string& stored);
+
+    // 跳表被清空时调用：所有已写入的记录都变为垃圾，后续写入换到新段
+    void markAllGarbage();
+
+    // 判断跳表中保存的值是否为句柄
+    static bool isHandle(const std::string& stored);
+
+    bool isOpen() const { return open_; }
+
+    // 对段表加共享锁，期间不会有段被新建或删除（fork前调用）
+    std::shared_lock<std::shared_mutex> lockSegments() const { return std::shared_lock<std::shared_mutex>(segments_mutex_); }
+    Stats getStats() const;
+
+    // 执行一轮GC，返回回收的段数
+    int runGC();
+
+private:
+    struct Segment {
+        int fd = -1;
+        uint64_t size = 0;        // 已写入字节数
+        uint64_t live_bytes = 0;  // 仍被跳表引用的记录字节数
+    };
+
+    static std::string makeHandle(uint32_t segment_id, uint32_t offset, uint32_t length);
+    static void parseHandle(const std::string& handle, uint32_t* segment_id, uint32_t* offset, uint32_t* length);
+
+    std::string segmentPath(uint32_t segment_id) const;
+    void openSegment(uint32_t segment_id);
+    std::string append(int key, const std::string& value);
+    bool collectSegment(uint32_t segment_id);
+    void gcLoop();
+
+    std::string dir_;
+    size_t threshold_ = 1024;
+    size_t segment_size_ = 64 * 1024 * 1024;
+    bool open_ = false;
+
+    // 段表：读取value时加共享锁，新建和删除段时加独占锁
+    std::map<uint32_t, Segment> segments_;
+    mutable std::shared_mutex segments_mutex_;
+    // 追加写入以及各段大小、存活字节数的统计由meta_mutex_保护（先于segments_mutex_加锁）
+    mutable std::mutex meta_mutex_;
+    uint32_t active_segment_ = 0;
+
+    // GC
+    LiveCheckCallback is_live_;
+    RelocateCallback relocate_;
+    int garbage_ratio_percent_ = 50;
+    int gc_interval_seconds_ = 10;
+    std::thread gc_thread_;
+    std::atomic<bool> gc_running_{false};
+    std::mutex gc_mutex_;
+    std::condition_variable gc_cv_;
+    std::atomic<size_t> gc_runs_{0};
+    std::atomic<size_t> gc_relocated_{0};
+    std::atomic<size_t> gc_reclaimed_bytes_{0};
+};
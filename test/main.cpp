@@ -3,12 +3,32 @@
 #include <thread>
 #include <chrono>
 #include <csignal>
+#include <vector>
+#include <cstdio>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cstddef>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "../server/skiplist_server.h"
 #include "../logger/logger.h"
 #include "../config/config.h"
+#include "../persistence/snapshot.h"
+#include "../persistence/lz_codec.h"
+#include "../network/tcp_server.h"
+#include "../network/redis_protocol.h"
+#include "../network/uring_event_loop.h"
+#include "../skiplist/mmap_skiplist.h"
+#include "../include/exceptions.h"
+#include "../utils/utils.h"
 
 // 全局服务器实例
 static SkipListServer* g_server = nullptr;
+// 只执行检查、不启动服务器时的退出码
+static int g_exit_code = 0;
 
 // 信号处理函数
 void signalHandler(int signal) {
@@ -29,6 +49,15 @@ void showHelp() {
     std::cout << "  -l, --log-level <level> Log level (DEBUG|INFO|WARN|ERROR|FATAL)\n";
     std::cout << "  -d, --daemon            Run as daemon\n";
     std::cout << "  -v, --version           Show version information\n";
+    std::cout << "  --convert-snapshot <text> <out>\n";
+    std::cout << "                          Convert a key:value; text snapshot to the binary format\n";
+    std::cout << "  --bench-persistence [keys]\n";
+    std::cout << "                          Snapshot size and write/load MB/s per compression level\n";
+    std::cout << "  --bench-mmap-crash [keys]\n";
+    std::cout << "                          Reopen the mmap skiplist after clean close, crashes and corrupted files\n";
+    std::cout << "  --check-protocol        Check RESP and inline request framing and parsing\n";
+    std::cout << "  --bench-network [connections] [requests]\n";
+    std::cout << "                          PING req/s and syscalls per request for each network backend\n";
     std::cout << "  --help                  Show this help message\n\n";
     std::cout << "Examples:\n";
     std::cout << "  ./SkipListProject                    # Start with default settings\n";
@@ -67,6 +96,395 @@ void showVersion() {
     std::cout << "  - Graceful shutdown\n";
 }
 
+// 持久化基准：同一份数据按不同压缩级别写出快照，报告压缩率以及写出和并行加载的速度
+void benchPersistence(uint64_t keys) {
+    const std::string path = "store/bench_persistence.snapshot";
+    Utils::createDirectory("store");
+    std::vector<std::string> values(keys);
+    uint64_t raw_bytes = 0;
+    for (uint64_t i = 0; i < keys; i++) {
+        // 接近实际业务的value：字段名重复，字段值变化
+        values[i] = "{\"id\":" + std::to_string(i) + ",\"user\":\"user_" + std::to_string(i % 1000) +
+                    "\",\"status\":\"" + (i % 3 == 0 ? "active" : "inactive") + "\",\"score\":" +
+                    std::to_string((i * 7919) % 100000) + "}";
+        raw_bytes += sizeof(int64_t) + values[i].size();
+    }
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "Persistence benchmark: " << keys << " keys, " << raw_bytes / (1024 * 1024) << " MB raw, "
+              << threads << " load threads\n";
+    auto mbps = [](uint64_t bytes, std::chrono::duration<double> elapsed) {
+        return elapsed.count() > 0 ? bytes / (1024.0 * 1024.0) / elapsed.count() : 0.0;
+    };
+    for (int level : {0, 1, 3, 6, LZ_MAX_LEVEL}) {
+        auto start = std::chrono::steady_clock::now();
+        {
+            SnapshotWriter writer(path);
+            writer.setCompression(level);
+            for (uint64_t i = 0; i < keys; i++) {
+                writer.add(static_cast<int64_t>(i), values[i]);
+            }
+            writer.commit();
+        }
+        std::chrono::duration<double> write_time = std::chrono::steady_clock::now() - start;
+        uint64_t file_bytes = Utils::getFileSize(path);
+
+        // 与load_file相同，按块把快照分给各线程解压和解码
+        start = std::chrono::steady_clock::now();
+        SnapshotReader reader(path);
+        std::vector<std::thread> workers;
+        std::vector<uint64_t> counts(threads, 0);
+        size_t blocks = reader.blockCount();
+        for (unsigned t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                std::string buffer;
+                for (size_t b = blocks * t / threads; b < blocks * (t + 1) / threads; b++) {
+                    reader.readBlock(b, buffer, [&](int64_t, const char*, size_t) { counts[t]++; });
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        std::chrono::duration<double> load_time = std::chrono::steady_clock::now() - start;
+        uint64_t loaded = 0;
+        for (uint64_t count : counts) {
+            loaded += count;
+        }
+
+        printf("  level %d: %8.2f MB  ratio %5.2fx  write %8.1f MB/s  load %8.1f MB/s%s\n", level,
+               file_bytes / (1024.0 * 1024.0), file_bytes > 0 ? static_cast<double>(raw_bytes) / file_bytes : 0.0,
+               mbps(raw_bytes, write_time), mbps(raw_bytes, load_time), loaded == keys ? "" : "  (key count mismatch)");
+    }
+    std::remove(path.c_str());
+}
+
+// mmap跳表崩溃一致性检查：在本地文件系统上分别模拟正常关闭、进程崩溃（不sync直接_exit、
+// 插入途中被SIGKILL）、写坏的节点和损坏的文件头，重新打开后校验链表中的每个key
+void benchMmapCrash(int keys) {
+    const std::string path = "store/bench_mmap_crash.mmap";
+    const size_t initial_size = 1 << 20;
+    // 文件头中clean_shutdown和used的偏移量
+    const off_t clean_shutdown_offset = offsetof(MmapSkipList::MmapHeader, clean_shutdown);
+    const off_t used_offset = offsetof(MmapSkipList::MmapHeader, used);
+    Utils::createDirectory("store");
+    keys = std::max(keys, 2);
+
+    auto value_of = [](int key) {
+        return "value_" + std::to_string(key) + std::string(64 + key % 64, static_cast<char>('a' + key % 26));
+    };
+    auto patch = [&path](off_t offset, const void* data, size_t size) {
+        int fd = ::open(path.c_str(), O_WRONLY);
+        bool ok = fd >= 0 && pwrite(fd, data, size, offset) == static_cast<ssize_t>(size);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return ok;
+    };
+    // [begin, end)中存在的key的value必须完整，expect_present为真的key必须存在；present为存在的key数
+    auto verify = [&](MmapSkipList& list, int begin, int end, const std::function<bool(int)>& expect_present,
+                      int* present) {
+        *present = 0;
+        std::string value;
+        for (int key = begin; key < end; key++) {
+            bool found = list.get_element(key, &value);
+            if (found && value != value_of(key)) {
+                return false;
+            }
+            if (!found && expect_present(key)) {
+                return false;
+            }
+            *present += found ? 1 : 0;
+        }
+        return true;
+    };
+    int failures = 0;
+    auto report = [&failures](const char* name, bool ok, const std::string& detail) {
+        printf("  %-24s %-6s %s\n", name, ok ? "ok" : "FAILED", detail.c_str());
+        failures += ok ? 0 : 1;
+    };
+    auto flags = [](MmapSkipList& list) {
+        return "recovered=" + std::to_string(list.recovered()) + " truncated=" + std::to_string(list.truncated());
+    };
+    auto all = [](int) { return true; };
+
+    std::cout << "Mmap skiplist crash checks: " << keys << " keys, " << path << "\n";
+    std::remove(path.c_str());
+
+    // 1. 正常关闭后重新打开，直接使用文件，不需要恢复
+    {
+        MmapSkipList list(18);
+        list.open(path, initial_size);
+        for (int key = 0; key < keys; key++) {
+            list.insert_element(key, value_of(key));
+        }
+        list.close();
+        list.open(path, initial_size);
+        int present = 0;
+        bool ok = verify(list, 0, keys, all, &present) && present == keys && list.size() == keys
+                  && !list.recovered();
+        report("clean close", ok, std::to_string(present) + " keys, " + flags(list));
+        list.close();
+    }
+
+    // 2. 子进程写入后不sync、不close直接_exit，映射中的写入全部保留，打开时沿第0层恢复
+    {
+        pid_t pid = fork();
+        if (pid == 0) {
+            MmapSkipList list(18);
+            list.open(path, initial_size);
+            for (int key = keys; key < keys * 2; key++) {
+                list.insert_element(key, value_of(key));
+            }
+            for (int key = 0; key < keys; key += 2) {
+                list.delete_element(key);
+            }
+            _exit(0);
+        }
+        waitpid(pid, nullptr, 0);
+        MmapSkipList list(18);
+        list.open(path, initial_size);
+        int present = 0;
+        bool ok = verify(list, 0, keys * 2, [keys](int key) { return key >= keys || key % 2 == 1; }, &present)
+                  && present == keys + keys / 2 && list.size() == present && list.recovered() && !list.truncated();
+        report("exit without sync", ok, std::to_string(present) + " keys, " + flags(list));
+        list.close();
+    }
+
+    // 3. 子进程不断插入时被SIGKILL，插入到一半的节点不能出现在链表中
+    {
+        int pipe_fds[2];
+        if (pipe(pipe_fds) != 0) {
+            throw std::runtime_error("pipe failed");
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(pipe_fds[0]);
+            MmapSkipList list(18);
+            list.open(path, initial_size);
+            for (int key = keys * 2; ; key++) {
+                list.insert_element(key, value_of(key));
+                if (key == keys * 2 + keys / 2) {
+                    char ready = 1;
+                    ssize_t written = write(pipe_fds[1], &ready, 1);
+                    (void)written;
+                }
+            }
+        }
+        close(pipe_fds[1]);
+        char ready;
+        ssize_t got = read(pipe_fds[0], &ready, 1);
+        (void)got;
+        close(pipe_fds[0]);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        MmapSkipList list(18);
+        list.open(path, initial_size);
+        // 之前的key不受影响；顺序插入，新key必须是从keys*2开始连续的一段
+        int present = 0;
+        int inserted = list.size() - (keys + keys / 2);
+        bool ok = verify(list, 0, keys * 2, [keys](int key) { return key >= keys || key % 2 == 1; }, &present)
+                  && present == keys + keys / 2 && inserted > keys / 2
+                  && verify(list, keys * 2, keys * 2 + inserted, all, &present) && present == inserted
+                  && !list.search_element(keys * 2 + inserted) && list.recovered();
+        report("killed mid-insert", ok, std::to_string(inserted) + " new keys, " + flags(list));
+        list.close();
+    }
+    std::remove(path.c_str());
+
+    // 4. 写坏数据区中间的一段（模拟撕裂的页），恢复时在第一个非法节点处截断，剩下的key都完整
+    {
+        MmapSkipList list(18);
+        list.open(path, initial_size);
+        for (int key = 0; key < keys; key++) {
+            list.insert_element(key, value_of(key));
+        }
+        size_t used = list.used_bytes();
+        list.close();
+        uint32_t dirty = 0;
+        std::string garbage(256, '\xA5');
+        bool patched = patch(clean_shutdown_offset, &dirty, sizeof(dirty))
+                       && patch(static_cast<off_t>(used / 2), garbage.data(), garbage.size());
+        list.open(path, initial_size);
+        int present = 0;
+        int prefix = 0;
+        bool ok = patched && verify(list, 0, keys, [](int) { return false; }, &present)
+                  && present < keys && list.size() == present && list.recovered() && list.truncated()
+                  && verify(list, 0, present, all, &prefix);
+        report("torn node", ok, std::to_string(present) + " keys kept, " + flags(list));
+        list.close();
+    }
+
+    // 5. 文件头损坏：magic被写坏，或标记为正常关闭但used超出文件，打开时必须拒绝
+    {
+        uint64_t bad_used = UINT64_MAX / 2;
+        bool ok = patch(used_offset, &bad_used, sizeof(bad_used));
+        uint32_t clean = 1;
+        ok = ok && patch(clean_shutdown_offset, &clean, sizeof(clean));
+        bool rejected = false;
+        try {
+            MmapSkipList list(18);
+            list.open(path, initial_size);
+        } catch (const skiplist::DataCorruptionException&) {
+            rejected = true;
+        }
+        report("torn header", ok && rejected, rejected ? "rejected" : "accepted");
+
+        ok = patch(0, "XXXXXXXX", 8);
+        rejected = false;
+        try {
+            MmapSkipList list(18);
+            list.open(path, initial_size);
+        } catch (const skiplist::DataCorruptionException&) {
+            rejected = true;
+        }
+        report("corrupted header", ok && rejected, rejected ? "rejected" : "accepted");
+    }
+    std::remove(path.c_str());
+
+    std::cout << (failures == 0 ? "All checks passed\n" : std::to_string(failures) + " checks failed\n");
+}
+
+// 检查请求分帧和解析：requestLength切出的每一帧都能被parseCommand解析成预期的命令，
+// 不完整的请求返回0。有检查失败时返回false
+bool checkProtocol() {
+    int failures = 0;
+    // data按requestLength依次切帧，与expected逐条比较；expected中的一条为"命令 参数..."，
+    // 剩余不完整的数据长度应为rest
+    auto check = [&failures](const char* name, const std::string& data, const std::vector<std::string>& expected,
+                             size_t rest) {
+        std::vector<std::string> got;
+        size_t pos = 0;
+        while (pos < data.size()) {
+            size_t length = RedisProtocol::requestLength(data, pos);
+            if (length == 0) {
+                break;
+            }
+            RedisCommand cmd = RedisProtocol::parseCommand(data.substr(pos, length));
+            std::string line = cmd.command;
+            for (const auto& arg : cmd.arguments) {
+                line += " " + arg;
+            }
+            got.push_back(line);
+            pos += length;
+        }
+        bool ok = got == expected && data.size() - pos == rest;
+        std::string detail;
+        for (const auto& line : got) {
+            detail += "[" + line + "]";
+        }
+        printf("  %-24s %-6s %s\n", name, ok ? "ok" : "FAILED", detail.c_str());
+        failures += ok ? 0 : 1;
+    };
+
+    check("array", "*3\r\n$3\r\nset\r\n$1\r\n1\r\n$3\r\nabc\r\n", {"SET 1 abc"}, 0);
+    check("binary bulk", "*2\r\n$4\r\nECHO\r\n$4\r\na\r\nb\r\n", {"ECHO a\r\nb"}, 0);
+    check("inline crlf", "set 1 abc\r\n", {"SET 1 abc"}, 0);
+    check("inline lf", "PING\n", {"PING"}, 0);
+    check("inline spaces", "  get \t 7  \r\n", {"GET 7"}, 0);
+    check("pipeline", "PING\r\n*2\r\n$3\r\nGET\r\n$1\r\n7\r\nDEL 7\r\n", {"PING", "GET 7", "DEL 7"}, 0);
+    check("partial array", "PING\r\n*2\r\n$3\r\nGET\r\n$1\r\n", {"PING"}, 17);
+    check("partial inline", "*1\r\n$4\r\nPING\r\nGET 7", {"PING"}, 5);
+    check("bad header", "*x\r\nPING\r\n", {"", "PING"}, 0);
+
+    std::cout << (failures == 0 ? "All checks passed\n" : std::to_string(failures) + " checks failed\n");
+    return failures == 0;
+}
+
+// 网络基准：每个后端起一个只回复PONG的服务器，全部连接同时各发一个请求再等回复，
+// 报告每秒请求数和每个请求在服务器端的系统调用数
+void benchNetwork(int connections, uint64_t requests) {
+    std::vector<std::string> backends = {"epoll"};
+    if (UringEventLoop::probe()) {
+        backends.push_back("io_uring");
+    }
+    connections = std::max(connections, 1);
+    uint64_t rounds = std::max<uint64_t>(requests / connections, 1);
+    unsigned client_threads = std::min<unsigned>(connections, std::max(1u, std::thread::hardware_concurrency()));
+    std::cout << "Network benchmark: " << connections << " connections, " << rounds * connections << " requests, "
+              << client_threads << " client threads\n";
+    if (backends.size() == 1) {
+        std::cout << "  io_uring: not supported by this kernel\n";
+    }
+
+    const std::string request = RedisProtocol::createArray({"PING"});
+    const std::string reply = RedisProtocol::createSimpleString("PONG");
+    for (const auto& backend : backends) {
+        TCPServer server;
+        server.init("127.0.0.1", 0, 4, 1, backend);
+        server.setMessageHandler([&reply](const std::string&, std::shared_ptr<ClientConnection>) { return reply; });
+        server.setFrameSplitter(RedisProtocol::requestLength);
+        server.start();
+
+        std::vector<int> sockets;
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(server.getPort());
+        addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        for (int i = 0; i < connections; i++) {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (fd < 0 || connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+                std::cerr << "Error: failed to connect benchmark client: " << strerror(errno) << std::endl;
+                if (fd >= 0) {
+                    close(fd);
+                }
+                break;
+            }
+            sockets.push_back(fd);
+        }
+
+        // 每个客户端线程负责一部分连接，一轮中先全部发送再依次读回复
+        auto run_rounds = [&](uint64_t count) {
+            std::vector<std::thread> clients;
+            for (unsigned t = 0; t < client_threads; t++) {
+                clients.emplace_back([&, t]() {
+                    size_t begin = sockets.size() * t / client_threads;
+                    size_t end = sockets.size() * (t + 1) / client_threads;
+                    char buffer[64];
+                    for (uint64_t r = 0; r < count; r++) {
+                        for (size_t i = begin; i < end; i++) {
+                            if (::send(sockets[i], request.data(), request.size(), MSG_NOSIGNAL) < 0) {
+                                return;
+                            }
+                        }
+                        for (size_t i = begin; i < end; i++) {
+                            size_t received = 0;
+                            while (received < reply.size()) {
+                                ssize_t n = ::recv(sockets[i], buffer, sizeof(buffer), 0);
+                                if (n <= 0) {
+                                    return;
+                                }
+                                received += static_cast<size_t>(n);
+                            }
+                        }
+                    }
+                });
+            }
+            for (auto& client : clients) {
+                client.join();
+            }
+        };
+
+        // 预热一轮，把接受连接的开销排除在外
+        run_rounds(1);
+        TCPServer::Stats before = server.getStats();
+        auto start = std::chrono::steady_clock::now();
+        run_rounds(rounds);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        TCPServer::Stats after = server.getStats();
+
+        uint64_t handled = after.requests - before.requests;
+        printf("  %-8s %10.0f req/s  %6.2f syscalls/request\n", server.backendName(),
+               elapsed.count() > 0 ? handled / elapsed.count() : 0.0,
+               handled > 0 ? static_cast<double>(after.syscalls - before.syscalls) / handled : 0.0);
+
+        for (int fd : sockets) {
+            close(fd);
+        }
+        server.stop();
+    }
+}
+
 // 解析命令行参数
 bool parseArguments(int argc, char* argv[], std::string& config_file) {
     for (int i = 1; i < argc; ++i) {
@@ -109,6 +527,60 @@ bool parseArguments(int argc, char* argv[], std::string& config_file) {
                 std::cerr << "Error: Missing log level" << std::endl;
                 return false;
             }
+        } else if (arg == "--convert-snapshot") {
+            if (i + 2 < argc) {
+                std::string text_path = argv[i + 1];
+                std::string snapshot_path = argv[i + 2];
+                try {
+                    uint64_t converted = convertTextSnapshot(text_path, snapshot_path);
+                    std::cout << "Converted " << converted << " keys from " << text_path << " to " << snapshot_path << std::endl;
+                } catch (const std::exception& e) {
+                    std::cerr << "Error: " << e.what() << std::endl;
+                }
+            } else {
+                std::cerr << "Error: --convert-snapshot needs <text> <out>" << std::endl;
+            }
+            return false;
+        } else if (arg == "--bench-persistence") {
+            uint64_t keys = 1000000;
+            if (i + 1 < argc) {
+                keys = std::stoull(argv[++i]);
+            }
+            try {
+                benchPersistence(keys);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+            }
+            return false;
+        } else if (arg == "--bench-mmap-crash") {
+            int keys = 20000;
+            if (i + 1 < argc) {
+                keys = std::stoi(argv[++i]);
+            }
+            try {
+                benchMmapCrash(keys);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+            }
+            return false;
+        } else if (arg == "--check-protocol") {
+            g_exit_code = checkProtocol() ? 0 : 1;
+            return false;
+        } else if (arg == "--bench-network") {
+            int connections = 50;
+            uint64_t requests = 200000;
+            if (i + 1 < argc) {
+                connections = std::stoi(argv[++i]);
+            }
+            if (i + 1 < argc) {
+                requests = std::stoull(argv[++i]);
+            }
+            try {
+                benchNetwork(connections, requests);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+            }
+            return false;
         } else if (arg == "--daemon" || arg == "-d") {
             // TODO: Implement daemon mode
             std::cout << "Daemon mode not implemented yet" << std::endl;
@@ -171,7 +643,7 @@ int main(int argc, char* argv[]) {
     // 解析命令行参数
     std::string config_file;
     if (!parseArguments(argc, argv, config_file)) {
-        return 0;
+        return g_exit_code;
     }
     
     try {
@@ -199,6 +671,8 @@ int main(int argc, char* argv[]) {
         std::cout << "  Port: " << server_config.port << "\n";
         std::cout << "  Max Connections: " << server_config.max_connections << "\n";
         std::cout << "  Thread Pool Size: " << server_config.thread_pool_size << "\n";
+        std::cout << "  Reactor Threads: " << server_config.reactor_threads << "\n";
+        std::cout << "  Network Backend: " << server_config.network_backend << "\n";
         std::cout << "  Log Level: " << log_config.log_level << "\n";
         std::cout << "  Log File: " << log_config.log_file << "\n";
         std::cout << "  Data File: " << config.getSkipListConfig().data_file << "\n\n";
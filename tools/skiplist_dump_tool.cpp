@@ -0,0 +1,744 @@
+// 快照和AOF的离线检查与转换工具
+//
+// 不启动服务器即可校验store/dumpFile和AOF、查看key数量和value大小分布、在文本和
+// 二进制格式之间转换，以及离线合并多段AOF。快照块之间互不依赖：检查和统计时每个
+// 线程用mmap解码一段连续的块；需要按顺序输出时（转换、合并）按波次并行解码
+// threads*16块，再按块的顺序写出，内存占用与文件大小无关。AOF的普通记录只能顺序
+// 扫描，前导快照与普通快照一样并行处理。
+
+#include "../persistence/snapshot.h"
+#include "../persistence/aof_format.h"
+#include "../persistence/aof_manifest.h"
+#include "../include/exceptions.h"
+#include "../utils/utils.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <exception>
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t BLOCKS_PER_THREAD = 16;  // 每个波次中每个线程解码的块数
+const size_t WRITE_CHUNK = 1 << 20;
+
+enum class FileKind { Snapshot, Aof, TextSnapshot, TextAof };
+
+struct Options {
+    int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int compression = 0;
+    bool preamble = true;
+    std::string format;  // convert的目标格式：text或binary，默认与输入相反
+};
+
+void usage() {
+    std::cerr <<
+        "Usage: skiplist-dump-tool [options] <command> <args>\n"
+        "\n"
+        "Commands:\n"
+        "  check <file>            verify checksums of a snapshot or AOF\n"
+        "  stats <file>            print key count, key range and size histograms\n"
+        "  convert <in> <out>      convert between text and binary formats; a binary\n"
+        "                          snapshot converted to binary is rewritten (e.g. with -c)\n"
+        "  compact <aof> <out>     merge an AOF (base and all segments) into a single file\n"
+        "\n"
+        "<file> is a snapshot, an AOF file, or an AOF whose <file>.manifest lists its segments.\n"
+        "\n"
+        "Options:\n"
+        "  -j <threads>            worker threads (default: number of CPUs)\n"
+        "  -c <level>              LZ compression level for written snapshots (0-9, default 0)\n"
+        "  --format <text|binary>  output format for convert\n"
+        "  --no-preamble           compact into plain SET records instead of a snapshot preamble\n";
+}
+
+// 按大小取对数分桶的直方图：第i桶为[2^(i-1), 2^i)，第0桶为0
+struct Histogram {
+    uint64_t buckets[65] = {};
+
+    void add(uint64_t size) {
+        buckets[size == 0 ? 0 : 64 - __builtin_clzll(size)]++;
+    }
+
+    void merge(const Histogram& other) {
+        for (int i = 0; i < 65; i++) {
+            buckets[i] += other.buckets[i];
+        }
+    }
+
+    void print(const std::string& title) const {
+        uint64_t total = 0;
+        for (uint64_t count : buckets) {
+            total += count;
+        }
+        if (total == 0) {
+            return;
+        }
+        std::cout << title << ":\n";
+        for (int i = 0; i < 65; i++) {
+            if (buckets[i] == 0) {
+                continue;
+            }
+            uint64_t low = i == 0 ? 0 : 1ull << (i - 1);
+            uint64_t high = i == 0 ? 0 : (i == 64 ? UINT64_MAX : (1ull << i) - 1);
+            std::ostringstream range;
+            range << low;
+            if (high != low) {
+                range << "-" << high;
+            }
+            std::cout << "  " << std::setw(24) << range.str() << " B  " << std::setw(12) << buckets[i]
+                      << "  " << std::fixed << std::setprecision(2) << 100.0 * buckets[i] / total << "%\n";
+        }
+    }
+};
+
+struct KeyStats {
+    uint64_t entries = 0;
+    uint64_t value_bytes = 0;
+    int64_t min_key = INT64_MAX;
+    int64_t max_key = INT64_MIN;
+    int64_t first_key = 0;  // 按顺序处理时的第一个和最后一个key，用于检查范围之间的顺序
+    int64_t last_key = 0;
+    bool ordered = true;
+    Histogram values;
+
+    void add(int64_t key, size_t length) {
+        if (entries > 0 && key <= last_key) {
+            ordered = false;
+        }
+        if (entries == 0) {
+            first_key = key;
+        }
+        last_key = key;
+        entries++;
+        value_bytes += length;
+        min_key = std::min(min_key, key);
+        max_key = std::max(max_key, key);
+        values.add(length);
+    }
+
+    // other紧接在this之后
+    void append(const KeyStats& other) {
+        if (other.entries == 0) {
+            return;
+        }
+        if (entries > 0 && other.first_key <= last_key) {
+            ordered = false;
+        }
+        if (entries == 0) {
+            first_key = other.first_key;
+        }
+        last_key = other.last_key;
+        entries += other.entries;
+        value_bytes += other.value_bytes;
+        min_key = std::min(min_key, other.min_key);
+        max_key = std::max(max_key, other.max_key);
+        ordered = ordered && other.ordered;
+        values.merge(other.values);
+    }
+
+    void print(bool histogram) const {
+        std::cout << "  entries:        " << entries << "\n";
+        std::cout << "  value bytes:    " << value_bytes << "\n";
+        if (entries > 0) {
+            std::cout << "  key range:      " << min_key << " .. " << max_key << "\n";
+            std::cout << "  avg value size: " << std::fixed << std::setprecision(1)
+                      << static_cast<double>(value_bytes) / static_cast<double>(entries) << " B\n";
+        }
+        if (histogram) {
+            values.print("  value sizes");
+        }
+    }
+};
+
+// 在threads个线程中调用fn(线程序号)，任一线程的异常在全部结束后重新抛出
+void runParallel(int threads, const std::function<void(int)>& fn) {
+    std::vector<std::thread> workers;
+    std::vector<std::exception_ptr> errors(static_cast<size_t>(threads));
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            try {
+                fn(t);
+            } catch (...) {
+                errors[static_cast<size_t>(t)] = std::current_exception();
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+// 并行校验并统计快照的全部块：每个线程用mmap解码一段连续的块
+KeyStats scanSnapshot(const SnapshotReader& reader, int threads) {
+    size_t blocks = reader.blockCount();
+    threads = static_cast<int>(std::max<size_t>(1, std::min<size_t>(static_cast<size_t>(threads), blocks)));
+    std::vector<KeyStats> parts(static_cast<size_t>(threads));
+    runParallel(threads, [&](int t) {
+        size_t begin = blocks * static_cast<size_t>(t) / static_cast<size_t>(threads);
+        size_t end = blocks * static_cast<size_t>(t + 1) / static_cast<size_t>(threads);
+        KeyStats& stats = parts[static_cast<size_t>(t)];
+        reader.mapBlocks(begin, end, [&](int64_t key, const char*, size_t length) {
+            stats.add(key, length);
+        });
+    });
+    KeyStats total;
+    for (const auto& part : parts) {
+        total.append(part);
+    }
+    return total;
+}
+
+// 按波次并行解码块，再按块的顺序交给emit；decode在工作线程中把第block块转换为T
+template<typename T>
+void orderedBlocks(const SnapshotReader& reader, int threads,
+                   const std::function<void(size_t block, std::string& buffer, T& out)>& decode,
+                   const std::function<void(T& out)>& emit) {
+    size_t blocks = reader.blockCount();
+    size_t wave = static_cast<size_t>(threads) * BLOCKS_PER_THREAD;
+    std::vector<T> outputs(wave);
+    std::vector<std::string> buffers(static_cast<size_t>(threads));
+    for (size_t begin = 0; begin < blocks; begin += wave) {
+        size_t count = std::min(wave, blocks - begin);
+        runParallel(threads, [&](int t) {
+            for (size_t i = static_cast<size_t>(t); i < count; i += static_cast<size_t>(threads)) {
+                decode(begin + i, buffers[static_cast<size_t>(t)], outputs[i]);
+            }
+        });
+        for (size_t i = 0; i < count; i++) {
+            emit(outputs[i]);
+            outputs[i] = T();
+        }
+    }
+}
+
+using Entries = std::vector<std::pair<int64_t, std::string>>;
+
+// 按顺序并行读取快照的全部记录
+void forEachEntry(const SnapshotReader& reader, int threads, const std::function<void(int64_t, const std::string&)>& visit) {
+    orderedBlocks<Entries>(reader, threads,
+        [&](size_t block, std::string& buffer, Entries& out) {
+            reader.readBlock(block, buffer, [&](int64_t key, const char* value, size_t length) {
+                out.emplace_back(key, std::string(value, length));
+            });
+        },
+        [&](Entries& entries) {
+            for (const auto& entry : entries) {
+                visit(entry.first, entry.second);
+            }
+        });
+}
+
+bool startsWith(const std::string& s, const char* prefix) {
+    return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+bool endsWith(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// AOF的加载顺序文件：path旁有manifest时为其中的base和增量段，path是manifest本身时同理
+std::vector<std::string> aofFiles(const std::string& path) {
+    std::string aof_file = path;
+    if (endsWith(aof_file, ".manifest")) {
+        aof_file.resize(aof_file.size() - strlen(".manifest"));
+    }
+    AofManifest manifest(aof_file);
+    if (manifest.read()) {
+        return manifest.files();
+    }
+    return {path};
+}
+
+FileKind detectKind(const std::string& path) {
+    if (endsWith(path, ".manifest") || Utils::fileExists(path + ".manifest")) {
+        return FileKind::Aof;
+    }
+    if (!Utils::fileExists(path)) {
+        throw skiplist::FileIOException(path, "open");
+    }
+    if (SnapshotReader::isSnapshot(path)) {
+        return FileKind::Snapshot;
+    }
+    if (isBinaryAof(path)) {
+        return FileKind::Aof;
+    }
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    if (startsWith(line, "SET ") || startsWith(line, "DEL ") || startsWith(line, "FLUSH")) {
+        return FileKind::TextAof;
+    }
+    return FileKind::TextSnapshot;
+}
+
+double elapsedSeconds(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+void printThroughput(uint64_t bytes, std::chrono::steady_clock::time_point begin) {
+    double seconds = elapsedSeconds(begin);
+    std::cout << "  scanned:        " << bytes << " bytes in " << std::fixed << std::setprecision(3) << seconds << " s ("
+              << std::setprecision(1) << (seconds > 0 ? bytes / seconds / (1 << 20) : 0.0) << " MB/s)\n";
+}
+
+// AOF中一个文件的统计
+struct AofFileStats {
+    KeyStats preamble;
+    uint64_t records = 0;
+    uint64_t ops[5] = {};
+    uint64_t torn_bytes = 0;  // 末尾不完整记录的字节数，加载时会被截掉
+    Histogram record_sizes;
+};
+
+AofFileStats scanAofFile(const std::string& path, int threads) {
+    AofFileStats stats;
+    AofReader reader(path);
+    uint64_t offset = AOF_HEADER_SIZE;
+    if (reader.hasPreamble()) {
+        SnapshotReader snapshot(path, reader.preambleOffset(), reader.preambleLength());
+        stats.preamble = scanSnapshot(snapshot, threads);
+        offset = reader.preambleOffset() + reader.preambleLength();
+    }
+    stats.records = reader.readRecords([&](const char* record, size_t size) {
+        uint8_t op = static_cast<uint8_t>(record[0]);
+        stats.ops[op < 5 ? op : 0]++;
+        stats.record_sizes.add(size);
+        offset += size;
+        return true;
+    });
+    uint64_t file_size = Utils::getFileSize(path);
+    stats.torn_bytes = file_size > offset ? file_size - offset : 0;
+    return stats;
+}
+
+int checkOrStats(const std::string& path, const Options& options, bool detailed) {
+    auto begin = std::chrono::steady_clock::now();
+    FileKind kind = detectKind(path);
+    bool ok = true;
+    if (kind == FileKind::Snapshot) {
+        SnapshotReader reader(path);
+        KeyStats stats = scanSnapshot(reader, options.threads);
+        std::cout << path << ": binary snapshot" << (reader.isDelta() ? " (delta)" : "") << "\n";
+        std::cout << "  blocks:         " << reader.blockCount() << "\n";
+        std::cout << "  sequence:       " << reader.sequence() << "\n";
+        stats.print(detailed);
+        if (stats.entries != reader.entries()) {
+            std::cout << "  ERROR: footer says " << reader.entries() << " entries, blocks contain " << stats.entries << "\n";
+            ok = false;
+        }
+        if (!stats.ordered) {
+            std::cout << "  ERROR: keys are not strictly increasing\n";
+            ok = false;
+        }
+        printThroughput(Utils::getFileSize(path), begin);
+    } else if (kind == FileKind::Aof) {
+        std::vector<std::string> files = aofFiles(path);
+        std::cout << path << ": binary AOF, " << files.size() << " file(s)\n";
+        uint64_t total_bytes = 0;
+        for (size_t i = 0; i < files.size(); i++) {
+            AofFileStats stats = scanAofFile(files[i], options.threads);
+            total_bytes += Utils::getFileSize(files[i]);
+            std::cout << " " << files[i] << "\n";
+            if (stats.preamble.entries > 0) {
+                std::cout << "  preamble snapshot:\n";
+                stats.preamble.print(detailed);
+                if (!stats.preamble.ordered) {
+                    std::cout << "  ERROR: preamble keys are not strictly increasing\n";
+                    ok = false;
+                }
+            }
+            std::cout << "  records:        " << stats.records << " (SET " << stats.ops[static_cast<int>(AofOp::Set)]
+                      << ", DEL " << stats.ops[static_cast<int>(AofOp::Del)] << ", FLUSH "
+                      << stats.ops[static_cast<int>(AofOp::Flush)] << ")\n";
+            if (detailed) {
+                stats.record_sizes.print("  record sizes");
+            }
+            if (stats.torn_bytes > 0) {
+                // 只有最后一个文件可能写到一半，加载时截掉；其余文件不应有残缺的尾部
+                bool last = i + 1 == files.size();
+                std::cout << "  " << (last ? "WARNING" : "ERROR") << ": incomplete record at the end (" << stats.torn_bytes
+                          << " bytes)" << (last ? ", will be truncated on load" : "") << "\n";
+                ok = ok && last;
+            }
+        }
+        printThroughput(total_bytes, begin);
+    } else {
+        std::ifstream in(path);
+        uint64_t lines = 0;
+        std::string line;
+        Histogram sizes;
+        while (std::getline(in, line)) {
+            lines++;
+            sizes.add(line.size());
+        }
+        std::cout << path << ": legacy text " << (kind == FileKind::TextAof ? "AOF" : "snapshot") << " (no checksums)\n";
+        std::cout << "  lines:          " << lines << "\n";
+        if (detailed) {
+            sizes.print("  line sizes");
+        }
+        printThroughput(Utils::getFileSize(path), begin);
+    }
+    std::cout << (ok ? "OK" : "FAILED") << "\n";
+    return ok ? 0 : 1;
+}
+
+// 把数据写入fd，失败时抛出FileIOException
+void writeFully(int fd, const std::string& path, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw skiplist::FileIOException(path, "write");
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+class OutputFile {
+public:
+    explicit OutputFile(const std::string& path) : path_(path) {
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0) {
+            throw skiplist::FileIOException(path, "open");
+        }
+    }
+    ~OutputFile() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+
+    int fd() const { return fd_; }
+    std::string& buffer() { return buffer_; }
+
+    void maybeFlush() {
+        if (buffer_.size() >= WRITE_CHUNK) {
+            flush();
+        }
+    }
+    void flush() {
+        writeFully(fd_, path_, buffer_.data(), buffer_.size());
+        buffer_.clear();
+    }
+    void close() {
+        flush();
+        if (::fdatasync(fd_) != 0) {
+            throw skiplist::FileIOException(path_, "fsync");
+        }
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+private:
+    std::string path_;
+    int fd_;
+    std::string buffer_;
+};
+
+// 快照中的记录转为"key:value;"文本行
+uint64_t snapshotToText(const std::string& in, const std::string& out, const Options& options) {
+    SnapshotReader reader(in);
+    OutputFile file(out);
+    uint64_t entries = 0;
+    orderedBlocks<std::string>(reader, options.threads,
+        [&](size_t block, std::string& buffer, std::string& text) {
+            reader.readBlock(block, buffer, [&](int64_t key, const char* value, size_t length) {
+                text += std::to_string(key);
+                text += ':';
+                text.append(value, length);
+                text += ";\n";
+            });
+        },
+        [&](std::string& text) {
+            file.buffer() += text;
+            file.maybeFlush();
+        });
+    file.close();
+    entries = reader.entries();
+    return entries;
+}
+
+// 重新写出二进制快照（可改变压缩级别）
+uint64_t rewriteSnapshot(const std::string& in, const std::string& out, const Options& options) {
+    SnapshotReader reader(in);
+    SnapshotWriter writer(out);
+    writer.setCompression(options.compression);
+    forEachEntry(reader, options.threads, [&](int64_t key, const std::string& value) {
+        writer.add(key, value);
+    });
+    writer.commit();
+    return writer.entries();
+}
+
+// AOF的全部记录转为旧的文本格式，前导快照中的数据转为SET
+uint64_t aofToText(const std::string& in, const std::string& out, const Options& options, uint64_t* multiline) {
+    OutputFile file(out);
+    uint64_t records = 0;
+    auto set = [&](int64_t key, const char* value, size_t length) {
+        if (memchr(value, '\n', length) != nullptr) {
+            (*multiline)++;
+        }
+        file.buffer() += "SET " + std::to_string(key) + " ";
+        file.buffer().append(value, length);
+        file.buffer() += '\n';
+        file.maybeFlush();
+        records++;
+    };
+    for (const auto& path : aofFiles(in)) {
+        AofReader reader(path);
+        if (reader.hasPreamble()) {
+            SnapshotReader snapshot(path, reader.preambleOffset(), reader.preambleLength());
+            forEachEntry(snapshot, options.threads, [&](int64_t key, const std::string& value) {
+                set(key, value.data(), value.size());
+            });
+        }
+        reader.readRecords([&](const char* record, size_t size) {
+            AofOp op;
+            int32_t key;
+            const char* value;
+            size_t length;
+            decodeAofRecord(record, size, &op, &key, &value, &length);
+            if (op == AofOp::Set) {
+                set(key, value, length);
+            } else if (op == AofOp::Del) {
+                file.buffer() += "DEL " + std::to_string(key) + "\n";
+                records++;
+            } else if (op == AofOp::Flush) {
+                file.buffer() += "FLUSH\n";
+                records++;
+            }
+            file.maybeFlush();
+            return true;
+        });
+    }
+    file.close();
+    return records;
+}
+
+// 复制文件后原地转换（prepareAofFile处理旧的文本AOF）
+uint64_t textAofToBinary(const std::string& in, const std::string& out) {
+    {
+        std::ifstream src(in, std::ios::binary);
+        std::ofstream dst(out, std::ios::binary | std::ios::trunc);
+        if (!src.is_open() || !dst.is_open()) {
+            throw skiplist::FileIOException(out, "copy");
+        }
+        dst << src.rdbuf();
+    }
+    return prepareAofFile(out);
+}
+
+int convert(const std::string& in, const std::string& out, const Options& options) {
+    auto begin = std::chrono::steady_clock::now();
+    FileKind kind = detectKind(in);
+    bool binary_in = kind == FileKind::Snapshot || kind == FileKind::Aof;
+    std::string format = options.format.empty() ? (binary_in ? "text" : "binary") : options.format;
+    if (format != "text" && format != "binary") {
+        std::cerr << "unknown format: " << format << "\n";
+        return 2;
+    }
+    uint64_t count = 0;
+    if (kind == FileKind::Snapshot) {
+        count = format == "text" ? snapshotToText(in, out, options) : rewriteSnapshot(in, out, options);
+    } else if (kind == FileKind::TextSnapshot) {
+        if (format == "text") {
+            std::cerr << in << " is already a text snapshot\n";
+            return 2;
+        }
+        if (options.compression > 0) {
+            // 先转换为未压缩的快照，再按压缩级别重写（不能用<out>.tmp，SnapshotWriter写出时使用它）
+            std::string plain = out + ".uncompressed";
+            convertTextSnapshot(in, plain);
+            count = rewriteSnapshot(plain, out, options);
+            ::unlink(plain.c_str());
+        } else {
+            count = convertTextSnapshot(in, out);
+        }
+    } else if (kind == FileKind::Aof) {
+        if (format != "text") {
+            std::cerr << in << " is already a binary AOF (use compact to rewrite it)\n";
+            return 2;
+        }
+        uint64_t multiline = 0;
+        count = aofToText(in, out, options, &multiline);
+        if (multiline > 0) {
+            std::cerr << "WARNING: " << multiline << " values contain newlines and cannot be represented in the text format\n";
+        }
+    } else {
+        if (format == "text") {
+            std::cerr << in << " is already a text AOF\n";
+            return 2;
+        }
+        count = textAofToBinary(in, out);
+    }
+    std::cout << "converted " << count << " records from " << in << " to " << format << " " << out << " in "
+              << std::fixed << std::setprecision(3) << elapsedSeconds(begin) << " s\n";
+    return 0;
+}
+
+// 离线合并AOF：base的前导快照之后的全部写入先归并成覆盖表（FLUSH清空覆盖表并丢弃
+// 前导），再与按顺序并行解码的前导快照做一次归并，写出只含前导快照（或SET记录）的
+// 单个AOF文件，可以直接作为aof_file使用
+int compact(const std::string& in, const std::string& out, const Options& options) {
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::string> files = aofFiles(in);
+    std::map<int64_t, std::pair<bool, std::string>> overlay;  // key -> (存在, value)
+    bool drop_preamble = false;
+    uint64_t records = 0;
+    uint64_t input_bytes = 0;
+    for (const auto& path : files) {
+        input_bytes += Utils::getFileSize(path);
+        records += AofReader(path).readRecords([&](const char* record, size_t size) {
+            AofOp op;
+            int32_t key;
+            const char* value;
+            size_t length;
+            decodeAofRecord(record, size, &op, &key, &value, &length);
+            if (op == AofOp::Set) {
+                overlay[key] = {true, std::string(value, length)};
+            } else if (op == AofOp::Del) {
+                overlay[key] = {false, std::string()};
+            } else if (op == AofOp::Flush) {
+                overlay.clear();
+                drop_preamble = true;
+            }
+            return true;
+        });
+    }
+
+    OutputFile file(out);
+    file.buffer() = aofFileHeader();
+    std::unique_ptr<SnapshotWriter> preamble;
+    if (options.preamble) {
+        // 前导记录在快照写完、长度已知后回填
+        file.buffer().append(AOF_PREAMBLE_RECORD_SIZE, '\0');
+        file.flush();
+        preamble = std::make_unique<SnapshotWriter>(file.fd(), out);
+        preamble->setCompression(options.compression);
+    }
+    uint64_t keys = 0;
+    auto emit = [&](int64_t key, const std::string& value) {
+        if (preamble) {
+            preamble->add(key, value);
+        } else {
+            encodeAofRecord(file.buffer(), AofOp::Set, static_cast<int32_t>(key), value.data(), value.size());
+            file.maybeFlush();
+        }
+        keys++;
+    };
+    auto next = overlay.begin();
+    // 覆盖表中key小于limit的部分
+    auto emitOverlayBelow = [&](int64_t limit, bool inclusive) {
+        while (next != overlay.end() && (next->first < limit || (inclusive && next->first == limit))) {
+            if (next->second.first) {
+                emit(next->first, next->second.second);
+            }
+            ++next;
+        }
+    };
+    if (!files.empty() && !drop_preamble) {
+        AofReader reader(files.front());
+        if (reader.hasPreamble()) {
+            SnapshotReader snapshot(files.front(), reader.preambleOffset(), reader.preambleLength());
+            forEachEntry(snapshot, options.threads, [&](int64_t key, const std::string& value) {
+                emitOverlayBelow(key, false);
+                if (next != overlay.end() && next->first == key) {
+                    emitOverlayBelow(key, true);  // 被之后的写入覆盖或删除
+                } else {
+                    emit(key, value);
+                }
+            });
+        }
+    }
+    emitOverlayBelow(INT64_MAX, true);
+    if (preamble) {
+        preamble->commit();
+        std::string record = aofPreambleRecord(preamble->bytes());
+        if (::pwrite(file.fd(), record.data(), record.size(), AOF_HEADER_SIZE) != static_cast<ssize_t>(record.size())) {
+            throw skiplist::FileIOException(out, "write");
+        }
+    }
+    file.close();
+    uint64_t output_bytes = Utils::getFileSize(out);
+    std::cout << "compacted " << files.size() << " file(s), " << records << " records, into " << keys << " keys\n";
+    std::cout << "  " << input_bytes << " -> " << output_bytes << " bytes in " << std::fixed << std::setprecision(3)
+              << elapsedSeconds(begin) << " s\n";
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if ((arg == "-j" || arg == "-c" || arg == "--format") && i + 1 < argc) {
+            std::string value = argv[++i];
+            if (arg == "--format") {
+                options.format = value;
+                continue;
+            }
+            int number = 0;
+            try {
+                number = std::stoi(value);
+            } catch (const std::exception&) {
+                usage();
+                return 2;
+            }
+            if (arg == "-j") {
+                options.threads = std::max(1, number);
+            } else {
+                options.compression = std::max(0, std::min(number, 9));
+            }
+        } else if (arg == "--no-preamble") {
+            options.preamble = false;
+        } else if (arg == "-h" || arg == "--help") {
+            usage();
+            return 0;
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    try {
+        if (args.size() == 2 && args[0] == "check") {
+            return checkOrStats(args[1], options, false);
+        }
+        if (args.size() == 2 && args[0] == "stats") {
+            return checkOrStats(args[1], options, true);
+        }
+        if (args.size() == 3 && args[0] == "convert") {
+            return convert(args[1], args[2], options);
+        }
+        if (args.size() == 3 && args[0] == "compact") {
+            return compact(args[1], args[2], options);
+        }
+    } catch (const std::exception& e) {
+        std::cout << "FAILED: " << e.what() << "\n";
+        return 1;
+    }
+    usage();
+    return 2;
+}
@@ -0,0 +1,137 @@
+#include "io_uring.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+int ringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+}
+
+IoUringRing::~IoUringRing() {
+    if (sqes != nullptr) {
+        ::munmap(sqes, sqes_len);
+    }
+    if (cq_ptr != nullptr && cq_ptr != sq_ptr) {
+        ::munmap(cq_ptr, cq_len);
+    }
+    if (sq_ptr != nullptr) {
+        ::munmap(sq_ptr, sq_len);
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+bool IoUringRing::probe() {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ring_fd = ringSetup(2, &params);
+    if (ring_fd < 0) {
+        return false;
+    }
+    ::close(ring_fd);
+    return true;
+}
+
+bool IoUringRing::setup(unsigned sq_entries, unsigned cq_entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    if (cq_entries > 0) {
+        params.flags |= IORING_SETUP_CQSIZE;
+        params.cq_entries = cq_entries;
+    }
+    fd = ringSetup(sq_entries, &params);
+    if (fd < 0) {
+        return false;
+    }
+    features = params.features;
+    entries = params.sq_entries;
+    sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        sq_len = cq_len = std::max(sq_len, cq_len);
+    }
+    sq_ptr = ::mmap(nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED) {
+        sq_ptr = nullptr;
+        return false;
+    }
+    if (single_mmap) {
+        cq_ptr = sq_ptr;
+    } else {
+        cq_ptr = ::mmap(nullptr, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED) {
+            cq_ptr = nullptr;
+            return false;
+        }
+    }
+    sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes_ptr = ::mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes_ptr == MAP_FAILED) {
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe*>(sqes_ptr);
+
+    char* sq = static_cast<char*>(sq_ptr);
+    char* cq = static_cast<char*>(cq_ptr);
+    sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+// 只有本线程写SQ尾，内核读取前用release发布
+io_uring_sqe* IoUringRing::nextSqe() {
+    unsigned tail = *sq_tail + pending;
+    unsigned index = tail & *sq_mask;
+    io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    pending++;
+    return sqe;
+}
+
+unsigned IoUringRing::sqSpace() const {
+    return entries - (*sq_tail + pending - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE));
+}
+
+int IoUringRing::enter(unsigned min_complete) {
+    if (pending > 0) {
+        __atomic_store_n(sq_tail, *sq_tail + pending, __ATOMIC_RELEASE);
+        inflight += pending;
+        pending = 0;
+    }
+    while (true) {
+        // 被信号打断或内核暂时无法接受时，只重新提交内核还没取走的SQE
+        unsigned to_submit = *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        int ret = ringEnter(fd, to_submit, min_complete, min_complete > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (ret >= 0) {
+            return 0;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            return errno;
+        }
+    }
+}
+
+int IoUringRing::registerOp(unsigned opcode, void* arg, unsigned count) {
+    if (syscall(__NR_io_uring_register, fd, opcode, arg, count) != 0) {
+        return errno;
+    }
+    return 0;
+}
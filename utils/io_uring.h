@@ -0,0 +1,52 @@
+#pragma once
+#include <linux/io_uring.h>
+#include <cstddef>
+
+// 不依赖liburing的io_uring环：直接用io_uring_setup/io_uring_enter系统调用，把SQ/CQ环和
+// SQE数组映射到用户态。持久化的AsyncFile和网络的io_uring事件循环共用。
+// 一个环只能由一个线程提交和收割
+struct IoUringRing {
+    int fd = -1;
+    unsigned features = 0;
+    void* sq_ptr = nullptr;
+    size_t sq_len = 0;
+    void* cq_ptr = nullptr;
+    size_t cq_len = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_len = 0;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    unsigned entries = 0;
+    unsigned inflight = 0;   // 已提交、尚未收割的CQE数
+    unsigned pending = 0;    // 已填入SQ、尚未io_uring_enter的SQE数
+
+    IoUringRing() = default;
+    ~IoUringRing();
+
+    IoUringRing(const IoUringRing&) = delete;
+    IoUringRing& operator=(const IoUringRing&) = delete;
+
+    // 内核是否支持io_uring（未被seccomp等禁用）
+    static bool probe();
+
+    // 创建环；cq_entries不为0时单独指定CQ大小
+    bool setup(unsigned sq_entries, unsigned cq_entries = 0);
+
+    // 取下一个空的SQE，调用方保证SQ中还有空位
+    io_uring_sqe* nextSqe();
+
+    // SQ中还能填入的SQE数
+    unsigned sqSpace() const;
+
+    // 提交已填入的SQE，并等待至少min_complete个完成；返回0或errno
+    int enter(unsigned min_complete);
+
+    // io_uring_register，返回0或errno
+    int registerOp(unsigned opcode, void* arg, unsigned count);
+};
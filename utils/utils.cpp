@@ -15,6 +15,7 @@
 #include <filesystem>
 #include <regex>
 #include <cctype>
+#include <array>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -23,6 +24,7 @@
 #include <psapi.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -294,6 +296,23 @@ std::vector<std::string> Utils::listFiles(const std::string& directory) {
     return files;
 }
 
+bool Utils::syncParentDirectory(const std::string& path) {
+#ifdef _WIN32
+    return true;
+#else
+    std::string directory = getDirectory(path);
+    int fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ::fsync(fd) == 0;
+    int error = errno;
+    ::close(fd);
+    errno = error;
+    return ok;
+#endif
+}
+
 // 网络工具
 bool Utils::isValidIP(const std::string& ip) {
     std::regex ip_regex("^(?:[0-9]{1,3}\\.){3}[0-9]{1,3}$");
@@ -406,6 +425,80 @@ std::string Utils::base64Decode(const std::string& input) {
     return input;
 }
 
+#if defined(__x86_64__)
+// SSE4.2的crc32指令实现的正是CRC32C，每次处理8字节
+__attribute__((target("sse4.2")))
+static uint32_t crc32cHardware(const char* data, size_t length, uint32_t crc) {
+    uint64_t c = ~crc;
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        c = __builtin_ia32_crc32di(c, word);
+        data += 8;
+        length -= 8;
+    }
+    uint32_t c32 = static_cast<uint32_t>(c);
+    while (length > 0) {
+        c32 = __builtin_ia32_crc32qi(c32, static_cast<unsigned char>(*data));
+        ++data;
+        --length;
+    }
+    return ~c32;
+}
+#endif
+
+uint32_t Utils::crc32c(const char* data, size_t length, uint32_t crc) {
+#if defined(__x86_64__)
+    static const bool hardware = __builtin_cpu_supports("sse4.2");
+    if (hardware) {
+        return crc32cHardware(data, length, crc);
+    }
+#endif
+    // 按字节查表，表在首次调用时生成
+    static const auto table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : (c >> 1);
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    
+    crc = ~crc;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < length; ++i) {
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void Utils::appendVarint(std::string& dst, uint64_t value) {
+    char buf[10];
+    size_t n = 0;
+    while (value >= 0x80) {
+        buf[n++] = static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    buf[n++] = static_cast<char>(value);
+    dst.append(buf, n);
+}
+
+const char* Utils::decodeVarint(const char* p, const char* limit, uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift <= 63 && p < limit; shift += 7) {
+        uint64_t byte = static_cast<unsigned char>(*p++);
+        result |= (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return p;
+        }
+    }
+    return nullptr;
+}
+
 // 系统工具
 int Utils::getProcessId() {
 #ifdef _WIN32
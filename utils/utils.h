@@ -3,6 +3,7 @@
 #include <vector>
 #include <chrono>
 #include <random>
+#include <cstdint>
 
 class Utils {
 public:
@@ -43,6 +44,8 @@ public:
     static std::string getDirectory(const std::string& path);
     static bool createDirectory(const std::string& path);
     static std::vector<std::string> listFiles(const std::string& directory);
+    // fsync path所在的目录，使之前在其中的创建、rename和删除持久化；失败时errno为原因
+    static bool syncParentDirectory(const std::string& path);
     
     // 网络工具
     static bool isValidIP(const std::string& ip);
@@ -65,6 +68,16 @@ public:
     static std::string base64Encode(const std::string& input);
     static std::string base64Decode(const std::string& input);
     
+    // 校验工具：CRC32C（Castagnoli多项式），crc为上一段数据的结果，可分段计算
+    static uint32_t crc32c(const char* data, size_t length, uint32_t crc = 0);
+    
+    // 编码工具：LEB128变长整数，有符号数先做zigzag编码
+    static void appendVarint(std::string& dst, uint64_t value);
+    // 从[p, limit)解码一个变长整数，返回下一个字节的位置，数据不完整或非法时返回nullptr
+    static const char* decodeVarint(const char* p, const char* limit, uint64_t* value);
+    static uint64_t zigzagEncode(int64_t value) { return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); }
+    static int64_t zigzagDecode(uint64_t value) { return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1); }
+    
     // 系统工具
     static int getProcessId();
     static std::string getProcessName();